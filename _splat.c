@@ -19,6 +19,10 @@
 */
 
 #include "_splat.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define BASE_TYPE_FLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE)
 
@@ -44,23 +48,68 @@
          19,18,17,16,15,14,13,12,11,10, \
          9,8,7,6,5,4,3,2,1,0
 
-static const char SPLAT_INT_8[] = "int8";
-static const char SPLAT_INT_16[] = "int16";
-static const char SPLAT_INT_24[] = "int24";
-static const char SPLAT_FLOAT_32[] = "float32";
-static const char SPLAT_FLOAT_64[] = "float64";
-
-#define SPLAT_NATIVE_SAMPLE_WIDTH (sizeof(sample_t) * 8)
-
-struct splat_raw_io {
-	const char *sample_type;
-	size_t sample_width;
-	void (*import)(sample_t *out, const char *in, size_t n, size_t step);
-	void (*export)(char *out, const sample_t **it, unsigned channels,
-		       size_t n);
-};
-
-static const struct splat_raw_io *splat_get_raw_io(const char *sample_type);
+/* Sample width of the fragments unless specified, 64 unless changed with the
+ * SPLAT_SAMPLE_TYPE environment variable when building the extension */
+#ifndef SPLAT_DEFAULT_SAMPLE_WIDTH
+# define SPLAT_DEFAULT_SAMPLE_WIDTH 64
+#endif
+
+/* Default size of the exported data chunks written to files */
+#define SPLAT_WRITE_CHUNK_SIZE 65536
+
+/* The functions which depend on the sample type are called via the operations
+ * of each fragment, so they can be used the same way with any of them */
+#define splat_frag_call(_fn, _frag, ...)			\
+	(splat_ops_of(_frag)->_fn((_frag), ##__VA_ARGS__))
+#define splat_source_call(_fn, _src, ...)			\
+	(splat_ops_of((_src)->frag)->_fn((_src), __VA_ARGS__))
+
+#define splat_frag_free(...) splat_frag_call(frag_free, __VA_ARGS__)
+#define splat_frag_reserve(...) splat_frag_call(frag_reserve, __VA_ARGS__)
+#define splat_frag_resize(...) splat_frag_call(frag_resize, __VA_ARGS__)
+#define splat_frag_touch(...) splat_frag_call(frag_touch, __VA_ARGS__)
+#define splat_frag_share(...) splat_frag_call(frag_share, __VA_ARGS__)
+#define splat_frag_unshare(...) splat_frag_call(frag_unshare, __VA_ARGS__)
+#define splat_frag_mix(...) splat_frag_call(frag_mix, __VA_ARGS__)
+#define splat_frag_mix_many(...) splat_frag_call(frag_mix_many, __VA_ARGS__)
+#define splat_frag_get_peak(...) splat_frag_call(frag_get_peak, __VA_ARGS__)
+#define splat_frag_get_stats(...) splat_frag_call(frag_get_stats, __VA_ARGS__)
+#define splat_frag_get_norm(...) splat_frag_call(frag_get_norm, __VA_ARGS__)
+#define splat_frag_normalize(...) splat_frag_call(frag_normalize, __VA_ARGS__)
+#define splat_frag_amp(...) splat_frag_call(frag_amp, __VA_ARGS__)
+#define splat_frag_lin2dB(...) splat_frag_call(frag_lin2dB, __VA_ARGS__)
+#define splat_frag_dB2lin(...) splat_frag_call(frag_dB2lin, __VA_ARGS__)
+#define splat_frag_offset(...) splat_frag_call(frag_offset, __VA_ARGS__)
+#define splat_frag_resample(...) splat_frag_call(frag_resample, __VA_ARGS__)
+#define splat_raw_import(...) splat_frag_call(raw_import, __VA_ARGS__)
+#define splat_raw_export(...) splat_frag_call(raw_export, __VA_ARGS__)
+#define splat_filter_biquad(...) splat_frag_call(filter_biquad, __VA_ARGS__)
+#define splat_filter_limiter(...) splat_frag_call(filter_limiter, __VA_ARGS__)
+#define splat_filter_limiter_stream(...)			\
+	splat_frag_call(filter_limiter_stream, __VA_ARGS__)
+#define splat_filter_compressor(...)				\
+	splat_frag_call(filter_compressor, __VA_ARGS__)
+#define splat_filter_chain(...) splat_frag_call(filter_chain, __VA_ARGS__)
+#define splat_filter_reverse(...) splat_frag_call(filter_reverse, __VA_ARGS__)
+#define splat_filter_reverb(...) splat_frag_call(filter_reverb, __VA_ARGS__)
+#define splat_filter_convolve(...)				\
+	splat_frag_call(filter_convolve, __VA_ARGS__)
+#define splat_filter_fdn(...) splat_frag_call(filter_fdn, __VA_ARGS__)
+#define splat_sine_floats(...) splat_source_call(sine_floats, __VA_ARGS__)
+#define splat_sine_signals(...) splat_source_call(sine_signals, __VA_ARGS__)
+#define splat_square_floats(...) splat_source_call(square_floats, __VA_ARGS__)
+#define splat_square_signals(...)				\
+	splat_source_call(square_signals, __VA_ARGS__)
+#define splat_triangle_floats(...)				\
+	splat_source_call(triangle_floats, __VA_ARGS__)
+#define splat_triangle_signals(...)				\
+	splat_source_call(triangle_signals, __VA_ARGS__)
+#define splat_overtones_float(...)				\
+	splat_source_call(overtones_float, __VA_ARGS__)
+#define splat_overtones_mixed(...)				\
+	splat_source_call(overtones_mixed, __VA_ARGS__)
+#define splat_overtones_signal(...)				\
+	splat_source_call(overtones_signal, __VA_ARGS__)
 
 /* ----------------------------------------------------------------------------
  * Module constants
@@ -504,6 +553,20 @@ struct splat_fragment *splat_frag_from_obj(PyObject *obj)
 	return &((Fragment *)obj)->frag;
 }
 
+/* Get the operations for a fragment sample type name */
+static const struct splat_ops *splat_ops_from_name(const char *sample_type)
+{
+	if (!strcmp(sample_type, splat_sample_ops.sample_type))
+		return &splat_sample_ops;
+
+	if (!strcmp(sample_type, splat32_sample_ops.sample_type))
+		return &splat32_sample_ops;
+
+	PyErr_SetString(PyExc_ValueError, "unsupported fragment sample type");
+
+	return NULL;
+}
+
 static void Fragment_dealloc(Fragment *self)
 {
 	if (self->init) {
@@ -517,16 +580,23 @@ static void Fragment_dealloc(Fragment *self)
 static int Fragment_init(Fragment *self, PyObject *args, PyObject *kw)
 {
 	static char *kwlist[] = {
-		"channels", "rate", "duration", "length", "name", NULL };
+		"channels", "rate", "duration", "length", "name", "path",
+		"reopen", "sample_type", NULL };
 	unsigned n_channels = 2;
 	unsigned rate = 48000;
 	double duration = 0.0;
 	unsigned long length = 0;
 	const char *name = NULL;
+	const char *path = NULL;
+	PyObject *reopen = Py_False;
+	const char *sample_type = NULL;
+
+	const struct splat_ops *ops;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kw, "|IIdkz", kwlist,
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "|IIdkzzO!z", kwlist,
 					 &n_channels, &rate, &duration,
-					 &length, &name))
+					 &length, &name, &path, &PyBool_Type,
+					 &reopen, &sample_type))
 		return -1;
 
 	if (n_channels > SPLAT_MAX_CHANNELS) {
@@ -553,8 +623,45 @@ static int Fragment_init(Fragment *self, PyObject *args, PyObject *kw)
 		return -1;
 	}
 
-	if (splat_frag_init(&self->frag, n_channels, rate, length, name))
+	if (reopen == Py_True) {
+		if (path == NULL) {
+			PyErr_SetString(PyExc_ValueError,
+					"path required to reopen a file");
+			return -1;
+		}
+
+		if (length) {
+			PyErr_SetString(PyExc_ValueError,
+					"cannot specify length when reopening");
+			return -1;
+		}
+	}
+
+	if (sample_type != NULL) {
+		ops = splat_ops_from_name(sample_type);
+
+		if (ops == NULL)
+			return -1;
+	} else if (reopen == Py_True) {
+		unsigned sample_width;
+
+		/* Use the sample type of the file being reopened */
+		if (splat_file_sample_width(path, &sample_width))
+			return -1;
+
+		ops = splat_ops_get(sample_width);
+	} else {
+		ops = splat_ops_get(SPLAT_DEFAULT_SAMPLE_WIDTH);
+	}
+
+	if (path != NULL) {
+		if (ops->file_init(&self->frag, n_channels, rate, length,
+				   name, path, (reopen == Py_True)))
+			return -1;
+	} else if (ops->frag_init(&self->frag, n_channels, rate, length,
+				  name)) {
 		return -1;
+	}
 
 	self->init = 1;
 
@@ -577,6 +684,16 @@ static PyObject *Fragment_new(PyTypeObject *type, PyObject *args, PyObject *kw)
 
 /* Fragment sequence interface */
 
+/* Set sample i of channel c, rounded to the sample type of the fragment */
+static void splat_frag_set_sample(struct splat_fragment *frag, unsigned c,
+				  size_t i, double s)
+{
+	if (frag->sample_width == 32)
+		((float *)(void *)frag->data[c])[i] = s;
+	else
+		((double *)(void *)frag->data[c])[i] = s;
+}
+
 static Py_ssize_t Fragment_sq_length(Fragment *self)
 {
 	return self->frag.length;
@@ -598,7 +715,7 @@ static PyObject *Fragment_sq_item(Fragment *self, Py_ssize_t i)
 		return NULL;
 
 	for (c = 0; c < self->frag.n_channels; ++c) {
-		const sample_t s = self->frag.data[c][i];
+		const double s = splat_frag_sample(&self->frag, c, i);
 		PyTuple_SET_ITEM(sample, c, PyFloat_FromDouble(s));
 	}
 
@@ -624,6 +741,9 @@ static int Fragment_sq_ass_item(Fragment *self, Py_ssize_t i, PyObject *v)
 		return -1;
 	}
 
+	if (splat_frag_unshare(&self->frag))
+		return -1;
+
 	for (c = 0; c < self->frag.n_channels; ++c) {
 		PyObject *s = PyTuple_GET_ITEM(v, c);
 
@@ -633,9 +753,12 @@ static int Fragment_sq_ass_item(Fragment *self, Py_ssize_t i, PyObject *v)
 			return -1;
 		}
 
-		self->frag.data[c][i] = (sample_t)PyFloat_AS_DOUBLE(s);
+		splat_frag_set_sample(&self->frag, c, i,
+				      PyFloat_AS_DOUBLE(s));
 	}
 
+	splat_frag_touch(&self->frag, i, 1);
+
 	return 0;
 }
 
@@ -696,209 +819,254 @@ static int Fragment_set_name(Fragment *self, PyObject *value, void *_)
 	return splat_frag_set_name(&self->frag, PyString_AS_STRING(value));
 }
 
+PyDoc_STRVAR(sample_type_doc, "Get the type of the samples, either "
+	     "``float64`` or ``float32``.");
+
+static PyObject *Fragment_get_sample_type(Fragment *self, void *_)
+{
+	return PyString_FromString(splat_ops_of(&self->frag)->sample_type);
+}
+
+PyDoc_STRVAR(path_doc, "Get the path of the file holding the fragment data, "
+	     "or ``None`` if it is in memory.");
+
+static PyObject *Fragment_get_path(Fragment *self, void *_)
+{
+	if (self->frag.file == NULL)
+		Py_RETURN_NONE;
+
+	return PyString_FromString(splat_file_path(self->frag.file));
+}
+
 static PyGetSetDef Fragment_getsetters[] = {
 	{ "rate", (getter)Fragment_get_rate, NULL, rate_doc },
 	{ "duration", (getter)Fragment_get_duration, NULL, duration_doc },
 	{ "channels", (getter)Fragment_get_channels, NULL, channels_doc },
 	{ "name", (getter)Fragment_get_name, (setter)Fragment_set_name,
 	  name_doc },
+	{ "path", (getter)Fragment_get_path, NULL, path_doc },
+	{ "sample_type", (getter)Fragment_get_sample_type, NULL,
+	  sample_type_doc },
 	{ NULL }
 };
 
 /* Fragment methods */
 
-static void splat_import_float64(sample_t *out, const char *in, size_t n,
-				 size_t step)
-{
-	while (n--) {
-		*out++ = *(const double *)in;
-		in += step;
-	}
-}
+/* Memory-mapped files */
+
+struct splat_mmap {
+	int fd;
+	char *data;
+	size_t size;
+};
 
-static void splat_export_float64(char *out, const sample_t **in,
-				 unsigned channels, size_t n)
+static int splat_mmap_open(struct splat_mmap *m, const char *file_name)
 {
-	double *out64 = (double *)out;
+	struct stat st;
 
-	while (n--) {
-		unsigned c;
+	m->fd = open(file_name, O_RDONLY);
 
-		for (c = 0; c < channels; ++c)
-			*out64++ = *(in[c]++);
-	}
-}
+	if (m->fd < 0)
+		goto err_errno;
 
-static void splat_import_float32(sample_t *out, const char *in, size_t n,
-				 size_t step)
-{
-	while (n--) {
-		*out++ = *(const float *)in;
-		in += step;
+	if (fstat(m->fd, &st))
+		goto err_close;
+
+	m->size = st.st_size;
+
+	if (!m->size) {
+		m->data = NULL;
+		return 0;
 	}
-}
 
-static void splat_export_float32(char *out, const sample_t **in,
-				 unsigned channels, size_t n)
-{
-	float *out32 = (float *)out;
+	m->data = mmap(NULL, m->size, PROT_READ, MAP_SHARED, m->fd, 0);
 
-	while (n--) {
-		unsigned c;
+	if (m->data == MAP_FAILED)
+		goto err_close;
 
-		for (c = 0; c < channels; ++c)
-			*out32++ = *(in[c]++);
-	}
+	madvise(m->data, m->size, MADV_SEQUENTIAL);
+
+	return 0;
+
+err_close:
+	close(m->fd);
+err_errno:
+	PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *)file_name);
+
+	return -1;
 }
 
-static void splat_import_int24(sample_t *out, const char *in, size_t n,
-			       size_t step)
+static int splat_mmap_create(struct splat_mmap *m, const char *file_name,
+			     size_t size)
 {
-	static const int32_t neg24 = 1 << 23;
-	static const int32_t neg_mask32 = 0xFF000000;
-	static const sample_t scale = (1 << 23) - 1;
+	m->fd = open(file_name, (O_RDWR | O_CREAT | O_TRUNC), 0666);
 
-	while (n--) {
-		const uint8_t *in8 = (const uint8_t *)in;
-		int32_t sample32;
+	if (m->fd < 0)
+		goto err_errno;
 
-		sample32 = *in8++;
-		sample32 += (*in8++) << 8;
-		sample32 += (*in8++) << 16;
+	if (ftruncate(m->fd, size))
+		goto err_close;
 
-		if (sample32 & neg24)
-			sample32 |= neg_mask32;
+	m->size = size;
 
-		*out++ = sample32 / scale;
-		in += step;
+	if (!m->size) {
+		m->data = NULL;
+		return 0;
 	}
-}
 
-static void splat_export_int24(char *out, const sample_t **in,
-			       unsigned channels, size_t n)
-{
-	static const int32_t scale = (1 << 23) - 1;
+	m->data = mmap(NULL, m->size, (PROT_READ | PROT_WRITE), MAP_SHARED,
+		       m->fd, 0);
 
-	while (n--) {
-		unsigned c;
+	if (m->data == MAP_FAILED)
+		goto err_close;
 
-		for (c = 0; c < channels; ++c) {
-			const sample_t z = *(in[c]++);
-			int32_t s;
+	return 0;
 
-			if (z < -1.0)
-				s = -scale;
-			else if (z > 1.0)
-				s = scale;
-			else
-				s = z * scale;
+err_close:
+	close(m->fd);
+err_errno:
+	PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *)file_name);
 
-			*out++ = s & 0xFF;
-			*out++ = (s >> 8) & 0xFF;
-			*out++ = (s >> 16) & 0xFF;
-		}
-	}
+	return -1;
 }
 
-static void splat_import_int16(sample_t *out, const char *in, size_t n,
-			       size_t step)
+static void splat_mmap_close(struct splat_mmap *m)
 {
-	static const sample_t scale = (1 << 15) - 1;
+	if (m->data != NULL)
+		munmap(m->data, m->size);
 
-	while (n--) {
-		*out++ = *(int16_t *)in / scale;
-		in += step;
-	}
+	close(m->fd);
 }
 
-static void splat_export_int16(char *out, const sample_t **in,
-			       unsigned channels, size_t n)
+/* Raw data conversion */
+
+/* Get the converters for a raw sample type, or for the sample type of the
+ * fragment if NULL */
+static const struct splat_raw_io *splat_frag_raw_io(
+	const struct splat_fragment *frag, const char *sample_type)
 {
-	static const long scale = (1 << 15) - 1;
+	const struct splat_ops *ops = splat_ops_of(frag);
 
-	while (n--) {
-		unsigned c;
+	if (sample_type == NULL)
+		sample_type = ops->sample_type;
 
-		for (c = 0; c < channels; ++c) {
-			const sample_t z = *(in[c]++);
-			int16_t s;
+	return ops->raw_io_get(sample_type);
+}
 
-			if (z < -1.0)
-				s = -scale;
-			else if (z > 1.0)
-				s = scale;
-			else
-				s = z * scale;
+static int splat_frag_import_raw(struct splat_fragment *frag,
+				 const struct splat_raw_io *io,
+				 const char *bytes, size_t bytes_size,
+				 PyObject *offset_obj, PyObject *start_obj,
+				 PyObject *end_obj)
+{
+	const size_t sample_size = io->sample_width / 8;
+	const size_t frame_size = sample_size * frag->n_channels;
+	const size_t bytes_length = bytes_size / frame_size;
+	size_t offset;
+	size_t start;
+	size_t end;
+	size_t length;
 
-			*out++ = s & 0xFF;
-			*out++ = (s >> 8) & 0xFF;
-		}
+	if (bytes_size % frame_size) {
+		PyErr_SetString(PyExc_ValueError,
+				"buffer length not multiple of frame size");
+		return -1;
 	}
+
+	if (offset_obj == Py_None)
+		offset = 0;
+	else if (splat_frag_sample_number(&offset, 0, LONG_MAX, offset_obj))
+		return -1;
+
+	if (start_obj == Py_None)
+		start = 0;
+	else if (splat_frag_sample_number(&start, 0, bytes_length, start_obj))
+		return -1;
+
+	if (end_obj == Py_None)
+		end = bytes_length;
+	else if (splat_frag_sample_number(&end, start, bytes_length, end_obj))
+		return -1;
+
+	length = end - start;
+
+	if (splat_frag_unshare(frag) ||
+	    splat_frag_grow(frag, (offset + length)))
+		return -1;
+
+	splat_frag_touch(frag, offset, length);
+	splat_raw_import(frag, io, (bytes + (start * frame_size)), offset,
+			 length, frame_size);
+
+	return 0;
 }
 
-static void splat_import_int8(sample_t *out, const char *in, size_t n,
-			      size_t step)
+static int splat_frag_export_range(const struct splat_fragment *frag,
+				   PyObject *start_obj, PyObject *end_obj,
+				   size_t *start, size_t *length)
 {
-	static const sample_t scale = 127.0;
+	size_t end;
 
-	while (n--) {
-		*out++ = *(int8_t *)in / scale;
-		in += step;
-	}
+	if (start_obj == Py_None)
+		*start = 0;
+	else if (splat_frag_sample_number(start, 0, frag->length, start_obj))
+		return -1;
+
+	if (end_obj == Py_None)
+		end = frag->length;
+	else if (splat_frag_sample_number(&end, *start, frag->length,
+					  end_obj))
+		return -1;
+
+	*length = end - *start;
+
+	return 0;
 }
 
-static void splat_export_int8(char *out, const sample_t **in,
-			      unsigned channels, size_t n)
+static int splat_frag_export_norm(const struct splat_fragment *frag,
+				  PyObject *norm_obj, struct splat_norm *norm)
 {
-	while (n--) {
-		unsigned c;
+	PyObject *offset_obj;
+	unsigned c;
 
-		for (c = 0; c < channels; ++c) {
-			const sample_t z = (*in[c]++);
-			int8_t s;
+	if (norm_obj == Py_None) {
+		norm->gain = 1.0;
 
-			if (z < -1.0)
-				s = 0;
-			else if (z > 1.0)
-				s = 255;
-			else
-				s = z * 127.0;
+		for (c = 0; c < frag->n_channels; ++c)
+			norm->offset[c] = 0.0;
 
-			*out++ = s;
-		}
+		return 0;
 	}
-}
-
-static const struct splat_raw_io splat_raw_io_table[] = {
-	{ SPLAT_FLOAT_64, 64, splat_import_float64, splat_export_float64 },
-	{ SPLAT_FLOAT_32, 32, splat_import_float32, splat_export_float32 },
-	{ SPLAT_INT_24, 24, splat_import_int24, splat_export_int24, },
-	{ SPLAT_INT_16, 16, splat_import_int16, splat_export_int16, },
-	{ SPLAT_INT_8, 8, splat_import_int8, splat_export_int8 },
-};
 
-static const struct splat_raw_io *splat_get_raw_io(const char *sample_type)
-{
-	const struct splat_raw_io *it;
-	const struct splat_raw_io * const end =
-		&splat_raw_io_table[ARRAY_SIZE(splat_raw_io_table)];
+	if (!PyArg_ParseTuple(norm_obj, "dO!", &norm->gain, &PyTuple_Type,
+			      &offset_obj))
+		return -1;
 
-	for (it = splat_raw_io_table; it != end; ++it)
-		if (!strcmp(sample_type, it->sample_type))
-			return it;
+	if (PyTuple_GET_SIZE(offset_obj) != frag->n_channels) {
+		PyErr_SetString(PyExc_ValueError, "channels number mismatch");
+		return -1;
+	}
 
-	PyErr_SetString(PyExc_ValueError, "unsupported sample type");
+	for (c = 0; c < frag->n_channels; ++c) {
+		if (splat_obj2double(PyTuple_GET_ITEM(offset_obj, c),
+				     &norm->offset[c])) {
+			PyErr_SetString(PyExc_TypeError,
+					"offset must be a number");
+			return -1;
+		}
+	}
 
-	return NULL;
+	return 0;
 }
 
 PyDoc_STRVAR(Fragment_import_bytes_doc,
-"import_bytes(raw_bytes, rate, channels, sample_type=splat.SAMPLE_TYPE, "
-"offset=None, start=None, end=None)\n"
+"import_bytes(raw_bytes, rate, channels, sample_type=None, offset=None, "
+"start=None, end=None)\n"
 "\n"
 "Import data as raw bytes.\n"
 "\n"
 "The ``sample_type`` gives the format of the raw data to import as samples, "
+"or the :py:attr:`sample_type` of the fragment if ``None``.  See "
 ":ref:`sample_formats` for more details. "
 "The ``rate`` and ``channels`` need to match the Fragment instance values. "
 "The ``offset`` argument can be used as a sample number to specify the point "
@@ -915,24 +1083,14 @@ static PyObject *Fragment_import_bytes(Fragment *self, PyObject *args,
 	PyObject *bytes_obj;
 	unsigned rate;
 	unsigned n_channels;
-	const char *sample_type = SPLAT_NATIVE_SAMPLE_TYPE;
+	const char *sample_type = NULL;
 	PyObject *offset_obj = Py_None;
 	PyObject *start_obj = Py_None;
 	PyObject *end_obj = Py_None;
 
-	size_t sample_size;
-	size_t bytes_size;
-	size_t frame_size;
-	size_t bytes_length;
 	const struct splat_raw_io *io;
-	size_t offset;
-	size_t start;
-	size_t end;
-	size_t length;
-	const char *bytes;
-	unsigned c;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kw, "O!II|sOOO", kwlist,
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "O!II|zOOO", kwlist,
 					 &PyByteArray_Type, &bytes_obj, &rate,
 					 &n_channels, &sample_type,
 					 &offset_obj, &start_obj, &end_obj))
@@ -948,988 +1106,2851 @@ static PyObject *Fragment_import_bytes(Fragment *self, PyObject *args,
 		return NULL;
 	}
 
-	io = splat_get_raw_io(sample_type);
+	io = splat_frag_raw_io(&self->frag, sample_type);
 
 	if (io == NULL)
 		return NULL;
 
-	bytes_size = PyByteArray_Size(bytes_obj);
-	sample_size = io->sample_width / 8;
-	frame_size = sample_size * n_channels;
-	bytes_length = bytes_size / frame_size;
-
-	if (bytes_size % frame_size) {
-		PyErr_SetString(PyExc_ValueError,
-				"buffer length not multiple of frame size");
+	if (splat_frag_import_raw(&self->frag, io,
+				  PyByteArray_AsString(bytes_obj),
+				  PyByteArray_Size(bytes_obj),
+				  offset_obj, start_obj, end_obj))
 		return NULL;
-	}
 
-	if (offset_obj == Py_None)
-		offset = 0;
-	else if (splat_frag_sample_number(&offset, 0, LONG_MAX, offset_obj))
-		return NULL;
+	Py_RETURN_NONE;
+}
 
-	if (start_obj == Py_None)
-		start = 0;
-	else if (splat_frag_sample_number(&start, 0, bytes_length, start_obj))
+PyDoc_STRVAR(Fragment_import_file_doc,
+"import_file(file_name, sample_type=None, data_offset=0, "
+"data_size=None, offset=None)\n"
+"\n"
+"Import raw interleaved audio data directly from a file.\n"
+"\n"
+"The file called ``file_name`` is memory-mapped and the samples are "
+"converted straight into the fragment, without any intermediate buffer.  The "
+"data starts ``data_offset`` bytes into the file and is ``data_size`` bytes "
+"long, or goes until the end of the file if ``None``.  The ``sample_type`` "
+"and ``offset`` arguments work in the same way as with "
+":py:meth:`splat.data.Fragment.import_bytes`, the data being expected to "
+"have the same number of channels as the fragment.\n");
+
+static PyObject *Fragment_import_file(Fragment *self, PyObject *args,
+				      PyObject *kw)
+{
+	static char *kwlist[] = {
+		"file_name", "sample_type", "data_offset", "data_size",
+		"offset", NULL };
+	const char *file_name;
+	const char *sample_type = NULL;
+	unsigned long data_offset = 0;
+	PyObject *data_size_obj = Py_None;
+	PyObject *offset_obj = Py_None;
+
+	const struct splat_raw_io *io;
+	struct splat_mmap m;
+	size_t data_size;
+	int res;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "s|zkOO", kwlist,
+					 &file_name, &sample_type,
+					 &data_offset, &data_size_obj,
+					 &offset_obj))
 		return NULL;
 
-	if (end_obj == Py_None)
-		end = bytes_length;
-	else if (splat_frag_sample_number(&end, start, bytes_length, end_obj))
+	io = splat_frag_raw_io(&self->frag, sample_type);
+
+	if (io == NULL)
 		return NULL;
 
-	length = end - start;
+	if (splat_mmap_open(&m, file_name))
+		return NULL;
 
-	if (splat_frag_grow(&self->frag, (offset + length)))
+	if (data_offset > m.size) {
+		PyErr_SetString(PyExc_ValueError,
+				"data offset beyond end of file");
+		splat_mmap_close(&m);
 		return NULL;
+	}
 
-	bytes = PyByteArray_AsString(bytes_obj);
+	data_size = m.size - data_offset;
 
-	for (c = 0; c < self->frag.n_channels; ++c) {
-		const char *in =
-			bytes + (start * frame_size) + (c * sample_size);
-		sample_t *out = &self->frag.data[c][offset];
+	if (data_size_obj != Py_None) {
+		const Py_ssize_t size =
+			PyNumber_AsSsize_t(data_size_obj, PyExc_OverflowError);
+
+		if ((size < 0) && PyErr_Occurred()) {
+			splat_mmap_close(&m);
+			return NULL;
+		}
 
-		io->import(out, in, length, frame_size);
+		data_size = minmax(size, 0, data_size);
 	}
 
+	res = splat_frag_import_raw(&self->frag, io, (m.data + data_offset),
+				    data_size, offset_obj, Py_None, Py_None);
+	splat_mmap_close(&m);
+
+	if (res)
+		return NULL;
+
 	Py_RETURN_NONE;
 }
 
 PyDoc_STRVAR(Fragment_export_bytes_doc,
-"export_bytes(sample_type=splat.SAMPLE_TYPE, start=None, end=None)\n"
+"export_bytes(sample_type=None, start=None, end=None, norm=None)\n"
 "\n"
 "Export audio data as raw bytes.\n"
 "\n"
 "The ``sample_type`` is a string to specify the format of the exported "
-"samples.  See :ref:`sample_formats` for more details.\n"
+"samples, or ``None`` to use the :py:attr:`sample_type` of the fragment.  "
+"See :ref:`sample_formats` for more details.\n"
 "\n"
 "The ``start`` and ``end`` arguments can be specified in sample numbers to "
 "only get a subset of the data.\n"
 "\n"
+"The ``norm`` argument can be used to normalize the exported data on the fly "
+"without modifying the fragment.  It is a 2-tuple with a gain and a tuple "
+"with an offset for each channel as returned by "
+":py:meth:`splat.data.Fragment.get_norm`.\n"
+"\n"
 "A ``bytearray`` object is then returned with the exported sample data.\n");
 
 static PyObject *Fragment_export_bytes(Fragment *self, PyObject *args,
 				       PyObject *kw)
 {
-	static char *kwlist[] = { "sample_type", "start", "end", NULL };
-	const char *sample_type = SPLAT_NATIVE_SAMPLE_TYPE;
+	static char *kwlist[] = {
+		"sample_type", "start", "end", "norm", NULL };
+	const char *sample_type = NULL;
 	PyObject *start_obj = Py_None;
 	PyObject *end_obj = Py_None;
+	PyObject *norm_obj = Py_None;
 
 	struct splat_fragment *frag = &self->frag;
 	const struct splat_raw_io *io;
-	size_t sample_size;
+	struct splat_norm norm;
 	size_t frame_size;
 	size_t start;
-	size_t end;
 	size_t length;
-	unsigned c;
 	PyObject *bytes_obj;
 	Py_ssize_t bytes_size;
-	char *out;
-	const sample_t *in[SPLAT_MAX_CHANNELS];
 
-	if (!PyArg_ParseTupleAndKeywords(args, kw, "|sOO", kwlist,
-					 &sample_type, &start_obj, &end_obj))
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "|zOOO", kwlist,
+					 &sample_type, &start_obj, &end_obj,
+					 &norm_obj))
 		return NULL;
 
-	io = splat_get_raw_io(sample_type);
+	io = splat_frag_raw_io(&self->frag, sample_type);
 
 	if (io == NULL)
 		return NULL;
 
-	sample_size = io->sample_width / 8;
-	frame_size = sample_size * frag->n_channels;
-
-	if (start_obj == Py_None)
-		start = 0;
-	else if (splat_frag_sample_number(&start, 0, frag->length, start_obj))
+	if (splat_frag_export_range(frag, start_obj, end_obj, &start, &length))
 		return NULL;
 
-	if (end_obj == Py_None)
-		end = frag->length;
-	else if (splat_frag_sample_number(&end, start, frag->length, end_obj))
+	if (splat_frag_export_norm(frag, norm_obj, &norm))
 		return NULL;
 
-	length = end - start;
+	frame_size = (io->sample_width / 8) * frag->n_channels;
 	bytes_size = length * frame_size;
 	bytes_obj = PyByteArray_FromStringAndSize(NULL, bytes_size);
 
 	if (bytes_obj == NULL)
 		return PyErr_NoMemory();
 
-	out = PyByteArray_AS_STRING(bytes_obj);
-
-	for (c = 0; c < frag->n_channels; ++c)
-		in[c] = &frag->data[c][start];
-
-	io->export(out, in, frag->n_channels, length);
+	splat_raw_export(frag, io, PyByteArray_AS_STRING(bytes_obj), start,
+			 length, &norm);
 
 	return bytes_obj;
 }
 
-PyDoc_STRVAR(Fragment_mix_doc,
-"mix(fragment, offset=0.0, skip=0.0, levels=None, duration=None)\n"
-"\n"
-"Mix the given other ``fragment`` data into this instance.\n"
+PyDoc_STRVAR(Fragment_export_file_doc,
+"export_file(file_name, sample_type=None, data_offset=0, "
+"start=None, end=None, norm=None)\n"
 "\n"
-"This is achieved by simply adding the corresponding samples of an incoming "
-"fragment to this fragment' samples.  The ``offset``, ``skip`` and "
-"``duration`` values in seconds can be used to alter the mixing times.  The "
-"incoming fragment can start being mixed with an ``offset`` into this "
-"fragment, its beginning can be skipped until the given ``skip`` time, and "
-"the ``duration`` to be mixed can be manually limited.  These values will be "
-"automatically adjusted to remain within the available incoming data.  The "
-"length of this fragment will be automatically increased if necessary to hold "
-"the mixed data.\n"
+"Export audio data directly into a file.\n"
 "\n"
-"The ``levels`` argument can be used to alter the amplitude of the incoming "
-"fragment while mixing - this does not affect the original fragment.\n"
+"The file called ``file_name`` is created or truncated and memory-mapped, "
+"then the samples are converted straight into it starting ``data_offset`` "
+"bytes into the file.  The first ``data_offset`` bytes are left blank so a "
+"file header can then be written there.  The ``sample_type``, ``start``, "
+"``end`` and ``norm`` arguments work in the same way as with "
+":py:meth:`splat.data.Fragment.export_bytes`.\n"
 "\n"
-"Please note that the two fragments must use the same sample rate and have "
-"the same number of channels.\n");
+"The number of exported samples per channel is returned.\n");
 
-static PyObject *Fragment_mix(Fragment *self, PyObject *args, PyObject *kw)
+static PyObject *Fragment_export_file(Fragment *self, PyObject *args,
+				      PyObject *kw)
 {
 	static char *kwlist[] = {
-		"frag", "offset", "skip", "levels", "duration", NULL };
-	Fragment *incoming_obj;
-	double offset = 0.0;
-	double skip = 0.0;
-	PyObject *levels_obj = Py_None;
-	PyObject *duration_obj = Py_None;
+		"file_name", "sample_type", "data_offset", "start", "end",
+		"norm", NULL };
+	const char *file_name;
+	const char *sample_type = NULL;
+	unsigned long data_offset = 0;
+	PyObject *start_obj = Py_None;
+	PyObject *end_obj = Py_None;
+	PyObject *norm_obj = Py_None;
 
 	struct splat_fragment *frag = &self->frag;
-	const struct splat_fragment *incoming;
-	struct splat_levels levels;
-	ssize_t length;
+	const struct splat_raw_io *io;
+	struct splat_norm norm;
+	struct splat_mmap m;
+	size_t frame_size;
+	size_t start;
+	size_t length;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kw, "O!|ddOO", kwlist,
-					 &splat_FragmentType, &incoming_obj,
-					 &offset, &skip, &levels_obj,
-					 &duration_obj))
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "s|zkOOO", kwlist,
+					 &file_name, &sample_type,
+					 &data_offset, &start_obj, &end_obj,
+					 &norm_obj))
 		return NULL;
 
-	incoming = &incoming_obj->frag;
+	io = splat_frag_raw_io(&self->frag, sample_type);
 
-	if (incoming->n_channels != frag->n_channels) {
-		PyErr_SetString(PyExc_ValueError, "channels number mismatch");
+	if (io == NULL)
 		return NULL;
-	}
 
-	if (incoming->rate != frag->rate) {
-		PyErr_SetString(PyExc_ValueError, "sample rate mismatch");
+	if (splat_frag_export_range(frag, start_obj, end_obj, &start, &length))
 		return NULL;
-	}
-
-	if (levels_obj == Py_None)
-		levels_obj = splat_zero;
 
-	if (splat_levels_init(frag, &levels, levels_obj))
+	if (splat_frag_export_norm(frag, norm_obj, &norm))
 		return NULL;
 
-	if (duration_obj != Py_None) {
-		if (!PyFloat_Check(duration_obj)) {
-			PyErr_SetString(PyExc_ValueError,
-					"duration must be float");
-			return NULL;
-		}
-
-		length = PyFloat_AS_DOUBLE(duration_obj) * frag->rate;
-	} else {
-		length = incoming->length;
-	}
+	frame_size = (io->sample_width / 8) * frag->n_channels;
 
-	if (splat_frag_mix(frag, incoming, &levels, length, offset, skip,
-			   levels_obj == splat_zero))
+	if (splat_mmap_create(&m, file_name,
+			      (data_offset + (length * frame_size))))
 		return NULL;
 
-	Py_RETURN_NONE;
+	if (length)
+		splat_raw_export(frag, io, (m.data + data_offset), start,
+				 length, &norm);
+
+	splat_mmap_close(&m);
+
+	return PyInt_FromSize_t(length);
 }
 
-PyDoc_STRVAR(Fragment_get_peak_doc,
-"get_peak()\n"
+PyDoc_STRVAR(Fragment_write_to_doc,
+"write_to(file, sample_type=None, start=None, end=None, "
+"chunk=None, norm=None)\n"
 "\n"
-"Get peak and average values for the whole fragment and for each channel.\n"
+"Export audio data and write it into a file object.\n"
 "\n"
-"Scan all the data and look for the peak maximum, minimum and absolute values "
-"as well as the average values for each channel and for the whole fragment. "
-"The results are returned as a 2-tuple, the first item being for the whole "
-"fragment and the second one a list with results for each channel.  "
-"Each result is a dictionary with ``max``, ``min``, ``peak`` and ``avg`` "
-"values respectively for linear maximum, minimum, absolute peak and average "
-"values.\n");
+"The samples are converted and written by chunks of ``chunk`` samples per "
+"channel, so only a buffer of the size of a chunk is needed instead of the "
+"whole exported data.  When ``None``, the chunk size is set to match 64KB of "
+"exported data.  The ``file`` can be a standard Python ``file`` object or "
+"any object with a ``write`` method.  The ``sample_type``, ``start``, "
+"``end`` and ``norm`` arguments work in the same way as with "
+":py:meth:`splat.data.Fragment.export_bytes`.\n"
+"\n"
+"The number of exported samples per channel is returned.\n");
 
-static PyObject *Fragment_get_peak(Fragment *self, PyObject *_)
+static PyObject *Fragment_write_to(Fragment *self, PyObject *args,
+				   PyObject *kw)
+{
+	static char *kwlist[] = {
+		"file", "sample_type", "start", "end", "chunk", "norm", NULL };
+	PyObject *file_obj;
+	const char *sample_type = NULL;
+	PyObject *start_obj = Py_None;
+	PyObject *end_obj = Py_None;
+	PyObject *chunk_obj = Py_None;
+	PyObject *norm_obj = Py_None;
+
+	struct splat_fragment *frag = &self->frag;
+	const struct splat_raw_io *io;
+	struct splat_norm norm;
+	size_t frame_size;
+	size_t start;
+	size_t length;
+	size_t chunk;
+	size_t rem;
+	PyObject *write = NULL;
+	FILE *fp = NULL;
+	char *buffer = NULL;
+	int stat = -1;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "O|zOOOO", kwlist,
+					 &file_obj, &sample_type, &start_obj,
+					 &end_obj, &chunk_obj, &norm_obj))
+		return NULL;
+
+	io = splat_frag_raw_io(&self->frag, sample_type);
+
+	if (io == NULL)
+		return NULL;
+
+	if (splat_frag_export_range(frag, start_obj, end_obj, &start, &length))
+		return NULL;
+
+	if (splat_frag_export_norm(frag, norm_obj, &norm))
+		return NULL;
+
+	frame_size = (io->sample_width / 8) * frag->n_channels;
+
+	if (chunk_obj == Py_None)
+		chunk = max((SPLAT_WRITE_CHUNK_SIZE / frame_size), 1);
+	else if (splat_frag_sample_number(&chunk, 1, LONG_MAX, chunk_obj))
+		return NULL;
+
+	chunk = min(chunk, length);
+
+	if (PyFile_Check(file_obj)) {
+		fp = PyFile_AsFile(file_obj);
+
+		if (fp == NULL) {
+			PyErr_SetString(PyExc_ValueError,
+					"I/O operation on closed file");
+			return NULL;
+		}
+
+		buffer = PyMem_Malloc(chunk * frame_size);
+
+		if (buffer == NULL)
+			return PyErr_NoMemory();
+
+		PyFile_IncUseCount((PyFileObject *)file_obj);
+	} else {
+		write = PyObject_GetAttrString(file_obj, "write");
+
+		if (write == NULL)
+			return NULL;
+	}
+
+	for (rem = length; rem; rem -= chunk, start += chunk) {
+		size_t chunk_size;
+
+		chunk = min(chunk, rem);
+		chunk_size = chunk * frame_size;
+
+		if (fp != NULL) {
+			size_t written;
+
+			splat_raw_export(frag, io, buffer, start, chunk,
+					 &norm);
+			Py_BEGIN_ALLOW_THREADS;
+			written = fwrite(buffer, chunk_size, 1, fp);
+			Py_END_ALLOW_THREADS;
+
+			if (written != 1) {
+				PyErr_SetFromErrno(PyExc_IOError);
+				goto free_write;
+			}
+		} else {
+			PyObject *str;
+			PyObject *ret;
+
+			str = PyString_FromStringAndSize(NULL, chunk_size);
+
+			if (str == NULL)
+				goto free_write;
+
+			splat_raw_export(frag, io, PyString_AS_STRING(str),
+					 start, chunk, &norm);
+			ret = PyObject_CallFunctionObjArgs(write, str, NULL);
+			Py_DECREF(str);
+
+			if (ret == NULL)
+				goto free_write;
+
+			Py_DECREF(ret);
+		}
+	}
+
+	stat = 0;
+
+free_write:
+	if (fp != NULL) {
+		PyFile_DecUseCount((PyFileObject *)file_obj);
+		PyMem_Free(buffer);
+	} else {
+		Py_DECREF(write);
+	}
+
+	if (stat)
+		return NULL;
+
+	return PyInt_FromSize_t(length);
+}
+
+PyDoc_STRVAR(Fragment_mix_doc,
+"mix(fragment, offset=0.0, skip=0.0, levels=None, duration=None, "
+"resample=False, matrix=None, pan=None)\n"
+"\n"
+"Mix the given other ``fragment`` data into this instance.\n"
+"\n"
+"This is achieved by simply adding the corresponding samples of an incoming "
+"fragment to this fragment' samples.  The ``offset``, ``skip`` and "
+"``duration`` values in seconds can be used to alter the mixing times.  The "
+"incoming fragment can start being mixed with an ``offset`` into this "
+"fragment, its beginning can be skipped until the given ``skip`` time, and "
+"the ``duration`` to be mixed can be manually limited.  These values will be "
+"automatically adjusted to remain within the available incoming data.  The "
+"length of this fragment will be automatically increased if necessary to hold "
+"the mixed data.\n"
+"\n"
+"The ``levels`` argument can be used to alter the amplitude of the incoming "
+"fragment while mixing - this does not affect the original fragment.\n"
+"\n"
+"The incoming channels are normally mixed into the same channels of this "
+"fragment.  Alternatively, a ``matrix`` can be given with one row for each "
+"channel of this fragment, each with the linear gain of every incoming "
+"channel.  For example, ``((1.0, 0.0), (0.5, 0.5))`` mixes the first "
+"incoming channel into the first channel and the average of both into the "
+"second one.  A mono fragment can also be given a ``pan`` position from "
+"-1.0 for the first channel to 1.0 for the last one, with a constant-power "
+"law between the two closest channels.  The ``levels`` still apply to the "
+"channels of this fragment, so a mono source can be generated once and then "
+"mixed into any number of channels without creating a multi-channel copy of "
+"it.  Without a ``matrix`` or ``pan``, the two fragments must have the same "
+"number of channels.\n"
+"\n"
+"The two fragments must also use the same sample rate unless ``resample`` is "
+"``True``, in which case the incoming fragment is converted on the fly to the "
+"sample rate of this fragment one block at a time without creating a "
+"resampled copy of it.  The ``skip`` and ``duration`` values then apply to "
+"the converted data.  See :py:meth:`splat.data.Fragment.resample` for more "
+"details.\n"
+"\n"
+"The incoming fragment may have a different :py:attr:`sample_type`, in which "
+"case a copy of it converted to the sample type of this fragment gets "
+"mixed.\n");
+
+/* Linear gain of each incoming channel into each output channel */
+typedef double splat_mix_matrix[SPLAT_MAX_CHANNELS][SPLAT_MAX_CHANNELS];
+
+/* Only keep the non-zero gains of the matrix */
+static int splat_mix_set_routes(struct splat_mix *mix, splat_mix_matrix m,
+				unsigned n_out, unsigned n_in)
 {
-	struct splat_peak chan_peak[SPLAT_MAX_CHANNELS];
-	struct splat_peak frag_peak;
 	unsigned c;
+	unsigned j;
 
-	PyObject *ret;
-	PyObject *frag_peak_obj;
-	PyObject *chan_peak_obj;
+	mix->routes = PyMem_Malloc(n_out * n_in *
+				   sizeof(struct splat_mix_route));
 
-	splat_frag_get_peak(&self->frag, chan_peak, &frag_peak, 1);
-	frag_peak_obj = splat_frag_peak_as_dict(&frag_peak);
+	if (mix->routes == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
 
-	if (frag_peak_obj == NULL)
-		return PyErr_NoMemory();
+	mix->n_routes = 0;
 
-	chan_peak_obj = PyList_New(self->frag.n_channels);
+	for (c = 0; c < n_out; ++c) {
+		for (j = 0; j < n_in; ++j) {
+			struct splat_mix_route *route;
 
-	if (chan_peak_obj == NULL)
+			if (m[c][j] == 0.0)
+				continue;
+
+			route = &mix->routes[mix->n_routes++];
+			route->out = c;
+			route->in = j;
+			route->gain = m[c][j];
+		}
+	}
+
+	return 0;
+}
+
+/* Mix a copy of the incoming fragment converted to the sample type of the
+ * fragment it gets mixed into */
+static int splat_mix_convert(const struct splat_fragment *frag,
+			     struct splat_mix *mix)
+{
+	mix->converted = PyMem_Malloc(sizeof(struct splat_fragment));
+
+	if (mix->converted == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	if (splat_ops_of(frag)->frag_convert(mix->converted, mix->incoming)) {
+		PyMem_Free(mix->converted);
+		mix->converted = NULL;
+		return -1;
+	}
+
+	mix->incoming = mix->converted;
+
+	return 0;
+}
+
+static void splat_mix_free(struct splat_mix *mix)
+{
+	PyMem_Free(mix->routes);
+	mix->routes = NULL;
+
+	if (mix->converted != NULL) {
+		splat_frag_free(mix->converted);
+		PyMem_Free(mix->converted);
+		mix->converted = NULL;
+	}
+}
+
+/* Constant-power pan of a mono fragment between the two closest channels,
+ * with the position going from the first channel at -1.0 to the last one at
+ * 1.0 */
+static void splat_mix_pan(splat_mix_matrix m, unsigned n_channels, double pan)
+{
+	const double pos = (minmax(pan, -1.0, 1.0) + 1.0) / 2.0 *
+		(n_channels - 1);
+	unsigned c;
+	unsigned i;
+	double a;
+
+	for (c = 0; c < n_channels; ++c)
+		m[c][0] = 0.0;
+
+	if (n_channels == 1) {
+		m[0][0] = 1.0;
+		return;
+	}
+
+	i = min((unsigned)pos, (n_channels - 2));
+	a = (pos - i) * M_PI / 2.0;
+	m[i][0] = cos(a);
+	m[i + 1][0] = sin(a);
+}
+
+static int splat_mix_parse_matrix(splat_mix_matrix m, unsigned n_out,
+				  unsigned n_in, PyObject *matrix_obj)
+{
+	PyObject *rows;
+	unsigned c;
+	unsigned j;
+	int res = -1;
+
+	rows = PySequence_Fast(matrix_obj, "matrix must be a sequence");
+
+	if (rows == NULL)
+		return -1;
+
+	if (PySequence_Fast_GET_SIZE(rows) != n_out) {
+		PyErr_SetString(PyExc_ValueError, "matrix rows mismatch");
+		goto free_rows;
+	}
+
+	for (c = 0; c < n_out; ++c) {
+		PyObject *row = PySequence_Fast(
+			PySequence_Fast_GET_ITEM(rows, c),
+			"matrix row must be a sequence");
+
+		if (row == NULL)
+			goto free_rows;
+
+		if (PySequence_Fast_GET_SIZE(row) != n_in) {
+			PyErr_SetString(PyExc_ValueError,
+					"matrix columns mismatch");
+			Py_DECREF(row);
+			goto free_rows;
+		}
+
+		for (j = 0; j < n_in; ++j) {
+			if (splat_obj2double(PySequence_Fast_GET_ITEM(row, j),
+					     &m[c][j])) {
+				PyErr_SetString(PyExc_TypeError,
+						"matrix gain must be a number");
+				Py_DECREF(row);
+				goto free_rows;
+			}
+		}
+
+		Py_DECREF(row);
+	}
+
+	res = 0;
+
+free_rows:
+	Py_DECREF(rows);
+
+	return res;
+}
+
+/* Parse the Fragment.mix arguments, also used with each mix_many event */
+static int splat_mix_parse(struct splat_fragment *frag, PyObject *args,
+			   PyObject *kw, struct splat_mix *mix)
+{
+	static char *kwlist[] = {
+		"frag", "offset", "skip", "levels", "duration", "resample",
+		"matrix", "pan", NULL };
+	Fragment *incoming_obj;
+	PyObject *levels_obj = Py_None;
+	PyObject *duration_obj = Py_None;
+	PyObject *resample = Py_False;
+	PyObject *matrix_obj = Py_None;
+	PyObject *pan_obj = Py_None;
+	splat_mix_matrix m;
+
+	const struct splat_fragment *incoming;
+	ssize_t length;
+
+	mix->offset = 0.0;
+	mix->skip = 0.0;
+	mix->routes = NULL;
+	mix->converted = NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "O!|ddOOO!OO", kwlist,
+					 &splat_FragmentType, &incoming_obj,
+					 &mix->offset, &mix->skip, &levels_obj,
+					 &duration_obj, &PyBool_Type,
+					 &resample, &matrix_obj, &pan_obj))
+		return -1;
+
+	incoming = &incoming_obj->frag;
+
+	if ((matrix_obj != Py_None) && (pan_obj != Py_None)) {
+		PyErr_SetString(PyExc_ValueError,
+				"cannot specify both matrix and pan");
+		return -1;
+	} else if (matrix_obj != Py_None) {
+		if (splat_mix_parse_matrix(m, frag->n_channels,
+					   incoming->n_channels, matrix_obj))
+			return -1;
+	} else if (pan_obj != Py_None) {
+		double pan;
+
+		if (incoming->n_channels != 1) {
+			PyErr_SetString(PyExc_ValueError,
+					"pan requires a mono fragment");
+			return -1;
+		}
+
+		if (splat_obj2double(pan_obj, &pan)) {
+			PyErr_SetString(PyExc_TypeError,
+					"pan must be a number");
+			return -1;
+		}
+
+		splat_mix_pan(m, frag->n_channels, pan);
+	} else if (incoming->n_channels != frag->n_channels) {
+		PyErr_SetString(PyExc_ValueError, "channels number mismatch");
+		return -1;
+	}
+
+	if ((incoming->rate != frag->rate) && (resample != Py_True)) {
+		PyErr_SetString(PyExc_ValueError, "sample rate mismatch");
+		return -1;
+	}
+
+	if (levels_obj == Py_None)
+		levels_obj = splat_zero;
+
+	if (splat_levels_init(frag, &mix->levels, levels_obj))
+		return -1;
+
+	if (duration_obj != Py_None) {
+		if (!PyFloat_Check(duration_obj)) {
+			PyErr_SetString(PyExc_ValueError,
+					"duration must be float");
+			return -1;
+		}
+
+		length = PyFloat_AS_DOUBLE(duration_obj) * frag->rate;
+	} else if (incoming->rate != frag->rate) {
+		length = splat_resample_length(incoming->length,
+					       incoming->rate, frag->rate);
+	} else {
+		length = incoming->length;
+	}
+
+	mix->incoming = incoming;
+	mix->length = length;
+	mix->zero_dB = (levels_obj == splat_zero) ? 1 : 0;
+	mix->resample = (incoming->rate != frag->rate) ? 1 : 0;
+
+	if (((matrix_obj != Py_None) || (pan_obj != Py_None)) &&
+	    splat_mix_set_routes(mix, m, frag->n_channels,
+				 incoming->n_channels))
+		return -1;
+
+	if ((incoming->sample_width != frag->sample_width) &&
+	    splat_mix_convert(frag, mix)) {
+		splat_mix_free(mix);
+		return -1;
+	}
+
+	return 0;
+}
+
+static PyObject *Fragment_mix(Fragment *self, PyObject *args, PyObject *kw)
+{
+	struct splat_mix mix;
+	int res;
+
+	if (splat_mix_parse(&self->frag, args, kw, &mix))
+		return NULL;
+
+	res = splat_frag_unshare(&self->frag);
+
+	if (!res)
+		res = splat_frag_mix(&self->frag, &mix);
+
+	splat_mix_free(&mix);
+
+	if (res)
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_mix_many_doc,
+"mix_many(events)\n"
+"\n"
+"Mix several fragments into this one.\n"
+"\n"
+"The ``events`` argument is a sequence of tuples with the same arguments as "
+":py:meth:`splat.data.Fragment.mix` in the same order, i.e. "
+"``(frag, offset, skip, levels, duration, resample, matrix, pan)`` where "
+"only ``frag`` is mandatory.  The result is the same as calling "
+":py:meth:`splat.data.Fragment.mix` with each event, but this fragment is "
+"only resized once and the events are mixed in the order of their offset "
+"which is much faster with a large number of them.  Events with the same "
+"offset are mixed in the order of the sequence.  As a result, overlapping "
+"events which are not already sorted by offset may lead to slightly "
+"different rounding errors.\n");
+
+static PyObject *Fragment_mix_many(Fragment *self, PyObject *args)
+{
+	PyObject *events_obj;
+
+	PyObject *events;
+	struct splat_mix *mix;
+	Py_ssize_t n;
+	Py_ssize_t i;
+	int res = 0;
+
+	if (!PyArg_ParseTuple(args, "O", &events_obj))
+		return NULL;
+
+	events = PySequence_Fast(events_obj, "events must be a sequence");
+
+	if (events == NULL)
+		return NULL;
+
+	n = PySequence_Fast_GET_SIZE(events);
+	mix = PyMem_Malloc(max(n, 1) * sizeof(struct splat_mix));
+
+	if (mix == NULL) {
+		Py_DECREF(events);
 		return PyErr_NoMemory();
+	}
+
+	for (i = 0; i < n; ++i) {
+		PyObject *event = PySequence_Fast_GET_ITEM(events, i);
+
+		if (!PyTuple_Check(event)) {
+			PyErr_SetString(PyExc_TypeError,
+					"mix event must be a tuple");
+			res = -1;
+			break;
+		}
+
+		if (splat_mix_parse(&self->frag, event, NULL, &mix[i])) {
+			res = -1;
+			break;
+		}
+	}
+
+	if (!res)
+		res = splat_frag_unshare(&self->frag);
+
+	/* The levels keep borrowed references to the event objects */
+	if (!res)
+		res = splat_frag_mix_many(&self->frag, mix, n);
+
+	while (i--)
+		splat_mix_free(&mix[i]);
+
+	PyMem_Free(mix);
+	Py_DECREF(events);
+
+	if (res)
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_get_peak_doc,
+"get_peak()\n"
+"\n"
+"Get peak and average values for the whole fragment and for each channel.\n"
+"\n"
+"Scan all the data and look for the peak maximum, minimum and absolute values "
+"as well as the average values for each channel and for the whole fragment. "
+"The results are returned as a 2-tuple, the first item being for the whole "
+"fragment and the second one a list with results for each channel.  "
+"Each result is a dictionary with ``max``, ``min``, ``peak`` and ``avg`` "
+"values respectively for linear maximum, minimum, absolute peak and average "
+"values.\n"
+"\n"
+"A summary of each block of samples is kept with the fragment, so only the "
+"blocks which have been modified since the last call need to be scanned "
+"again.\n");
+
+static PyObject *Fragment_get_peak(Fragment *self, PyObject *_)
+{
+	struct splat_peak chan_peak[SPLAT_MAX_CHANNELS];
+	struct splat_peak frag_peak;
+	unsigned c;
+
+	PyObject *ret;
+	PyObject *frag_peak_obj;
+	PyObject *chan_peak_obj;
+
+	if (splat_frag_get_peak(&self->frag, chan_peak, &frag_peak))
+		return NULL;
+
+	frag_peak_obj = splat_frag_peak_as_dict(&frag_peak);
+
+	if (frag_peak_obj == NULL)
+		return PyErr_NoMemory();
+
+	chan_peak_obj = PyList_New(self->frag.n_channels);
+
+	if (chan_peak_obj == NULL)
+		return PyErr_NoMemory();
+
+	for (c = 0; c < self->frag.n_channels; ++c) {
+		PyObject *peak_dict = splat_frag_peak_as_dict(&chan_peak[c]);
+
+		if (peak_dict == NULL)
+			return PyErr_NoMemory();
+
+		PyList_SET_ITEM(chan_peak_obj, c, peak_dict);
+	}
+
+	ret = Py_BuildValue("(OO)", frag_peak_obj, chan_peak_obj);
+	Py_DECREF(frag_peak_obj);
+	Py_DECREF(chan_peak_obj);
+
+	return ret;
+}
+
+static PyObject *splat_frag_stats_as_dict(const struct splat_stats *stats)
+{
+	return Py_BuildValue("{sdsdsdsdsdsdsd}", "avg", stats->avg,
+			     "max", stats->max, "min", stats->min,
+			     "peak", stats->peak, "rms", stats->rms,
+			     "true_peak", stats->true_peak,
+			     "loudness", stats->loudness);
+}
+
+PyDoc_STRVAR(Fragment_get_stats_doc,
+"get_stats()\n"
+"\n"
+"Get level statistics for the whole fragment and for each channel.\n"
+"\n"
+"This is like :py:meth:`splat.data.Fragment.get_peak` with some extra "
+"values, all gathered while going through the data only once.  The results "
+"are returned in the same way, as a 2-tuple with a dictionary for the whole "
+"fragment and a list of dictionaries for each channel.  On top of ``max``, "
+"``min``, ``peak`` and ``avg``, each dictionary contains the following "
+"values:\n"
+"\n"
+"``rms``\n"
+"  linear RMS level, for all the channels put together in the case of the "
+"whole fragment\n"
+"\n"
+"``true_peak``\n"
+"  linear absolute peak value estimated with 4x oversampling, which can be "
+"higher than ``peak`` as it includes peaks between samples\n"
+"\n"
+"``loudness``\n"
+"  integrated loudness in LUFS as defined by ITU-R BS.1770 with K-weighting "
+"and gating, with the same weight for all the channels; it is ``-inf`` if "
+"the fragment is silent or shorter than 400ms\n");
+
+static PyObject *Fragment_get_stats(Fragment *self, PyObject *_)
+{
+	struct splat_stats chan_stats[SPLAT_MAX_CHANNELS];
+	struct splat_stats frag_stats;
+	unsigned c;
+
+	PyObject *ret;
+	PyObject *frag_stats_obj;
+	PyObject *chan_stats_obj;
+
+	if (splat_frag_get_stats(&self->frag, chan_stats, &frag_stats))
+		return NULL;
+
+	frag_stats_obj = splat_frag_stats_as_dict(&frag_stats);
+
+	if (frag_stats_obj == NULL)
+		return NULL;
+
+	chan_stats_obj = PyList_New(self->frag.n_channels);
+
+	if (chan_stats_obj == NULL) {
+		Py_DECREF(frag_stats_obj);
+		return NULL;
+	}
+
+	for (c = 0; c < self->frag.n_channels; ++c) {
+		PyObject *stats = splat_frag_stats_as_dict(&chan_stats[c]);
+
+		if (stats == NULL) {
+			Py_DECREF(frag_stats_obj);
+			Py_DECREF(chan_stats_obj);
+			return NULL;
+		}
+
+		PyList_SET_ITEM(chan_stats_obj, c, stats);
+	}
+
+	ret = Py_BuildValue("(OO)", frag_stats_obj, chan_stats_obj);
+	Py_DECREF(frag_stats_obj);
+	Py_DECREF(chan_stats_obj);
+
+	return ret;
+}
+
+PyDoc_STRVAR(Fragment_normalize_doc,
+"normalize(level=-0.05, zero=True)\n"
+"\n"
+"Normalize the amplitude.\n"
+"\n"
+"The ``level`` value in dB is the resulting maximum amplitude after "
+"normalization.  The default value of -0.05 dB is the maximum level while "
+"ensuring no clipping occurs due to rounding errors, even when saving with "
+"8-bit sample resolution. "
+"The same gain is applied to all channels, so the relative difference in "
+"levels between channels is preserved.\n"
+"\n"
+"When ``zero`` is ``True``, the average value is substracted from all the "
+"fragment prior to amplification to avoid any offset and achieve maximum "
+"amplitude.  With some imbalanced transitory signals, it may be better to not "
+"remove the average value as this may have the undesirable effect of adding "
+"some offset instead.\n");
+
+static PyObject *Fragment_normalize(Fragment *self, PyObject *args)
+{
+	double level_dB = -0.05;
+	PyObject *zero = NULL;
+
+	int do_zero;
+
+	if (!PyArg_ParseTuple(args, "|dO!", &level_dB, &PyBool_Type, &zero))
+		return NULL;
+
+	if (self->frag.n_channels > SPLAT_MAX_CHANNELS) {
+		PyErr_SetString(PyExc_ValueError, "too many channels");
+		return NULL;
+	}
+
+	if (splat_frag_unshare(&self->frag))
+		return NULL;
+
+	do_zero = ((zero == NULL) || (zero == Py_True)) ? 1 : 0;
+
+	if (splat_frag_normalize(&self->frag, level_dB, do_zero) < 0)
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_get_norm_doc,
+"get_norm(level=-0.05, zero=True)\n"
+"\n"
+"Get the normalization parameters.\n"
+"\n"
+"Scan the data in the same way as :py:meth:`splat.data.Fragment.normalize` "
+"with the same ``level`` and ``zero`` arguments, but only return the "
+"resulting parameters instead of modifying the fragment.  They are returned "
+"as a 2-tuple with the linear gain and a tuple with the offset for each "
+"channel, which can then be passed as the ``norm`` argument to export the "
+"data normalized on the fly, for example with "
+":py:meth:`splat.data.Fragment.export_bytes`.\n");
+
+static PyObject *Fragment_get_norm(Fragment *self, PyObject *args)
+{
+	double level_dB = -0.05;
+	PyObject *zero = NULL;
+
+	struct splat_norm norm;
+	PyObject *offset_obj;
+	unsigned c;
+	int do_zero;
+
+	if (!PyArg_ParseTuple(args, "|dO!", &level_dB, &PyBool_Type, &zero))
+		return NULL;
+
+	do_zero = ((zero == NULL) || (zero == Py_True)) ? 1 : 0;
+
+	if (splat_frag_get_norm(&self->frag, level_dB, do_zero, &norm) < 0)
+		return NULL;
+
+	offset_obj = PyTuple_New(self->frag.n_channels);
+
+	if (offset_obj == NULL)
+		return NULL;
+
+	for (c = 0; c < self->frag.n_channels; ++c)
+		PyTuple_SET_ITEM(offset_obj, c,
+				 PyFloat_FromDouble(norm.offset[c]));
+
+	return Py_BuildValue("(dN)", norm.gain, offset_obj);
+}
+
+PyDoc_STRVAR(Fragment_amp_doc,
+"amp(gain)\n"
+"\n"
+"Amplify the fragment by the given linear ``gain`` which can either be a "
+"single signal  to apply to all channels or a tuple with a signal "
+"for each individual channel.  Please note that a negative value will "
+"invert the data in the fragment.\n");
+
+static PyObject *Fragment_amp(Fragment *self, PyObject *args)
+{
+	PyObject *gain_obj;
+
+	struct splat_levels gains;
+
+	if (!PyArg_ParseTuple(args, "O", &gain_obj))
+		return NULL;
+
+	if (splat_levels_init(&self->frag, &gains, gain_obj))
+		return NULL;
+
+	if (splat_frag_unshare(&self->frag))
+		return NULL;
+
+	if (splat_frag_amp(&self->frag, &gains))
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_lin2dB_doc,
+"lin2dB()\n"
+"\n"
+"Convert all the sample values to dB.\n");
+
+static PyObject *Fragment_lin2dB(Fragment *self, PyObject *_)
+{
+	if (splat_frag_unshare(&self->frag))
+		return NULL;
+
+	splat_frag_lin2dB(&self->frag);
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_dB2lin_doc,
+"dB2lin()\n"
+"\n"
+"Convert all the sample values from dB to linear scale.\n");
+
+static PyObject *Fragment_dB2lin(Fragment *self, PyObject *_)
+{
+	if (splat_frag_unshare(&self->frag))
+		return NULL;
+
+	splat_frag_dB2lin(&self->frag);
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_offset_doc,
+"offset(value, start=0.0)\n"
+"\n"
+"Add a linear offset to the data already in the fragment starting at the "
+"``start`` time in seconds.  This is especially useful when generating a "
+"modulation fragment.\n");
+
+static PyObject *Fragment_offset(Fragment *self, PyObject *args)
+{
+	PyObject *offset;
+	double start = 0.0;
+
+	if (!PyArg_ParseTuple(args, "O|d", &offset, &start))
+		return NULL;
+
+	if (splat_frag_unshare(&self->frag))
+		return NULL;
+
+	if (splat_frag_offset(&self->frag, offset, start))
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_resample_doc,
+"resample(rate, quality=32)\n"
+"\n"
+"Convert the fragment to the given sample ``rate``.\n"
+"\n"
+"This uses a polyphase filter with a windowed sinc.  The ``quality`` is the "
+"number of zero crossings of the sinc on each side, between 4 and 256.  "
+"Higher values give a sharper cut-off just below the Nyquist frequency, at "
+"the cost of more processing time.  When lowering the sample rate, the "
+"frequencies above the new Nyquist frequency are removed.  The length of the "
+"fragment is adjusted to keep the same duration.\n");
+
+static PyObject *Fragment_resample(Fragment *self, PyObject *args,
+				   PyObject *kw)
+{
+	static char *kwlist[] = { "rate", "quality", NULL };
+	unsigned rate;
+	unsigned quality = SPLAT_RESAMPLE_QUALITY;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "I|I", kwlist,
+					 &rate, &quality))
+		return NULL;
+
+	if (!rate) {
+		PyErr_SetString(PyExc_ValueError, "invalid sample rate");
+		return NULL;
+	}
+
+	if ((quality < SPLAT_RESAMPLE_MIN_QUALITY) ||
+	    (quality > SPLAT_RESAMPLE_MAX_QUALITY)) {
+		PyErr_SetString(PyExc_ValueError, "invalid quality");
+		return NULL;
+	}
+
+	if (splat_frag_resample(&self->frag, rate, quality))
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_resize_doc,
+"resize(duration=0.0, length=0)\n"
+"\n"
+"Resize the fragment to the given ``duration`` in seconds or ``length`` in "
+"number of samples per channel.  If the fragment grows, silence is added at "
+"the end.  When shrinking, the end of the fragment is lost.\n");
+
+/* Parse a duration or a length as used by resize and reserve */
+static int splat_frag_parse_length(const struct splat_fragment *frag,
+				   PyObject *args, PyObject *kw,
+				   unsigned long *length)
+{
+	static char *kwlist[] = { "duration", "length", NULL };
+	double duration = 0.0;
+
+	*length = 0;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "|dk", kwlist,
+					 &duration, length))
+		return -1;
+
+	if (duration < 0.0) {
+		PyErr_SetString(PyExc_ValueError, "negative duration");
+		return -1;
+	}
+
+	if (!*length) {
+		*length = duration * frag->rate;
+	} else if (duration != 0.0) {
+		PyErr_SetString(PyExc_ValueError,
+				"cannot specify both length and duration");
+		return -1;
+	}
+
+	return 0;
+}
+
+static PyObject *Fragment_resize(Fragment *self, PyObject *args, PyObject *kw)
+{
+	unsigned long length;
+
+	if (splat_frag_parse_length(&self->frag, args, kw, &length))
+		return NULL;
+
+	if (splat_frag_resize(&self->frag, length))
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_reserve_doc,
+"reserve(duration=0.0, length=0)\n"
+"\n"
+"Reserve memory for the given ``duration`` in seconds or ``length`` in "
+"number of samples per channel, without changing the actual length of the "
+"fragment.\n"
+"\n"
+"The fragment memory grows automatically by increasingly large steps as "
+"needed, but reserving it beforehand avoids copying the data when the final "
+"length is known, for example before mixing many fragments one after the "
+"other.  Reserving less than what has already been allocated has no "
+"effect.\n");
+
+static PyObject *Fragment_reserve(Fragment *self, PyObject *args,
+				  PyObject *kw)
+{
+	unsigned long length;
+
+	if (splat_frag_parse_length(&self->frag, args, kw, &length))
+		return NULL;
+
+	if (splat_frag_reserve(&self->frag, length))
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Fragment_view_doc,
+"view(start=None, end=None)\n"
+"\n"
+"Create a new fragment with the samples between ``start`` and ``end`` "
+"sample numbers, which default to the whole fragment.\n"
+"\n"
+"The new fragment initially shares the memory with this one, so this is "
+"very fast and uses no extra memory.  The data only gets copied when one of "
+"the fragments is modified, so it is a real independent copy and changing "
+"one will never alter the other.\n");
+
+static PyObject *Fragment_view(Fragment *self, PyObject *args, PyObject *kw)
+{
+	static char *kwlist[] = { "start", "end", NULL };
+	PyObject *start_obj = Py_None;
+	PyObject *end_obj = Py_None;
+
+	struct splat_fragment *frag = &self->frag;
+	PyObject *view_args;
+	PyObject *view_kw;
+	PyObject *view_obj;
+	size_t start;
+	size_t length;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "|OO", kwlist,
+					 &start_obj, &end_obj))
+		return NULL;
+
+	if (splat_frag_export_range(frag, start_obj, end_obj, &start, &length))
+		return NULL;
+
+	view_args = Py_BuildValue("(II)", frag->n_channels, frag->rate);
+	view_kw = Py_BuildValue("{ss}", "sample_type",
+				splat_ops_of(frag)->sample_type);
+
+	if ((view_args != NULL) && (view_kw != NULL))
+		view_obj = PyObject_Call((PyObject *)self->ob_type, view_args,
+					 view_kw);
+	else
+		view_obj = NULL;
+
+	Py_XDECREF(view_args);
+	Py_XDECREF(view_kw);
+
+	if (view_obj == NULL)
+		return NULL;
+
+	if (splat_frag_share(&((Fragment *)view_obj)->frag, frag, start,
+			     (start + length))) {
+		Py_DECREF(view_obj);
+		return NULL;
+	}
+
+	return view_obj;
+}
+
+static PyMethodDef Fragment_methods[] = {
+	{ "import_bytes", (PyCFunction)Fragment_import_bytes, METH_KEYWORDS,
+	  Fragment_import_bytes_doc },
+	{ "import_file", (PyCFunction)Fragment_import_file, METH_KEYWORDS,
+	  Fragment_import_file_doc },
+	{ "export_bytes", (PyCFunction)Fragment_export_bytes, METH_KEYWORDS,
+	  Fragment_export_bytes_doc },
+	{ "export_file", (PyCFunction)Fragment_export_file, METH_KEYWORDS,
+	  Fragment_export_file_doc },
+	{ "write_to", (PyCFunction)Fragment_write_to, METH_KEYWORDS,
+	  Fragment_write_to_doc },
+	{ "mix", (PyCFunction)Fragment_mix, METH_KEYWORDS,
+	  Fragment_mix_doc },
+	{ "mix_many", (PyCFunction)Fragment_mix_many, METH_VARARGS,
+	  Fragment_mix_many_doc },
+	{ "get_peak", (PyCFunction)Fragment_get_peak, METH_NOARGS,
+	  Fragment_get_peak_doc },
+	{ "get_stats", (PyCFunction)Fragment_get_stats, METH_NOARGS,
+	  Fragment_get_stats_doc },
+	{ "normalize", (PyCFunction)Fragment_normalize, METH_VARARGS,
+	  Fragment_normalize_doc },
+	{ "get_norm", (PyCFunction)Fragment_get_norm, METH_VARARGS,
+	  Fragment_get_norm_doc },
+	{ "amp", (PyCFunction)Fragment_amp, METH_VARARGS,
+	  Fragment_amp_doc },
+	{ "lin2dB", (PyCFunction)Fragment_lin2dB, METH_NOARGS,
+	  Fragment_lin2dB_doc },
+	{ "dB2lin", (PyCFunction)Fragment_dB2lin, METH_NOARGS,
+	  Fragment_dB2lin_doc },
+	{ "offset", (PyCFunction)Fragment_offset, METH_VARARGS,
+	  Fragment_offset_doc },
+	{ "resample", (PyCFunction)Fragment_resample, METH_KEYWORDS,
+	  Fragment_resample_doc },
+	{ "resize", (PyCFunction)Fragment_resize, METH_KEYWORDS,
+	  Fragment_resize_doc },
+	{ "reserve", (PyCFunction)Fragment_reserve, METH_KEYWORDS,
+	  Fragment_reserve_doc },
+	{ "view", (PyCFunction)Fragment_view, METH_KEYWORDS,
+	  Fragment_view_doc },
+	{ NULL }
+};
+
+static PyTypeObject splat_FragmentType = {
+	PyObject_HEAD_INIT(NULL)
+	0,                                 /* ob_size */
+	"_splat.Fragment",                 /* tp_name */
+	sizeof(Fragment),                  /* tp_basicsize */
+	0,                                 /* tp_itemsize */
+	(destructor)Fragment_dealloc,      /* tp_dealloc */
+	0,                                 /* tp_print */
+	0,                                 /* tp_getattr */
+	0,                                 /* tp_setattr */
+	0,                                 /* tp_compare */
+	0,                                 /* tp_repr */
+	0,                                 /* tp_as_number */
+	&Fragment_as_sequence,             /* tp_as_sequence */
+	0,                                 /* tp_as_mapping */
+	0,                                 /* tp_hash  */
+	0,                                 /* tp_call */
+	0,                                 /* tp_str */
+	0,                                 /* tp_getattro */
+	0,                                 /* tp_setattro */
+	0,                                 /* tp_as_buffer */
+	BASE_TYPE_FLAGS,                   /* tp_flags */
+	"Fragment of audio data",          /* tp_doc */
+	0,                                 /* tp_traverse */
+	0,                                 /* tp_clear */
+	0,                                 /* tp_richcompare */
+	0,                                 /* tp_weaklistoffset */
+	0,                                 /* tp_iter */
+	0,                                 /* tp_iternext */
+	Fragment_methods,                  /* tp_methods */
+	0,                                 /* tp_members */
+	Fragment_getsetters,               /* tp_getset */
+	0,                                 /* tp_base */
+	0,                                 /* tp_dict */
+	0,                                 /* tp_descr_get */
+	0,                                 /* tp_descr_set */
+	0,                                 /* tp_dictoffset */
+	(initproc)Fragment_init,           /* tp_init */
+	0,                                 /* tp_alloc */
+	Fragment_new,                      /* tp_new */
+};
+
+/* ----------------------------------------------------------------------------
+ * _splat methods
+ */
+
+PyDoc_STRVAR(splat_lin2dB_doc,
+"lin2dB(value)\n"
+"\n"
+"Convert floating point linear ``value`` to dB.\n");
+
+static PyObject *splat_lin2dB(PyObject *self, PyObject *args)
+{
+	double level;
+
+	if (!PyArg_ParseTuple(args, "d", &level))
+		return NULL;
+
+	return PyFloat_FromDouble(lin2dB(level));
+}
+
+PyDoc_STRVAR(splat_dB2lin_doc,
+"dB2lin(value)\n"
+"\n"
+"Convert floating point dB ``value`` to linear.\n");
+
+static PyObject *splat_dB2lin(PyObject *self, PyObject *args)
+{
+	double dB;
+
+	if (!PyArg_ParseTuple(args, "d", &dB))
+		return NULL;
+
+	return PyFloat_FromDouble(dB2lin(dB));
+}
+
+PyDoc_STRVAR(splat_get_threads_doc,
+"get_threads()\n"
+"\n"
+"Get the number of threads used by the filters which can process several "
+"channels or blocks of samples in parallel.\n");
+
+static PyObject *splat_get_threads(PyObject *self, PyObject *args)
+{
+	return PyInt_FromLong(splat_pool_get_threads());
+}
+
+PyDoc_STRVAR(splat_set_threads_doc,
+"set_threads(n)\n"
+"\n"
+"Set the number of threads used by the filters to ``n``, including the "
+"calling one so 1 means no extra threads.  The initial value is the "
+"``SPLAT_THREADS`` environment variable if set, or the number of CPUs "
+"otherwise.  The results are exactly the same regardless of the number of "
+"threads.  The global interpreter lock is kept while the filters are "
+"running, so other Python threads wait for them to complete.\n");
+
+static PyObject *splat_set_threads(PyObject *self, PyObject *args)
+{
+	int n;
+
+	if (!PyArg_ParseTuple(args, "i", &n))
+		return NULL;
+
+	if (n < 1) {
+		PyErr_SetString(PyExc_ValueError,
+				"number of threads must be >= 1");
+		return NULL;
+	}
+
+	splat_pool_set_threads(n);
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(splat_gen_ref_doc,
+"gen_ref(frag)\n"
+"\n"
+"Generate a reference signal into a single channel fragment."
+"\n"
+"This is useful mainly for benchmarks and testing purposes.\n");
+
+static PyObject *splat_gen_ref(PyObject *self, PyObject *args)
+{
+	Fragment *frag_obj;
+	struct splat_fragment *frag;
+	size_t n;
+	size_t i;
+
+	if (!PyArg_ParseTuple(args, "O!", &splat_FragmentType, &frag_obj))
+		return NULL;
+
+	frag = &frag_obj->frag;
+
+	if (frag->n_channels != 1) {
+		PyErr_SetString(PyExc_ValueError,
+				"fragment must have a single channel");
+		return NULL;
+	}
+
+	if (frag->length == 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"fragment length must be greater than 0");
+		return NULL;
+	}
+
+	if (splat_frag_unshare(frag))
+		return NULL;
+
+	splat_frag_touch_all(frag);
+	n = frag->length;
+
+	for (i = 0; i < n; ++i)
+		splat_frag_set_sample(frag, 0, i, (i / n));
+
+	Py_RETURN_NONE;
+}
+
+/* ----------------------------------------------------------------------------
+ * Sources
+ */
+
+/* -- helpers for sources -- */
+
+/* Without an offset, the source is written over the whole fragment.
+ * Otherwise, it is added from the offset for the given duration or until the
+ * end, and the fragment grows if needed as with Fragment.mix.  */
+static int splat_source_init(struct splat_source *src,
+			     struct splat_fragment *frag, PyObject *offset_obj,
+			     PyObject *duration_obj, double gain)
+{
+	double offset;
+	double duration;
+
+	src->frag = frag;
+	src->gain = gain;
+
+	if (offset_obj == Py_None) {
+		if (duration_obj != Py_None) {
+			PyErr_SetString(PyExc_ValueError,
+					"duration requires an offset");
+			return -1;
+		}
+
+		src->start = 0;
+		src->length = frag->length;
+		src->add = 0;
+	} else {
+		if (splat_obj2double(offset_obj, &offset) || (offset < 0.0)) {
+			PyErr_SetString(PyExc_ValueError, "invalid offset");
+			return -1;
+		}
+
+		src->start = offset * frag->rate;
+		src->add = 1;
+
+		if (duration_obj == Py_None) {
+			src->length = (src->start < frag->length) ?
+				(frag->length - src->start) : 0;
+		} else if (splat_obj2double(duration_obj, &duration) ||
+			   (duration < 0.0)) {
+			PyErr_SetString(PyExc_ValueError, "invalid duration");
+			return -1;
+		} else {
+			src->length = duration * frag->rate;
+		}
+	}
+
+	if (splat_frag_unshare(frag))
+		return -1;
+
+	if (splat_frag_grow(frag, (src->start + src->length)))
+		return -1;
+
+	splat_frag_touch(frag, src->start, src->length);
+
+	return 0;
+}
+
+#define splat_check_all_floats(...)			\
+	_splat_check_all_floats(PP_NARG(__VA_ARGS__), __VA_ARGS__)
+
+static int _splat_check_all_floats(size_t n, ...)
+{
+	va_list objs;
+	size_t i;
+
+	va_start(objs, n);
+
+	for (i = 0; i < n; ++i) {
+		PyObject *obj = va_arg(objs, PyObject *);
+
+		if (!PyFloat_Check(obj))
+			break;
+	}
+
+	va_end(objs);
+
+	return (i == n);
+}
+
+PyDoc_STRVAR(splat_sine_doc,
+"sine(fragment, levels, frequency, phase=0.0, origin=0.0, offset=None, "
+"duration=None, gain=1.0)\n"
+"\n"
+"Generate a sine wave for the given ``levels``, ``frequency`` and ``phase`` "
+"signals over the entire ``fragment`` with the given ``origin`` in time.  "
+"With an ``offset``, the wave is added to the fragment instead as described "
+"in :ref:`sources`.\n");
+
+static PyObject *splat_sine(PyObject *self, PyObject *args, PyObject *kw)
+{
+	static char *kwlist[] = {
+		"fragment", "levels", "frequency", "phase", "origin", "offset",
+		"duration", "gain", NULL };
+	Fragment *frag_obj;
+	PyObject *levels_obj;
+	PyObject *freq;
+	PyObject *phase = splat_zero;
+	double origin = 0.0;
+	PyObject *offset = Py_None;
+	PyObject *duration = Py_None;
+	double gain = 1.0;
+
+	struct splat_fragment *frag;
+	struct splat_levels levels;
+	struct splat_source src;
+	int all_floats;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "O!OO|OdOOd", kwlist,
+					 &splat_FragmentType, &frag_obj,
+					 &levels_obj, &freq, &phase, &origin,
+					 &offset, &duration, &gain))
+		return NULL;
+
+	frag = &frag_obj->frag;
+
+	if (splat_levels_init(frag, &levels, levels_obj))
+		return NULL;
+
+	all_floats = levels.all_floats && splat_check_all_floats(freq, phase);
+
+	if (splat_source_init(&src, frag, offset, duration, gain))
+		return NULL;
+
+	if (all_floats)
+		splat_sine_floats(&src, levels.fl, PyFloat_AS_DOUBLE(freq),
+				  PyFloat_AS_DOUBLE(phase) + origin);
+	else if (splat_sine_signals(&src, levels.obj, freq, phase, origin))
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(splat_square_doc,
+"square(fragment, levels, frequency, phase=0.0, origin=0.0, ratio=0.5, "
+"offset=None, duration=None, gain=1.0)\n"
+"\n"
+"Generate a square wave with standard argments and the given ``ratio`` over "
+"the entire ``fragment``.  The ratio is between the duration of the high and "
+"low states.  The ``offset``, ``duration`` and ``gain`` work as with "
+":py:func:`splat.sources.sine`.\n");
+
+static PyObject *splat_square(PyObject *self, PyObject *args, PyObject *kw)
+{
+	static char *kwlist[] = {
+		"fragment", "levels", "frequency", "phase", "origin", "ratio",
+		"offset", "duration", "gain", NULL };
+	Fragment *frag_obj;
+	PyObject *levels_obj;
+	PyObject *freq;
+	PyObject *phase = splat_zero;
+	double origin = 0.0;
+	PyObject *ratio = splat_init_source_ratio;
+	PyObject *offset = Py_None;
+	PyObject *duration = Py_None;
+	double gain = 1.0;
+
+	struct splat_fragment *frag;
+	struct splat_levels levels;
+	struct splat_source src;
+	int all_floats;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "O!OO|OdOOOd", kwlist,
+					 &splat_FragmentType, &frag_obj,
+					 &levels_obj, &freq, &phase, &origin,
+					 &ratio, &offset, &duration, &gain))
+		return NULL;
+
+	frag = &frag_obj->frag;
+
+	if (splat_levels_init(frag, &levels, levels_obj))
+		return NULL;
+
+	all_floats = levels.all_floats;
+	all_floats = all_floats && splat_check_all_floats(freq, phase, ratio);
+
+	if (splat_source_init(&src, frag, offset, duration, gain))
+		return NULL;
+
+	if (all_floats)
+		splat_square_floats(&src, levels.fl, PyFloat_AS_DOUBLE(freq),
+				    PyFloat_AS_DOUBLE(phase) + origin,
+				    PyFloat_AS_DOUBLE(ratio));
+	else if (splat_square_signals(&src, levels.obj, freq, phase, ratio,
+				      origin))
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(splat_triangle_doc,
+"triangle(fragment, levels, frequency, phase=0.0, origin=0.0, ratio=0.5, "
+"offset=None, duration=None, gain=1.0)\n"
+"\n"
+"Generate a triangle wave with the given ``ratio`` over the entire "
+"``fragment``.  The ratio is between the duration of the high and "
+"low states.  The ``offset``, ``duration`` and ``gain`` work as with "
+":py:func:`splat.sources.sine`.\n");
+
+static PyObject *splat_triangle(PyObject *self, PyObject *args, PyObject *kw)
+{
+	static char *kwlist[] = {
+		"fragment", "levels", "frequency", "phase", "origin", "ratio",
+		"offset", "duration", "gain", NULL };
+	Fragment *frag_obj;
+	PyObject *levels_obj;
+	PyObject *freq;
+	PyObject *phase = splat_zero;
+	double origin = 0.0;
+	PyObject *ratio = splat_init_source_ratio;
+	PyObject *offset = Py_None;
+	PyObject *duration = Py_None;
+	double gain = 1.0;
+
+	struct splat_fragment *frag;
+	struct splat_levels levels;
+	struct splat_source src;
+	int all_floats;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "O!OO|OdOOOd", kwlist,
+					 &splat_FragmentType, &frag_obj,
+					 &levels_obj, &freq, &phase, &origin,
+					 &ratio, &offset, &duration, &gain))
+		return NULL;
+
+	frag = &frag_obj->frag;
+
+	if (splat_levels_init(frag, &levels, levels_obj))
+		return NULL;
+
+	all_floats = levels.all_floats;
+	all_floats = all_floats && splat_check_all_floats(freq, phase, ratio);
+
+	if (splat_source_init(&src, frag, offset, duration, gain))
+		return NULL;
+
+	if (all_floats)
+		splat_triangle_floats(&src, levels.fl, PyFloat_AS_DOUBLE(freq),
+				      PyFloat_AS_DOUBLE(phase) + origin,
+				      PyFloat_AS_DOUBLE(ratio));
+	else if (splat_triangle_signals(&src, levels.obj, freq, phase, ratio,
+					origin))
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(splat_overtones_doc,
+"overtones(fragment, levels, frequency, overtones, phase=0.0, origin=0.0, "
+"offset=None, duration=None, gain=1.0)\n"
+"\n"
+"Generate a sum of overtones as pure sine waves with the given fundamental "
+"``frequency`` and ``levels``.\n"
+"\n"
+"The ``overtones`` are described with a list of 3-tuples containing the "
+"ratio between the overtone and the fundamental frequency, the phase and "
+"linear levels: ``(ratio, phase, levels)``.  All these values can be signals, "
+"and the levels can either be a single value for all channels or individual "
+"values for each channel.  The generation is performed over the entire "
+"fragment, and unlike other sources the overtones are always added to the "
+"existing samples.  The ``offset``, ``duration`` and ``gain`` can be used to "
+"limit them to a part of the fragment as with "
+":py:func:`splat.sources.sine`.\n");
+
+static PyObject *splat_overtones(PyObject *self, PyObject *args,
+				 PyObject *kw)
+{
+	static char *kwlist[] = {
+		"fragment", "levels", "frequency", "overtones", "phase",
+		"origin", "offset", "duration", "gain", NULL };
+	enum {
+		OT_RATIO = 0,
+		OT_PHASE,
+		OT_LEVELS,
+	};
+	Fragment *frag_obj;
+	PyObject *levels_obj;
+	PyObject *freq;
+	PyObject *overtones_obj;
+	PyObject *phase = splat_zero;
+	double origin = 0.0;
+	PyObject *offset = Py_None;
+	PyObject *duration = Py_None;
+	double gain = 1.0;
+
+	struct splat_fragment *frag;
+	struct splat_levels levels;
+	struct splat_source src;
+	struct splat_overtone *overtones;
+	struct splat_overtone *ot;
+	Py_ssize_t n;
+	Py_ssize_t pos;
+	int all_floats;
+	int ot_all_floats;
+	int stat = 0;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, "O!OOO!|OdOOd", kwlist,
+					 &splat_FragmentType, &frag_obj,
+					 &levels_obj, &freq, &PyList_Type,
+					 &overtones_obj, &phase, &origin,
+					 &offset, &duration, &gain))
+		return NULL;
+
+	frag = &frag_obj->frag;
+
+	if (splat_levels_init(frag, &levels, levels_obj))
+		return NULL;
+
+	n = PyList_GET_SIZE(overtones_obj);
+	overtones = PyMem_Malloc(n * sizeof(struct splat_overtone));
+
+	if (overtones == NULL)
+		return PyErr_NoMemory();
+
+	all_floats = levels.all_floats && splat_check_all_floats(freq, phase);
+	ot_all_floats = 1;
+
+	for (pos = 0, ot = overtones; pos < n; ++pos, ++ot) {
+		PyObject *ot_params = PyList_GET_ITEM(overtones_obj, pos);
+		PyObject *ot_levels;
+
+		if (!PyTuple_Check(ot_params) ||
+		    (PyTuple_GET_SIZE(ot_params) != 3)) {
+			PyErr_SetString(PyExc_ValueError,
+					"overtone params must be a 3-tuple");
+			goto free_overtones;
+		}
+
+		ot->ratio = PyTuple_GET_ITEM(ot_params, OT_RATIO);
+
+		if (ot_all_floats && PyFloat_Check(ot->ratio))
+			ot->fl_ratio = PyFloat_AS_DOUBLE(ot->ratio);
+		else
+			ot_all_floats = 0;
+
+		ot->phase = PyTuple_GET_ITEM(ot_params, OT_PHASE);
+
+		if (ot_all_floats && PyFloat_Check(ot->phase))
+			ot->fl_phase = PyFloat_AS_DOUBLE(ot->phase);
+		else
+			ot_all_floats = 0;
+
+		ot_levels = PyTuple_GET_ITEM(ot_params, OT_LEVELS);
+
+		if (splat_levels_init(frag, &ot->levels, ot_levels))
+			goto free_overtones;
+
+		ot_all_floats = ot_all_floats && ot->levels.all_floats;
+	}
+
+	all_floats = all_floats && ot_all_floats;
+	stat = splat_source_init(&src, frag, offset, duration, gain);
+
+	if (stat)
+		goto free_overtones;
+
+	if (all_floats)
+		splat_overtones_float(&src, levels.fl, PyFloat_AS_DOUBLE(freq),
+				      PyFloat_AS_DOUBLE(phase) + origin,
+				      overtones, n);
+	else if (ot_all_floats)
+		stat = splat_overtones_mixed(&src, levels.obj, freq, phase,
+					     overtones, n, origin);
+	else
+		stat = splat_overtones_signal(&src, levels.obj, freq, phase,
+					      overtones, n, origin);
+free_overtones:
+	PyMem_Free(overtones);
+
+	if (stat)
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+/* ----------------------------------------------------------------------------
+ * Filters
+ */
+
+PyDoc_STRVAR(splat_dec_envelope_doc,
+"dec_envelope(fragment, k=1.0, p=1.0)\n"
+"\n"
+"This filter applies a decreasing linear envelope over the ``fragment`` with "
+" ``k`` and ``p`` arguments as follows, for a sound signal ``s`` "
+"at index ``i``:\n"
+"\n"
+".. math::\n"
+"\n"
+"   s[i] = \\frac{s[i]}{(1 + \\frac{i}{k})^p}\n"
+"\n");
+
+static int splat_dec_envelope_init(struct splat_dec_envelope *dec,
+				   double k, double p)
+{
+	if (k == 0.0) {
+		PyErr_SetString(PyExc_ValueError, "k must not be 0");
+		return -1;
+	}
+
+	dec->k = k;
+	dec->p = p;
+
+	return 0;
+}
+
+static PyObject *splat_dec_envelope(PyObject *self, PyObject *args)
+{
+	Fragment *frag_obj;
+	double k = 1.0;
+	double p = 1.0;
+
+	struct splat_block_filter filter;
 
-	for (c = 0; c < self->frag.n_channels; ++c) {
-		PyObject *peak_dict = splat_frag_peak_as_dict(&chan_peak[c]);
+	if (!PyArg_ParseTuple(args, "O!|dd", &splat_FragmentType, &frag_obj,
+			      &k, &p))
+		return NULL;
 
-		if (peak_dict == NULL)
-			return PyErr_NoMemory();
+	filter.id = SPLAT_BLOCK_FILTER_DEC_ENVELOPE;
 
-		PyList_SET_ITEM(chan_peak_obj, c, peak_dict);
-	}
+	if (splat_dec_envelope_init(&filter.u.dec_envelope, k, p))
+		return NULL;
 
-	ret = Py_BuildValue("(OO)", frag_peak_obj, chan_peak_obj);
-	Py_DECREF(frag_peak_obj);
-	Py_DECREF(chan_peak_obj);
+	if (splat_frag_unshare(&frag_obj->frag))
+		return NULL;
 
-	return ret;
+	splat_filter_chain(&frag_obj->frag, &filter, 1);
+
+	Py_RETURN_NONE;
 }
 
-PyDoc_STRVAR(Fragment_normalize_doc,
-"normalize(level=-0.05, zero=True)\n"
-"\n"
-"Normalize the amplitude.\n"
+PyDoc_STRVAR(splat_envelope_doc,
+"envelope(fragment, points, exp=False)\n"
 "\n"
-"The ``level`` value in dB is the resulting maximum amplitude after "
-"normalization.  The default value of -0.05 dB is the maximum level while "
-"ensuring no clipping occurs due to rounding errors, even when saving with "
-"8-bit sample resolution. "
-"The same gain is applied to all channels, so the relative difference in "
-"levels between channels is preserved.\n"
+"Apply an envelope defined by some breakpoints to all the channels of the "
+"``fragment``.  The ``points`` are a sequence of 2-tuples with a time in "
+"seconds and a linear gain, sorted by time.  The gain is interpolated "
+"linearly between each point, or exponentially if ``exp`` is ``True`` in "
+"which case all the gains need to be positive.  Before the first point and "
+"after the last one, the gain of the nearest point is used.\n"
 "\n"
-"When ``zero`` is ``True``, the average value is substracted from all the "
-"fragment prior to amplification to avoid any offset and achieve maximum "
-"amplitude.  With some imbalanced transitory signals, it may be better to not "
-"remove the average value as this may have the undesirable effect of adding "
-"some offset instead.\n");
+"The gains are computed once for all the channels and applied in a single "
+"pass, so this is also the fastest way to make fades or ADSR envelopes as in "
+":py:func:`splat.filters.linear_fade` and :py:func:`splat.filters.adsr`.\n");
 
-static PyObject *Fragment_normalize(Fragment *self, PyObject *args)
+static int splat_envelope_init(struct splat_envelope *env,
+			       const struct splat_fragment *frag,
+			       PyObject *points_obj, int exp)
 {
-	double level_dB = -0.05;
-	PyObject *zero = NULL;
+	struct splat_envelope_point *points;
+	PyObject *seq;
+	Py_ssize_t n_points;
+	Py_ssize_t i;
 
-	int do_zero;
+	seq = PySequence_Fast(points_obj, "points must be a sequence");
 
-	if (!PyArg_ParseTuple(args, "|dO!", &level_dB, &PyBool_Type, &zero))
-		return NULL;
+	if (seq == NULL)
+		return -1;
 
-	if (self->frag.n_channels > SPLAT_MAX_CHANNELS) {
-		PyErr_SetString(PyExc_ValueError, "too many channels");
-		return NULL;
+	n_points = PySequence_Fast_GET_SIZE(seq);
+
+	if (!n_points) {
+		PyErr_SetString(PyExc_ValueError, "no envelope points");
+		goto free_seq;
 	}
 
-	do_zero = ((zero == NULL) || (zero == Py_True)) ? 1 : 0;
-	splat_frag_normalize(&self->frag, level_dB, do_zero);
+	points = PyMem_Malloc(n_points * sizeof(struct splat_envelope_point));
 
-	Py_RETURN_NONE;
-}
+	if (points == NULL) {
+		PyErr_NoMemory();
+		goto free_seq;
+	}
 
-PyDoc_STRVAR(Fragment_amp_doc,
-"amp(gain)\n"
-"\n"
-"Amplify the fragment by the given linear ``gain`` which can either be a "
-"single signal  to apply to all channels or a tuple with a signal "
-"for each individual channel.  Please note that a negative value will "
-"invert the data in the fragment.\n");
+	for (i = 0; i < n_points; ++i) {
+		PyObject *pair = PySequence_Fast_GET_ITEM(seq, i);
+		double time;
 
-static PyObject *Fragment_amp(Fragment *self, PyObject *args)
-{
-	PyObject *gain_obj;
+		if (!PyTuple_Check(pair) || (PyTuple_GET_SIZE(pair) != 2)) {
+			PyErr_SetString(PyExc_TypeError,
+					"envelope point must be a 2-tuple");
+			goto free_points;
+		}
 
-	struct splat_levels gains;
+		if (splat_obj2double(PyTuple_GET_ITEM(pair, 0), &time) ||
+		    splat_obj2double(PyTuple_GET_ITEM(pair, 1),
+				     &points[i].gain)) {
+			PyErr_SetString(PyExc_TypeError,
+					"envelope values must be numbers");
+			goto free_points;
+		}
 
-	if (!PyArg_ParseTuple(args, "O", &gain_obj))
-		return NULL;
+		points[i].pos = time * frag->rate;
 
-	if (splat_levels_init(&self->frag, &gains, gain_obj))
-		return NULL;
+		if (i && (points[i].pos < points[i - 1].pos)) {
+			PyErr_SetString(PyExc_ValueError,
+					"envelope points must be sorted");
+			goto free_points;
+		}
 
-	if (splat_frag_amp(&self->frag, &gains))
-		return NULL;
+		if (exp && !(points[i].gain > 0.0)) {
+			PyErr_SetString(PyExc_ValueError,
+				"exponential envelope gains must be positive");
+			goto free_points;
+		}
+	}
 
-	Py_RETURN_NONE;
-}
+	Py_DECREF(seq);
+	env->points = points;
+	env->n_points = n_points;
+	env->exp = exp;
 
-PyDoc_STRVAR(Fragment_lin2dB_doc,
-"lin2dB()\n"
-"\n"
-"Convert all the sample values to dB.\n");
+	return 0;
 
-static PyObject *Fragment_lin2dB(Fragment *self, PyObject *_)
-{
-	splat_frag_lin2dB(&self->frag);
+free_points:
+	PyMem_Free(points);
+free_seq:
+	Py_DECREF(seq);
 
-	Py_RETURN_NONE;
+	return -1;
 }
 
-PyDoc_STRVAR(Fragment_dB2lin_doc,
-"dB2lin()\n"
-"\n"
-"Convert all the sample values from dB to linear scale.\n");
-
-static PyObject *Fragment_dB2lin(Fragment *self, PyObject *_)
+static PyObject *splat_envelope(PyObject *self, PyObject *args)
 {
-	splat_frag_dB2lin(&self->frag);
+	Fragment *frag_obj;
+	PyObject *points_obj;
+	int exp = 0;
 
-	Py_RETURN_NONE;
-}
+	struct splat_fragment *frag;
+	struct splat_block_filter filter;
+	int res;
 
-PyDoc_STRVAR(Fragment_offset_doc,
-"offset(value, start=0.0)\n"
-"\n"
-"Add a linear offset to the data already in the fragment starting at the "
-"``start`` time in seconds.  This is especially useful when generating a "
-"modulation fragment.\n");
+	if (!PyArg_ParseTuple(args, "O!O|i", &splat_FragmentType, &frag_obj,
+			      &points_obj, &exp))
+		return NULL;
 
-static PyObject *Fragment_offset(Fragment *self, PyObject *args)
-{
-	PyObject *offset;
-	double start = 0.0;
+	frag = &frag_obj->frag;
+	filter.id = SPLAT_BLOCK_FILTER_ENVELOPE;
 
-	if (!PyArg_ParseTuple(args, "O|d", &offset, &start))
+	if (splat_envelope_init(&filter.u.envelope, frag, points_obj, exp))
 		return NULL;
 
-	if (splat_frag_offset(&self->frag, offset, start))
+	res = splat_frag_unshare(frag);
+
+	if (!res)
+		splat_filter_chain(frag, &filter, 1);
+
+	PyMem_Free(filter.u.envelope.points);
+
+	if (res)
 		return NULL;
 
 	Py_RETURN_NONE;
 }
 
-PyDoc_STRVAR(Fragment_resize_doc,
-"resize(duration=0.0, length=0)\n"
+PyDoc_STRVAR(splat_filter_chain_doc,
+"filter_chain(fragment, filters)\n"
 "\n"
-"Resize the fragment to the given ``duration`` in seconds or ``length`` in "
-"number of samples per channel.  If the fragment grows, silence is added at "
-"the end.  When shrinking, the end of the fragment is lost.\n");
+"Run a chain of native filters on the ``fragment``.  The ``filters`` are a "
+"sequence of 2-tuples with a filter function and a tuple with its arguments "
+"except the fragment, as used in :py:class:`splat.filters.FilterChain`.  Only "
+":py:func:`splat.filters.envelope` and :py:func:`splat.filters.dec_envelope` "
+"are supported.\n"
+"\n"
+"The result is the same as running each filter in turn on the whole "
+"fragment, but the data is processed one small tile at a time by all the "
+"filters so it only goes once through the memory.  This is automatically "
+"used by :py:meth:`splat.filters.FilterChain.run`.\n");
 
-static PyObject *Fragment_resize(Fragment *self, PyObject *args, PyObject *kw)
+static PyObject *splat_filter_chain_run(PyObject *self, PyObject *args)
 {
-	static char *kwlist[] = { "duration", "length", NULL };
-	double duration = 0.0;
-	unsigned long length = 0;
+	Fragment *frag_obj;
+	PyObject *filters_obj;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kw, "|dk", kwlist,
-					 &duration, &length))
+	struct splat_fragment *frag;
+	struct splat_block_filter *filters;
+	PyObject *seq;
+	Py_ssize_t n_filters;
+	Py_ssize_t n_init;
+	Py_ssize_t i;
+	PyObject *ret = NULL;
+
+	if (!PyArg_ParseTuple(args, "O!O", &splat_FragmentType, &frag_obj,
+			      &filters_obj))
 		return NULL;
 
-	if (duration < 0.0) {
-		PyErr_SetString(PyExc_ValueError, "negative duration");
+	frag = &frag_obj->frag;
+	seq = PySequence_Fast(filters_obj, "filters must be a sequence");
+
+	if (seq == NULL)
 		return NULL;
+
+	n_filters = PySequence_Fast_GET_SIZE(seq);
+	filters = PyMem_Malloc(max(n_filters, 1) *
+			       sizeof(struct splat_block_filter));
+
+	if (filters == NULL) {
+		PyErr_NoMemory();
+		goto free_seq;
 	}
 
-	if (!length) {
-		length = duration * self->frag.rate;
-	} else if (duration != 0.0) {
-		PyErr_SetString(PyExc_ValueError,
-				"cannot specify both length and duration");
-		return NULL;
+	for (n_init = 0; n_init < n_filters; ++n_init) {
+		struct splat_block_filter *filter = &filters[n_init];
+		PyObject *entry = PySequence_Fast_GET_ITEM(seq, n_init);
+		PyObject *func;
+		PyObject *func_args;
+		PyCFunction meth;
+
+		if (!PyArg_ParseTuple(entry, "OO!", &func, &PyTuple_Type,
+				      &func_args))
+			goto free_filters;
+
+		meth = PyCFunction_Check(func) ?
+			PyCFunction_GET_FUNCTION(func) : NULL;
+
+		if (meth == splat_dec_envelope) {
+			double k = 1.0;
+			double p = 1.0;
+
+			filter->id = SPLAT_BLOCK_FILTER_DEC_ENVELOPE;
+
+			if (!PyArg_ParseTuple(func_args, "|dd", &k, &p) ||
+			    splat_dec_envelope_init(&filter->u.dec_envelope,
+						    k, p))
+				goto free_filters;
+		} else if (meth == splat_envelope) {
+			PyObject *points_obj;
+			int exp = 0;
+
+			filter->id = SPLAT_BLOCK_FILTER_ENVELOPE;
+
+			if (!PyArg_ParseTuple(func_args, "O|i", &points_obj,
+					      &exp) ||
+			    splat_envelope_init(&filter->u.envelope, frag,
+						points_obj, exp))
+				goto free_filters;
+		} else {
+			PyErr_SetString(PyExc_TypeError,
+					"not a native block filter");
+			goto free_filters;
+		}
 	}
 
-	if (splat_frag_resize(&self->frag, length))
-		return NULL;
+	if (splat_frag_unshare(frag))
+		goto free_filters;
 
-	Py_RETURN_NONE;
+	splat_filter_chain(frag, filters, n_filters);
+	Py_INCREF(Py_None);
+	ret = Py_None;
+
+free_filters:
+	for (i = 0; i < n_init; ++i)
+		if (filters[i].id == SPLAT_BLOCK_FILTER_ENVELOPE)
+			PyMem_Free(filters[i].u.envelope.points);
+
+	PyMem_Free(filters);
+free_seq:
+	Py_DECREF(seq);
+
+	return ret;
 }
 
-static PyMethodDef Fragment_methods[] = {
-	{ "import_bytes", (PyCFunction)Fragment_import_bytes, METH_KEYWORDS,
-	  Fragment_import_bytes_doc },
-	{ "export_bytes", (PyCFunction)Fragment_export_bytes, METH_KEYWORDS,
-	  Fragment_export_bytes_doc },
-	{ "mix", (PyCFunction)Fragment_mix, METH_KEYWORDS,
-	  Fragment_mix_doc },
-	{ "get_peak", (PyCFunction)Fragment_get_peak, METH_NOARGS,
-	  Fragment_get_peak_doc },
-	{ "normalize", (PyCFunction)Fragment_normalize, METH_VARARGS,
-	  Fragment_normalize_doc },
-	{ "amp", (PyCFunction)Fragment_amp, METH_VARARGS,
-	  Fragment_amp_doc },
-	{ "lin2dB", (PyCFunction)Fragment_lin2dB, METH_NOARGS,
-	  Fragment_lin2dB_doc },
-	{ "dB2lin", (PyCFunction)Fragment_dB2lin, METH_NOARGS,
-	  Fragment_dB2lin_doc },
-	{ "offset", (PyCFunction)Fragment_offset, METH_VARARGS,
-	  Fragment_offset_doc },
-	{ "resize", (PyCFunction)Fragment_resize, METH_KEYWORDS,
-	  Fragment_resize_doc },
-	{ NULL }
-};
+PyDoc_STRVAR(splat_reverse_doc,
+"reverse(fragment)\n"
+"\n"
+"Reverse the order of all the samples in ``fragment``.\n");
 
-static PyTypeObject splat_FragmentType = {
-	PyObject_HEAD_INIT(NULL)
-	0,                                 /* ob_size */
-	"_splat.Fragment",                 /* tp_name */
-	sizeof(Fragment),                  /* tp_basicsize */
-	0,                                 /* tp_itemsize */
-	(destructor)Fragment_dealloc,      /* tp_dealloc */
-	0,                                 /* tp_print */
-	0,                                 /* tp_getattr */
-	0,                                 /* tp_setattr */
-	0,                                 /* tp_compare */
-	0,                                 /* tp_repr */
-	0,                                 /* tp_as_number */
-	&Fragment_as_sequence,             /* tp_as_sequence */
-	0,                                 /* tp_as_mapping */
-	0,                                 /* tp_hash  */
-	0,                                 /* tp_call */
-	0,                                 /* tp_str */
-	0,                                 /* tp_getattro */
-	0,                                 /* tp_setattro */
-	0,                                 /* tp_as_buffer */
-	BASE_TYPE_FLAGS,                   /* tp_flags */
-	"Fragment of audio data",          /* tp_doc */
-	0,                                 /* tp_traverse */
-	0,                                 /* tp_clear */
-	0,                                 /* tp_richcompare */
-	0,                                 /* tp_weaklistoffset */
-	0,                                 /* tp_iter */
-	0,                                 /* tp_iternext */
-	Fragment_methods,                  /* tp_methods */
-	0,                                 /* tp_members */
-	Fragment_getsetters,               /* tp_getset */
-	0,                                 /* tp_base */
-	0,                                 /* tp_dict */
-	0,                                 /* tp_descr_get */
-	0,                                 /* tp_descr_set */
-	0,                                 /* tp_dictoffset */
-	(initproc)Fragment_init,           /* tp_init */
-	0,                                 /* tp_alloc */
-	Fragment_new,                      /* tp_new */
-};
+static PyObject *splat_reverse(PyObject *self, PyObject *args)
+{
+	Fragment *frag_obj;
 
-/* ----------------------------------------------------------------------------
- * _splat methods
- */
+	if (!PyArg_ParseTuple(args, "O!", &splat_FragmentType, &frag_obj))
+		return NULL;
 
-PyDoc_STRVAR(splat_lin2dB_doc,
-"lin2dB(value)\n"
+	if (splat_frag_unshare(&frag_obj->frag))
+		return NULL;
+
+	splat_filter_reverse(&frag_obj->frag);
+
+	Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(splat_reverb_doc,
+"reverb(fragment, delays, time_factor=0.2, gain_factor=6.0, seed=0)\n"
+"\n"
+"This filter creates a fast basic reverb effect with some randomness.\n"
+"\n"
+"The ``delays`` are a list of 2-tuples with a delay duration in seconds and "
+"a gain in dB.  They are used to repeat and mix the whole ``fragment`` once "
+"for each element in the list, shifted by the given time and amplified by the "
+"given gain.  All values must be floating point numbers.  The time delay must "
+"not be negative - it's a *causal* reverb.\n"
+"\n"
+"The ``time_factor`` and ``gain_factor`` parameters are used when adding a "
+"random element to the delay and gain.  For example, a ``time_factor`` of 0.2 "
+"means the delay will be randomly picked between 1.0 and 1.2 times the value "
+"given in the ``delays`` list.  Similarly, for a ``gain_factor`` of 6.0dB the "
+"gain will be randomly picked within +/- 6dB around the given value in "
+"``delays``.\n"
+"\n"
+"The ``seed`` argument can be used to initialise the pseudo-random number "
+"sequence.  With the default value of 0, the seed will be initialised based "
+"on the current time.\n"
+"\n"
+"With many delays, such as the ones created by "
+":py:func:`splat.filters.reverb_delays`, the reverb is applied as a "
+"convolution with an impulse response made of all the delays in the same way "
+"as :py:func:`splat.filters.convolve`.  This is much faster, and the result "
+"only differs by rounding errors.\n"
+"\n"
+".. note::\n"
 "\n"
-"Convert floating point linear ``value`` to dB.\n");
+"   This filter function can also produce a *delay* effect by specifiying "
+"   only a few regularly spaced ``delays``.\n");
 
-static PyObject *splat_lin2dB(PyObject *self, PyObject *args)
+static PyObject *splat_reverb(PyObject *self, PyObject *args)
 {
-	double level;
+	Fragment *frag_obj;
+	PyObject *delays_list;
+	double time_factor = 0.2;
+	double gain_factor = 6.0;
+	unsigned int seed = 0;
 
-	if (!PyArg_ParseTuple(args, "d", &level))
+	struct splat_fragment *frag;
+	struct splat_delay *delays[SPLAT_MAX_CHANNELS];
+	Py_ssize_t n_delays;
+	size_t delays_size;
+	size_t max_delay;
+	size_t length;
+	size_t d;
+	unsigned c;
+	PyObject *ret = NULL;
+
+	if (!PyArg_ParseTuple(args, "O!O!|ddI", &splat_FragmentType, &frag_obj,
+			      &PyList_Type, &delays_list, &time_factor,
+			      &gain_factor, &seed))
 		return NULL;
 
-	return PyFloat_FromDouble(lin2dB(level));
-}
+	if (!seed)
+		seed = time(0);
 
-PyDoc_STRVAR(splat_dB2lin_doc,
-"dB2lin(value)\n"
-"\n"
-"Convert floating point dB ``value`` to linear.\n");
+	srand(seed);
 
-static PyObject *splat_dB2lin(PyObject *self, PyObject *args)
-{
-	double dB;
+	frag = &frag_obj->frag;
+	n_delays = PyList_GET_SIZE(delays_list);
+	delays_size = n_delays * sizeof(struct splat_delay);
 
-	if (!PyArg_ParseTuple(args, "d", &dB))
-		return NULL;
+	for (c = 0; c < frag->n_channels; ++c) {
+		delays[c] = PyMem_Malloc(delays_size);
 
-	return PyFloat_FromDouble(dB2lin(dB));
+		if (delays[c] == NULL) {
+			while (c--)
+				PyMem_Free(delays[c]);
+
+			return PyErr_NoMemory();
+		}
+	}
+
+	max_delay = 0;
+
+	for (d = 0; d < n_delays; ++d) {
+		PyObject *pair = PyList_GetItem(delays_list, d);
+		double time;
+		double gain;
+
+		if (!PyTuple_Check(pair)) {
+			PyErr_SetString(PyExc_TypeError,
+					"delay values must be a tuple");
+			goto free_delays;
+		}
+
+		if (PyTuple_GET_SIZE(pair) != 2) {
+			PyErr_SetString(PyExc_ValueError,
+					"delay tuple length must be 2");
+			goto free_delays;
+		}
+
+		time = PyFloat_AsDouble(PyTuple_GetItem(pair, 0));
+
+		if (time < 0.0) {
+			PyErr_SetString(PyExc_ValueError,
+					"delay time must be >= 0");
+			goto free_delays;
+		}
+
+		for (c = 0; c < frag->n_channels; ++c) {
+			const double c_time =
+				(time
+				 * (1.0 + (rand() * time_factor / RAND_MAX)));
+
+			delays[c][d].time = c_time * frag->rate;
+
+			if (delays[c][d].time > max_delay)
+				max_delay = delays[c][d].time;
+		}
+
+		gain = PyFloat_AsDouble(PyTuple_GetItem(pair, 1));
+
+		for (c = 0; c < frag->n_channels; ++c) {
+			const double c_gain_dB =
+				(gain - gain_factor
+				 + (rand() * gain_factor * 2.0 / RAND_MAX));
+
+			delays[c][d].gain = dB2lin(c_gain_dB);
+		}
+	}
+
+	length = frag->length;
+
+	if (splat_frag_unshare(frag) ||
+	    splat_frag_grow(frag, (length + max_delay)) ||
+	    splat_filter_reverb(frag, delays, n_delays, length))
+		goto free_delays;
+
+	Py_INCREF(Py_None);
+	ret = Py_None;
+
+free_delays:
+	for (c = 0; c < frag->n_channels; ++c)
+		PyMem_Free(delays[c]);
+
+	return ret;
 }
 
-PyDoc_STRVAR(splat_gen_ref_doc,
-"gen_ref(frag)\n"
+PyDoc_STRVAR(splat_convolve_doc,
+"convolve(fragment, impulse)\n"
 "\n"
-"Generate a reference signal into a single channel fragment."
+"Convolve the ``fragment`` with an ``impulse`` response, which is another "
+"fragment with the same sample rate and either a single channel used for all "
+"the channels or one channel for each of them.  The ``fragment`` is made "
+"longer to contain the whole result, i.e. by the length of ``impulse`` minus "
+"one sample.\n"
 "\n"
-"This is useful mainly for benchmarks and testing purposes.\n");
+"This is typically used to apply a reverb recorded from a real room.  It "
+"uses a partitioned FFT convolution, so even long impulse responses can be "
+"used with a reasonable cost.  The :py:func:`splat.filters.reverb` filter "
+"relies on it as well when there are many delays.\n");
 
-static PyObject *splat_gen_ref(PyObject *self, PyObject *args)
+static PyObject *splat_convolve(PyObject *self, PyObject *args)
 {
 	Fragment *frag_obj;
+	Fragment *impulse_obj;
+
 	struct splat_fragment *frag;
-	sample_t *data;
-	size_t n;
-	size_t i;
+	struct splat_fragment *impulse;
+	double *irs[SPLAT_MAX_CHANNELS];
+	size_t length;
+	size_t ir_length;
+	unsigned ir_channels;
+	unsigned c;
+	PyObject *ret = NULL;
 
-	if (!PyArg_ParseTuple(args, "O!", &splat_FragmentType, &frag_obj))
+	if (!PyArg_ParseTuple(args, "O!O!", &splat_FragmentType, &frag_obj,
+			      &splat_FragmentType, &impulse_obj))
 		return NULL;
 
 	frag = &frag_obj->frag;
+	impulse = &impulse_obj->frag;
 
-	if (frag->n_channels != 1) {
-		PyErr_SetString(PyExc_ValueError,
-				"fragment must have a single channel");
+	if (impulse->rate != frag->rate) {
+		PyErr_SetString(PyExc_ValueError, "sample rates don't match");
 		return NULL;
 	}
 
-	if (frag->length == 0) {
+	if ((impulse->n_channels != 1) &&
+	    (impulse->n_channels != frag->n_channels)) {
 		PyErr_SetString(PyExc_ValueError,
-				"fragment length must be greater than 0");
+				"impulse response channels mismatch");
 		return NULL;
 	}
 
-	data = frag->data[0];
-	n = frag->length;
+	if (!impulse->length) {
+		PyErr_SetString(PyExc_ValueError, "empty impulse response");
+		return NULL;
+	}
 
-	for (i = 0; i < n; ++i)
-		*data++ = i / n;
+	/* Take a copy as the impulse may be the fragment itself */
+	ir_length = impulse->length;
+	ir_channels = impulse->n_channels;
 
-	Py_RETURN_NONE;
-}
+	for (c = 0; c < ir_channels; ++c) {
+		size_t i;
 
-/* ----------------------------------------------------------------------------
- * Sources
- */
+		irs[c] = PyMem_Malloc(ir_length * sizeof(double));
 
-/* -- helpers for sources -- */
+		if (irs[c] == NULL) {
+			PyErr_NoMemory();
+			goto free_irs;
+		}
 
-#define splat_check_all_floats(...)			\
-	_splat_check_all_floats(PP_NARG(__VA_ARGS__), __VA_ARGS__)
+		for (i = 0; i < ir_length; ++i)
+			irs[c][i] = splat_frag_sample(impulse, c, i);
+	}
 
-static int _splat_check_all_floats(size_t n, ...)
-{
-	va_list objs;
-	size_t i;
+	while (c < frag->n_channels)
+		irs[c++] = irs[0];
 
-	va_start(objs, n);
+	length = frag->length;
 
-	for (i = 0; i < n; ++i) {
-		PyObject *obj = va_arg(objs, PyObject *);
+	if (splat_frag_unshare(frag) ||
+	    splat_frag_grow(frag, (length + ir_length - 1)) ||
+	    splat_filter_convolve(frag, length, (const double **)irs,
+				  ir_length))
+		goto free_irs;
 
-		if (!PyFloat_Check(obj))
-			break;
-	}
+	Py_INCREF(Py_None);
+	ret = Py_None;
 
-	va_end(objs);
+free_irs:
+	c = min(c, ir_channels);
 
-	return (i == n);
+	while (c--)
+		PyMem_Free(irs[c]);
+
+	return ret;
 }
 
-PyDoc_STRVAR(splat_sine_doc,
-"sine(fragment, levels, frequency, phase=0.0, origin=0.0)\n"
+PyDoc_STRVAR(splat_fdn_reverb_doc,
+"fdn_reverb(fragment, rt60=2.0, size=1.0, damping=0.3, wet=-6.0)\n"
 "\n"
-"Generate a sine wave for the given ``levels``, ``frequency`` and ``phase`` "
-"signals over the entire ``fragment`` with the given ``origin`` in time.\n");
+"This filter creates an algorithmic reverb with a feedback delay network.\n"
+"\n"
+"The ``rt60`` argument is the reverberation time in seconds, i.e. the time it "
+"takes for the tail to decay by 60dB.  The ``size`` is a factor applied to "
+"the lengths of the delay lines, so larger values sound like a larger room.  "
+"The ``damping`` factor between 0.0 and 1.0 makes the high frequencies decay "
+"faster than the low ones, and the ``wet`` gain in dB is the level of the "
+"reverberated signal mixed with the original one.  The ``fragment`` is made "
+"longer by ``rt60`` seconds to contain the tail.\n"
+"\n"
+"Unlike :py:func:`splat.filters.reverb`, the cost does not depend on the "
+"length of the tail, which makes it suitable for long reverberation times.  "
+"The result is deterministic and the tail is decorrelated between "
+"channels.\n");
 
-static PyObject *splat_sine(PyObject *self, PyObject *args)
+static PyObject *splat_fdn_reverb(PyObject *self, PyObject *args)
 {
 	Fragment *frag_obj;
-	PyObject *levels_obj;
-	PyObject *freq;
-	PyObject *phase = splat_zero;
-	double origin = 0.0;
+	double rt60 = 2.0;
+	double size = 1.0;
+	double damping = 0.3;
+	double wet = -6.0;
 
 	struct splat_fragment *frag;
-	struct splat_levels levels;
-	int all_floats;
+	size_t length;
 
-	if (!PyArg_ParseTuple(args, "O!OO|Od", &splat_FragmentType, &frag_obj,
-			      &levels_obj, &freq, &phase, &origin))
+	if (!PyArg_ParseTuple(args, "O!|dddd", &splat_FragmentType, &frag_obj,
+			      &rt60, &size, &damping, &wet))
 		return NULL;
 
-	frag = &frag_obj->frag;
+	if (rt60 <= 0.0) {
+		PyErr_SetString(PyExc_ValueError, "rt60 must be > 0");
+		return NULL;
+	}
 
-	if (splat_levels_init(frag, &levels, levels_obj))
+	if (size <= 0.0) {
+		PyErr_SetString(PyExc_ValueError, "size must be > 0");
 		return NULL;
+	}
 
-	all_floats = levels.all_floats && splat_check_all_floats(freq, phase);
+	if ((damping < 0.0) || (damping >= 1.0)) {
+		PyErr_SetString(PyExc_ValueError,
+				"damping must be >= 0 and < 1");
+		return NULL;
+	}
 
-	if (all_floats)
-		splat_sine_floats(frag, levels.fl, PyFloat_AS_DOUBLE(freq),
-				  PyFloat_AS_DOUBLE(phase) + origin);
-	else if (splat_sine_signals(frag, levels.obj, freq, phase, origin))
+	frag = &frag_obj->frag;
+	length = frag->length;
+
+	if (splat_frag_unshare(frag) ||
+	    splat_frag_grow(frag, (length + (size_t)(rt60 * frag->rate))) ||
+	    splat_filter_fdn(frag, length, rt60, size, damping, dB2lin(wet)))
 		return NULL;
 
 	Py_RETURN_NONE;
 }
 
-PyDoc_STRVAR(splat_square_doc,
-"square(fragment, levels, frequency, phase=0.0, origin=0.0, ratio=0.5)\n"
+PyDoc_STRVAR(splat_biquad_doc,
+"biquad(fragment, sections, state=None, origin=0.0)\n"
 "\n"
-"Generate a square wave with standard argments and the given ``ratio`` over "
-"the entire ``fragment``.  The ratio is between the duration of the high and "
-"low states.\n");
+"Run a cascade of biquad filter ``sections`` on all the channels of the "
+"``fragment``.  Each section is either a tuple with a filter type and its "
+"parameters as ``(type, frequency, q=0.7071, gain=0.0)``, or a tuple with 5 "
+"coefficients ``(b0, b1, b2, a1, a2)`` normalised with ``a0 = 1``.\n"
+"\n"
+"The filter types are the ones from the Audio EQ Cookbook: ``lowpass``, "
+"``highpass``, ``bandpass``, ``notch``, ``allpass``, ``peak``, ``lowshelf`` "
+"and ``highshelf``.  The ``frequency`` is in Hz and the ``gain`` in dB is "
+"only used by the peak and shelf filters.  These parameters can be signals, "
+"in which case they are evaluated at the beginning of every 256 samples "
+"with ``origin`` being the time of the first sample in seconds.\n"
+"\n"
+"The filter state is returned, and it can be passed as ``state`` to carry on "
+"filtering the next fragment of a same stream with the same sections.\n");
 
-static PyObject *splat_square(PyObject *self, PyObject *args)
+static PyObject *splat_biquad_param(PyObject *obj)
 {
-	Fragment *frag_obj;
-	PyObject *levels_obj;
-	PyObject *freq;
-	PyObject *phase = splat_zero;
-	double origin = 0.0;
-	PyObject *ratio = splat_init_source_ratio;
+	double value;
 
-	struct splat_fragment *frag;
-	struct splat_levels levels;
-	int all_floats;
+	if (PyFloat_Check(obj) || splat_obj2double(obj, &value)) {
+		Py_INCREF(obj);
+		return obj;
+	}
 
-	if (!PyArg_ParseTuple(args, "O!OO|OdO", &splat_FragmentType, &frag_obj,
-			      &levels_obj, &freq, &phase, &origin, &ratio))
-		return NULL;
+	return PyFloat_FromDouble(value);
+}
 
-	frag = &frag_obj->frag;
+struct splat_biquad_name {
+	const char *name;
+	enum splat_biquad_type type;
+};
 
-	if (splat_levels_init(frag, &levels, levels_obj))
-		return NULL;
+static const struct splat_biquad_name splat_biquad_names[] = {
+	{ "lowpass", SPLAT_BIQUAD_LOWPASS },
+	{ "highpass", SPLAT_BIQUAD_HIGHPASS },
+	{ "bandpass", SPLAT_BIQUAD_BANDPASS },
+	{ "notch", SPLAT_BIQUAD_NOTCH },
+	{ "allpass", SPLAT_BIQUAD_ALLPASS },
+	{ "peak", SPLAT_BIQUAD_PEAK },
+	{ "lowshelf", SPLAT_BIQUAD_LOWSHELF },
+	{ "highshelf", SPLAT_BIQUAD_HIGHSHELF },
+};
 
-	all_floats = levels.all_floats;
-	all_floats = all_floats && splat_check_all_floats(freq, phase, ratio);
+static int splat_biquad_init(struct splat_biquad *bq, PyObject *section)
+{
+	const char *type;
+	PyObject *freq;
+	PyObject *q = NULL;
+	PyObject *gain = NULL;
+	size_t i;
 
-	if (all_floats)
-		splat_square_floats(frag, levels.fl, PyFloat_AS_DOUBLE(freq),
-				    PyFloat_AS_DOUBLE(phase) + origin,
-				    PyFloat_AS_DOUBLE(ratio));
-	else if (splat_square_signals(frag, levels.obj, freq, phase, ratio,
-				      origin))
-		return NULL;
+	bq->freq = bq->q = bq->gain = NULL;
+	memset(bq->s1, 0, sizeof(bq->s1));
+	memset(bq->s2, 0, sizeof(bq->s2));
 
-	Py_RETURN_NONE;
-}
+	if (!PyTuple_Check(section)) {
+		PyErr_SetString(PyExc_TypeError,
+				"biquad section must be a tuple");
+		return -1;
+	}
 
-PyDoc_STRVAR(splat_triangle_doc,
-"triangle(fragment, levels, frequency, phase=0.0, origin=0.0, ratio=0.5)\n"
-"\n"
-"Generate a triangle wave with the given ``ratio`` over the entire "
-"``fragment``.  The ratio is between the duration of the high and "
-"low states.\n");
+	if ((PyTuple_GET_SIZE(section) == 5) &&
+	    !PyString_Check(PyTuple_GET_ITEM(section, 0))) {
+		bq->type = SPLAT_BIQUAD_COEFS;
 
-static PyObject *splat_triangle(PyObject *self, PyObject *args)
-{
-	Fragment *frag_obj;
-	PyObject *levels_obj;
-	PyObject *freq;
-	PyObject *phase = splat_zero;
-	double origin = 0.0;
-	PyObject *ratio = splat_init_source_ratio;
+		return PyArg_ParseTuple(section, "ddddd", &bq->k.b0,
+					&bq->k.b1, &bq->k.b2, &bq->k.a1,
+					&bq->k.a2) ? 0 : -1;
+	}
 
-	struct splat_fragment *frag;
-	struct splat_levels levels;
-	int all_floats;
+	if (!PyArg_ParseTuple(section, "sO|OO", &type, &freq, &q, &gain))
+		return -1;
 
-	if (!PyArg_ParseTuple(args, "O!OO|OdO", &splat_FragmentType, &frag_obj,
-			      &levels_obj, &freq, &phase, &origin, &ratio))
-		return NULL;
+	for (i = 0; i < ARRAY_SIZE(splat_biquad_names); ++i)
+		if (!strcmp(type, splat_biquad_names[i].name))
+			break;
 
-	frag = &frag_obj->frag;
+	if (i == ARRAY_SIZE(splat_biquad_names)) {
+		PyErr_SetString(PyExc_ValueError, "unknown biquad type");
+		return -1;
+	}
 
-	if (splat_levels_init(frag, &levels, levels_obj))
-		return NULL;
+	bq->type = splat_biquad_names[i].type;
 
-	all_floats = levels.all_floats;
-	all_floats = all_floats && splat_check_all_floats(freq, phase, ratio);
+	bq->freq = splat_biquad_param(freq);
+	bq->q = (q == NULL) ?
+		PyFloat_FromDouble(M_SQRT1_2) : splat_biquad_param(q);
+	bq->gain = (gain == NULL) ?
+		PyFloat_FromDouble(0.0) : splat_biquad_param(gain);
 
-	if (all_floats)
-		splat_triangle_floats(frag, levels.fl, PyFloat_AS_DOUBLE(freq),
-				      PyFloat_AS_DOUBLE(phase) + origin,
-				      PyFloat_AS_DOUBLE(ratio));
-	else if (splat_triangle_signals(frag, levels.obj, freq, phase, ratio,
-					origin))
-		return NULL;
+	if ((bq->freq == NULL) || (bq->q == NULL) || (bq->gain == NULL))
+		return -1;
 
-	Py_RETURN_NONE;
+	return 0;
 }
 
-PyDoc_STRVAR(splat_overtones_doc,
-"overtones(fragment, levels, frequency, overtones, phase=0.0, origin=0.0)\n"
-"\n"
-"Generate a sum of overtones as pure sine waves with the given fundamental "
-"``frequency`` and ``levels``.\n"
-"\n"
-"The ``overtones`` are described with a list of 3-tuples containing the "
-"ratio between the overtone and the fundamental frequency, the phase and "
-"linear levels: ``(ratio, phase, levels)``.  All these values can be signals, "
-"and the levels can either be a single value for all channels or individual "
-"values for each channel.  The generation is performed over the entire "
-"fragment.\n");
+static void splat_biquad_free(struct splat_biquad *bq)
+{
+	Py_XDECREF(bq->freq);
+	Py_XDECREF(bq->q);
+	Py_XDECREF(bq->gain);
+}
 
-static PyObject *splat_overtones(PyObject *self, PyObject *args)
+static PyObject *splat_biquad(PyObject *self, PyObject *args)
 {
-	enum {
-		OT_RATIO = 0,
-		OT_PHASE,
-		OT_LEVELS,
-	};
 	Fragment *frag_obj;
-	PyObject *levels_obj;
-	PyObject *freq;
-	PyObject *overtones_obj;
-	PyObject *phase = splat_zero;
+	PyObject *sections_obj;
+	PyObject *state = Py_None;
 	double origin = 0.0;
 
 	struct splat_fragment *frag;
-	struct splat_levels levels;
-	struct splat_overtone *overtones;
-	struct splat_overtone *ot;
-	Py_ssize_t n;
-	Py_ssize_t pos;
-	int all_floats;
-	int ot_all_floats;
-	int stat = 0;
+	struct splat_biquad *sections;
+	Py_ssize_t n_sections;
+	Py_ssize_t n_init;
+	Py_ssize_t s;
+	size_t n_state;
+	size_t i;
+	unsigned c;
+	PyObject *ret = NULL;
 
-	if (!PyArg_ParseTuple(args, "O!OOO!|Od", &splat_FragmentType, &frag_obj,
-			      &levels_obj, &freq, &PyList_Type, &overtones_obj,
-			      &phase, &origin))
+	if (!PyArg_ParseTuple(args, "O!O!|Od", &splat_FragmentType, &frag_obj,
+			      &PyList_Type, &sections_obj, &state, &origin))
 		return NULL;
 
 	frag = &frag_obj->frag;
+	n_sections = PyList_GET_SIZE(sections_obj);
+	n_state = n_sections * frag->n_channels * 2;
 
-	if (splat_levels_init(frag, &levels, levels_obj))
+	if ((state != Py_None) && (!PyList_Check(state) ||
+				   (PyList_GET_SIZE(state) != n_state))) {
+		PyErr_SetString(PyExc_ValueError, "invalid biquad state");
 		return NULL;
+	}
 
-	n = PyList_GET_SIZE(overtones_obj);
-	overtones = PyMem_Malloc(n * sizeof(struct splat_overtone));
+	sections = PyMem_Malloc(n_sections * sizeof(struct splat_biquad));
 
-	if (overtones == NULL)
+	if (sections == NULL)
 		return PyErr_NoMemory();
 
-	all_floats = levels.all_floats && splat_check_all_floats(freq, phase);
-	ot_all_floats = 1;
-
-	for (pos = 0, ot = overtones; pos < n; ++pos, ++ot) {
-		PyObject *ot_params = PyList_GET_ITEM(overtones_obj, pos);
-		PyObject *ot_levels;
+	for (n_init = 0; n_init < n_sections; ++n_init) {
+		struct splat_biquad *bq = &sections[n_init];
 
-		if (!PyTuple_Check(ot_params) ||
-		    (PyTuple_GET_SIZE(ot_params) != 3)) {
-			PyErr_SetString(PyExc_ValueError,
-					"overtone params must be a 3-tuple");
-			goto free_overtones;
+		if (splat_biquad_init(bq,
+				      PyList_GET_ITEM(sections_obj, n_init))) {
+			splat_biquad_free(bq);
+			goto free_sections;
 		}
+	}
 
-		ot->ratio = PyTuple_GET_ITEM(ot_params, OT_RATIO);
-
-		if (ot_all_floats && PyFloat_Check(ot->ratio))
-			ot->fl_ratio = PyFloat_AS_DOUBLE(ot->ratio);
-		else
-			ot_all_floats = 0;
+	if (state != Py_None) {
+		for (s = 0, i = 0; s < n_sections; ++s) {
+			for (c = 0; c < frag->n_channels; ++c) {
+				sections[s].s1[c] = PyFloat_AsDouble(
+					PyList_GET_ITEM(state, i++));
+				sections[s].s2[c] = PyFloat_AsDouble(
+					PyList_GET_ITEM(state, i++));
+			}
+		}
 
-		ot->phase = PyTuple_GET_ITEM(ot_params, OT_PHASE);
+		if (PyErr_Occurred())
+			goto free_sections;
+	}
 
-		if (ot_all_floats && PyFloat_Check(ot->phase))
-			ot->fl_phase = PyFloat_AS_DOUBLE(ot->phase);
-		else
-			ot_all_floats = 0;
+	if (splat_frag_unshare(frag) ||
+	    splat_filter_biquad(frag, sections, n_sections, origin))
+		goto free_sections;
 
-		ot_levels = PyTuple_GET_ITEM(ot_params, OT_LEVELS);
+	ret = PyList_New(n_state);
 
-		if (splat_levels_init(frag, &ot->levels, ot_levels))
-			goto free_overtones;
+	if (ret == NULL)
+		goto free_sections;
 
-		ot_all_floats = ot_all_floats && ot->levels.all_floats;
+	for (s = 0, i = 0; s < n_sections; ++s) {
+		for (c = 0; c < frag->n_channels; ++c) {
+			PyList_SET_ITEM(ret, i++,
+					PyFloat_FromDouble(sections[s].s1[c]));
+			PyList_SET_ITEM(ret, i++,
+					PyFloat_FromDouble(sections[s].s2[c]));
+		}
 	}
 
-	all_floats = all_floats && ot_all_floats;
-
-	if (all_floats)
-		splat_overtones_float(frag, levels.fl, PyFloat_AS_DOUBLE(freq),
-				      PyFloat_AS_DOUBLE(phase) + origin,
-				      overtones, n);
-	else if (ot_all_floats)
-		stat = splat_overtones_mixed(frag, levels.obj, freq, phase,
-					     overtones, n, origin);
-	else
-		stat = splat_overtones_signal(frag, levels.obj, freq, phase,
-					      overtones, n, origin);
-free_overtones:
-	PyMem_Free(overtones);
+free_sections:
+	while (n_init--)
+		splat_biquad_free(&sections[n_init]);
 
-	if (stat)
-		return NULL;
+	PyMem_Free(sections);
 
-	Py_RETURN_NONE;
+	return ret;
 }
 
-/* ----------------------------------------------------------------------------
- * Filters
- */
-
-PyDoc_STRVAR(splat_dec_envelope_doc,
-"dec_envelope(fragment, k=1.0, p=1.0)\n"
+PyDoc_STRVAR(splat_limiter_doc,
+"limiter(fragment, threshold=-1.0, lookahead=0.005, release=0.05, "
+"state=None)\n"
 "\n"
-"This filter applies a decreasing linear envelope over the ``fragment`` with "
-" ``k`` and ``p`` arguments as follows, for a sound signal ``s`` "
-"at index ``i``:\n"
+"Limit the peaks of the ``fragment`` to the ``threshold`` level in dB.  The "
+"gain starts going down ``lookahead`` seconds before each peak so it is "
+"applied smoothly, and goes back up to 1.0 with an exponential ``release`` "
+"time constant in seconds.  The same gain is applied to all the channels.\n"
 "\n"
-".. math::\n"
+"Unlike :py:meth:`splat.data.Fragment.normalize`, this is done in a single "
+"pass without finding the overall peak first, and loud transients only "
+"reduce the level around them.\n"
 "\n"
-"   s[i] = \\frac{s[i]}{(1 + \\frac{i}{k})^p}\n"
-"\n");
-
-static PyObject *splat_dec_envelope(PyObject *self, PyObject *args)
+"To limit a stream made of several fragments in turn, ``state`` needs to be "
+"an empty list for the first one and then the state returned by the "
+"previous call.  The output is then delayed by the ``lookahead`` time so the "
+"peaks at the beginning of each fragment can be anticipated at the end of "
+"the previous one, and a last fragment of at least ``lookahead`` seconds of "
+"silence gets the end of the stream.  The result is the same as when "
+"limiting all the fragments at once.\n");
+
+/* The counters and gains followed by the box, q_gain, q_pos and delay
+ * arrays */
+#define SPLAT_LIMITER_STATE_HEAD 9
+
+static size_t splat_limiter_state_size(const struct splat_limiter *lim)
 {
-	Fragment *frag_obj;
-	double k = 1.0;
-	double p = 1.0;
+	const size_t W = lim->lookahead + 1;
 
-	if (!PyArg_ParseTuple(args, "O!|dd", &splat_FragmentType, &frag_obj,
-			      &k, &p))
-		return NULL;
+	return SPLAT_LIMITER_STATE_HEAD + (3 * W) +
+		(lim->lookahead * lim->n_channels);
+}
 
-	if (k == 0.0) {
-		PyErr_SetString(PyExc_ValueError, "k must not be 0");
-		return NULL;
+static int splat_limiter_set_state(struct splat_limiter *lim,
+				   PyObject *state)
+{
+	const size_t W = lim->lookahead + 1;
+	double *values[] = {
+		&lim->box_sum, &lim->gain,
+	};
+	size_t *counters[] = {
+		&lim->pos, &lim->b, &lim->q_head, &lim->q_len, &lim->rest,
+		&lim->d, &lim->zeros,
+	};
+	size_t i = 0;
+	size_t k;
+
+	if (PyList_GET_SIZE(state) != splat_limiter_state_size(lim)) {
+		PyErr_SetString(PyExc_ValueError, "invalid limiter state");
+		return -1;
 	}
 
-	splat_filter_dec_envelope(&frag_obj->frag, k, p);
+	for (k = 0; k < ARRAY_SIZE(counters); ++k)
+		*counters[k] = PyFloat_AsDouble(PyList_GET_ITEM(state, i++));
 
-	Py_RETURN_NONE;
-}
+	for (k = 0; k < ARRAY_SIZE(values); ++k)
+		*values[k] = PyFloat_AsDouble(PyList_GET_ITEM(state, i++));
 
-PyDoc_STRVAR(splat_reverse_doc,
-"reverse(fragment)\n"
-"\n"
-"Reverse the order of all the samples in ``fragment``.\n");
+	for (k = 0; k < W; ++k)
+		lim->box[k] = PyFloat_AsDouble(PyList_GET_ITEM(state, i++));
 
-static PyObject *splat_reverse(PyObject *self, PyObject *args)
+	for (k = 0; k < W; ++k)
+		lim->q_gain[k] = PyFloat_AsDouble(PyList_GET_ITEM(state, i++));
+
+	for (k = 0; k < W; ++k)
+		lim->q_pos[k] = PyFloat_AsDouble(PyList_GET_ITEM(state, i++));
+
+	for (k = 0; k < (lim->lookahead * lim->n_channels); ++k)
+		lim->delay[k] = PyFloat_AsDouble(PyList_GET_ITEM(state, i++));
+
+	if (PyErr_Occurred())
+		return -1;
+
+	if ((lim->q_len > W) || (lim->q_head >= W) || (lim->b >= W) ||
+	    (lim->lookahead && (lim->d >= lim->lookahead))) {
+		PyErr_SetString(PyExc_ValueError, "invalid limiter state");
+		return -1;
+	}
+
+	return 0;
+}
+
+static PyObject *splat_limiter_get_state(const struct splat_limiter *lim)
 {
-	Fragment *frag_obj;
+	const size_t W = lim->lookahead + 1;
+	const double head[] = {
+		lim->pos, lim->b, lim->q_head, lim->q_len, lim->rest, lim->d,
+		lim->zeros, lim->box_sum, lim->gain,
+	};
+	PyObject *state;
+	size_t i = 0;
+	size_t k;
 
-	if (!PyArg_ParseTuple(args, "O!", &splat_FragmentType, &frag_obj))
+	state = PyList_New(splat_limiter_state_size(lim));
+
+	if (state == NULL)
 		return NULL;
 
-	splat_filter_reverse(&frag_obj->frag);
+	for (k = 0; k < ARRAY_SIZE(head); ++k)
+		PyList_SET_ITEM(state, i++, PyFloat_FromDouble(head[k]));
 
-	Py_RETURN_NONE;
-}
+	for (k = 0; k < W; ++k)
+		PyList_SET_ITEM(state, i++, PyFloat_FromDouble(lim->box[k]));
 
-PyDoc_STRVAR(splat_reverb_doc,
-"reverb(fragment, delays, time_factor=0.2, gain_factor=6.0, seed=0)\n"
-"\n"
-"This filter creates a fast basic reverb effect with some randomness.\n"
-"\n"
-"The ``delays`` are a list of 2-tuples with a delay duration in seconds and "
-"a gain in dB.  They are used to repeat and mix the whole ``fragment`` once "
-"for each element in the list, shifted by the given time and amplified by the "
-"given gain.  All values must be floating point numbers.  The time delay must "
-"not be negative - it's a *causal* reverb.\n"
-"\n"
-"The ``time_factor`` and ``gain_factor`` parameters are used when adding a "
-"random element to the delay and gain.  For example, a ``time_factor`` of 0.2 "
-"means the delay will be randomly picked between 1.0 and 1.2 times the value "
-"given in the ``delays`` list.  Similarly, for a ``gain_factor`` of 6.0dB the "
-"gain will be randomly picked within +/- 6dB around the given value in "
-"``delays``.\n"
-"\n"
-"The ``seed`` argument can be used to initialise the pseudo-random number "
-"sequence.  With the default value of 0, the seed will be initialised based "
-"on the current time.\n"
-"\n"
-".. note::\n"
-"\n"
-"   This filter function can also produce a *delay* effect by specifiying "
-"   only a few regularly spaced ``delays``.\n");
+	for (k = 0; k < W; ++k)
+		PyList_SET_ITEM(state, i++, PyFloat_FromDouble(lim->q_gain[k]));
 
-static PyObject *splat_reverb(PyObject *self, PyObject *args)
+	for (k = 0; k < W; ++k)
+		PyList_SET_ITEM(state, i++, PyFloat_FromDouble(lim->q_pos[k]));
+
+	for (k = 0; k < (lim->lookahead * lim->n_channels); ++k)
+		PyList_SET_ITEM(state, i++, PyFloat_FromDouble(lim->delay[k]));
+
+	return state;
+}
+
+static PyObject *splat_limiter(PyObject *self, PyObject *args)
 {
 	Fragment *frag_obj;
-	PyObject *delays_list;
-	double time_factor = 0.2;
-	double gain_factor = 6.0;
-	unsigned int seed = 0;
+	double threshold = -1.0;
+	double lookahead = 0.005;
+	double release = 0.05;
+	PyObject *state = Py_None;
 
 	struct splat_fragment *frag;
-	struct splat_delay *delays[SPLAT_MAX_CHANNELS];
-	Py_ssize_t n_delays;
-	size_t delays_size;
-	size_t max_delay;
-	size_t max_index;
-	size_t d;
-	unsigned c;
+	struct splat_limiter lim;
+	PyObject *ret = NULL;
 
-	if (!PyArg_ParseTuple(args, "O!O!|ddI", &splat_FragmentType, &frag_obj,
-			      &PyList_Type, &delays_list, &time_factor,
-			      &gain_factor, &seed))
+	if (!PyArg_ParseTuple(args, "O!|dddO", &splat_FragmentType, &frag_obj,
+			      &threshold, &lookahead, &release, &state))
 		return NULL;
 
-	if (!seed)
-		seed = time(0);
+	if (lookahead < 0.0) {
+		PyErr_SetString(PyExc_ValueError, "lookahead must be >= 0");
+		return NULL;
+	}
 
-	srand(seed);
+	if (release <= 0.0) {
+		PyErr_SetString(PyExc_ValueError, "release must be > 0");
+		return NULL;
+	}
 
-	frag = &frag_obj->frag;
-	n_delays = PyList_GET_SIZE(delays_list);
-	delays_size = n_delays * sizeof(struct splat_delay);
+	if ((state != Py_None) && !PyList_Check(state)) {
+		PyErr_SetString(PyExc_ValueError, "invalid limiter state");
+		return NULL;
+	}
 
-	for (c = 0; c < frag->n_channels; ++c) {
-		delays[c] = PyMem_Malloc(delays_size);
+	frag = &frag_obj->frag;
 
-		if (delays[c] == NULL) {
-			while (--c)
-				PyMem_Free(delays[c]);
+	if (splat_frag_unshare(frag) ||
+	    splat_limiter_init(&lim, frag->n_channels, frag->rate,
+			       dB2lin(threshold), lookahead, release))
+		return NULL;
 
-			return PyErr_NoMemory();
-		}
+	if (state == Py_None) {
+		splat_filter_limiter(frag, &lim);
+		ret = Py_None;
+		Py_INCREF(ret);
+	} else if (!PyList_GET_SIZE(state) ||
+		   !splat_limiter_set_state(&lim, state)) {
+		splat_filter_limiter_stream(frag, &lim);
+		ret = splat_limiter_get_state(&lim);
 	}
 
-	max_delay = 0;
-
-	for (d = 0; d < n_delays; ++d) {
-		PyObject *pair = PyList_GetItem(delays_list, d);
-		double time;
-		double gain;
+	splat_limiter_free(&lim);
 
-		if (!PyTuple_Check(pair)) {
-			PyErr_SetString(PyExc_TypeError,
-					"delay values must be a tuple");
-			return NULL;
-		}
+	return ret;
+}
 
-		if (PyTuple_GET_SIZE(pair) != 2) {
-			PyErr_SetString(PyExc_ValueError,
-					"delay tuple length must be 2");
-			return NULL;
-		}
+PyDoc_STRVAR(splat_compressor_doc,
+"compressor(fragment, threshold=-20.0, ratio=4.0, attack=0.01, "
+"release=0.1, window=0.05, makeup=0.0, state=None)\n"
+"\n"
+"Compress the dynamic range of the ``fragment`` when its RMS level goes "
+"above the ``threshold`` in dB, by dividing the excess level by ``ratio``.  "
+"The RMS level of all the channels is measured with an exponential moving "
+"average with a ``window`` time constant, and the gain follows the level "
+"with the ``attack`` and ``release`` time constants.  All the times are in "
+"seconds, and the ``makeup`` gain in dB is applied to the whole result.  "
+"This is done in a single pass.\n"
+"\n"
+"The compressor state is returned, and it can be passed as ``state`` to "
+"carry on compressing the next fragment of a same stream with the same "
+"parameters.\n");
 
-		time = PyFloat_AsDouble(PyTuple_GetItem(pair, 0));
+static PyObject *splat_compressor(PyObject *self, PyObject *args)
+{
+	Fragment *frag_obj;
+	struct splat_compressor comp = {
+		-20.0, 4.0, 0.01, 0.1, 0.05, 0.0, 0.0, 0.0,
+	};
+	PyObject *state = Py_None;
 
-		if (time < 0.0) {
-			PyErr_SetString(PyExc_ValueError,
-					"delay time must be >= 0");
-			return NULL;
-		}
+	if (!PyArg_ParseTuple(args, "O!|ddddddO", &splat_FragmentType,
+			      &frag_obj, &comp.threshold, &comp.ratio,
+			      &comp.attack, &comp.release, &comp.window,
+			      &comp.makeup, &state))
+		return NULL;
 
-		for (c = 0; c < frag->n_channels; ++c) {
-			const double c_time =
-				(time
-				 * (1.0 + (rand() * time_factor / RAND_MAX)));
+	if (comp.ratio < 1.0) {
+		PyErr_SetString(PyExc_ValueError, "ratio must be >= 1");
+		return NULL;
+	}
 
-			delays[c][d].time = c_time * frag->rate;
+	if ((comp.attack <= 0.0) || (comp.release <= 0.0) ||
+	    (comp.window <= 0.0)) {
+		PyErr_SetString(PyExc_ValueError, "times must be > 0");
+		return NULL;
+	}
 
-			if (delays[c][d].time > max_delay)
-				max_delay = delays[c][d].time;
+	if (state != Py_None) {
+		if (!PyList_Check(state) || (PyList_GET_SIZE(state) != 2)) {
+			PyErr_SetString(PyExc_ValueError,
+					"invalid compressor state");
+			return NULL;
 		}
 
-		gain = PyFloat_AsDouble(PyTuple_GetItem(pair, 1));
-
-		for (c = 0; c < frag->n_channels; ++c) {
-			const double c_gain_dB =
-				(gain - gain_factor
-				 + (rand() * gain_factor * 2.0 / RAND_MAX));
+		comp.ms = PyFloat_AsDouble(PyList_GET_ITEM(state, 0));
+		comp.gain_dB = PyFloat_AsDouble(PyList_GET_ITEM(state, 1));
 
-			delays[c][d].gain = dB2lin(c_gain_dB);
-		}
+		if (PyErr_Occurred())
+			return NULL;
 	}
 
-	max_index = frag->length + 1;
-
-	if (splat_frag_grow(frag, (frag->length + max_delay)))
+	if (splat_frag_unshare(&frag_obj->frag))
 		return NULL;
 
-	splat_filter_reverb(&frag_obj->frag, delays, n_delays, max_index);
-
-	for (c = 0; c < frag->n_channels; ++c)
-		PyMem_Free(delays[c]);
+	splat_filter_compressor(&frag_obj->frag, &comp);
 
-	Py_RETURN_NONE;
+	return Py_BuildValue("[dd]", comp.ms, comp.gain_dB);
 }
 
 static PyObject *splat_poly_value(PyObject *self, PyObject *args)
@@ -1977,22 +3998,40 @@ static PyMethodDef splat_methods[] = {
 	  splat_lin2dB_doc },
 	{ "dB2lin", splat_dB2lin, METH_VARARGS,
 	  splat_dB2lin_doc },
+	{ "get_threads", splat_get_threads, METH_VARARGS,
+	  splat_get_threads_doc },
+	{ "set_threads", splat_set_threads, METH_VARARGS,
+	  splat_set_threads_doc },
 	{ "gen_ref", splat_gen_ref, METH_VARARGS,
 	  splat_gen_ref_doc },
-	{ "sine", splat_sine, METH_VARARGS,
+	{ "sine", (PyCFunction)splat_sine, METH_KEYWORDS,
 	  splat_sine_doc },
-	{ "square", splat_square, METH_VARARGS,
+	{ "square", (PyCFunction)splat_square, METH_KEYWORDS,
 	  splat_square_doc },
-	{ "triangle", splat_triangle, METH_VARARGS,
+	{ "triangle", (PyCFunction)splat_triangle, METH_KEYWORDS,
 	  splat_triangle_doc },
-	{ "overtones", splat_overtones, METH_VARARGS,
+	{ "overtones", (PyCFunction)splat_overtones, METH_KEYWORDS,
 	  splat_overtones_doc },
 	{ "dec_envelope", splat_dec_envelope, METH_VARARGS,
 	  splat_dec_envelope_doc },
+	{ "envelope", splat_envelope, METH_VARARGS,
+	  splat_envelope_doc },
+	{ "filter_chain", splat_filter_chain_run, METH_VARARGS,
+	  splat_filter_chain_doc },
 	{ "reverse", splat_reverse, METH_VARARGS,
 	  splat_reverse_doc },
 	{ "reverb", splat_reverb, METH_VARARGS,
 	  splat_reverb_doc },
+	{ "convolve", splat_convolve, METH_VARARGS,
+	  splat_convolve_doc },
+	{ "fdn_reverb", splat_fdn_reverb, METH_VARARGS,
+	  splat_fdn_reverb_doc },
+	{ "biquad", splat_biquad, METH_VARARGS,
+	  splat_biquad_doc },
+	{ "limiter", splat_limiter, METH_VARARGS,
+	  splat_limiter_doc },
+	{ "compressor", splat_compressor, METH_VARARGS,
+	  splat_compressor_doc },
 	{ "poly_value", splat_poly_value, METH_VARARGS, NULL },
 	{ "spline_value", splat_spline_value, METH_VARARGS, NULL },
 	{ NULL, NULL, 0, NULL }
@@ -2005,7 +4044,7 @@ static void splat_init_sample_types(PyObject *m, const char *name,
 
 	obj = PyDict_New();
 
-	for (i = 0; i < ARRAY_SIZE(splat_raw_io_table); ++i) {
+	for (i = 0; i < SPLAT_RAW_IO_N; ++i) {
 		const struct splat_raw_io *io = &splat_raw_io_table[i];
 
 		PyDict_SetItem(obj, PyString_FromString(io->sample_type),
@@ -2015,6 +4054,45 @@ static void splat_init_sample_types(PyObject *m, const char *name,
 	PyModule_AddObject(m, name, obj);
 }
 
+/* The kernels are initialised for both sample types, and the ones used with
+ * the default sample type are listed in the module */
+static void splat_init_kernels(PyObject *m, const char *name)
+{
+	static const struct splat_ops *all_ops[] = {
+		&splat_sample_ops, &splat32_sample_ops,
+	};
+	enum splat_simd level = SPLAT_SIMD_GENERIC;
+	const char *raw_io = NULL;
+	PyObject *obj = PyDict_New();
+	PyObject *str;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(all_ops); ++i) {
+		const struct splat_ops *ops = all_ops[i];
+		const char *ops_raw_io;
+
+		level = ops->simd_init();
+		ops_raw_io = ops->raw_io_init(level);
+
+		if (ops->sample_width == SPLAT_DEFAULT_SAMPLE_WIDTH)
+			raw_io = ops_raw_io;
+	}
+
+	str = PyString_FromString(splat_kernels.name);
+	PyDict_SetItemString(obj, "mix", str);
+	PyDict_SetItemString(obj, "amp", str);
+	PyDict_SetItemString(obj, "biquad", str);
+	PyDict_SetItemString(obj, "sums", str);
+	PyDict_SetItemString(obj, "true_peak", str);
+	Py_DECREF(str);
+	str = PyString_FromString(raw_io);
+	PyDict_SetItemString(obj, "import", str);
+	PyDict_SetItemString(obj, "export", str);
+	Py_DECREF(str);
+	PyModule_AddObject(m, name, obj);
+	PyModule_AddStringConstant(m, "SIMD", splat_simd_names[level]);
+}
+
 PyMODINIT_FUNC init_splat(void)
 {
 	struct splat_type {
@@ -2050,7 +4128,10 @@ PyMODINIT_FUNC init_splat(void)
 	splat_zero = PyFloat_FromDouble(0.0);
 	PyModule_AddObject(m, "_zero", splat_zero);
 	splat_init_sample_types(m, "sample_types", splat_sample_types);
+	splat_init_kernels(m, "kernels");
+	splat_pool_init();
 
-	PyModule_AddStringConstant(m, "SAMPLE_TYPE", SPLAT_NATIVE_SAMPLE_TYPE);
-	PyModule_AddIntConstant(m, "SAMPLE_WIDTH", SPLAT_NATIVE_SAMPLE_WIDTH);
+	PyModule_AddStringConstant(m, "SAMPLE_TYPE",
+		splat_ops_get(SPLAT_DEFAULT_SAMPLE_WIDTH)->sample_type);
+	PyModule_AddIntConstant(m, "SAMPLE_WIDTH", SPLAT_DEFAULT_SAMPLE_WIDTH);
 }
@@ -48,9 +48,91 @@
 # define ARRAY_SIZE(_array) (sizeof(_array) / sizeof(_array[0]))
 #endif
 
-/* Sample type */
+/* Sample type, double unless built with SPLAT_FLOAT32 to halve the memory
+ * footprint and bandwidth at the cost of precision.  The code which depends on
+ * it is built for both types, see struct splat_ops.  */
+#ifdef SPLAT_FLOAT32
+typedef float sample_t;
+typedef double other_sample_t;
+#else
 typedef double sample_t;
-#define SPLAT_NATIVE_SAMPLE_TYPE SPLAT_FLOAT_64
+typedef float other_sample_t;
+#endif
+
+#define SPLAT_SAMPLE_WIDTH (sizeof(sample_t) * 8)
+
+/* The code which depends on the sample type is built a second time with
+ * SPLAT_FLOAT32 and all its global symbols get a different prefix */
+#ifdef SPLAT_FLOAT32
+# define splat_biquad_design splat32_biquad_design
+# define splat_file_close splat32_file_close
+# define splat_file_init splat32_file_init
+# define splat_file_path splat32_file_path
+# define splat_file_reserve splat32_file_reserve
+# define splat_file_sample_width splat32_file_sample_width
+# define splat_file_set_length splat32_file_set_length
+# define splat_file_set_rate splat32_file_set_rate
+# define splat_file_zero splat32_file_zero
+# define splat_filter_biquad splat32_filter_biquad
+# define splat_filter_chain splat32_filter_chain
+# define splat_filter_compressor splat32_filter_compressor
+# define splat_filter_convolve splat32_filter_convolve
+# define splat_filter_dec_envelope splat32_filter_dec_envelope
+# define splat_filter_envelope splat32_filter_envelope
+# define splat_filter_fdn splat32_filter_fdn
+# define splat_filter_limiter splat32_filter_limiter
+# define splat_filter_limiter_stream splat32_filter_limiter_stream
+# define splat_filter_reverb splat32_filter_reverb
+# define splat_filter_reverse splat32_filter_reverse
+# define splat_frag_amp splat32_frag_amp
+# define splat_frag_convert splat32_frag_convert
+# define splat_frag_dB2lin splat32_frag_dB2lin
+# define splat_frag_dirty splat32_frag_dirty
+# define splat_frag_free splat32_frag_free
+# define splat_frag_get_norm splat32_frag_get_norm
+# define splat_frag_get_peak splat32_frag_get_peak
+# define splat_frag_get_stats splat32_frag_get_stats
+# define splat_frag_init splat32_frag_init
+# define splat_frag_lin2dB splat32_frag_lin2dB
+# define splat_frag_mix splat32_frag_mix
+# define splat_frag_mix_many splat32_frag_mix_many
+# define splat_frag_normalize splat32_frag_normalize
+# define splat_frag_offset splat32_frag_offset
+# define splat_frag_resample splat32_frag_resample
+# define splat_frag_reserve splat32_frag_reserve
+# define splat_frag_reserve_blocks splat32_frag_reserve_blocks
+# define splat_frag_resize splat32_frag_resize
+# define splat_frag_sample_number splat32_frag_sample_number
+# define splat_frag_set_name splat32_frag_set_name
+# define splat_frag_share splat32_frag_share
+# define splat_frag_touch splat32_frag_touch
+# define splat_frag_unshare splat32_frag_unshare
+# define splat_kernels splat32_kernels
+# define splat_limiter_free splat32_limiter_free
+# define splat_limiter_init splat32_limiter_init
+# define splat_overtones_float splat32_overtones_float
+# define splat_overtones_mixed splat32_overtones_mixed
+# define splat_overtones_signal splat32_overtones_signal
+# define splat_raw_export splat32_raw_export
+# define splat_raw_import splat32_raw_import
+# define splat_raw_io_get splat32_raw_io_get
+# define splat_raw_io_init splat32_raw_io_init
+# define splat_raw_io_table splat32_raw_io_table
+# define splat_resample splat32_resample
+# define splat_resample_length splat32_resample_length
+# define splat_resample_used splat32_resample_used
+# define splat_resampler_free splat32_resampler_free
+# define splat_resampler_init splat32_resampler_init
+# define splat_sample_ops splat32_sample_ops
+# define splat_simd_init splat32_simd_init
+# define splat_simd_names splat32_simd_names
+# define splat_sine_floats splat32_sine_floats
+# define splat_sine_signals splat32_sine_signals
+# define splat_square_floats splat32_square_floats
+# define splat_square_signals splat32_square_signals
+# define splat_triangle_floats splat32_triangle_floats
+# define splat_triangle_signals splat32_triangle_signals
+#endif
 
 /* Convert any number type to a double or return -1 */
 extern int splat_obj2double(PyObject *obj, double *out);
@@ -67,14 +149,63 @@ struct splat_levels {
  * Fragment
  */
 
+/* Fragments keep track of which blocks of samples may contain some sound, so
+ * the silent ones can be skipped as they only contain zeros */
+#define SPLAT_FRAG_BLOCK_BITS 12
+#define SPLAT_FRAG_BLOCK (1 << SPLAT_FRAG_BLOCK_BITS)
+
+struct splat_file;
+
+/* Sample buffers shared between fragments until one of them gets modified */
+struct splat_share {
+	unsigned refs;
+	unsigned n_channels;
+	size_t capacity;
+	size_t length; /* length of the data when it was first shared */
+	sample_t *data[SPLAT_MAX_CHANNELS];
+};
+
+/* Summary of the samples of a block in one channel */
+struct splat_block_sums {
+	double min;
+	double max;
+	double sum;
+	double sum2;
+};
+
 struct splat_fragment {
+	unsigned sample_width; /* 32 for float or 64 for double samples */
 	unsigned n_channels;
 	unsigned rate;
 	size_t length;
+	size_t capacity; /* number of samples allocated for each channel */
 	sample_t *data[SPLAT_MAX_CHANNELS];
+	unsigned char *blocks; /* SPLAT_FRAG_BLOCK_ flags for each block */
+	struct splat_block_sums *sums; /* for each block, then each channel */
+	size_t n_sums; /* number of blocks the sums have been allocated for */
+	struct splat_share *share; /* set when the data is not owned */
+	struct splat_file *file; /* set when the data is mapped from a file */
 	char *name;
 };
 
+/* Set if any sample in the block was set */
+#define SPLAT_FRAG_BLOCK_USED 1
+/* Set if the block is used and its sums are up to date, this gets cleared
+ * whenever the block is touched or made dirty */
+#define SPLAT_FRAG_BLOCK_SUMS 2
+
+#define splat_frag_block_used(_frag, _i) \
+	((_frag)->blocks[(_i) >> SPLAT_FRAG_BLOCK_BITS] & SPLAT_FRAG_BLOCK_USED)
+#define splat_frag_n_blocks(_capacity) \
+	(((_capacity) + SPLAT_FRAG_BLOCK - 1) >> SPLAT_FRAG_BLOCK_BITS)
+
+/* Sample i of channel c as a double, for the code built only once which needs
+ * to deal with both sample types */
+#define splat_frag_sample(_frag, _c, _i)				\
+	(((_frag)->sample_width == 32) ?				\
+	 (double)((const float *)(const void *)(_frag)->data[_c])[_i] :	\
+	 ((const double *)(const void *)(_frag)->data[_c])[_i])
+
 struct splat_peak {
 	double avg;
 	double max;
@@ -82,6 +213,51 @@ struct splat_peak {
 	double peak;
 };
 
+/* Levels are linear except for the loudness in LUFS */
+struct splat_stats {
+	double avg;
+	double max;
+	double min;
+	double peak;
+	double rms;
+	double true_peak;
+	double loudness;
+};
+
+/* Incoming channel mixed into an output channel with a linear gain */
+struct splat_mix_route {
+	unsigned out;
+	unsigned in;
+	double gain;
+};
+
+/* Incoming fragment to be mixed, times are in seconds */
+struct splat_mix {
+	const struct splat_fragment *incoming;
+	struct splat_levels levels;
+	double offset;
+	double skip;
+	size_t length;
+	int zero_dB;
+	int resample; /* set when the incoming sample rate is converted */
+	/* set with a channel matrix, otherwise each channel is mixed into the
+	 * same one */
+	struct splat_mix_route *routes;
+	unsigned n_routes;
+	/* sample numbers set when mixing */
+	size_t offset_sample;
+	size_t skip_sample;
+	/* copy of the incoming fragment with the sample type of the fragment
+	 * it gets mixed into, when they don't match */
+	struct splat_fragment *converted;
+};
+
+/* Normalisation gain and offset, applied as (s - offset) * gain */
+struct splat_norm {
+	double gain;
+	double offset[SPLAT_MAX_CHANNELS];
+};
+
 struct splat_levels;
 
 extern struct splat_fragment *splat_frag_from_obj(PyObject *obj);
@@ -89,21 +265,55 @@ extern int splat_frag_init(struct splat_fragment *frag, unsigned n_channels,
 			   unsigned rate, size_t length, const char *name);
 extern void splat_frag_free(struct splat_fragment *frag);
 extern int splat_frag_set_name(struct splat_fragment *frag, const char *name);
+extern int splat_frag_reserve(struct splat_fragment *frag, size_t capacity);
+extern int splat_frag_reserve_blocks(struct splat_fragment *frag,
+				     size_t capacity);
 extern int splat_frag_resize(struct splat_fragment *frag, size_t length);
 #define splat_frag_grow(_frag, _length)		\
 	(((_length) <= (_frag)->length) ? 0 :	\
 	 splat_frag_resize((_frag), (_length)))
-extern int splat_frag_mix(struct splat_fragment *frag,
-			  const struct splat_fragment *incoming,
-			  const struct splat_levels *levels, size_t length,
-			  double offset, double skip, int zero_dB);
+extern void splat_frag_touch(struct splat_fragment *frag, size_t start,
+			     size_t length);
+#define splat_frag_touch_all(_frag)			\
+	splat_frag_touch((_frag), 0, (_frag)->length)
+extern void splat_frag_dirty(struct splat_fragment *frag, size_t start,
+			     size_t length);
+#define splat_frag_dirty_all(_frag)			\
+	splat_frag_dirty((_frag), 0, (_frag)->length)
+extern int splat_frag_share(struct splat_fragment *frag,
+			    struct splat_fragment *src, size_t start,
+			    size_t end);
+extern int splat_frag_unshare(struct splat_fragment *frag);
+extern int splat_frag_convert(struct splat_fragment *frag,
+			      const struct splat_fragment *src);
+
+/* Fragment data mapped from a file */
+extern int splat_file_init(struct splat_fragment *frag, unsigned n_channels,
+			   unsigned rate, size_t length, const char *name,
+			   const char *path, int reopen);
+extern void splat_file_close(struct splat_file *file);
+extern const char *splat_file_path(const struct splat_file *file);
+extern int splat_file_reserve(struct splat_fragment *frag, size_t capacity);
+extern void splat_file_zero(struct splat_fragment *frag, unsigned c,
+			    size_t start, size_t end);
+extern void splat_file_set_length(struct splat_fragment *frag);
+extern void splat_file_set_rate(struct splat_fragment *frag);
+extern int splat_file_sample_width(const char *path, unsigned *width);
+extern int splat_frag_mix(struct splat_fragment *frag, struct splat_mix *mix);
+extern int splat_frag_mix_many(struct splat_fragment *frag,
+			       struct splat_mix *mix, size_t n);
 extern int splat_frag_sample_number(size_t *val, long min_val,
 				    long max_val, PyObject *obj);
-extern void splat_frag_get_peak(const struct splat_fragment *frag,
-				struct splat_peak *chan_peak,
-				struct splat_peak *frag_peak, int do_avg);
-extern void splat_frag_normalize(struct splat_fragment *frag, double level_dB,
-				 int do_zero);
+extern int splat_frag_get_peak(struct splat_fragment *frag,
+			       struct splat_peak *chan_peak,
+			       struct splat_peak *frag_peak);
+extern int splat_frag_get_stats(struct splat_fragment *frag,
+				struct splat_stats *chan_stats,
+				struct splat_stats *frag_stats);
+extern int splat_frag_get_norm(struct splat_fragment *frag, double level_dB,
+			       int do_zero, struct splat_norm *norm);
+extern int splat_frag_normalize(struct splat_fragment *frag, double level_dB,
+				int do_zero);
 extern int splat_frag_amp(struct splat_fragment *frag,
 			  struct splat_levels *gains);
 extern void splat_frag_lin2dB(struct splat_fragment *frag);
@@ -121,7 +331,7 @@ extern int splat_frag_offset(struct splat_fragment *frag, PyObject *offset_obj,
 struct splat_signal;
 
 struct splat_vector {
-	sample_t data[SPLAT_VECTOR_LEN];
+	double data[SPLAT_VECTOR_LEN];
 	PyObject *obj;
 	int (*signal)(struct splat_signal *s, struct splat_vector *v);
 };
@@ -183,38 +393,103 @@ struct splat_overtone {
 	struct splat_levels levels;
 };
 
-extern void splat_sine_floats(struct splat_fragment *frag,
+/* Samples written by a source from start to start + length, or added to the
+ * existing ones, with an extra linear gain */
+struct splat_source {
+	struct splat_fragment *frag;
+	size_t start;
+	size_t length;
+	double gain;
+	int add;
+};
+
+extern void splat_sine_floats(const struct splat_source *src,
 			      const double *levels, double freq, double phase);
-extern int splat_sine_signals(struct splat_fragment *frag, PyObject **levels,
-			      PyObject *freq, PyObject *phase, double origin);
-extern void splat_square_floats(struct splat_fragment *frag,
-				const double *fl_pos, double freq,
+extern int splat_sine_signals(const struct splat_source *src,
+			      PyObject **levels, PyObject *freq,
+			      PyObject *phase, double origin);
+extern void splat_square_floats(const struct splat_source *src,
+				const double *levels, double freq,
 				double phase, double ratio);
-extern int splat_square_signals(struct splat_fragment *frag, PyObject **levels,
-				PyObject *freq, PyObject *phase,
-				PyObject *ratio, double origin);
-extern void splat_triangle_floats(struct splat_fragment *frag,
+extern int splat_square_signals(const struct splat_source *src,
+				PyObject **levels, PyObject *freq,
+				PyObject *phase, PyObject *ratio,
+				double origin);
+extern void splat_triangle_floats(const struct splat_source *src,
 				  const double *lvls, double freq,
 				  double phase, double ratio);
-extern int splat_triangle_signals(struct splat_fragment *frag,
+extern int splat_triangle_signals(const struct splat_source *src,
 				  PyObject **levels, PyObject *freq,
 				  PyObject *phase, PyObject *ratio,
 				  double origin);
-extern void splat_overtones_float(struct splat_fragment *frag,
+extern void splat_overtones_float(const struct splat_source *src,
 				  const double *levels, double freq,
 				  double phase,
 				  struct splat_overtone *overtones,
 				  Py_ssize_t n);
-extern int splat_overtones_mixed(struct splat_fragment *frag, PyObject **levels,
-				 PyObject *freq, PyObject *phase,
+extern int splat_overtones_mixed(const struct splat_source *src,
+				 PyObject **levels, PyObject *freq,
+				 PyObject *phase,
 				 struct splat_overtone *overtones,
 				 Py_ssize_t n, double origin);
-extern int splat_overtones_signal(struct splat_fragment *frag,
+extern int splat_overtones_signal(const struct splat_source *src,
 				  PyObject **levels, PyObject *freq,
 				  PyObject *phase,
 				  struct splat_overtone *overtones,
 				  Py_ssize_t n, double origin);
 
+/* ----------------------------------------------------------------------------
+ * FFT
+ */
+
+struct splat_fft {
+	size_t n;
+	double *tw;
+	size_t *rev;
+};
+
+extern int splat_fft_init(struct splat_fft *fft, size_t n);
+extern void splat_fft_free(struct splat_fft *fft);
+extern void splat_fft_forward(const struct splat_fft *fft, double *data);
+extern void splat_fft_inverse(const struct splat_fft *fft, double *data);
+
+/* ----------------------------------------------------------------------------
+ * Resampling
+ */
+
+/* The quality is the number of zero crossings on each side of the sinc */
+#define SPLAT_RESAMPLE_QUALITY 32
+#define SPLAT_RESAMPLE_MIN_QUALITY 4
+#define SPLAT_RESAMPLE_MAX_QUALITY 256
+/* Beyond this, the coefficients are interpolated between phases */
+#define SPLAT_RESAMPLE_MAX_PHASES 1024
+
+/* Polyphase filter with the rates reduced to up / down */
+struct splat_resampler {
+	unsigned in_rate;
+	unsigned out_rate;
+	size_t up;
+	size_t down;
+	size_t n_phases;
+	size_t half; /* number of taps on each side */
+	size_t n_taps;
+	double *k; /* n_taps coefficients for each phase, plus one */
+};
+
+extern int splat_resampler_init(struct splat_resampler *rs, unsigned in_rate,
+				unsigned out_rate, unsigned quality);
+extern void splat_resampler_free(struct splat_resampler *rs);
+extern size_t splat_resample_length(size_t length, unsigned in_rate,
+				    unsigned out_rate);
+extern int splat_resample_used(const struct splat_resampler *rs,
+			       const struct splat_fragment *frag,
+			       size_t start, size_t n);
+extern void splat_resample(const struct splat_resampler *rs,
+			   const sample_t *in, size_t in_length,
+			   sample_t *out, size_t start, size_t n);
+extern int splat_frag_resample(struct splat_fragment *frag, unsigned rate,
+			       unsigned quality);
+
 /* ----------------------------------------------------------------------------
  * Filters
  */
@@ -224,11 +499,404 @@ struct splat_delay {
 	double gain;
 };
 
+struct splat_dec_envelope {
+	double k;
+	double p;
+};
+
+/* Envelope breakpoint, with a position in samples and a linear gain */
+struct splat_envelope_point {
+	double pos;
+	double gain;
+};
+
+struct splat_envelope {
+	struct splat_envelope_point *points;
+	size_t n_points;
+	int exp;
+};
+
 extern void splat_filter_dec_envelope(struct splat_fragment *frag,
-			       double k, double p);
+				      const struct splat_dec_envelope *dec,
+				      size_t start, size_t end);
+extern void splat_filter_envelope(struct splat_fragment *frag,
+				  const struct splat_envelope *env,
+				  size_t start, size_t end);
+
+enum splat_biquad_type {
+	SPLAT_BIQUAD_COEFS = 0,
+	SPLAT_BIQUAD_LOWPASS,
+	SPLAT_BIQUAD_HIGHPASS,
+	SPLAT_BIQUAD_BANDPASS,
+	SPLAT_BIQUAD_NOTCH,
+	SPLAT_BIQUAD_ALLPASS,
+	SPLAT_BIQUAD_PEAK,
+	SPLAT_BIQUAD_LOWSHELF,
+	SPLAT_BIQUAD_HIGHSHELF,
+};
+
+/* Normalised with a0 = 1 */
+struct splat_biquad_coefs {
+	double b0;
+	double b1;
+	double b2;
+	double a1;
+	double a2;
+};
+
+/* Biquad filter section, with its parameters as signals unless the
+ * coefficients are given directly and its state for each channel */
+struct splat_biquad {
+	enum splat_biquad_type type;
+	PyObject *freq;
+	PyObject *q;
+	PyObject *gain;
+	struct splat_biquad_coefs k;
+	double s1[SPLAT_MAX_CHANNELS];
+	double s2[SPLAT_MAX_CHANNELS];
+};
+
+extern void splat_biquad_design(struct splat_biquad_coefs *k,
+				enum splat_biquad_type type, double freq,
+				double q, double gain, unsigned rate);
+extern int splat_filter_biquad(struct splat_fragment *frag,
+			       struct splat_biquad *sections,
+			       size_t n_sections, double origin);
+
+/* Limiter parameters and state, with the lookahead in samples.  The box,
+ * q_gain and q_pos arrays have lookahead + 1 entries and the delay line has
+ * lookahead frames, only used when the limiter is run on a stream.  */
+struct splat_limiter {
+	double threshold;
+	double kr;
+	size_t lookahead;
+	unsigned n_channels;
+	size_t pos; /* number of samples which have entered the lookahead */
+	double *box;
+	double box_sum;
+	size_t b;
+	double *q_gain;
+	size_t *q_pos;
+	size_t q_head;
+	size_t q_len;
+	double gain;
+	size_t rest; /* number of consecutive gains equal to 1.0 */
+	double *delay;
+	size_t d;
+	size_t zeros; /* number of consecutive silent input frames */
+};
+
+extern int splat_limiter_init(struct splat_limiter *lim, unsigned n_channels,
+			      unsigned rate, double threshold,
+			      double lookahead, double release);
+extern void splat_limiter_free(struct splat_limiter *lim);
+extern void splat_filter_limiter(struct splat_fragment *frag,
+				 struct splat_limiter *lim);
+extern void splat_filter_limiter_stream(struct splat_fragment *frag,
+					struct splat_limiter *lim);
+
+/* Times are in seconds and levels in dB, followed by the state */
+struct splat_compressor {
+	double threshold;
+	double ratio;
+	double attack;
+	double release;
+	double window;
+	double makeup;
+	double ms;
+	double gain_dB;
+};
+
+extern void splat_filter_compressor(struct splat_fragment *frag,
+				    struct splat_compressor *comp);
+
+/* Filters which can process any range of samples in turn, so a chain of them
+ * can be run one tile at a time while the data is still in the cache */
+enum splat_block_filter_id {
+	SPLAT_BLOCK_FILTER_DEC_ENVELOPE = 0,
+	SPLAT_BLOCK_FILTER_ENVELOPE,
+};
+
+struct splat_block_filter {
+	enum splat_block_filter_id id;
+	union {
+		struct splat_dec_envelope dec_envelope;
+		struct splat_envelope envelope;
+	} u;
+};
+
+extern void splat_filter_chain(struct splat_fragment *frag,
+			       const struct splat_block_filter *filters,
+			       size_t n_filters);
 extern void splat_filter_reverse(struct splat_fragment *frag);
-extern void splat_filter_reverb(struct splat_fragment *frag,
-				struct splat_delay **delays,
-				size_t n_delays, size_t max_index);
+extern int splat_filter_reverb(struct splat_fragment *frag,
+			       struct splat_delay **delays,
+			       size_t n_delays, size_t length);
+extern int splat_filter_convolve(struct splat_fragment *frag, size_t length,
+				 const double **irs, size_t ir_length);
+extern int splat_filter_fdn(struct splat_fragment *frag, size_t length,
+			    double rt60, double size, double damping,
+			    double wet);
+
+/* ----------------------------------------------------------------------------
+ * Thread pool
+ */
+
+#define SPLAT_POOL_MAX_THREADS 64
+
+/* Job function called with each index from 0 to n_jobs - 1, possibly in
+ * parallel in threads which don't hold the GIL so it must not use the Python
+ * API */
+typedef void (*splat_pool_fn)(void *arg, size_t i);
+
+extern unsigned splat_pool_init(void);
+extern unsigned splat_pool_get_threads(void);
+extern void splat_pool_set_threads(unsigned n);
+extern void splat_pool_run(splat_pool_fn fn, void *arg, size_t n_jobs);
+
+/* ----------------------------------------------------------------------------
+ * Kernels
+ */
+
+/* Sums of samples and of their squares are split into as many lanes as the
+ * widest SIMD kernel, so the samples are always added in the same order */
+#define SPLAT_SUMS_LANES 8
+
+struct splat_sums {
+	double min;
+	double max;
+	double sum[SPLAT_SUMS_LANES];
+	double sum2[SPLAT_SUMS_LANES];
+};
+
+/* The true peak is estimated with 4x oversampling, by interpolating 3 values
+ * between each sample with a windowed sinc over SPLAT_TP_TAPS samples */
+#define SPLAT_TP_PHASES 4
+#define SPLAT_TP_TAPS 12
+#define SPLAT_TP_HALF (SPLAT_TP_TAPS / 2)
+
+/* Basic processing kernels, with a generic implementation and optimised
+ * variants selected at run-time depending on the CPU */
+struct splat_kernels {
+	const char *name;
+	void (*mix)(sample_t *dst, const sample_t *src, size_t n, double gain);
+	void (*mix_vec)(sample_t *dst, const sample_t *src,
+			const double *gains, size_t n);
+	void (*amp)(sample_t *data, size_t n, double gain);
+	void (*amp_vec)(sample_t *data, const double *gains, size_t n);
+	/* n frames of interleaved channels padded to a multiple of 4 lanes */
+	void (*biquad)(double *x, size_t n, size_t lanes,
+		       const struct splat_biquad_coefs *k, double *s1,
+		       double *s2);
+	/* sample i is added to lane i % SPLAT_SUMS_LANES */
+	void (*sums)(const sample_t *x, size_t n, struct splat_sums *sums);
+	/* x has SPLAT_TP_HALF more samples on each side of the n samples, and
+	 * k the interpolation coefficients for each intermediate phase */
+	double (*true_peak)(const double *x, size_t n, const double *k);
+};
+
+/* Number of channels the biquad kernel gets padded to */
+#define splat_biquad_lanes(_channels) (((_channels) + 3) & ~3)
+
+extern struct splat_kernels splat_kernels;
+
+/* ----------------------------------------------------------------------------
+ * SIMD
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define SPLAT_X86_SIMD 1
+#endif
+
+/* The SIMD sample format converters only deal with double samples */
+#if defined(SPLAT_X86_SIMD) && !defined(SPLAT_FLOAT32)
+# define SPLAT_X86_SIMD_IO 1
+#endif
+
+/* Instruction set levels, the SPLAT_SIMD environment variable can be set to
+ * one of the names to use a lower level than what the CPU supports */
+enum splat_simd {
+	SPLAT_SIMD_GENERIC = 0,
+	SPLAT_SIMD_AVX2,
+	SPLAT_SIMD_AVX512,
+	SPLAT_SIMD_N
+};
+
+extern const char *splat_simd_names[SPLAT_SIMD_N];
+extern enum splat_simd splat_simd_init(void);
+
+#ifdef SPLAT_X86_SIMD_IO
+extern void splat_import_float64_avx2(sample_t *out, const char *in, size_t n,
+				      size_t step);
+extern void splat_export_float64_avx2(char *out, const sample_t **in,
+				      unsigned channels, size_t n,
+				      const struct splat_norm *norm);
+extern void splat_import_float32_avx2(sample_t *out, const char *in, size_t n,
+				      size_t step);
+extern void splat_export_float32_avx2(char *out, const sample_t **in,
+				      unsigned channels, size_t n,
+				      const struct splat_norm *norm);
+extern void splat_import_int24_avx2(sample_t *out, const char *in, size_t n,
+				    size_t step);
+extern void splat_export_int24_avx2(char *out, const sample_t **in,
+				    unsigned channels, size_t n,
+				    const struct splat_norm *norm);
+extern void splat_import_int16_avx2(sample_t *out, const char *in, size_t n,
+				    size_t step);
+extern void splat_export_int16_avx2(char *out, const sample_t **in,
+				    unsigned channels, size_t n,
+				    const struct splat_norm *norm);
+extern void splat_import_int8_avx2(sample_t *out, const char *in, size_t n,
+				   size_t step);
+extern void splat_export_int8_avx2(char *out, const sample_t **in,
+				   unsigned channels, size_t n,
+				   const struct splat_norm *norm);
+#endif
+
+/* ----------------------------------------------------------------------------
+ * Raw sample data
+ */
+
+/* Converters between the samples and raw data of a given sample type */
+struct splat_raw_io {
+	const char *sample_type;
+	size_t sample_width;
+	void (*import)(sample_t *out, const char *in, size_t n, size_t step);
+	void (*export)(char *out, const sample_t **it, unsigned channels,
+		       size_t n, const struct splat_norm *norm);
+};
+
+#define SPLAT_RAW_IO_N 5
+
+extern struct splat_raw_io splat_raw_io_table[SPLAT_RAW_IO_N];
+extern const char *splat_raw_io_init(enum splat_simd level);
+extern const struct splat_raw_io *splat_raw_io_get(const char *sample_type);
+extern void splat_raw_import(struct splat_fragment *frag,
+			     const struct splat_raw_io *io, const char *in,
+			     size_t offset, size_t length, size_t step);
+extern void splat_raw_export(const struct splat_fragment *frag,
+			     const struct splat_raw_io *io, char *out,
+			     size_t start, size_t length,
+			     const struct splat_norm *norm);
+
+/* ----------------------------------------------------------------------------
+ * Sample type operations
+ */
+
+/* Functions which depend on the sample type, for the Python glue code to call
+ * the ones built for the sample type of each fragment */
+struct splat_ops {
+	const char *sample_type;
+	unsigned sample_width;
+	enum splat_simd (*simd_init)(void);
+	const char *(*raw_io_init)(enum splat_simd level);
+	const struct splat_raw_io *(*raw_io_get)(const char *sample_type);
+	void (*raw_import)(struct splat_fragment *frag,
+			   const struct splat_raw_io *io, const char *in,
+			   size_t offset, size_t length, size_t step);
+	void (*raw_export)(const struct splat_fragment *frag,
+			   const struct splat_raw_io *io, char *out,
+			   size_t start, size_t length,
+			   const struct splat_norm *norm);
+	int (*frag_init)(struct splat_fragment *frag, unsigned n_channels,
+			 unsigned rate, size_t length, const char *name);
+	void (*frag_free)(struct splat_fragment *frag);
+	int (*frag_reserve)(struct splat_fragment *frag, size_t capacity);
+	int (*frag_resize)(struct splat_fragment *frag, size_t length);
+	void (*frag_touch)(struct splat_fragment *frag, size_t start,
+			   size_t length);
+	int (*frag_share)(struct splat_fragment *frag,
+			  struct splat_fragment *src, size_t start,
+			  size_t end);
+	int (*frag_unshare)(struct splat_fragment *frag);
+	int (*frag_convert)(struct splat_fragment *frag,
+			    const struct splat_fragment *src);
+	int (*file_init)(struct splat_fragment *frag, unsigned n_channels,
+			 unsigned rate, size_t length, const char *name,
+			 const char *path, int reopen);
+	int (*frag_mix)(struct splat_fragment *frag, struct splat_mix *mix);
+	int (*frag_mix_many)(struct splat_fragment *frag,
+			     struct splat_mix *mix, size_t n);
+	int (*frag_get_peak)(struct splat_fragment *frag,
+			     struct splat_peak *chan_peak,
+			     struct splat_peak *frag_peak);
+	int (*frag_get_stats)(struct splat_fragment *frag,
+			      struct splat_stats *chan_stats,
+			      struct splat_stats *frag_stats);
+	int (*frag_get_norm)(struct splat_fragment *frag, double level_dB,
+			     int do_zero, struct splat_norm *norm);
+	int (*frag_normalize)(struct splat_fragment *frag, double level_dB,
+			      int do_zero);
+	int (*frag_amp)(struct splat_fragment *frag,
+			struct splat_levels *gains);
+	void (*frag_lin2dB)(struct splat_fragment *frag);
+	void (*frag_dB2lin)(struct splat_fragment *frag);
+	int (*frag_offset)(struct splat_fragment *frag, PyObject *offset_obj,
+			   double start);
+	int (*frag_resample)(struct splat_fragment *frag, unsigned rate,
+			     unsigned quality);
+	void (*sine_floats)(const struct splat_source *src,
+			    const double *levels, double freq, double phase);
+	int (*sine_signals)(const struct splat_source *src, PyObject **levels,
+			    PyObject *freq, PyObject *phase, double origin);
+	void (*square_floats)(const struct splat_source *src,
+			      const double *levels, double freq, double phase,
+			      double ratio);
+	int (*square_signals)(const struct splat_source *src,
+			      PyObject **levels, PyObject *freq,
+			      PyObject *phase, PyObject *ratio,
+			      double origin);
+	void (*triangle_floats)(const struct splat_source *src,
+				const double *lvls, double freq, double phase,
+				double ratio);
+	int (*triangle_signals)(const struct splat_source *src,
+				PyObject **levels, PyObject *freq,
+				PyObject *phase, PyObject *ratio,
+				double origin);
+	void (*overtones_float)(const struct splat_source *src,
+				const double *levels, double freq,
+				double phase, struct splat_overtone *overtones,
+				Py_ssize_t n);
+	int (*overtones_mixed)(const struct splat_source *src,
+			       PyObject **levels, PyObject *freq,
+			       PyObject *phase,
+			       struct splat_overtone *overtones, Py_ssize_t n,
+			       double origin);
+	int (*overtones_signal)(const struct splat_source *src,
+				PyObject **levels, PyObject *freq,
+				PyObject *phase,
+				struct splat_overtone *overtones,
+				Py_ssize_t n, double origin);
+	int (*filter_biquad)(struct splat_fragment *frag,
+			     struct splat_biquad *sections, size_t n_sections,
+			     double origin);
+	void (*filter_limiter)(struct splat_fragment *frag,
+			       struct splat_limiter *lim);
+	void (*filter_limiter_stream)(struct splat_fragment *frag,
+				      struct splat_limiter *lim);
+	void (*filter_compressor)(struct splat_fragment *frag,
+				  struct splat_compressor *comp);
+	void (*filter_chain)(struct splat_fragment *frag,
+			     const struct splat_block_filter *filters,
+			     size_t n_filters);
+	void (*filter_reverse)(struct splat_fragment *frag);
+	int (*filter_reverb)(struct splat_fragment *frag,
+			     struct splat_delay **delays, size_t n_delays,
+			     size_t length);
+	int (*filter_convolve)(struct splat_fragment *frag, size_t length,
+			       const double **irs, size_t ir_length);
+	int (*filter_fdn)(struct splat_fragment *frag, size_t length,
+			  double rt60, double size, double damping,
+			  double wet);
+};
+
+extern const struct splat_ops splat_sample_ops;
+extern const struct splat_ops splat32_sample_ops;
+
+/* Operations for a given sample width, or for the sample type of a fragment
+ * which defaults to double samples before it has been initialised */
+#define splat_ops_get(_width)						\
+	(((_width) == 32) ? &splat32_sample_ops : &splat_sample_ops)
+#define splat_ops_of(_frag) splat_ops_get((_frag)->sample_width)
 
 #endif /* _SPLAT_H */
@@ -0,0 +1,185 @@
+/*
+    Splat - fft.c
+
+    Copyright (C) 2015
+    Guillaume Tucker <guillaume@mangoz.org>
+
+    This program is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "_splat.h"
+
+/* Real FFT of n samples, done with a complex radix-2 FFT of n/2 points with
+ * the even samples as the real parts and the odd ones as the imaginary parts.
+ * Complex numbers are stored as pairs of doubles (real, imaginary).  */
+
+int splat_fft_init(struct splat_fft *fft, size_t n)
+{
+	const size_t m = n / 2;
+	size_t bits;
+	size_t k;
+
+	fft->n = n;
+	fft->tw = PyMem_Malloc(m * 2 * sizeof(double));
+	fft->rev = PyMem_Malloc(m * sizeof(size_t));
+
+	if ((fft->tw == NULL) || (fft->rev == NULL)) {
+		splat_fft_free(fft);
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	/* e^(-2.pi.i.k/n), also used with even indices for the n/2 FFT */
+	for (k = 0; k < m; ++k) {
+		const double a = -2.0 * M_PI * k / n;
+
+		fft->tw[2 * k] = cos(a);
+		fft->tw[(2 * k) + 1] = sin(a);
+	}
+
+	for (bits = 0; ((size_t)1 << bits) < m; ++bits);
+
+	for (k = 0; k < m; ++k) {
+		size_t r = 0;
+		size_t b;
+
+		for (b = 0; b < bits; ++b)
+			if (k & ((size_t)1 << b))
+				r |= (size_t)1 << (bits - 1 - b);
+
+		fft->rev[k] = r;
+	}
+
+	return 0;
+}
+
+void splat_fft_free(struct splat_fft *fft)
+{
+	PyMem_Free(fft->tw);
+	PyMem_Free(fft->rev);
+	fft->tw = NULL;
+	fft->rev = NULL;
+}
+
+static void splat_fft_complex(const struct splat_fft *fft, double *z,
+			      int inverse)
+{
+	const size_t m = fft->n / 2;
+	const double sign = inverse ? -1.0 : 1.0;
+	size_t len;
+	size_t k;
+
+	for (k = 0; k < m; ++k) {
+		const size_t r = fft->rev[k];
+
+		if (r > k) {
+			const double re = z[2 * k];
+			const double im = z[(2 * k) + 1];
+
+			z[2 * k] = z[2 * r];
+			z[(2 * k) + 1] = z[(2 * r) + 1];
+			z[2 * r] = re;
+			z[(2 * r) + 1] = im;
+		}
+	}
+
+	for (len = 2; len <= m; len <<= 1) {
+		const size_t half = len / 2;
+		const size_t step = fft->n / len;
+		size_t i;
+
+		for (i = 0; i < m; i += len) {
+			double *a = &z[2 * i];
+			double *b = &z[2 * (i + half)];
+			size_t j;
+
+			for (j = 0; j < half; ++j) {
+				const double *w = &fft->tw[2 * j * step];
+				const double wr = w[0];
+				const double wi = sign * w[1];
+				const double tr = (b[0] * wr) - (b[1] * wi);
+				const double ti = (b[0] * wi) + (b[1] * wr);
+
+				b[0] = a[0] - tr;
+				b[1] = a[1] - ti;
+				a[0] += tr;
+				a[1] += ti;
+				a += 2;
+				b += 2;
+			}
+		}
+	}
+}
+
+/* Transform n real samples in place into n/2 + 1 complex bins, so data needs
+ * to have room for n + 2 doubles */
+void splat_fft_forward(const struct splat_fft *fft, double *data)
+{
+	const size_t m = fft->n / 2;
+	size_t k;
+
+	splat_fft_complex(fft, data, 0);
+
+	data[2 * m] = data[0] - data[1];
+	data[(2 * m) + 1] = 0.0;
+	data[0] += data[1];
+	data[1] = 0.0;
+
+	for (k = 1; k <= (m / 2); ++k) {
+		double *zk = &data[2 * k];
+		double *zm = &data[2 * (m - k)];
+		const double *w = &fft->tw[2 * k];
+		const double er = (zk[0] + zm[0]) / 2.0;
+		const double ei = (zk[1] - zm[1]) / 2.0;
+		const double o_r = (zk[1] + zm[1]) / 2.0;
+		const double o_i = (zm[0] - zk[0]) / 2.0;
+		const double wo_r = (w[0] * o_r) - (w[1] * o_i);
+		const double wo_i = (w[0] * o_i) + (w[1] * o_r);
+
+		zk[0] = er + wo_r;
+		zk[1] = ei + wo_i;
+		zm[0] = er - wo_r;
+		zm[1] = wo_i - ei;
+	}
+}
+
+/* Transform n/2 + 1 complex bins in place back into n real samples, scaled by
+ * n/2 as the result is not normalised */
+void splat_fft_inverse(const struct splat_fft *fft, double *data)
+{
+	const size_t m = fft->n / 2;
+	size_t k;
+
+	data[1] = (data[0] - data[2 * m]) / 2.0;
+	data[0] = (data[0] + data[2 * m]) / 2.0;
+
+	for (k = 1; k <= (m / 2); ++k) {
+		double *xk = &data[2 * k];
+		double *xm = &data[2 * (m - k)];
+		const double *w = &fft->tw[2 * k];
+		const double er = (xk[0] + xm[0]) / 2.0;
+		const double ei = (xk[1] - xm[1]) / 2.0;
+		const double dr = (xk[0] - xm[0]) / 2.0;
+		const double di = (xk[1] + xm[1]) / 2.0;
+		const double o_r = (dr * w[0]) + (di * w[1]);
+		const double o_i = (di * w[0]) - (dr * w[1]);
+
+		xk[0] = er - o_i;
+		xk[1] = ei + o_r;
+		xm[0] = er + o_i;
+		xm[1] = o_r - ei;
+	}
+
+	splat_fft_complex(fft, data, 1);
+}
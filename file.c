@@ -0,0 +1,333 @@
+/*
+    Splat - file.c
+
+    Copyright (C) 2015
+    Guillaume Tucker <guillaume@mangoz.org>
+
+    This program is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "_splat.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Fragment data mapped from a file, with a header followed by the samples of
+ * each channel one after the other (planar) in the sample type of the
+ * fragment */
+
+#define SPLAT_FILE_MAGIC "SplatMap"
+#define SPLAT_FILE_FORMAT 1
+
+/* The header takes a whole page so the channels are all page-aligned */
+#define SPLAT_FILE_PAGE 4096
+#define SPLAT_FILE_PAGE_SAMPLES (SPLAT_FILE_PAGE / sizeof(sample_t))
+
+struct splat_file_header {
+	char magic[8];
+	uint32_t format;
+	uint32_t sample_width;
+	uint32_t n_channels;
+	uint32_t rate;
+	uint64_t length;
+	uint64_t capacity;
+};
+
+struct splat_file {
+	int fd;
+	char *map;
+	size_t size;
+	char *path;
+};
+
+#define splat_file_header(_file) ((struct splat_file_header *)(_file)->map)
+
+static size_t splat_file_capacity(size_t length)
+{
+	const size_t pages = (length + SPLAT_FILE_PAGE_SAMPLES - 1) /
+		SPLAT_FILE_PAGE_SAMPLES;
+
+	return max(pages, 1) * SPLAT_FILE_PAGE_SAMPLES;
+}
+
+static size_t splat_file_size(unsigned n_channels, size_t capacity)
+{
+	return SPLAT_FILE_PAGE + (n_channels * capacity * sizeof(sample_t));
+}
+
+static sample_t *splat_file_channel(struct splat_file *file, unsigned c,
+				    size_t capacity)
+{
+	return (sample_t *)(file->map + splat_file_size(c, capacity));
+}
+
+static void splat_file_set_data(struct splat_fragment *frag)
+{
+	unsigned c;
+
+	for (c = 0; c < frag->n_channels; ++c)
+		frag->data[c] = splat_file_channel(frag->file, c,
+						   frag->capacity);
+}
+
+/* Fill a range with zeros, without allocating any disk space if possible */
+static void splat_file_punch(struct splat_file *file, sample_t *start,
+			     sample_t *end)
+{
+	const size_t size = (end - start) * sizeof(sample_t);
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+	const off_t offset = (char *)start - file->map;
+
+	if (!fallocate(file->fd, (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE),
+		       offset, size))
+		return;
+#endif
+
+	memset(start, 0, size);
+}
+
+static int splat_file_read_header(struct splat_fragment *frag,
+				  struct splat_file *file, size_t *capacity)
+{
+	struct splat_file_header h;
+	struct stat st;
+
+	if (pread(file->fd, &h, sizeof(h), 0) != sizeof(h))
+		goto bad_file;
+
+	if (memcmp(h.magic, SPLAT_FILE_MAGIC, sizeof(h.magic)) ||
+	    (h.format > SPLAT_FILE_FORMAT) ||
+	    (h.sample_width != (sizeof(sample_t) * 8)) ||
+	    (h.n_channels > SPLAT_MAX_CHANNELS) || !h.rate ||
+	    (h.length > h.capacity))
+		goto bad_file;
+
+	if (fstat(file->fd, &st) ||
+	    (st.st_size < splat_file_size(h.n_channels, h.capacity)))
+		goto bad_file;
+
+	frag->n_channels = h.n_channels;
+	frag->rate = h.rate;
+	frag->length = h.length;
+	*capacity = h.capacity;
+
+	return 0;
+
+bad_file:
+	PyErr_Format(PyExc_ValueError, "invalid fragment file: %s",
+		     file->path);
+
+	return -1;
+}
+
+/* Get the sample width of an existing file, before it gets reopened with the
+ * matching sample type */
+int splat_file_sample_width(const char *path, unsigned *width)
+{
+	struct splat_file_header h;
+	int fd;
+	int res;
+
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *)path);
+		return -1;
+	}
+
+	res = ((pread(fd, &h, sizeof(h), 0) == sizeof(h)) &&
+	       !memcmp(h.magic, SPLAT_FILE_MAGIC, sizeof(h.magic)) &&
+	       ((h.sample_width == 32) || (h.sample_width == 64))) ? 0 : -1;
+	close(fd);
+
+	if (res) {
+		PyErr_Format(PyExc_ValueError, "invalid fragment file: %s",
+			     path);
+		return -1;
+	}
+
+	*width = h.sample_width;
+
+	return 0;
+}
+
+int splat_file_init(struct splat_fragment *frag, unsigned n_channels,
+		    unsigned rate, size_t length, const char *name,
+		    const char *path, int reopen)
+{
+	struct splat_file *file;
+	size_t capacity;
+
+	if (splat_frag_init(frag, n_channels, rate, 0, name))
+		return -1;
+
+	file = PyMem_Malloc(sizeof(struct splat_file));
+
+	if (file == NULL) {
+		PyErr_NoMemory();
+		goto free_frag;
+	}
+
+	file->map = MAP_FAILED;
+	file->path = strdup(path);
+	file->fd = open(path, (reopen ? O_RDWR : (O_RDWR | O_CREAT | O_TRUNC)),
+			0666);
+	frag->file = file;
+
+	if ((file->path == NULL) || (file->fd < 0))
+		goto error;
+
+	if (reopen) {
+		if (splat_file_read_header(frag, file, &capacity))
+			goto free_frag;
+	} else {
+		frag->length = length;
+		capacity = splat_file_capacity(length);
+	}
+
+	if (splat_frag_reserve_blocks(frag, capacity))
+		goto free_frag;
+
+	frag->capacity = capacity;
+	file->size = splat_file_size(frag->n_channels, capacity);
+
+	if (!reopen && ftruncate(file->fd, file->size))
+		goto error;
+
+	file->map = mmap(NULL, file->size, (PROT_READ | PROT_WRITE),
+			 MAP_SHARED, file->fd, 0);
+
+	if (file->map == MAP_FAILED)
+		goto error;
+
+	if (!reopen) {
+		struct splat_file_header *h = splat_file_header(file);
+
+		memcpy(h->magic, SPLAT_FILE_MAGIC, sizeof(h->magic));
+		h->format = SPLAT_FILE_FORMAT;
+		h->sample_width = sizeof(sample_t) * 8;
+		h->n_channels = frag->n_channels;
+		h->rate = frag->rate;
+		h->length = frag->length;
+		h->capacity = frag->capacity;
+	}
+
+	splat_file_set_data(frag);
+
+	/* Any samples may have been written before the file was reopened */
+	if (reopen)
+		splat_frag_touch_all(frag);
+
+	return 0;
+
+error:
+	PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *)path);
+free_frag:
+	splat_frag_free(frag);
+
+	return -1;
+}
+
+void splat_file_close(struct splat_file *file)
+{
+	if (file->map != MAP_FAILED)
+		munmap(file->map, file->size);
+
+	if (file->fd >= 0)
+		close(file->fd);
+
+	free(file->path);
+	PyMem_Free(file);
+}
+
+const char *splat_file_path(const struct splat_file *file)
+{
+	return file->path;
+}
+
+int splat_file_reserve(struct splat_fragment *frag, size_t capacity)
+{
+	struct splat_file *file = frag->file;
+	const size_t old_capacity = frag->capacity;
+	size_t size;
+	char *map;
+	unsigned c;
+
+	capacity = splat_file_capacity(capacity);
+	size = splat_file_size(frag->n_channels, capacity);
+
+	if (splat_frag_reserve_blocks(frag, capacity))
+		return -1;
+
+	if (ftruncate(file->fd, size))
+		goto error;
+
+#ifdef MREMAP_MAYMOVE
+	map = mremap(file->map, file->size, size, MREMAP_MAYMOVE);
+#else
+	map = mmap(NULL, size, (PROT_READ | PROT_WRITE), MAP_SHARED,
+		   file->fd, 0);
+
+	if (map != MAP_FAILED)
+		munmap(file->map, file->size);
+#endif
+
+	if (map == MAP_FAILED)
+		goto error;
+
+	file->map = map;
+	file->size = size;
+
+	/* Move the channels to their new place starting with the last one so
+	 * the data which hasn't been moved yet never gets overwritten, then
+	 * clear what is left of the old data */
+	for (c = frag->n_channels; c-- > 1; ) {
+		sample_t *from = splat_file_channel(file, c, old_capacity);
+		sample_t *to = splat_file_channel(file, c, capacity);
+
+		memmove(to, from, (frag->length * sizeof(sample_t)));
+		splat_file_punch(file, from, min((from + frag->length), to));
+	}
+
+	frag->capacity = capacity;
+	splat_file_header(file)->capacity = capacity;
+	splat_file_set_data(frag);
+
+	return 0;
+
+error:
+	PyErr_SetFromErrnoWithFilename(PyExc_IOError, file->path);
+
+	return -1;
+}
+
+void splat_file_zero(struct splat_fragment *frag, unsigned c, size_t start,
+		     size_t end)
+{
+	splat_file_punch(frag->file, &frag->data[c][start],
+			 &frag->data[c][end]);
+}
+
+void splat_file_set_length(struct splat_fragment *frag)
+{
+	splat_file_header(frag->file)->length = frag->length;
+}
+
+void splat_file_set_rate(struct splat_fragment *frag)
+{
+	splat_file_header(frag->file)->rate = frag->rate;
+}
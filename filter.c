@@ -20,59 +20,1404 @@
 
 #include "_splat.h"
 
-void splat_filter_dec_envelope(struct splat_fragment *frag, double k, double p)
+void splat_filter_dec_envelope(struct splat_fragment *frag,
+			       const struct splat_dec_envelope *dec,
+			       size_t start, size_t end)
 {
-	unsigned c;
+	double m[SPLAT_VECTOR_LEN];
+	size_t i;
 
-	for (c = 0; c < frag->n_channels; ++c) {
-		size_t i;
+	/* The same divisors apply to all the channels and silence stays
+	 * silent, so compute them once for each block of samples in use */
+	for (i = start; i < end; i += SPLAT_VECTOR_LEN) {
+		const size_t len = min(SPLAT_VECTOR_LEN, (end - i));
+		unsigned c;
+		size_t j;
+
+		if (!splat_frag_block_used(frag, i))
+			continue;
+
+		for (j = 0; j < len; ++j)
+			m[j] = pow(1.0 + ((double)(i + j) / dec->k), dec->p);
+
+		for (c = 0; c < frag->n_channels; ++c) {
+			sample_t *data = &frag->data[c][i];
+
+			for (j = 0; j < len; ++j)
+				data[j] /= m[j];
+		}
+	}
+}
+
+/* First point after a given sample position */
+static size_t splat_envelope_seg(const struct splat_envelope *env, size_t i)
+{
+	size_t lo = 0;
+	size_t hi = env->n_points;
+
+	while (lo < hi) {
+		const size_t mid = (lo + hi) / 2;
+
+		if (env->points[mid].pos <= i)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Fill gains with the envelope values for the samples from start to end, seg
+ * being the first point after the last sample processed before */
+static void splat_envelope_fill(double *gains,
+				const struct splat_envelope *env, size_t *seg,
+				size_t start, size_t end)
+{
+	const struct splat_envelope_point *points = env->points;
+	const size_t n_points = env->n_points;
+	size_t i = start;
+
+	while (i < end) {
+		const struct splat_envelope_point *a;
+		const struct splat_envelope_point *b;
+		size_t stop;
+
+		while ((*seg < n_points) && (points[*seg].pos <= i))
+			++(*seg);
+
+		if ((*seg == n_points) || (points[*seg].pos >= end))
+			stop = end;
+		else
+			stop = ceil(points[*seg].pos);
+
+		/* Hold the first or last gain outside of the points */
+		if (!*seg || (*seg == n_points)) {
+			const double gain = *seg ?
+				points[n_points - 1].gain : points[0].gain;
+
+			for (; i < stop; ++i)
+				gains[i - start] = gain;
+
+			continue;
+		}
+
+		a = &points[*seg - 1];
+		b = &points[*seg];
+
+		if (env->exp) {
+			/* Geometric progression, anchored again for each
+			 * vector so rounding errors don't accumulate */
+			const double r = pow((b->gain / a->gain),
+					     (1.0 / (b->pos - a->pos)));
+			double g = a->gain * pow(r, (i - a->pos));
+
+			for (; i < stop; ++i, g *= r)
+				gains[i - start] = g;
+		} else {
+			const double k =
+				(b->gain - a->gain) / (b->pos - a->pos);
+
+			for (; i < stop; ++i)
+				gains[i - start] = a->gain + ((i - a->pos) * k);
+		}
+	}
+}
+
+void splat_filter_envelope(struct splat_fragment *frag,
+			   const struct splat_envelope *env, size_t start,
+			   size_t end)
+{
+	double gains[SPLAT_VECTOR_LEN];
+	size_t seg = splat_envelope_seg(env, start);
+	size_t i;
+
+	for (i = start; i < end; i += SPLAT_VECTOR_LEN) {
+		const size_t len = min(SPLAT_VECTOR_LEN, (end - i));
+		unsigned c;
+
+		if (!splat_frag_block_used(frag, i))
+			continue;
+
+		splat_envelope_fill(gains, env, &seg, i, (i + len));
+
+		for (c = 0; c < frag->n_channels; ++c)
+			splat_kernels.amp_vec(&frag->data[c][i], gains, len);
+	}
+}
+
+/* Number of samples processed by each filter in a chain before moving on to
+ * the next one, small enough for all the channels to stay in the L2 cache */
+#define SPLAT_FILTER_TILE (4 * SPLAT_FRAG_BLOCK)
+
+struct splat_chain_job {
+	struct splat_fragment *frag;
+	const struct splat_block_filter *filters;
+	size_t n_filters;
+	size_t span;
+};
+
+static void splat_filter_chain_job(void *arg, size_t j)
+{
+	const struct splat_chain_job *job = arg;
+	struct splat_fragment *frag = job->frag;
+	const size_t start = j * job->span;
+	const size_t stop = min((start + job->span), frag->length);
+	size_t i;
+
+	for (i = start; i < stop; i += SPLAT_FILTER_TILE) {
+		const size_t end = min((i + SPLAT_FILTER_TILE), stop);
+		size_t f;
 
-		for (i = 0; i < frag->length; ++i) {
-			const double m = pow(1.0 + ((double)i / k), p);
-			frag->data[c][i] /= m;
+		for (f = 0; f < job->n_filters; ++f) {
+			const struct splat_block_filter *filter =
+				&job->filters[f];
+
+			switch (filter->id) {
+			case SPLAT_BLOCK_FILTER_DEC_ENVELOPE:
+				splat_filter_dec_envelope(
+					frag, &filter->u.dec_envelope, i, end);
+				break;
+			case SPLAT_BLOCK_FILTER_ENVELOPE:
+				splat_filter_envelope(
+					frag, &filter->u.envelope, i, end);
+				break;
+			}
 		}
 	}
 }
 
+/* Block filters only depend on the sample positions, so the tiles are split
+ * evenly between the threads */
+void splat_filter_chain(struct splat_fragment *frag,
+			const struct splat_block_filter *filters,
+			size_t n_filters)
+{
+	const size_t n_tiles =
+		(frag->length + SPLAT_FILTER_TILE - 1) / SPLAT_FILTER_TILE;
+	const size_t threads = splat_pool_get_threads();
+	struct splat_chain_job job;
+
+	job.frag = frag;
+	job.filters = filters;
+	job.n_filters = n_filters;
+	job.span = ((n_tiles + threads - 1) / threads) * SPLAT_FILTER_TILE;
+	splat_frag_dirty_all(frag);
+
+	if (job.span)
+		splat_pool_run(splat_filter_chain_job, &job,
+			       ((frag->length + job.span - 1) / job.span));
+}
+
+static void splat_filter_reverse_job(void *arg, size_t c)
+{
+	struct splat_fragment *frag = arg;
+	sample_t *data = frag->data[c];
+	size_t i;
+	size_t j;
+
+	for (i = 0, j = (frag->length - 1); i < j; ++i, --j) {
+		const sample_t s = data[i];
+
+		data[i] = data[j];
+		data[j] = s;
+	}
+}
+
 void splat_filter_reverse(struct splat_fragment *frag)
 {
-	unsigned c;
+	splat_frag_touch_all(frag);
 
-	for (c = 0; c < frag->n_channels; ++c) {
+	if (frag->length)
+		splat_pool_run(splat_filter_reverse_job, frag,
+			       frag->n_channels);
+}
+
+/* Jobs running in parallel on separate channels keep their own map of the
+ * blocks they write to, as the fragment one is shared by all the channels.
+ * They get merged into it once all the jobs are done.  */
+static unsigned char *splat_touch_map_new(const struct splat_fragment *frag,
+					  size_t n_maps)
+{
+	const size_t n_blocks = splat_frag_n_blocks(frag->length);
+	unsigned char *maps = PyMem_Malloc(n_maps * n_blocks);
+
+	if (maps == NULL)
+		PyErr_NoMemory();
+	else
+		memset(maps, 0, (n_maps * n_blocks));
+
+	return maps;
+}
+
+static void splat_touch_map(unsigned char *map,
+			    const struct splat_fragment *frag, size_t start,
+			    size_t length)
+{
+	const size_t end = min((start + length), frag->length);
+	size_t i;
+
+	for (i = start; i < end; i += SPLAT_FRAG_BLOCK)
+		map[i >> SPLAT_FRAG_BLOCK_BITS] = 1;
+}
+
+static void splat_touch_map_merge(struct splat_fragment *frag,
+				  unsigned char *maps, size_t n_maps)
+{
+	const size_t n_blocks = splat_frag_n_blocks(frag->length);
+	size_t m;
+	size_t b;
+
+	for (m = 0; m < n_maps; ++m, maps += n_blocks)
+		for (b = 0; b < n_blocks; ++b)
+			if (maps[b])
+				frag->blocks[b] = SPLAT_FRAG_BLOCK_USED;
+}
+
+/* Impulse responses are split into partitions of this many samples, each one
+ * being convolved with the input using a real FFT of twice this size */
+#define SPLAT_CONV_MIN_BLOCK SPLAT_FRAG_BLOCK
+#define SPLAT_CONV_MAX_BLOCK (16 * SPLAT_FRAG_BLOCK)
+
+struct splat_conv {
+	struct splat_fft fft;
+	size_t block;
+	size_t n_parts;
+	size_t bins; /* number of doubles in each spectrum */
+	double *ir;
+	double *in;
+	int *in_used;
+	double *acc;
+	double *tail;
+	unsigned char *touched; /* map of the output blocks */
+};
+
+static void splat_conv_free(struct splat_conv *conv)
+{
+	splat_fft_free(&conv->fft);
+	PyMem_Free(conv->ir);
+	PyMem_Free(conv->in);
+	PyMem_Free(conv->in_used);
+	PyMem_Free(conv->acc);
+	PyMem_Free(conv->tail);
+}
+
+static int splat_conv_init(struct splat_conv *conv, size_t ir_length)
+{
+	size_t block = SPLAT_CONV_MIN_BLOCK;
+
+	while ((block < ir_length) && (block < SPLAT_CONV_MAX_BLOCK))
+		block *= 2;
+
+	conv->block = block;
+	conv->n_parts = (ir_length + block - 1) / block;
+	conv->bins = (2 * block) + 2;
+	conv->ir = PyMem_Malloc(conv->n_parts * conv->bins * sizeof(double));
+	conv->in = PyMem_Malloc(conv->n_parts * conv->bins * sizeof(double));
+	conv->in_used = PyMem_Malloc(conv->n_parts * sizeof(int));
+	conv->acc = PyMem_Malloc(conv->bins * sizeof(double));
+	conv->tail = PyMem_Malloc(block * sizeof(double));
+
+	if (splat_fft_init(&conv->fft, (2 * block)))
+		goto error;
+
+	if ((conv->ir == NULL) || (conv->in == NULL) ||
+	    (conv->in_used == NULL) || (conv->acc == NULL) ||
+	    (conv->tail == NULL)) {
+		PyErr_NoMemory();
+		goto error;
+	}
+
+	return 0;
+
+error:
+	splat_conv_free(conv);
+
+	return -1;
+}
+
+/* Compute the spectrum of each partition of the impulse response, scaled to
+ * compensate for the inverse FFT not being normalised */
+static void splat_conv_set_ir(struct splat_conv *conv, const double *ir,
+			      size_t ir_length)
+{
+	const double scale = 1.0 / conv->block;
+	size_t k;
+
+	for (k = 0; k < conv->n_parts; ++k) {
+		double *h = &conv->ir[k * conv->bins];
+		const size_t start = k * conv->block;
+		const size_t n = min(conv->block, (ir_length - start));
 		size_t i;
-		size_t j;
 
-		for (i = 0, j = (frag->length - 1); i < j; ++i, --j) {
-			const double s = frag->data[c][i];
+		for (i = 0; i < n; ++i)
+			h[i] = ir[start + i] * scale;
+
+		memset(&h[n], 0, (conv->bins - n) * sizeof(double));
+		splat_fft_forward(&conv->fft, h);
+	}
+}
+
+static int splat_frag_range_used(const struct splat_fragment *frag,
+				 size_t start, size_t end)
+{
+	size_t i;
+
+	for (i = start; i < end; i += SPLAT_FRAG_BLOCK)
+		if (splat_frag_block_used(frag, i))
+			return 1;
+
+	return 0;
+}
+
+/* Uniformly partitioned overlap-add convolution of the first length samples
+ * of a channel, the result replacing them in place.  Each output block only
+ * depends on the input blocks up to the same position, so the input can be
+ * read just before being overwritten.  */
+static void splat_conv_run(struct splat_conv *conv,
+			   struct splat_fragment *frag, unsigned c,
+			   size_t length, size_t ir_length)
+{
+	sample_t *data = frag->data[c];
+	const size_t out_length = length + ir_length - 1;
+	const size_t B = conv->block;
+	const size_t K = conv->n_parts;
+	int tail_used = 0;
+	size_t j;
+
+	memset(conv->tail, 0, (B * sizeof(double)));
+
+	for (j = 0; (j * B) < out_length; ++j) {
+		const size_t start = j * B;
+		const size_t out_n = min(B, (out_length - start));
+		const size_t slot = j % K;
+		double *x = &conv->in[slot * conv->bins];
+		double *y = conv->acc;
+		int acc_used = 0;
+		size_t k;
+		size_t i;
+
+		conv->in_used[slot] = (start < length) &&
+			splat_frag_range_used(frag, start,
+					      min((start + B), length));
+
+		if (conv->in_used[slot]) {
+			const size_t n = min(B, (length - start));
+
+			for (i = 0; i < n; ++i)
+				x[i] = data[start + i];
+
+			memset(&x[n], 0, (conv->bins - n) * sizeof(double));
+			splat_fft_forward(&conv->fft, x);
+		}
+
+		memset(y, 0, (conv->bins * sizeof(double)));
+
+		for (k = 0; (k < K) && (k <= j); ++k) {
+			const size_t in_slot = (j - k) % K;
+			const double *xk = &conv->in[in_slot * conv->bins];
+			const double *h = &conv->ir[k * conv->bins];
+
+			if (!conv->in_used[in_slot])
+				continue;
+
+			for (i = 0; i < conv->bins; i += 2) {
+				y[i] += (xk[i] * h[i]) - (xk[i + 1] * h[i + 1]);
+				y[i + 1] += (xk[i] * h[i + 1]) +
+					(xk[i + 1] * h[i]);
+			}
+
+			acc_used = 1;
+		}
+
+		if (acc_used) {
+			splat_fft_inverse(&conv->fft, y);
+
+			for (i = 0; i < out_n; ++i)
+				data[start + i] = y[i] + conv->tail[i];
+
+			memcpy(conv->tail, &y[B], (B * sizeof(double)));
+			splat_touch_map(conv->touched, frag, start, B);
+		} else if (tail_used) {
+			for (i = 0; i < out_n; ++i)
+				data[start + i] = conv->tail[i];
+
+			memset(conv->tail, 0, (B * sizeof(double)));
+			splat_touch_map(conv->touched, frag, start, B);
+		}
+
+		tail_used = acc_used;
+	}
+}
+
+struct splat_convolve_job {
+	struct splat_conv conv[SPLAT_MAX_CHANNELS];
+	unsigned n_convs;
+	struct splat_fragment *frag;
+	size_t length;
+	const double **irs;
+	size_t ir_length;
+};
+
+static void splat_filter_convolve_job(void *arg, size_t j)
+{
+	struct splat_convolve_job *job = arg;
+	struct splat_conv *conv = &job->conv[j];
+	const double *ir = NULL;
+	unsigned c;
+
+	for (c = j; c < job->frag->n_channels; c += job->n_convs) {
+		if (job->irs[c] != ir) {
+			ir = job->irs[c];
+			splat_conv_set_ir(conv, ir, job->ir_length);
+		}
+
+		splat_conv_run(conv, job->frag, c, job->length,
+			       job->ir_length);
+	}
+}
+
+/* Each thread has its own convolution state and takes every n-th channel */
+int splat_filter_convolve(struct splat_fragment *frag, size_t length,
+			  const double **irs, size_t ir_length)
+{
+	const size_t n_blocks = splat_frag_n_blocks(frag->length);
+	struct splat_convolve_job job;
+	unsigned char *maps;
+	unsigned j;
+	int res = -1;
+
+	job.n_convs = min(frag->n_channels, splat_pool_get_threads());
+	job.frag = frag;
+	job.length = length;
+	job.irs = irs;
+	job.ir_length = ir_length;
+
+	maps = splat_touch_map_new(frag, job.n_convs);
+
+	if (maps == NULL)
+		return -1;
+
+	for (j = 0; j < job.n_convs; ++j) {
+		if (splat_conv_init(&job.conv[j], ir_length))
+			goto free_convs;
 
-			frag->data[c][i] = frag->data[c][j];
-			frag->data[c][j] = s;
+		job.conv[j].touched = &maps[j * n_blocks];
+	}
+
+	splat_pool_run(splat_filter_convolve_job, &job, job.n_convs);
+	splat_touch_map_merge(frag, maps, job.n_convs);
+	res = 0;
+
+free_convs:
+	while (j--)
+		splat_conv_free(&job.conv[j]);
+
+	PyMem_Free(maps);
+
+	return res;
+}
+
+/* With fewer delays than this, it's faster to add each delayed sample than
+ * to run an FFT convolution */
+#define SPLAT_REVERB_FFT_DELAYS 32
+
+/* Sort the delays by time, keeping the original order of equal ones so the
+ * samples are added up in the same order as when going through the input */
+static void splat_reverb_sort(struct splat_delay *delays, size_t n_delays)
+{
+	size_t d;
+
+	for (d = 1; d < n_delays; ++d) {
+		const struct splat_delay delay = delays[d];
+		size_t i = d;
+
+		for (; i && (delays[i - 1].time > delay.time); --i)
+			delays[i] = delays[i - 1];
+
+		delays[i] = delay;
+	}
+}
+
+struct splat_taps_job {
+	struct splat_fragment *frag;
+	struct splat_delay **delays;
+	size_t n_delays;
+	size_t length;
+	size_t end;
+	sample_t *tiles;
+	unsigned char *maps;
+};
+
+/* Each output tile gets all the delayed input samples with one contiguous
+ * mix per delay.  Tiles are done from the end as they only depend on the
+ * input up to their own position, and the input of each tile is kept aside
+ * before it gets overwritten by delays shorter than a tile.  */
+static void splat_filter_reverb_taps_job(void *arg, size_t c)
+{
+	static const size_t T = SPLAT_FRAG_BLOCK;
+	const struct splat_taps_job *job = arg;
+	struct splat_fragment *frag = job->frag;
+	struct splat_delay *delays = job->delays[c];
+	const size_t length = job->length;
+	const size_t end = job->end;
+	sample_t *tile = &job->tiles[c * T];
+	unsigned char *map = &job->maps[c * splat_frag_n_blocks(frag->length)];
+	sample_t *c_data = frag->data[c];
+	size_t o;
+	size_t d;
+
+	splat_reverb_sort(delays, job->n_delays);
+
+	for (o = (end + T - 1) & ~(T - 1); o; ) {
+		size_t tile_end;
+		int used = 0;
+
+		o -= T;
+		tile_end = min((o + T), end);
+
+		if (o < length)
+			memcpy(tile, &c_data[o],
+			       (min(tile_end, length) - o) * sizeof(sample_t));
+
+		for (d = 0; d < job->n_delays; ++d) {
+			const size_t t = delays[d].time;
+			const double gain = delays[d].gain;
+			size_t i = (o > t) ? (o - t) : 0;
+			size_t i_end;
+
+			if (tile_end <= t)
+				continue;
+
+			i_end = min((tile_end - t), length);
+
+			/* Split the input on block boundaries to skip the
+			 * silent ones */
+			while (i < i_end) {
+				const size_t n =
+					min(i_end, ((i | (T - 1)) + 1)) - i;
+
+				if (splat_frag_block_used(frag, i)) {
+					const sample_t *in = (i >= o) ?
+						&tile[i - o] : &c_data[i];
+
+					splat_kernels.mix(&c_data[i + t], in, n,
+							  gain);
+					used = 1;
+				}
+
+				i += n;
+			}
 		}
+
+		if (used)
+			splat_touch_map(map, frag, o, (tile_end - o));
 	}
 }
 
-void splat_filter_reverb(struct splat_fragment *frag,
-			 struct splat_delay **delays, size_t n_delays,
-			 size_t max_index)
+/* The channels are independent, each one is a separate job */
+static int splat_filter_reverb_taps(struct splat_fragment *frag,
+				    struct splat_delay **delays,
+				    size_t n_delays, size_t length)
 {
+	struct splat_taps_job job;
+	size_t max_time = 0;
+	unsigned c;
 	size_t d;
+
+	for (c = 0; c < frag->n_channels; ++c)
+		for (d = 0; d < n_delays; ++d)
+			max_time = max(max_time, delays[c][d].time);
+
+	job.frag = frag;
+	job.delays = delays;
+	job.n_delays = n_delays;
+	job.length = length;
+	job.end = min(frag->length, (length + max_time));
+	job.tiles = PyMem_Malloc(frag->n_channels * SPLAT_FRAG_BLOCK *
+				 sizeof(sample_t));
+
+	if (job.tiles == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	job.maps = splat_touch_map_new(frag, frag->n_channels);
+
+	if (job.maps == NULL) {
+		PyMem_Free(job.tiles);
+		return -1;
+	}
+
+	splat_pool_run(splat_filter_reverb_taps_job, &job, frag->n_channels);
+	splat_touch_map_merge(frag, job.maps, frag->n_channels);
+	PyMem_Free(job.tiles);
+	PyMem_Free(job.maps);
+
+	return 0;
+}
+
+/* The reverb is the convolution with an impulse response made of the dry
+ * signal and all the delays */
+static int splat_filter_reverb_fft(struct splat_fragment *frag,
+				   struct splat_delay **delays,
+				   size_t n_delays, size_t length)
+{
+	double *irs[SPLAT_MAX_CHANNELS];
+	size_t ir_length = 1;
 	unsigned c;
+	size_t d;
+	int res = -1;
+
+	for (c = 0; c < frag->n_channels; ++c)
+		for (d = 0; d < n_delays; ++d)
+			ir_length = max(ir_length, (delays[c][d].time + 1));
+
+	for (c = 0; c < frag->n_channels; ++c) {
+		irs[c] = PyMem_Malloc(ir_length * sizeof(double));
+
+		if (irs[c] == NULL) {
+			PyErr_NoMemory();
+			goto free_irs;
+		}
+
+		memset(irs[c], 0, (ir_length * sizeof(double)));
+		irs[c][0] = 1.0;
+
+		for (d = 0; d < n_delays; ++d)
+			irs[c][delays[c][d].time] += delays[c][d].gain;
+	}
+
+	res = splat_filter_convolve(frag, length, (const double **)irs,
+				    ir_length);
+
+free_irs:
+	while (c--)
+		PyMem_Free(irs[c]);
+
+	return res;
+}
+
+int splat_filter_reverb(struct splat_fragment *frag,
+			struct splat_delay **delays, size_t n_delays,
+			size_t length)
+{
+	if (n_delays >= SPLAT_REVERB_FFT_DELAYS)
+		return splat_filter_reverb_fft(frag, delays, n_delays, length);
+
+	return splat_filter_reverb_taps(frag, delays, n_delays, length);
+}
+
+/* ----------------------------------------------------------------------------
+ * Feedback delay network reverb
+ */
+
+#define SPLAT_FDN_LINES 8
+
+/* Once all the delay lines have stayed below this level for as long as the
+ * longest one, the network is silent until there is some input again */
+#define SPLAT_FDN_SILENCE 1e-10
+
+/* Delay line lengths in milliseconds for a size of 1.0, with no simple ratios
+ * between them so the echoes don't coincide */
+static const double splat_fdn_times[SPLAT_FDN_LINES] = {
+	29.7, 37.1, 41.1, 43.7, 53.3, 59.9, 67.7, 73.1,
+};
+
+struct splat_fdn {
+	double *lines[SPLAT_FDN_LINES];
+	size_t len[SPLAT_FDN_LINES];
+	size_t pos[SPLAT_FDN_LINES];
+	double gain[SPLAT_FDN_LINES];
+	double lp[SPLAT_FDN_LINES];
+	double out[SPLAT_MAX_CHANNELS][SPLAT_FDN_LINES];
+	double damping;
+	size_t max_len;
+	size_t quiet;
+};
+
+/* Orthogonal feedback matrix, as a normalised 8x8 Hadamard transform */
+static void splat_fdn_mix(double *v)
+{
+	static const double norm = 0.35355339059327373; /* 1 / sqrt(8) */
+	const double a0 = v[0] + v[1];
+	const double a1 = v[0] - v[1];
+	const double a2 = v[2] + v[3];
+	const double a3 = v[2] - v[3];
+	const double a4 = v[4] + v[5];
+	const double a5 = v[4] - v[5];
+	const double a6 = v[6] + v[7];
+	const double a7 = v[6] - v[7];
+	const double b0 = a0 + a2;
+	const double b1 = a1 + a3;
+	const double b2 = a0 - a2;
+	const double b3 = a1 - a3;
+	const double b4 = a4 + a6;
+	const double b5 = a5 + a7;
+	const double b6 = a4 - a6;
+	const double b7 = a5 - a7;
+
+	v[0] = (b0 + b4) * norm;
+	v[1] = (b1 + b5) * norm;
+	v[2] = (b2 + b6) * norm;
+	v[3] = (b3 + b7) * norm;
+	v[4] = (b0 - b4) * norm;
+	v[5] = (b1 - b5) * norm;
+	v[6] = (b2 - b6) * norm;
+	v[7] = (b3 - b7) * norm;
+}
+
+static void splat_fdn_run(struct splat_fdn *fdn, struct splat_fragment *frag,
+			  size_t start, size_t end, size_t in_end)
+{
+	const double in_gain = 1.0 / frag->n_channels;
 	size_t i;
+	size_t k;
+	unsigned c;
+
+	for (i = start; i < end; ++i) {
+		double y[SPLAT_FDN_LINES];
+		double v[SPLAT_FDN_LINES];
+		double x = 0.0;
+		double peak = 0.0;
+
+		if (i < in_end) {
+			for (c = 0; c < frag->n_channels; ++c)
+				x += frag->data[c][i];
+
+			x *= in_gain;
+		}
+
+		for (k = 0; k < SPLAT_FDN_LINES; ++k)
+			y[k] = v[k] = fdn->lines[k][fdn->pos[k]];
+
+		splat_fdn_mix(v);
+
+		for (k = 0; k < SPLAT_FDN_LINES; ++k) {
+			double w;
+
+			fdn->lp[k] = v[k] +
+				(fdn->damping * (fdn->lp[k] - v[k]));
+			w = x + (fdn->gain[k] * fdn->lp[k]);
+			fdn->lines[k][fdn->pos[k]] = w;
+
+			if (++fdn->pos[k] == fdn->len[k])
+				fdn->pos[k] = 0;
+
+			peak = max(peak, fabs(w));
+		}
+
+		for (c = 0; c < frag->n_channels; ++c) {
+			const double *out = fdn->out[c];
+			double s = 0.0;
+
+			for (k = 0; k < SPLAT_FDN_LINES; ++k)
+				s += out[k] * y[k];
+
+			frag->data[c][i] += s;
+		}
+
+		fdn->quiet = (peak < SPLAT_FDN_SILENCE) ? (fdn->quiet + 1) : 0;
+	}
+}
+
+/* The mono sum of the first length samples goes into all the delay lines,
+ * and each channel gets a different combination of their outputs, given by a
+ * row of the Hadamard matrix, so the tail is decorrelated between channels.
+ * Each line has a gain for its length to decay by 60dB in rt60 seconds and a
+ * low-pass filter set by the damping factor.  The cost per sample doesn't
+ * depend on the length of the tail, and the silent blocks are skipped once
+ * the tail has faded away.  */
+int splat_filter_fdn(struct splat_fragment *frag, size_t length, double rt60,
+		     double size, double damping, double wet)
+{
+	const double out_gain = wet / sqrt(SPLAT_FDN_LINES);
+	struct splat_fdn fdn;
+	double *buffer;
+	size_t total = 0;
+	size_t start;
+	size_t k;
+	unsigned c;
+	int idle = 1;
+
+	fdn.max_len = 0;
+
+	for (k = 0; k < SPLAT_FDN_LINES; ++k) {
+		const size_t len =
+			splat_fdn_times[k] * size * frag->rate / 1000;
+
+		fdn.len[k] = max(len, 1);
+		fdn.pos[k] = 0;
+		fdn.gain[k] = pow(10.0, (-3.0 * fdn.len[k] /
+					 (rt60 * frag->rate)));
+		fdn.lp[k] = 0.0;
+		fdn.max_len = max(fdn.max_len, fdn.len[k]);
+		total += fdn.len[k];
+	}
 
 	for (c = 0; c < frag->n_channels; ++c) {
-		const struct splat_delay *c_delay = delays[c];
-		sample_t *c_data = frag->data[c];
+		const unsigned row = (c % (SPLAT_FDN_LINES - 1)) + 1;
+
+		for (k = 0; k < SPLAT_FDN_LINES; ++k) {
+			unsigned bits = row & k;
+			double gain = out_gain;
+
+			for (; bits; bits &= bits - 1)
+				gain = -gain;
+
+			fdn.out[c][k] = gain;
+		}
+	}
+
+	fdn.damping = damping;
+	fdn.quiet = 0;
+
+	buffer = PyMem_Malloc(total * sizeof(double));
+
+	if (buffer == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	memset(buffer, 0, (total * sizeof(double)));
+
+	for (k = 0; k < SPLAT_FDN_LINES; ++k) {
+		fdn.lines[k] = buffer;
+		buffer += fdn.len[k];
+	}
+
+	for (start = 0; start < frag->length; start += SPLAT_FRAG_BLOCK) {
+		const size_t end = min((start + SPLAT_FRAG_BLOCK),
+				       frag->length);
+		const int input = (start < length) &&
+			splat_frag_block_used(frag, start);
+
+		if (!input && idle)
+			continue;
+
+		splat_fdn_run(&fdn, frag, start, end,
+			      (input ? min(end, length) : start));
+		splat_frag_touch(frag, start, (end - start));
+
+		idle = (fdn.quiet >= fdn.max_len);
+
+		if (idle) {
+			memset(fdn.lines[0], 0, (total * sizeof(double)));
+			memset(fdn.lp, 0, sizeof(fdn.lp));
+		}
+	}
+
+	PyMem_Free(fdn.lines[0]);
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * Biquad filters
+ */
+
+/* Below this level, the state of a filter with no input is reset to zero so
+ * the following silent blocks can be skipped */
+#define SPLAT_BIQUAD_SILENCE 1e-10
+
+/* Designs from the Audio EQ Cookbook by Robert Bristow-Johnson, with the
+ * gain in dB only used by the peak and shelf filters */
+void splat_biquad_design(struct splat_biquad_coefs *k,
+			 enum splat_biquad_type type, double freq, double q,
+			 double gain, unsigned rate)
+{
+	const double w0 = 2.0 * M_PI * freq / rate;
+	const double cw = cos(w0);
+	const double alpha = sin(w0) / (2.0 * q);
+	const double A = pow(10.0, (gain / 40.0));
+	const double sq = 2.0 * sqrt(A) * alpha;
+	double b0 = 1.0;
+	double b1 = 0.0;
+	double b2 = 0.0;
+	double a0 = 1.0 + alpha;
+	double a1 = -2.0 * cw;
+	double a2 = 1.0 - alpha;
+
+	switch (type) {
+	case SPLAT_BIQUAD_COEFS:
+		return;
+	case SPLAT_BIQUAD_LOWPASS:
+		b0 = (1.0 - cw) / 2.0;
+		b1 = 1.0 - cw;
+		b2 = b0;
+		break;
+	case SPLAT_BIQUAD_HIGHPASS:
+		b0 = (1.0 + cw) / 2.0;
+		b1 = -(1.0 + cw);
+		b2 = b0;
+		break;
+	case SPLAT_BIQUAD_BANDPASS:
+		b0 = alpha;
+		b1 = 0.0;
+		b2 = -alpha;
+		break;
+	case SPLAT_BIQUAD_NOTCH:
+		b0 = 1.0;
+		b1 = -2.0 * cw;
+		b2 = 1.0;
+		break;
+	case SPLAT_BIQUAD_ALLPASS:
+		b0 = 1.0 - alpha;
+		b1 = -2.0 * cw;
+		b2 = 1.0 + alpha;
+		break;
+	case SPLAT_BIQUAD_PEAK:
+		b0 = 1.0 + (alpha * A);
+		b1 = -2.0 * cw;
+		b2 = 1.0 - (alpha * A);
+		a0 = 1.0 + (alpha / A);
+		a2 = 1.0 - (alpha / A);
+		break;
+	case SPLAT_BIQUAD_LOWSHELF:
+		b0 = A * ((A + 1.0) - ((A - 1.0) * cw) + sq);
+		b1 = 2.0 * A * ((A - 1.0) - ((A + 1.0) * cw));
+		b2 = A * ((A + 1.0) - ((A - 1.0) * cw) - sq);
+		a0 = (A + 1.0) + ((A - 1.0) * cw) + sq;
+		a1 = -2.0 * ((A - 1.0) + ((A + 1.0) * cw));
+		a2 = (A + 1.0) + ((A - 1.0) * cw) - sq;
+		break;
+	case SPLAT_BIQUAD_HIGHSHELF:
+		b0 = A * ((A + 1.0) + ((A - 1.0) * cw) + sq);
+		b1 = -2.0 * A * ((A - 1.0) + ((A + 1.0) * cw));
+		b2 = A * ((A + 1.0) + ((A - 1.0) * cw) - sq);
+		a0 = (A + 1.0) - ((A - 1.0) * cw) + sq;
+		a1 = 2.0 * ((A - 1.0) - ((A + 1.0) * cw));
+		a2 = (A + 1.0) - ((A - 1.0) * cw) - sq;
+		break;
+	}
+
+	k->b0 = b0 / a0;
+	k->b1 = b1 / a0;
+	k->b2 = b2 / a0;
+	k->a1 = a1 / a0;
+	k->a2 = a2 / a0;
+}
+
+static int splat_biquad_idle(struct splat_biquad *sections, size_t n_sections,
+			     unsigned n_channels)
+{
+	size_t s;
+	unsigned c;
+
+	for (s = 0; s < n_sections; ++s)
+		for (c = 0; c < n_channels; ++c)
+			if ((fabs(sections[s].s1[c]) >= SPLAT_BIQUAD_SILENCE) ||
+			    (fabs(sections[s].s2[c]) >= SPLAT_BIQUAD_SILENCE))
+				return 0;
+
+	for (s = 0; s < n_sections; ++s) {
+		memset(sections[s].s1, 0, sizeof(sections[s].s1));
+		memset(sections[s].s2, 0, sizeof(sections[s].s2));
+	}
+
+	return 1;
+}
+
+/* The designed sections get their coefficients updated at the start of each
+ * vector of samples from their parameter signals.  The channels of each
+ * vector are interleaved so the kernel can run them in parallel.  */
+int splat_filter_biquad(struct splat_fragment *frag,
+			struct splat_biquad *sections, size_t n_sections,
+			double origin)
+{
+	const size_t lanes = splat_biquad_lanes(frag->n_channels);
+	struct splat_signal sig;
+	PyObject **signals;
+	size_t *sig_sections;
+	size_t n_signals = 0;
+	double *x;
+	size_t s;
+	int input;
+	int idle;
+	int res = -1;
+
+	signals = PyMem_Malloc(3 * n_sections * sizeof(PyObject *));
+	sig_sections = PyMem_Malloc(n_sections * sizeof(size_t));
+	x = PyMem_Malloc(SPLAT_VECTOR_LEN * lanes * sizeof(double));
+
+	if ((signals == NULL) || (sig_sections == NULL) || (x == NULL)) {
+		PyErr_NoMemory();
+		goto free_bufs;
+	}
+
+	for (s = 0; s < n_sections; ++s) {
+		if (sections[s].type == SPLAT_BIQUAD_COEFS)
+			continue;
+
+		sig_sections[n_signals / 3] = s;
+		signals[n_signals++] = sections[s].freq;
+		signals[n_signals++] = sections[s].q;
+		signals[n_signals++] = sections[s].gain;
+	}
+
+	if (splat_signal_init(&sig, frag->length, (origin * frag->rate),
+			      signals, n_signals, frag->rate))
+		goto free_bufs;
+
+	idle = splat_biquad_idle(sections, n_sections, frag->n_channels);
+	input = 0;
+
+	while (splat_signal_next(&sig) == SPLAT_SIGNAL_CONTINUE) {
+		const size_t i = sig.cur - sig.origin;
+		size_t j;
+		unsigned c;
+
+		/* Blocks with no input get touched when the filter output
+		 * goes into them, so check before processing each one */
+		if (!(i & (SPLAT_FRAG_BLOCK - 1)))
+			input = splat_frag_block_used(frag, i);
 
-		i = max_index;
+		if (!input && idle)
+			continue;
 
-		do {
-			const double s = c_data[i];
+		for (j = 0; j < n_signals; j += 3)
+			splat_biquad_design(&sections[sig_sections[j / 3]].k,
+					    sections[sig_sections[j / 3]].type,
+					    sig.vectors[j].data[0],
+					    sig.vectors[j + 1].data[0],
+					    sig.vectors[j + 2].data[0],
+					    frag->rate);
 
-			for (d = 0; d < n_delays; ++d) {
-				const double z = s * c_delay[d].gain;
+		for (c = 0; c < frag->n_channels; ++c) {
+			const sample_t *in = frag->data[c];
 
-				c_data[i + c_delay[d].time] += z;
+			for (j = 0; j < sig.len; ++j)
+				x[(j * lanes) + c] = in[i + j];
+		}
+
+		for (; c < lanes; ++c)
+			for (j = 0; j < sig.len; ++j)
+				x[(j * lanes) + c] = 0.0;
+
+		for (s = 0; s < n_sections; ++s)
+			splat_kernels.biquad(x, sig.len, lanes, &sections[s].k,
+					     sections[s].s1, sections[s].s2);
+
+		for (c = 0; c < frag->n_channels; ++c) {
+			sample_t *out = frag->data[c];
+
+			for (j = 0; j < sig.len; ++j)
+				out[i + j] = x[(j * lanes) + c];
+		}
+
+		splat_frag_touch(frag, i, sig.len);
+
+		if (input)
+			idle = 0;
+		else
+			idle = splat_biquad_idle(sections, n_sections,
+						 frag->n_channels);
+	}
+
+	splat_signal_free(&sig);
+
+	if (sig.stat != SPLAT_SIGNAL_ERROR)
+		res = 0;
+
+free_bufs:
+	PyMem_Free(signals);
+	PyMem_Free(sig_sections);
+	PyMem_Free(x);
+
+	return res;
+}
+
+/* ----------------------------------------------------------------------------
+ * Dynamics
+ */
+
+/* Gains this close to 1.0 are rounded to it so the state can come to rest */
+#define SPLAT_DYN_UNITY 1e-9
+
+/* Below this mean square level, the compressor input is considered silent */
+#define SPLAT_DYN_SILENCE 1e-20
+
+static double splat_frame_peak(const struct splat_fragment *frag, size_t i)
+{
+	double peak = 0.0;
+	unsigned c;
+
+	for (c = 0; c < frag->n_channels; ++c)
+		peak = max(peak, fabs(frag->data[c][i]));
+
+	return peak;
+}
+
+int splat_limiter_init(struct splat_limiter *lim, unsigned n_channels,
+		       unsigned rate, double threshold, double lookahead,
+		       double release)
+{
+	const size_t L = lookahead * rate;
+	const size_t W = L + 1;
+	size_t k;
+
+	lim->threshold = threshold;
+	lim->kr = 1.0 - exp(-1.0 / (release * rate));
+	lim->lookahead = L;
+	lim->n_channels = n_channels;
+	lim->pos = 0;
+	lim->box_sum = W;
+	lim->b = 0;
+	lim->q_head = 0;
+	lim->q_len = 0;
+	lim->gain = 1.0;
+	lim->rest = W;
+	lim->d = 0;
+	lim->zeros = L;
+	lim->box = PyMem_Malloc(W * sizeof(double));
+	lim->q_gain = PyMem_Malloc(W * sizeof(double));
+	lim->q_pos = PyMem_Malloc(W * sizeof(size_t));
+	lim->delay = PyMem_Malloc(W * n_channels * sizeof(double));
+
+	if ((lim->box == NULL) || (lim->q_gain == NULL) ||
+	    (lim->q_pos == NULL) || (lim->delay == NULL)) {
+		splat_limiter_free(lim);
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	for (k = 0; k < W; ++k)
+		lim->box[k] = 1.0;
+
+	memset(lim->delay, 0, (W * n_channels * sizeof(double)));
+
+	return 0;
+}
+
+void splat_limiter_free(struct splat_limiter *lim)
+{
+	PyMem_Free(lim->box);
+	PyMem_Free(lim->q_gain);
+	PyMem_Free(lim->q_pos);
+	PyMem_Free(lim->delay);
+	lim->box = NULL;
+	lim->q_gain = NULL;
+	lim->q_pos = NULL;
+	lim->delay = NULL;
+}
+
+#define splat_limiter_gain(_lim, _peak)				\
+	(((_peak) > (_lim)->threshold) ? ((_lim)->threshold / (_peak)) : 1.0)
+
+/* The gain needed by each sample to stay below the threshold is looked
+ * ahead with a sliding minimum over lookahead + 1 samples, which are kept in
+ * a monotonic queue.  It then goes through a release filter and a moving
+ * average over the same number of samples, so the gain ramps down smoothly
+ * and still reaches the required value on each peak.  This takes the gain g
+ * of the sample entering the lookahead and returns the one to apply to the
+ * sample leaving it, or 1.0 while the lookahead is being filled.  */
+static double splat_limiter_step(struct splat_limiter *lim, double g)
+{
+	const size_t L = lim->lookahead;
+	const size_t W = L + 1;
+	const size_t n = lim->pos++;
+	size_t k;
+
+	while (lim->q_len && (n >= L) && (lim->q_pos[lim->q_head] < (n - L))) {
+		lim->q_head = (lim->q_head + 1) % W;
+		--lim->q_len;
+	}
+
+	while (lim->q_len &&
+	       (lim->q_gain[(lim->q_head + lim->q_len - 1) % W] >= g))
+		--lim->q_len;
+
+	lim->q_gain[(lim->q_head + lim->q_len) % W] = g;
+	lim->q_pos[(lim->q_head + lim->q_len) % W] = n;
+	++lim->q_len;
+
+	if (n < L)
+		return 1.0;
+
+	g = lim->q_gain[lim->q_head];
+
+	/* The gains before the start can't be above the first one */
+	if (n == L) {
+		for (k = 0; k < W; ++k)
+			lim->box[k] = g;
+
+		lim->box_sum = g * W;
+		lim->gain = g;
+	}
+
+	if (g < lim->gain)
+		lim->gain = g;
+	else
+		lim->gain += (g - lim->gain) * lim->kr;
+
+	if (lim->gain > (1.0 - SPLAT_DYN_UNITY))
+		lim->gain = 1.0;
+
+	lim->rest = (lim->gain == 1.0) ? (lim->rest + 1) : 0;
+	lim->box_sum += lim->gain - lim->box[lim->b];
+	lim->box[lim->b] = lim->gain;
+	lim->b = (lim->b + 1) % W;
+
+	if (lim->rest < W)
+		return lim->box_sum / W;
+
+	lim->box_sum = W;
+
+	return 1.0;
+}
+
+/* Skip n silent samples once the gain is back to 1.0 */
+static void splat_limiter_skip(struct splat_limiter *lim, size_t n)
+{
+	lim->pos += n;
+	lim->q_len = 0;
+}
+
+/* The samples are read ahead before being scaled, so the fragment can be
+ * processed in place with the samples after the end taken as silence */
+void splat_filter_limiter(struct splat_fragment *frag,
+			  struct splat_limiter *lim)
+{
+	const size_t L = lim->lookahead;
+	const size_t W = L + 1;
+	size_t n;
+
+	splat_frag_dirty_all(frag);
+
+	for (n = 0; n < (frag->length + L); ++n) {
+		double g = 1.0;
+		double a;
+		unsigned c;
+
+		if (!(n & (SPLAT_FRAG_BLOCK - 1)) && (lim->rest >= W) &&
+		    ((n + SPLAT_FRAG_BLOCK) <= frag->length) &&
+		    !splat_frag_range_used(frag, (n > L) ? (n - L) : 0,
+					   (n + SPLAT_FRAG_BLOCK))) {
+			splat_limiter_skip(lim, SPLAT_FRAG_BLOCK);
+			n += SPLAT_FRAG_BLOCK - 1;
+			continue;
+		}
+
+		if ((n < frag->length) && splat_frag_block_used(frag, n))
+			g = splat_limiter_gain(lim, splat_frame_peak(frag, n));
+
+		a = splat_limiter_step(lim, g);
+
+		if ((n >= L) && (a != 1.0))
+			for (c = 0; c < frag->n_channels; ++c)
+				frag->data[c][n - L] *= a;
+	}
+}
+
+/* Each part of a stream is delayed by the lookahead so the gains can be
+ * computed with the samples of the next part.  The output is then the same
+ * as when running splat_filter_limiter on the whole stream, followed by the
+ * lookahead in silence to get the end of it.  */
+void splat_filter_limiter_stream(struct splat_fragment *frag,
+				 struct splat_limiter *lim)
+{
+	const size_t L = lim->lookahead;
+	const size_t W = L + 1;
+	const unsigned n_channels = frag->n_channels;
+	size_t n;
+
+	splat_frag_dirty_all(frag);
+
+	for (n = 0; n < frag->length; ++n) {
+		double *delay = &lim->delay[lim->d * n_channels];
+		double peak;
+		double a;
+		unsigned c;
+
+		if (!(n & (SPLAT_FRAG_BLOCK - 1))) {
+			if ((lim->rest >= W) && (lim->zeros >= L) &&
+			    ((n + SPLAT_FRAG_BLOCK) <= frag->length) &&
+			    !splat_frag_block_used(frag, n)) {
+				splat_limiter_skip(lim, SPLAT_FRAG_BLOCK);
+				lim->zeros += SPLAT_FRAG_BLOCK;
+				n += SPLAT_FRAG_BLOCK - 1;
+				continue;
 			}
-		} while (i--);
+
+			/* The delayed samples may land in a silent block */
+			splat_frag_touch(frag, n, SPLAT_FRAG_BLOCK);
+		}
+
+		peak = splat_frame_peak(frag, n);
+		a = splat_limiter_step(lim, splat_limiter_gain(lim, peak));
+		lim->zeros = (peak == 0.0) ? (lim->zeros + 1) : 0;
+
+		if (!L) {
+			for (c = 0; c < n_channels; ++c)
+				frag->data[c][n] *= a;
+
+			continue;
+		}
+
+		for (c = 0; c < n_channels; ++c) {
+			const double x = frag->data[c][n];
+
+			frag->data[c][n] = delay[c] * a;
+			delay[c] = x;
+		}
+
+		lim->d = (lim->d + 1) % L;
 	}
 }
+
+/* The level is the mean square of all the channels with an exponential
+ * moving average, and the gain in dB follows the one computed for the level
+ * with the attack and release times.  Silent blocks are skipped once the
+ * level has decayed and the gain has been released.  */
+void splat_filter_compressor(struct splat_fragment *frag,
+			     struct splat_compressor *comp)
+{
+	const double rate = frag->rate;
+	const double kw = 1.0 - exp(-1.0 / (comp->window * rate));
+	const double ka = 1.0 - exp(-1.0 / (comp->attack * rate));
+	const double kr = 1.0 - exp(-1.0 / (comp->release * rate));
+	const double slope = 1.0 - (1.0 / comp->ratio);
+	const double ms_threshold = pow(10.0, (comp->threshold / 10.0));
+	const double makeup = dB2lin(comp->makeup);
+	double ms = comp->ms;
+	double gain_dB = comp->gain_dB;
+	size_t i;
+
+	splat_frag_dirty_all(frag);
+
+	for (i = 0; i < frag->length; ++i) {
+		double power = 0.0;
+		double target = 0.0;
+		double gain;
+		unsigned c;
+
+		if (!(i & (SPLAT_FRAG_BLOCK - 1)) && (ms == 0.0) &&
+		    (gain_dB == 0.0) && !splat_frag_block_used(frag, i)) {
+			i += SPLAT_FRAG_BLOCK - 1;
+			continue;
+		}
+
+		for (c = 0; c < frag->n_channels; ++c)
+			power += frag->data[c][i] * frag->data[c][i];
+
+		ms += ((power / frag->n_channels) - ms) * kw;
+
+		if (ms > ms_threshold)
+			target = -(10.0 * log10(ms) - comp->threshold) * slope;
+		else if (ms < SPLAT_DYN_SILENCE)
+			ms = 0.0;
+
+		gain_dB += (target - gain_dB) * ((target < gain_dB) ? ka : kr);
+
+		if (fabs(gain_dB) < SPLAT_DYN_UNITY)
+			gain_dB = 0.0;
+
+		gain = (gain_dB == 0.0) ? makeup : dB2lin(gain_dB) * makeup;
+
+		if (gain != 1.0)
+			for (c = 0; c < frag->n_channels; ++c)
+				frag->data[c][i] *= gain;
+	}
+
+	comp->ms = ms;
+	comp->gain_dB = gain_dB;
+}
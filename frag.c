@@ -19,25 +19,124 @@
 */
 
 #include "_splat.h"
+#include <sys/mman.h>
+
+/* Alignment of the channel buffers, suitable for all the SIMD kernels */
+#define SPLAT_FRAG_ALIGN 64
+
+/* Buffers from this size are anonymous memory mappings, so the pages are only
+ * allocated by the kernel when first written to and silence costs nothing */
+#define SPLAT_FRAG_MAP_SIZE (256 * 1024)
+
+/* Large buffers can make use of huge pages if possible */
+#define SPLAT_FRAG_HUGE_PAGE (2 * 1024 * 1024)
+
+#define splat_frag_mapped(_capacity) \
+	(((_capacity) * sizeof(sample_t)) >= SPLAT_FRAG_MAP_SIZE)
+
+static void splat_frag_advise(void *data, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+	if (size >= SPLAT_FRAG_HUGE_PAGE)
+		madvise(data, size, MADV_HUGEPAGE);
+#endif
+}
+
+/* Allocate a buffer filled with zeros */
+static sample_t *splat_frag_alloc(size_t capacity)
+{
+	const size_t size = capacity * sizeof(sample_t);
+	void *data;
+
+	if (splat_frag_mapped(capacity)) {
+		data = mmap(NULL, size, (PROT_READ | PROT_WRITE),
+			    (MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE),
+			    -1, 0);
+
+		if (data == MAP_FAILED)
+			return NULL;
+
+		splat_frag_advise(data, size);
+	} else {
+		if (posix_memalign(&data, SPLAT_FRAG_ALIGN, size))
+			return NULL;
+
+		memset(data, 0, size);
+	}
+
+	return data;
+}
+
+static void splat_frag_free_data(sample_t *data, size_t capacity)
+{
+	if (data == NULL)
+		return;
+
+	if (splat_frag_mapped(capacity))
+		munmap(data, (capacity * sizeof(sample_t)));
+	else
+		free(data);
+}
+
+/* Fill a range with zeros, giving whole pages back to the kernel */
+static void splat_frag_zero(struct splat_fragment *frag, unsigned c,
+			    size_t start, size_t end)
+{
+	sample_t * const data = frag->data[c];
+
+	if (frag->file != NULL) {
+		splat_file_zero(frag, c, start, end);
+		return;
+	}
+
+#ifdef MADV_DONTNEED
+	if (splat_frag_mapped(frag->capacity)) {
+		const uintptr_t page = sysconf(_SC_PAGESIZE);
+		const uintptr_t from = (uintptr_t)&data[start];
+		const uintptr_t to = (uintptr_t)&data[end];
+		const uintptr_t first = (from + page - 1) & ~(page - 1);
+		const uintptr_t last = to & ~(page - 1);
+
+		if (first < last) {
+			memset(&data[start], 0, (first - from));
+			madvise((void *)first, (last - first), MADV_DONTNEED);
+			memset((void *)last, 0, (to - last));
+			return;
+		}
+	}
+#endif
+
+	memset(&data[start], 0, ((end - start) * sizeof(sample_t)));
+}
 
 int splat_frag_init(struct splat_fragment *frag, unsigned n_channels,
 		    unsigned rate, size_t length, const char *name)
 {
-	const size_t data_size = length * sizeof(sample_t);
+	const size_t n_blocks = splat_frag_n_blocks(length);
 	unsigned i;
 
+	frag->sample_width = SPLAT_SAMPLE_WIDTH;
+	frag->sums = NULL;
+	frag->n_sums = 0;
+	frag->blocks = PyMem_Malloc(max(n_blocks, 1));
+
+	if (frag->blocks == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	memset(frag->blocks, 0, n_blocks);
+
 	for (i = 0; i < n_channels; ++i) {
-		if (!data_size) {
+		if (!length) {
 			frag->data[i] = NULL;
 		} else {
-			frag->data[i] = PyMem_Malloc(data_size);
+			frag->data[i] = splat_frag_alloc(length);
 
 			if (frag->data[i] == NULL) {
 				PyErr_NoMemory();
 				return -1;
 			}
-
-			memset(frag->data[i], 0, data_size);
 		}
 	}
 
@@ -49,16 +148,40 @@ int splat_frag_init(struct splat_fragment *frag, unsigned n_channels,
 	frag->n_channels = n_channels;
 	frag->rate = rate;
 	frag->length = length;
+	frag->capacity = length;
+	frag->share = NULL;
+	frag->file = NULL;
 
 	return 0;
 }
 
+static void splat_frag_unref(struct splat_share *share)
+{
+	unsigned c;
+
+	if (--share->refs)
+		return;
+
+	for (c = 0; c < share->n_channels; ++c)
+		splat_frag_free_data(share->data[c], share->capacity);
+
+	PyMem_Free(share);
+}
+
 void splat_frag_free(struct splat_fragment *frag)
 {
 	unsigned c;
 
-	for (c = 0; c < frag->n_channels; ++c)
-		PyMem_Free(frag->data[c]);
+	if (frag->share != NULL)
+		splat_frag_unref(frag->share);
+	else if (frag->file != NULL)
+		splat_file_close(frag->file);
+	else
+		for (c = 0; c < frag->n_channels; ++c)
+			splat_frag_free_data(frag->data[c], frag->capacity);
+
+	PyMem_Free(frag->blocks);
+	PyMem_Free(frag->sums);
 
 	if (frag->name != NULL)
 		free(frag->name);
@@ -79,87 +202,575 @@ int splat_frag_set_name(struct splat_fragment *frag, const char *name)
 	return 0;
 }
 
+#ifdef MREMAP_MAYMOVE
+/* Grow the mappings without copying, the new pages are filled with zeros */
+static int splat_frag_remap(struct splat_fragment *frag, sample_t **data,
+			    size_t capacity)
+{
+	const size_t old_size = frag->capacity * sizeof(sample_t);
+	const size_t size = capacity * sizeof(sample_t);
+	unsigned c;
+
+	for (c = 0; c < frag->n_channels; ++c) {
+		data[c] = mremap(frag->data[c], old_size, size,
+				 MREMAP_MAYMOVE);
+
+		if (data[c] == MAP_FAILED) {
+			while (c--)
+				frag->data[c] = mremap(data[c], size, old_size,
+						       MREMAP_MAYMOVE);
+
+			return -1;
+		}
+
+		splat_frag_advise(data[c], size);
+	}
+
+	return 0;
+}
+#endif
+
+int splat_frag_reserve_blocks(struct splat_fragment *frag, size_t capacity)
+{
+	const size_t n_blocks = splat_frag_n_blocks(capacity);
+	const size_t old_n_blocks = splat_frag_n_blocks(frag->capacity);
+	unsigned char *blocks;
+
+	if (n_blocks <= old_n_blocks)
+		return 0;
+
+	blocks = PyMem_Realloc(frag->blocks, n_blocks);
+
+	if (blocks == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	memset(&blocks[old_n_blocks], 0, (n_blocks - old_n_blocks));
+	frag->blocks = blocks;
+
+	return 0;
+}
+
+int splat_frag_reserve(struct splat_fragment *frag, size_t capacity)
+{
+	sample_t *data[SPLAT_MAX_CHANNELS];
+	unsigned c;
+
+	if (splat_frag_unshare(frag))
+		return -1;
+
+	if (capacity <= frag->capacity)
+		return 0;
+
+	if (frag->file != NULL)
+		return splat_file_reserve(frag, capacity);
+
+	if (splat_frag_reserve_blocks(frag, capacity))
+		return -1;
+
+#ifdef MREMAP_MAYMOVE
+	if (splat_frag_mapped(frag->capacity)) {
+		if (splat_frag_remap(frag, data, capacity))
+			goto no_memory;
+
+		goto done;
+	}
+#endif
+
+	for (c = 0; c < frag->n_channels; ++c) {
+		data[c] = splat_frag_alloc(capacity);
+
+		if (data[c] == NULL) {
+			while (c--)
+				splat_frag_free_data(data[c], capacity);
+
+			goto no_memory;
+		}
+	}
+
+	for (c = 0; c < frag->n_channels; ++c) {
+		if (frag->data[c] != NULL) {
+			memcpy(data[c], frag->data[c],
+			       (frag->length * sizeof(sample_t)));
+			splat_frag_free_data(frag->data[c], frag->capacity);
+		}
+	}
+
+#ifdef MREMAP_MAYMOVE
+done:
+#endif
+	for (c = 0; c < frag->n_channels; ++c)
+		frag->data[c] = data[c];
+
+	frag->capacity = capacity;
+
+	return 0;
+
+no_memory:
+	PyErr_NoMemory();
+
+	return -1;
+}
+
 int splat_frag_resize(struct splat_fragment *frag, size_t length)
 {
-	const size_t start = frag->length * sizeof(sample_t);
-	const size_t size = length * sizeof(sample_t);
-	const ssize_t extra = size - start;
+	unsigned c;
+
+	if (splat_frag_unshare(frag))
+		return -1;
+
+	/* Grow geometrically to avoid copying the data every time */
+	if (length > frag->capacity) {
+		const size_t capacity = frag->capacity + (frag->capacity / 2);
+
+		if (splat_frag_reserve(frag, max(length, capacity)))
+			return -1;
+	}
+
+	/* The last block gets some zeros added or removed */
+	if (length != frag->length)
+		splat_frag_dirty(frag, (min(length, frag->length) - 1), 1);
+
+	/* The samples after the end are always kept as zeros */
+	if (length < frag->length) {
+		const size_t first = splat_frag_n_blocks(length);
+		const size_t last = splat_frag_n_blocks(frag->length);
+
+		for (c = 0; c < frag->n_channels; ++c)
+			splat_frag_zero(frag, c, length, frag->length);
+
+		memset(&frag->blocks[first], 0, (last - first));
+	}
+
+	frag->length = length;
+
+	if (frag->file != NULL)
+		splat_file_set_length(frag);
+
+	return 0;
+}
+
+void splat_frag_touch(struct splat_fragment *frag, size_t start,
+		      size_t length)
+{
+	size_t first;
+	size_t last;
+
+	if (start >= frag->length)
+		return;
+
+	length = min(length, (frag->length - start));
+
+	if (!length)
+		return;
+
+	first = start >> SPLAT_FRAG_BLOCK_BITS;
+	last = (start + length - 1) >> SPLAT_FRAG_BLOCK_BITS;
+	memset(&frag->blocks[first], SPLAT_FRAG_BLOCK_USED, (last - first + 1));
+}
+
+void splat_frag_dirty(struct splat_fragment *frag, size_t start,
+		      size_t length)
+{
+	size_t b;
+
+	if (start >= frag->length)
+		return;
+
+	length = min(length, (frag->length - start));
+
+	if (!length)
+		return;
+
+	for (b = (start >> SPLAT_FRAG_BLOCK_BITS);
+	     b <= ((start + length - 1) >> SPLAT_FRAG_BLOCK_BITS); ++b)
+		frag->blocks[b] &= ~SPLAT_FRAG_BLOCK_SUMS;
+}
+
+/* Copy the data into new buffers owned by the fragment */
+static int splat_frag_copy(struct splat_fragment *frag)
+{
+	sample_t *data[SPLAT_MAX_CHANNELS];
+	size_t i;
 	unsigned c;
 
 	for (c = 0; c < frag->n_channels; ++c) {
-		if (frag->data[c] == NULL)
-			frag->data[c] = PyMem_Malloc(size);
-		else
-			frag->data[c] = PyMem_Realloc(frag->data[c], size);
+		data[c] = splat_frag_alloc(frag->length);
+
+		if (data[c] == NULL) {
+			while (c--)
+				splat_frag_free_data(data[c], frag->length);
 
-		if (frag->data[c] == NULL) {
 			PyErr_NoMemory();
 			return -1;
 		}
+	}
+
+	/* The new buffers are already filled with zeros */
+	for (i = 0; i < frag->length; i += SPLAT_FRAG_BLOCK) {
+		const size_t n = min(SPLAT_FRAG_BLOCK, (frag->length - i));
+
+		if (!splat_frag_block_used(frag, i))
+			continue;
 
-		if (extra > 0)
-			memset(&frag->data[c][frag->length], 0, extra);
+		for (c = 0; c < frag->n_channels; ++c)
+			memcpy(&data[c][i], &frag->data[c][i],
+			       (n * sizeof(sample_t)));
+	}
+
+	for (c = 0; c < frag->n_channels; ++c)
+		frag->data[c] = data[c];
+
+	frag->capacity = frag->length;
+
+	return 0;
+}
+
+int splat_frag_share(struct splat_fragment *frag, struct splat_fragment *src,
+		     size_t start, size_t end)
+{
+	struct splat_share *share = src->share;
+	const size_t length = end - start;
+	unsigned char *blocks;
+	size_t i;
+	unsigned c;
+
+	if (!length)
+		return 0;
+
+	blocks = PyMem_Realloc(frag->blocks, splat_frag_n_blocks(length));
+
+	if (blocks == NULL) {
+		PyErr_NoMemory();
+		return -1;
 	}
 
+	frag->blocks = blocks;
+
+	/* Blocks are not aligned in the same way if start is not a multiple
+	 * of the block size, so each one may overlap two source blocks */
+	for (i = 0; i < length; i += SPLAT_FRAG_BLOCK) {
+		const size_t last = min((i + SPLAT_FRAG_BLOCK), length) - 1;
+
+		blocks[i >> SPLAT_FRAG_BLOCK_BITS] =
+			splat_frag_block_used(src, (start + i)) ||
+			splat_frag_block_used(src, (start + last));
+	}
+
+	for (c = 0; c < frag->n_channels; ++c)
+		frag->data[c] = &src->data[c][start];
+
 	frag->length = length;
+	frag->capacity = length;
+
+	/* Data mapped from a file is copied as the file may keep changing */
+	if (src->file != NULL) {
+		if (splat_frag_copy(frag))
+			goto error;
+
+		return 0;
+	}
+
+	if (share == NULL) {
+		share = PyMem_Malloc(sizeof(struct splat_share));
+
+		if (share == NULL) {
+			PyErr_NoMemory();
+			goto error;
+		}
+
+		share->refs = 1;
+		share->n_channels = src->n_channels;
+		share->capacity = src->capacity;
+		share->length = src->length;
+
+		for (c = 0; c < src->n_channels; ++c)
+			share->data[c] = src->data[c];
+
+		src->share = share;
+	}
+
+	frag->share = share;
+	++share->refs;
 
 	return 0;
+
+error:
+	for (c = 0; c < frag->n_channels; ++c)
+		frag->data[c] = NULL;
+
+	frag->length = 0;
+	frag->capacity = 0;
+
+	return -1;
 }
 
-static void splat_frag_mix_floats(struct splat_fragment *frag,
-				  const struct splat_fragment *incoming,
-				  size_t offset, size_t start, size_t length,
-				  const double *levels, int zero_dB)
+int splat_frag_unshare(struct splat_fragment *frag)
+{
+	struct splat_share *share = frag->share;
+
+	if (share == NULL)
+		return 0;
+
+	/* Take the whole buffers back if nothing else uses them any more */
+	if ((share->refs == 1) && (frag->data[0] == share->data[0]) &&
+	    (frag->length == share->length)) {
+		if (splat_frag_reserve_blocks(frag, share->capacity))
+			return -1;
+
+		frag->capacity = share->capacity;
+		frag->share = NULL;
+		PyMem_Free(share);
+
+		return 0;
+	}
+
+	if (splat_frag_copy(frag))
+		return -1;
+
+	frag->share = NULL;
+	splat_frag_unref(share);
+
+	return 0;
+}
+
+/* Initialise a fragment with a copy of one which has the other sample type,
+ * only converting the blocks which are used */
+int splat_frag_convert(struct splat_fragment *frag,
+		       const struct splat_fragment *src)
+{
+	size_t i;
+
+	if (splat_frag_init(frag, src->n_channels, src->rate, src->length,
+			    src->name))
+		return -1;
+
+	for (i = 0; i < src->length; i += SPLAT_FRAG_BLOCK) {
+		const size_t n = min(SPLAT_FRAG_BLOCK, (src->length - i));
+		unsigned c;
+
+		if (!splat_frag_block_used(src, i))
+			continue;
+
+		for (c = 0; c < src->n_channels; ++c) {
+			const other_sample_t *in =
+				(const other_sample_t *)src->data[c] + i;
+			sample_t *out = &frag->data[c][i];
+			size_t j;
+
+			for (j = 0; j < n; ++j)
+				out[j] = in[j];
+		}
+
+		splat_frag_touch(frag, i, n);
+	}
+
+	return 0;
+}
+
+static void splat_mix_generic(sample_t *dst, const sample_t *src, size_t n,
+			      double gain)
+{
+	if (gain == 1.0) {
+		while (n--)
+			*dst++ += *src++;
+	} else {
+		while (n--)
+			*dst++ += gain * (*src++);
+	}
+}
+
+static void splat_mix_vec_generic(sample_t *dst, const sample_t *src,
+				  const double *gains, size_t n)
+{
+	while (n--)
+		*dst++ += *src++ * *gains++;
+}
+
+static void splat_amp_generic(sample_t *data, size_t n, double gain)
+{
+	while (n--)
+		*data++ *= gain;
+}
+
+static void splat_amp_vec_generic(sample_t *data, const double *gains,
+				  size_t n)
+{
+	while (n--)
+		*data++ *= *gains++;
+}
+
+/* Transposed direct form II, which keeps the state small */
+static void splat_biquad_generic(double *x, size_t n, size_t lanes,
+				 const struct splat_biquad_coefs *k,
+				 double *s1, double *s2)
+{
+	for (; n; --n, x += lanes) {
+		size_t c;
+
+		for (c = 0; c < lanes; ++c) {
+			const double in = x[c];
+			const double y = (k->b0 * in) + s1[c];
+
+			s1[c] = ((k->b1 * in) - (k->a1 * y)) + s2[c];
+			s2[c] = (k->b2 * in) - (k->a2 * y);
+			x[c] = y;
+		}
+	}
+}
+
+static void splat_sums_generic(const sample_t *x, size_t n,
+			       struct splat_sums *sums)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		const double v = x[i];
+		const size_t l = i % SPLAT_SUMS_LANES;
+
+		sums->min = min(sums->min, v);
+		sums->max = max(sums->max, v);
+		sums->sum[l] += v;
+		sums->sum2[l] += v * v;
+	}
+}
+
+static double splat_true_peak_generic(const double *x, size_t n,
+				      const double *k)
+{
+	double peak = 0.0;
+	size_t t;
+
+	for (t = 0; t < n; ++t) {
+		unsigned p;
+
+		for (p = 0; p < (SPLAT_TP_PHASES - 1); ++p) {
+			const double *kp = &k[p * SPLAT_TP_TAPS];
+			double y = 0.0;
+			unsigned j;
+
+			for (j = 0; j < SPLAT_TP_TAPS; ++j)
+				y += x[t + j + 1] * kp[j];
+
+			peak = max(peak, fabs(y));
+		}
+	}
+
+	return peak;
+}
+
+/* Replaced with faster variants by splat_simd_init() */
+struct splat_kernels splat_kernels = {
+	"generic", splat_mix_generic, splat_mix_vec_generic,
+	splat_amp_generic, splat_amp_vec_generic, splat_biquad_generic,
+	splat_sums_generic, splat_true_peak_generic,
+};
+
+/* Get a copy of the routes, or each channel mixed into the same one */
+static unsigned splat_frag_mix_routes(const struct splat_mix *mix,
+				      unsigned n_channels,
+				      struct splat_mix_route *routes)
 {
 	unsigned c;
 
-	for (c = 0; c < frag->n_channels; ++c) {
-		const sample_t *src = &incoming->data[c][start];
-		sample_t *dst =  &frag->data[c][offset];
-		Py_ssize_t i = length;
+	if (mix->routes != NULL) {
+		memcpy(routes, mix->routes,
+		       (mix->n_routes * sizeof(struct splat_mix_route)));
+		return mix->n_routes;
+	}
 
-		if (zero_dB) {
-			while (i--)
-				*dst++ += *src++;
-		} else {
-			const double g = levels[c];
+	for (c = 0; c < n_channels; ++c) {
+		routes[c].out = c;
+		routes[c].in = c;
+		routes[c].gain = 1.0;
+	}
 
-			while (i--)
-				*dst++ += g * (*src++);
+	return n_channels;
+}
+
+static void splat_frag_mix_floats(struct splat_fragment *frag,
+				  const struct splat_fragment *incoming,
+				  size_t offset, size_t start, size_t length,
+				  const struct splat_mix *mix)
+{
+	struct splat_mix_route routes[SPLAT_MAX_CHANNELS * SPLAT_MAX_CHANNELS];
+	const unsigned n_routes = splat_frag_mix_routes(mix, frag->n_channels,
+							routes);
+	int skip_silence = 1;
+	size_t i;
+	unsigned r;
+
+	for (r = 0; r < n_routes; ++r)
+		if (!mix->zero_dB)
+			routes[r].gain *= mix->levels.fl[routes[r].out];
+
+	/* Silent blocks add nothing, unless a gain turns zeros into NaN */
+	for (r = 0; r < n_routes; ++r)
+		if (!isfinite(routes[r].gain))
+			skip_silence = 0;
+
+	for (i = 0; i < length; ) {
+		const size_t src = start + i;
+		const size_t n = min((length - i), (SPLAT_FRAG_BLOCK -
+					(src & (SPLAT_FRAG_BLOCK - 1))));
+
+		if (!skip_silence || splat_frag_block_used(incoming, src)) {
+			splat_frag_touch(frag, (offset + i), n);
+
+			for (r = 0; r < n_routes; ++r)
+				splat_kernels.mix(
+					&frag->data[routes[r].out][offset + i],
+					&incoming->data[routes[r].in][src], n,
+					routes[r].gain);
 		}
+
+		i += n;
 	}
 }
 
 static int splat_frag_mix_signals(struct splat_fragment *frag,
 				  const struct splat_fragment *incoming,
 				  size_t offset, size_t start, size_t length,
-				  const struct splat_levels *levels)
+				  const struct splat_mix *mix)
 {
+	struct splat_mix_route routes[SPLAT_MAX_CHANNELS * SPLAT_MAX_CHANNELS];
+	const unsigned n_routes = splat_frag_mix_routes(mix, frag->n_channels,
+							routes);
 	struct splat_signal sig;
 	PyObject *signals[SPLAT_MAX_CHANNELS];
+	double gains[SPLAT_VECTOR_LEN];
 	unsigned c;
-	size_t in;
-	size_t i;
+	unsigned r;
 
-	for (c = 0; c < incoming->n_channels; ++c)
-		signals[c] = levels->obj[c];
+	for (c = 0; c < frag->n_channels; ++c)
+		signals[c] = mix->levels.obj[c];
 
 	if (splat_signal_init(&sig, length, offset, signals, frag->n_channels,
 			      frag->rate))
 		return -1;
 
-	in = sig.cur;
-	i = 0;
+	splat_frag_touch(frag, offset, length);
 
 	while (splat_signal_next(&sig) == SPLAT_SIGNAL_CONTINUE) {
-		size_t j;
+		const size_t i = sig.cur - offset;
+
+		for (r = 0; r < n_routes; ++r) {
+			const double *vec = sig.vectors[routes[r].out].data;
+			size_t k;
 
-		for (j = 0; j < sig.len; ++i, ++j, ++in) {
-			for (c = 0; c < incoming->n_channels; ++c) {
-				double a = sig.vectors[c].data[j];
+			/* Matrix gains are applied on top of the signal */
+			if (routes[r].gain != 1.0) {
+				for (k = 0; k < sig.len; ++k)
+					gains[k] = vec[k] * routes[r].gain;
 
-				frag->data[c][i] += incoming->data[c][in] * a;
+				vec = gains;
 			}
+
+			splat_kernels.mix_vec(
+				&frag->data[routes[r].out][offset + i],
+				&incoming->data[routes[r].in][start + i],
+				vec, sig.len);
 		}
 	}
 
@@ -168,34 +779,182 @@ static int splat_frag_mix_signals(struct splat_fragment *frag,
 	return (sig.stat == SPLAT_SIGNAL_ERROR) ? -1 : 0;
 }
 
-int splat_frag_mix(struct splat_fragment *frag,
-		   const struct splat_fragment *incoming,
-		   const struct splat_levels *levels,
-		   size_t length, double offset, double skip, int zero_dB)
+/* Convert the mixing times to sample numbers and return the end position */
+static size_t splat_frag_mix_samples(const struct splat_fragment *frag,
+				     struct splat_mix *mix)
+{
+	const struct splat_fragment *incoming = mix->incoming;
+	size_t length = incoming->length;
+
+	/* With resampling, skip and length are at the rate of this fragment */
+	if (mix->resample)
+		length = splat_resample_length(length, incoming->rate,
+					       frag->rate);
+
+	mix->offset_sample = mix->offset * frag->rate;
+	mix->offset_sample = max(mix->offset_sample, 0);
+	mix->skip_sample = mix->skip * frag->rate;
+	mix->skip_sample = minmax(mix->skip_sample, 0, length);
+	mix->length = minmax(mix->length, 0, (length - mix->skip_sample));
+
+	return mix->offset_sample + mix->length;
+}
+
+/* Mix from the incoming fragment or from a converted copy of some of it */
+static int splat_frag_mix_data(struct splat_fragment *frag,
+			       const struct splat_fragment *incoming,
+			       size_t offset, size_t start, size_t length,
+			       const struct splat_mix *mix)
 {
-	size_t offset_sample;
-	size_t skip_sample;
-	size_t total_length;
+	if (mix->levels.all_floats) {
+		splat_frag_mix_floats(frag, incoming, offset, start, length,
+				      mix);
+		return 0;
+	}
 
-	offset_sample = offset * frag->rate;
-	offset_sample = max(offset_sample, 0);
-	skip_sample = skip * frag->rate;
-	skip_sample = minmax(skip_sample, 0, incoming->length);
-	length = minmax(length, 0, (incoming->length - skip_sample));
-	total_length = offset_sample + length;
+	return splat_frag_mix_signals(frag, incoming, offset, start, length,
+				      mix);
+}
+
+/* Convert the incoming samples one block at a time, then mix them as usual */
+static int splat_frag_mix_resampled(struct splat_fragment *frag,
+				    const struct splat_mix *mix,
+				    const struct splat_resampler *rs)
+{
+	const struct splat_fragment *incoming = mix->incoming;
+	struct splat_fragment tmp;
+	size_t i;
+	unsigned c;
+	int res = 0;
 
-	if (splat_frag_grow(frag, total_length))
+	if (splat_frag_init(&tmp, incoming->n_channels, frag->rate,
+			    SPLAT_FRAG_BLOCK, NULL))
 		return -1;
 
-	if (levels->all_floats)
-		splat_frag_mix_floats(frag, incoming, offset_sample,
-				      skip_sample, length, levels->fl,
-				      zero_dB);
-	else if (splat_frag_mix_signals(frag, incoming, offset_sample,
-					skip_sample, length, levels))
+	for (i = 0; i < mix->length; i += SPLAT_FRAG_BLOCK) {
+		const size_t n = min(SPLAT_FRAG_BLOCK, (mix->length - i));
+		const size_t start = mix->skip_sample + i;
+
+		if (splat_resample_used(rs, incoming, start, n)) {
+			for (c = 0; c < tmp.n_channels; ++c)
+				splat_resample(rs, incoming->data[c],
+					       incoming->length, tmp.data[c],
+					       start, n);
+
+			tmp.blocks[0] = SPLAT_FRAG_BLOCK_USED;
+		} else if (tmp.blocks[0]) {
+			for (c = 0; c < tmp.n_channels; ++c)
+				memset(tmp.data[c], 0, (n * sizeof(sample_t)));
+
+			tmp.blocks[0] = 0;
+		}
+
+		if (splat_frag_mix_data(frag, &tmp, (mix->offset_sample + i),
+					0, n, mix)) {
+			res = -1;
+			break;
+		}
+	}
+
+	splat_frag_free(&tmp);
+
+	return res;
+}
+
+/* The resampler is kept between calls as long as the rates are the same */
+static int splat_frag_mix_run(struct splat_fragment *frag,
+			      const struct splat_mix *mix,
+			      struct splat_resampler *rs)
+{
+	if (mix->resample) {
+		if ((rs->k == NULL) || (rs->in_rate != mix->incoming->rate) ||
+		    (rs->out_rate != frag->rate)) {
+			splat_resampler_free(rs);
+
+			if (splat_resampler_init(rs, mix->incoming->rate,
+						 frag->rate,
+						 SPLAT_RESAMPLE_QUALITY))
+				return -1;
+		}
+
+		return splat_frag_mix_resampled(frag, mix, rs);
+	}
+
+	return splat_frag_mix_data(frag, mix->incoming, mix->offset_sample,
+				   mix->skip_sample, mix->length, mix);
+}
+
+int splat_frag_mix(struct splat_fragment *frag, struct splat_mix *mix)
+{
+	struct splat_resampler rs;
+	int res;
+
+	if (splat_frag_grow(frag, splat_frag_mix_samples(frag, mix)))
 		return -1;
 
-	return 0;
+	rs.k = NULL;
+	res = splat_frag_mix_run(frag, mix, &rs);
+	splat_resampler_free(&rs);
+
+	return res;
+}
+
+/* Sort by offset, and keep the original order with identical offsets */
+static int splat_frag_mix_cmp(const void *a, const void *b)
+{
+	const struct splat_mix *ma = *(const struct splat_mix **)a;
+	const struct splat_mix *mb = *(const struct splat_mix **)b;
+
+	if (ma->offset_sample != mb->offset_sample)
+		return (ma->offset_sample < mb->offset_sample) ? -1 : 1;
+
+	return (ma < mb) ? -1 : ((ma > mb) ? 1 : 0);
+}
+
+int splat_frag_mix_many(struct splat_fragment *frag, struct splat_mix *mix,
+			size_t n)
+{
+	struct splat_mix **sorted;
+	struct splat_resampler rs;
+	size_t total_length = 0;
+	size_t i;
+	int res = 0;
+
+	sorted = PyMem_Malloc(max(n, 1) * sizeof(struct splat_mix *));
+
+	if (sorted == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	for (i = 0; i < n; ++i) {
+		const size_t end = splat_frag_mix_samples(frag, &mix[i]);
+
+		total_length = max(total_length, end);
+		sorted[i] = &mix[i];
+	}
+
+	if (splat_frag_grow(frag, total_length)) {
+		res = -1;
+		goto free_sorted;
+	}
+
+	qsort(sorted, n, sizeof(struct splat_mix *), splat_frag_mix_cmp);
+	rs.k = NULL;
+
+	for (i = 0; i < n; ++i) {
+		if (splat_frag_mix_run(frag, sorted[i], &rs)) {
+			res = -1;
+			break;
+		}
+	}
+
+	splat_resampler_free(&rs);
+
+free_sorted:
+	PyMem_Free(sorted);
+
+	return res;
 }
 
 int splat_frag_sample_number(size_t *val, long min_val, long max_val,
@@ -203,71 +962,548 @@ int splat_frag_sample_number(size_t *val, long min_val, long max_val,
 {
 	long tmp_val;
 
-	if (!PyInt_Check(obj)) {
+	if (!PyInt_Check(obj) && !PyLong_Check(obj)) {
 		PyErr_SetString(PyExc_TypeError,
 				"sample number must be an integer");
 		return -1;
 	}
 
-	tmp_val = min(PyInt_AsLong(obj), max_val);
+	tmp_val = PyInt_AsLong(obj);
+
+	if ((tmp_val == -1) && PyErr_Occurred())
+		return -1;
+
+	tmp_val = min(tmp_val, max_val);
 	*val = max(tmp_val, min_val);
 
 	return 0;
 }
 
-void splat_frag_get_peak(const struct splat_fragment *frag,
-			 struct splat_peak *chan_peak,
-			 struct splat_peak *frag_peak, int do_avg)
+/* ----------------------------------------------------------------------------
+ * Statistics
+ */
+
+/* The blocks are split into a fixed number of parts which are processed in
+ * parallel, each job doing all the channels of its part */
+#define SPLAT_STATS_PARTS SPLAT_POOL_MAX_THREADS
+
+/* Integrated loudness as per ITU-R BS.1770, with K-weighting, 400ms gating
+ * blocks made of 100ms segments and the absolute and relative gates in LU */
+#define SPLAT_LOUD_SEGS 4
+#define SPLAT_LOUD_ABS_GATE -70.0
+#define SPLAT_LOUD_REL_GATE -10.0
+#define SPLAT_LOUD_CHUNK 256
+
+/* Below this, the K-weighting filter state is considered to be at rest */
+#define SPLAT_LOUD_IDLE 1e-10
+
+#define splat_loud_bound(_seg, _rate) ((size_t)(_seg) * (_rate) / 10)
+#define splat_lufs(_ms) (-0.691 + (10.0 * log10(_ms)))
+
+struct splat_loudness {
+	struct splat_biquad_coefs k[2];
+	size_t n_segs;
+	double *segs; /* energy of each segment for each channel */
+	double *buf; /* SPLAT_LOUD_CHUNK frames of interleaved channels */
+};
+
+struct splat_stats_job {
+	struct splat_fragment *frag;
+	size_t n_parts;
+	double true_peak[SPLAT_STATS_PARTS][SPLAT_MAX_CHANNELS];
+	double tp[SPLAT_TP_PHASES - 1][SPLAT_TP_TAPS];
+	int do_true_peak;
+	struct splat_loudness *loud; /* NULL when not measured */
+};
+
+static void splat_true_peak_init(struct splat_stats_job *job)
+{
+	unsigned p;
+
+	for (p = 1; p < SPLAT_TP_PHASES; ++p) {
+		double *k = job->tp[p - 1];
+		double sum = 0.0;
+		int j;
+
+		for (j = 0; j < SPLAT_TP_TAPS; ++j) {
+			const double d = (j - (SPLAT_TP_HALF - 1)) -
+				((double)p / SPLAT_TP_PHASES);
+			const double w =
+				0.5 + (0.5 * cos(M_PI * d / SPLAT_TP_HALF));
+
+			k[j] = w * sin(M_PI * d) / (M_PI * d);
+			sum += k[j];
+		}
+
+		for (j = 0; j < SPLAT_TP_TAPS; ++j)
+			k[j] /= sum;
+	}
+}
+
+/* Copy the n samples from i into x with SPLAT_TP_HALF samples on each side,
+ * and zeros for the unused blocks */
+static int splat_true_peak_load(const struct splat_fragment *frag, unsigned c,
+				double *x, size_t i, size_t n)
 {
+	const sample_t *data = frag->data[c];
+	const int prev = (i >= SPLAT_TP_HALF) &&
+		splat_frag_block_used(frag, (i - SPLAT_TP_HALF));
+	const int next = ((i + n + SPLAT_TP_HALF) <= frag->length) &&
+		splat_frag_block_used(frag, (i + n));
+	const int used = splat_frag_block_used(frag, i);
+	size_t t;
+
+	if (!prev && !used && !next)
+		return 0;
+
+	for (t = 0; t < SPLAT_TP_HALF; ++t) {
+		x[t] = prev ? data[i - SPLAT_TP_HALF + t] : 0.0;
+		x[SPLAT_TP_HALF + n + t] = next ? data[i + n + t] : 0.0;
+	}
+
+	x += SPLAT_TP_HALF;
+
+	if (used) {
+		for (t = 0; t < n; ++t)
+			x[t] = data[i + t];
+	} else {
+		for (t = 0; t < n; ++t)
+			x[t] = 0.0;
+	}
+
+	return 1;
+}
+
+/* Interpolated peak of the n samples from i, excluding the samples */
+static double splat_true_peak(const struct splat_stats_job *job, unsigned c,
+			      size_t i, size_t n)
+{
+	double x[SPLAT_TP_HALF + SPLAT_FRAG_BLOCK + SPLAT_TP_HALF];
+
+	if (!splat_true_peak_load(job->frag, c, x, i, n))
+		return 0.0;
+
+	return splat_kernels.true_peak(x, n, job->tp[0]);
+}
+
+static void splat_loudness_k_init(struct splat_biquad_coefs *k, unsigned rate)
+{
+	/* High shelf for the head, then high-pass filter (RLB weighting) */
+	const double shelf_gain = 3.999843853973347;
+	const double shelf_freq = 1681.974450955533;
+	const double shelf_q = 0.7071752369554196;
+	const double hp_freq = 38.13547087602444;
+	const double hp_q = 0.5003270373238773;
+	const double vh = pow(10.0, (shelf_gain / 20.0));
+	const double vb = pow(vh, 0.4996667741545416);
+	double t;
+	double a0;
+
+	t = tan(M_PI * shelf_freq / rate);
+	a0 = 1.0 + (t / shelf_q) + (t * t);
+	k[0].b0 = (vh + (vb * t / shelf_q) + (t * t)) / a0;
+	k[0].b1 = 2.0 * ((t * t) - vh) / a0;
+	k[0].b2 = (vh - (vb * t / shelf_q) + (t * t)) / a0;
+	k[0].a1 = 2.0 * ((t * t) - 1.0) / a0;
+	k[0].a2 = (1.0 - (t / shelf_q) + (t * t)) / a0;
+
+	t = tan(M_PI * hp_freq / rate);
+	a0 = 1.0 + (t / hp_q) + (t * t);
+	k[1].b0 = 1.0;
+	k[1].b1 = -2.0;
+	k[1].b2 = 1.0;
+	k[1].a1 = 2.0 * ((t * t) - 1.0) / a0;
+	k[1].a2 = (1.0 - (t / hp_q) + (t * t)) / a0;
+}
+
+static int splat_loudness_idle(double *s, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i)
+		if (fabs(s[i]) >= SPLAT_LOUD_IDLE)
+			return 0;
+
+	for (i = 0; i < n; ++i)
+		s[i] = 0.0;
+
+	return 1;
+}
+
+/* All the channels go through the K-weighting filter together, and the
+ * energy of each one is added up for each segment */
+static void splat_loudness_run(const struct splat_fragment *frag,
+			       struct splat_loudness *loud)
+{
+	const unsigned n_channels = frag->n_channels;
+	const size_t lanes = splat_biquad_lanes(n_channels);
+	const size_t end = splat_loud_bound(loud->n_segs, frag->rate);
+	double s[4 * SPLAT_MAX_CHANNELS];
+	double *s1 = &s[0];
+	double *s2 = &s[SPLAT_MAX_CHANNELS];
+	double *s3 = &s[2 * SPLAT_MAX_CHANNELS];
+	double *s4 = &s[3 * SPLAT_MAX_CHANNELS];
+	size_t seg = 0;
+	size_t i = 0;
+
+	memset(s, 0, sizeof(s));
+
+	while (i < end) {
+		const size_t block_end = (i | (SPLAT_FRAG_BLOCK - 1)) + 1;
+		const int used = splat_frag_block_used(frag, i);
+		size_t n;
+		size_t t;
+		unsigned c;
+
+		if (!used && !(i & (SPLAT_FRAG_BLOCK - 1)) &&
+		    splat_loudness_idle(s, ARRAY_SIZE(s))) {
+			i = block_end;
+			continue;
+		}
+
+		while (i >= splat_loud_bound((seg + 1), frag->rate))
+			++seg;
+
+		n = min(SPLAT_LOUD_CHUNK, (block_end - i));
+		n = min(n, (splat_loud_bound((seg + 1), frag->rate) - i));
+
+		for (t = 0; t < n; ++t)
+			for (c = 0; c < lanes; ++c)
+				loud->buf[(t * lanes) + c] =
+					(used && (c < n_channels)) ?
+					frag->data[c][i + t] : 0.0;
+
+		splat_kernels.biquad(loud->buf, n, lanes, &loud->k[0], s1, s2);
+		splat_kernels.biquad(loud->buf, n, lanes, &loud->k[1], s3, s4);
+
+		for (c = 0; c < n_channels; ++c) {
+			double e = 0.0;
+
+			for (t = 0; t < n; ++t) {
+				const double y = loud->buf[(t * lanes) + c];
+
+				e += y * y;
+			}
+
+			loud->segs[(seg * n_channels) + c] += e;
+		}
+
+		i += n;
+	}
+}
+
+/* Gated loudness of the channels from c0 to c1 */
+static double splat_loudness_gate(const struct splat_fragment *frag,
+				  const struct splat_loudness *loud,
+				  double *z, unsigned c0, unsigned c1)
+{
+	const size_t n_blocks = loud->n_segs - SPLAT_LOUD_SEGS + 1;
+	double sum = 0.0;
+	double gate;
+	size_t m = 0;
+	size_t j;
+
+	for (j = 0; j < n_blocks; ++j) {
+		const double *seg = &loud->segs[j * frag->n_channels];
+		const size_t len =
+			splat_loud_bound((j + SPLAT_LOUD_SEGS), frag->rate) -
+			splat_loud_bound(j, frag->rate);
+		double e = 0.0;
+		unsigned k;
+		unsigned c;
+
+		for (k = 0; k < SPLAT_LOUD_SEGS; ++k)
+			for (c = c0; c < c1; ++c)
+				e += seg[(k * frag->n_channels) + c];
+
+		z[j] = e / len;
+
+		if (splat_lufs(z[j]) > SPLAT_LOUD_ABS_GATE) {
+			sum += z[j];
+			++m;
+		}
+	}
+
+	if (!m)
+		return -HUGE_VAL;
+
+	gate = max(splat_lufs(sum / m) + SPLAT_LOUD_REL_GATE,
+		   SPLAT_LOUD_ABS_GATE);
+
+	for (j = 0, sum = 0.0, m = 0; j < n_blocks; ++j) {
+		if (splat_lufs(z[j]) > gate) {
+			sum += z[j];
+			++m;
+		}
+	}
+
+	return splat_lufs(sum / m);
+}
+
+/* Update the sums of a block which has been used since they were last
+ * computed, the lanes are always added in the same order */
+static void splat_stats_block(struct splat_fragment *frag, size_t b)
+{
+	const size_t i = b << SPLAT_FRAG_BLOCK_BITS;
+	const size_t n = min(SPLAT_FRAG_BLOCK, (frag->length - i));
+	unsigned c;
+
+	for (c = 0; c < frag->n_channels; ++c) {
+		struct splat_block_sums *block =
+			&frag->sums[(b * frag->n_channels) + c];
+		struct splat_sums sums;
+		unsigned l;
+
+		memset(&sums, 0, sizeof(sums));
+		sums.min = HUGE_VAL;
+		sums.max = -HUGE_VAL;
+		splat_kernels.sums(&frag->data[c][i], n, &sums);
+		block->min = sums.min;
+		block->max = sums.max;
+		block->sum = 0.0;
+		block->sum2 = 0.0;
+
+		for (l = 0; l < SPLAT_SUMS_LANES; ++l) {
+			block->sum += sums.sum[l];
+			block->sum2 += sums.sum2[l];
+		}
+	}
+
+	frag->blocks[b] |= SPLAT_FRAG_BLOCK_SUMS;
+}
+
+static void splat_stats_job(void *arg, size_t j)
+{
+	struct splat_stats_job *job = arg;
+	struct splat_fragment *frag = job->frag;
+	const size_t n_blocks = splat_frag_n_blocks(frag->length);
+	double *true_peak;
 	unsigned c;
+	size_t b;
+
+	/* The loudness is measured in one go so it's started first */
+	if (job->loud != NULL) {
+		if (!j) {
+			splat_loudness_run(frag, job->loud);
+			return;
+		}
+
+		--j;
+	}
+
+	true_peak = job->true_peak[j];
+
+	for (c = 0; c < frag->n_channels; ++c)
+		true_peak[c] = 0.0;
 
-	frag_peak->avg = 0.0;
-	frag_peak->max = -1.0;
-	frag_peak->min = 1.0;
-	frag_peak->peak = 0.0;
+	for (b = (j * n_blocks / job->n_parts);
+	     b < ((j + 1) * n_blocks / job->n_parts); ++b) {
+		const size_t i = b << SPLAT_FRAG_BLOCK_BITS;
+		const size_t n = min(SPLAT_FRAG_BLOCK, (frag->length - i));
+
+		if (frag->blocks[b] == SPLAT_FRAG_BLOCK_USED)
+			splat_stats_block(frag, b);
+
+		if (!job->do_true_peak)
+			continue;
+
+		for (c = 0; c < frag->n_channels; ++c)
+			true_peak[c] = max(true_peak[c],
+					   splat_true_peak(job, c, i, n));
+	}
+}
+
+/* The sums of each block are kept in the fragment so only the blocks which
+ * have been used since the last time need to be processed again */
+static int splat_stats_run(struct splat_stats_job *job,
+			   struct splat_stats *chan_stats,
+			   struct splat_stats *frag_stats)
+{
+	struct splat_fragment *frag = job->frag;
+	const size_t n_blocks = splat_frag_n_blocks(frag->length);
+	const size_t length = max(frag->length, 1);
+	double ms = 0.0;
+	unsigned c;
+
+	if (n_blocks > frag->n_sums) {
+		struct splat_block_sums *sums;
+
+		sums = PyMem_Realloc(frag->sums, (n_blocks * frag->n_channels *
+						  sizeof(*sums)));
+
+		if (sums == NULL) {
+			PyErr_NoMemory();
+			return -1;
+		}
+
+		frag->sums = sums;
+		frag->n_sums = n_blocks;
+	}
+
+	job->n_parts = min(SPLAT_STATS_PARTS, n_blocks);
+	splat_pool_run(splat_stats_job, job,
+		       (job->n_parts + ((job->loud != NULL) ? 1 : 0)));
+
+	frag_stats->avg = 0.0;
+	frag_stats->max = frag->length ? -HUGE_VAL : 0.0;
+	frag_stats->min = frag->length ? HUGE_VAL : 0.0;
+	frag_stats->peak = 0.0;
+	frag_stats->true_peak = 0.0;
 
 	for (c = 0; c < frag->n_channels; ++c) {
-		sample_t * const chan_data = frag->data[c];
-		const sample_t * const end = &chan_data[frag->length];
-		const sample_t *it;
-		double avg = 0.0;
-		double max = -1.0;
-		double min = 1.0;
-
-		for (it = chan_data; it != end; ++it) {
-			if (do_avg)
-				avg += *it / frag->length;
-
-			if (*it > max)
-				max = *it;
-			else if (*it < min)
-				min = *it;
+		struct splat_stats *stats = &chan_stats[c];
+		double sum = 0.0;
+		double sum2 = 0.0;
+		size_t b;
+		size_t j;
+
+		stats->max = frag->length ? -HUGE_VAL : 0.0;
+		stats->min = frag->length ? HUGE_VAL : 0.0;
+		stats->true_peak = 0.0;
+
+		for (b = 0; b < n_blocks; ++b) {
+			const struct splat_block_sums *block =
+				&frag->sums[(b * frag->n_channels) + c];
+
+			if (!(frag->blocks[b] & SPLAT_FRAG_BLOCK_USED)) {
+				stats->max = max(stats->max, 0.0);
+				stats->min = min(stats->min, 0.0);
+				continue;
+			}
+
+			stats->max = max(stats->max, block->max);
+			stats->min = min(stats->min, block->min);
+			sum += block->sum;
+			sum2 += block->sum2;
+		}
+
+		for (j = 0; j < job->n_parts; ++j)
+			stats->true_peak = max(stats->true_peak,
+					       job->true_peak[j][c]);
+
+		stats->avg = sum / length;
+		stats->rms = sqrt(sum2 / length);
+		stats->peak = max(fabs(stats->min), fabs(stats->max));
+		stats->true_peak = max(stats->true_peak, stats->peak);
+		ms += sum2 / length;
+		frag_stats->avg += stats->avg / frag->n_channels;
+		frag_stats->max = max(frag_stats->max, stats->max);
+		frag_stats->min = min(frag_stats->min, stats->min);
+		frag_stats->peak = max(frag_stats->peak, stats->peak);
+		frag_stats->true_peak = max(frag_stats->true_peak,
+					    stats->true_peak);
+	}
+
+	frag_stats->rms = sqrt(ms / frag->n_channels);
+
+	return 0;
+}
+
+int splat_frag_get_peak(struct splat_fragment *frag,
+			struct splat_peak *chan_peak,
+			struct splat_peak *frag_peak)
+{
+	struct splat_stats_job job;
+	struct splat_stats chan_stats[SPLAT_MAX_CHANNELS];
+	struct splat_stats frag_stats;
+	unsigned c;
+
+	job.frag = frag;
+	job.do_true_peak = 0;
+	job.loud = NULL;
+
+	if (splat_stats_run(&job, chan_stats, &frag_stats))
+		return -1;
+
+	for (c = 0; c < frag->n_channels; ++c) {
+		chan_peak[c].avg = chan_stats[c].avg;
+		chan_peak[c].max = chan_stats[c].max;
+		chan_peak[c].min = chan_stats[c].min;
+		chan_peak[c].peak = chan_stats[c].peak;
+	}
+
+	frag_peak->avg = frag_stats.avg;
+	frag_peak->max = frag_stats.max;
+	frag_peak->min = frag_stats.min;
+	frag_peak->peak = frag_stats.peak;
+
+	return 0;
+}
+
+/* All the statistics are gathered in a single pass through the data, except
+ * for the loudness which is measured in parallel */
+int splat_frag_get_stats(struct splat_fragment *frag,
+			 struct splat_stats *chan_stats,
+			 struct splat_stats *frag_stats)
+{
+	struct splat_stats_job job;
+	struct splat_loudness loud;
+	const size_t lanes = splat_biquad_lanes(frag->n_channels);
+	double *z;
+	unsigned c;
+	int res;
+
+	job.frag = frag;
+	job.do_true_peak = 1;
+	job.loud = NULL;
+	splat_true_peak_init(&job);
+	loud.n_segs = frag->length * 10 / frag->rate;
+	loud.segs = NULL;
+	loud.buf = NULL;
+	z = NULL;
+
+	if (loud.n_segs >= SPLAT_LOUD_SEGS) {
+		splat_loudness_k_init(loud.k, frag->rate);
+		loud.segs = PyMem_Malloc(loud.n_segs * frag->n_channels *
+					 sizeof(double));
+		loud.buf = PyMem_Malloc(SPLAT_LOUD_CHUNK * lanes *
+					sizeof(double));
+		z = PyMem_Malloc(loud.n_segs * sizeof(double));
+
+		if ((loud.segs == NULL) || (loud.buf == NULL) || (z == NULL)) {
+			PyMem_Free(loud.segs);
+			PyMem_Free(loud.buf);
+			PyMem_Free(z);
+			PyErr_NoMemory();
+			return -1;
 		}
 
-		chan_peak[c].avg = avg;
-		chan_peak[c].max = max;
-		chan_peak[c].min = min;
+		memset(loud.segs, 0, (loud.n_segs * frag->n_channels *
+				      sizeof(double)));
+		job.loud = &loud;
+	}
+
+	res = splat_stats_run(&job, chan_stats, frag_stats);
 
-		if (do_avg)
-			frag_peak->avg += avg / frag->n_channels;
+	if (job.loud == NULL) {
+		for (c = 0; c < frag->n_channels; ++c)
+			chan_stats[c].loudness = -HUGE_VAL;
 
-		if (max > frag_peak->max)
-			frag_peak->max = max;
+		frag_stats->loudness = -HUGE_VAL;
 
-		if (min < frag_peak->min)
-			frag_peak->min = min;
+		return res;
+	}
 
-		min = fabsf(min);
-		max = fabsf(max);
-		chan_peak[c].peak = (min > max) ? min : max;
+	if (!res) {
+		for (c = 0; c < frag->n_channels; ++c)
+			chan_stats[c].loudness =
+				splat_loudness_gate(frag, &loud, z, c,
+						    (c + 1));
 
-		if (frag_peak->peak < chan_peak[c].peak)
-			frag_peak->peak = chan_peak[c].peak;
+		frag_stats->loudness =
+			splat_loudness_gate(frag, &loud, z, 0,
+					    frag->n_channels);
 	}
+
+	PyMem_Free(loud.segs);
+	PyMem_Free(loud.buf);
+	PyMem_Free(z);
+
+	return res;
 }
 
-void splat_frag_normalize(struct splat_fragment *frag, double level_dB,
-			  int do_zero)
+int splat_frag_get_norm(struct splat_fragment *frag, double level_dB,
+			int do_zero, struct splat_norm *norm)
 {
 	const double level = dB2lin(level_dB);
 	struct splat_peak chan_peak[SPLAT_MAX_CHANNELS];
@@ -275,7 +1511,16 @@ void splat_frag_normalize(struct splat_fragment *frag, double level_dB,
 	unsigned c;
 	double gain;
 
-	splat_frag_get_peak(frag, chan_peak, &frag_peak, do_zero);
+	norm->gain = 1.0;
+
+	for (c = 0; c < frag->n_channels; ++c)
+		norm->offset[c] = 0.0;
+
+	if (splat_frag_get_peak(frag, chan_peak, &frag_peak))
+		return -1;
+
+	if (frag_peak.peak == 0.0)
+		return 0;
 
 	if (do_zero) {
 		double offset = 0.0;
@@ -296,27 +1541,69 @@ void splat_frag_normalize(struct splat_fragment *frag, double level_dB,
 		int zero;
 
 		if (!do_zero)
-			return;
+			return 0;
 
 		for (c = 0, zero = 1; c < frag->n_channels && zero; ++c)
 			if (fabs(chan_peak[c].avg) > 0.001)
 				zero = 0;
 
 		if (zero)
-			return;
+			return 0;
 	}
 
+	norm->gain = gain;
+
+	if (do_zero)
+		for (c = 0; c < frag->n_channels; ++c)
+			norm->offset[c] = chan_peak[c].avg;
+
+	return 1;
+}
+
+int splat_frag_normalize(struct splat_fragment *frag, double level_dB,
+			 int do_zero)
+{
+	struct splat_norm norm;
+	int skip_silence;
+	unsigned c;
+	int res;
+
+	res = splat_frag_get_norm(frag, level_dB, do_zero, &norm);
+
+	if (res <= 0)
+		return res;
+
+	skip_silence = isfinite(norm.gain);
+
+	for (c = 0; c < frag->n_channels; ++c)
+		if (norm.offset[c] != 0.0)
+			skip_silence = 0;
+
+	if (!skip_silence)
+		splat_frag_touch_all(frag);
+	else
+		splat_frag_dirty_all(frag);
+
 	for (c = 0; c < frag->n_channels; ++c) {
-		const double chan_avg = chan_peak[c].avg;
+		const double chan_avg = norm.offset[c];
 		sample_t * const chan_data = frag->data[c];
-		const sample_t * const end = &chan_data[frag->length];
-		sample_t *it;
+		size_t i;
+
+		for (i = 0; i < frag->length; i += SPLAT_FRAG_BLOCK) {
+			const size_t n = min(SPLAT_FRAG_BLOCK,
+					     (frag->length - i));
+			sample_t *it = &chan_data[i];
+			const sample_t * const end = it + n;
+
+			if (skip_silence && !splat_frag_block_used(frag, i))
+				continue;
 
-		for (it = chan_data; it != end; ++it) {
-			*it -= chan_avg;
-			*it *= gain;
+			for (; it != end; ++it)
+				*it = (*it - chan_avg) * norm.gain;
 		}
 	}
+
+	return 0;
 }
 
 static void splat_frag_amp_floats(struct splat_fragment *frag,
@@ -325,14 +1612,26 @@ static void splat_frag_amp_floats(struct splat_fragment *frag,
 	unsigned c;
 
 	for (c = 0; c < frag->n_channels; ++c) {
-		const double g = gains[c];
+		const double gain = gains[c];
 		size_t i;
 
-		if (g == 1.0)
+		if (gain == 1.0)
 			continue;
 
-		for (i = 0; i < frag->length; ++i)
-			frag->data[c][i] *= g;
+		splat_frag_dirty_all(frag);
+
+		if (!isfinite(gain)) {
+			splat_frag_touch_all(frag);
+			splat_kernels.amp(frag->data[c], frag->length, gain);
+			continue;
+		}
+
+		for (i = 0; i < frag->length; i += SPLAT_FRAG_BLOCK)
+			if (splat_frag_block_used(frag, i))
+				splat_kernels.amp(&frag->data[c][i],
+						  min(SPLAT_FRAG_BLOCK,
+						      (frag->length - i)),
+						  gain);
 	}
 }
 
@@ -342,8 +1641,6 @@ static int splat_frag_amp_signals(struct splat_fragment *frag,
 	struct splat_signal sig;
 	PyObject *signals[SPLAT_MAX_CHANNELS];
 	unsigned c;
-	size_t in;
-	size_t i;
 
 	for (c = 0; c < frag->n_channels; ++c)
 		signals[c] = gains->obj[c];
@@ -352,16 +1649,12 @@ static int splat_frag_amp_signals(struct splat_fragment *frag,
 			      frag->n_channels, frag->rate))
 		return -1;
 
-	in = sig.cur;
-	i = 0;
+	splat_frag_touch_all(frag);
 
-	while (splat_signal_next(&sig) == SPLAT_SIGNAL_CONTINUE) {
-		size_t j;
-
-		for (j = 0; j < sig.len; ++i, ++j, ++in)
-			for (c = 0; c < frag->n_channels; ++c)
-				frag->data[c][i] *= sig.vectors[c].data[j];
-	}
+	while (splat_signal_next(&sig) == SPLAT_SIGNAL_CONTINUE)
+		for (c = 0; c < frag->n_channels; ++c)
+			splat_kernels.amp_vec(&frag->data[c][sig.cur],
+					      sig.vectors[c].data, sig.len);
 
 	splat_signal_free(&sig);
 
@@ -382,6 +1675,8 @@ void splat_frag_lin2dB(struct splat_fragment *frag)
 {
 	unsigned c;
 
+	splat_frag_touch_all(frag);
+
 	for (c = 0; c < frag->n_channels; ++c) {
 		size_t i;
 
@@ -394,6 +1689,8 @@ void splat_frag_dB2lin(struct splat_fragment *frag)
 {
 	unsigned c;
 
+	splat_frag_touch_all(frag);
+
 	for (c = 0; c < frag->n_channels; ++c) {
 		size_t i;
 
@@ -408,6 +1705,8 @@ int splat_frag_offset(struct splat_fragment *frag, PyObject *offset_obj,
 	size_t i;
 	unsigned c;
 
+	splat_frag_touch_all(frag);
+
 	if (PyFloat_Check(offset_obj)) {
 		const double offset_float = PyFloat_AS_DOUBLE(offset_obj);
 
@@ -0,0 +1,78 @@
+/*
+    Splat - ops.c
+
+    Copyright (C) 2015
+    Guillaume Tucker <guillaume@mangoz.org>
+
+    This program is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "_splat.h"
+
+/* This gets built for each sample type, with the names of the functions
+ * changed accordingly by _splat.h */
+
+#ifdef SPLAT_FLOAT32
+# define SPLAT_OPS_SAMPLE_TYPE "float32"
+#else
+# define SPLAT_OPS_SAMPLE_TYPE "float64"
+#endif
+
+const struct splat_ops splat_sample_ops = {
+	SPLAT_OPS_SAMPLE_TYPE,
+	SPLAT_SAMPLE_WIDTH,
+	splat_simd_init,
+	splat_raw_io_init,
+	splat_raw_io_get,
+	splat_raw_import,
+	splat_raw_export,
+	splat_frag_init,
+	splat_frag_free,
+	splat_frag_reserve,
+	splat_frag_resize,
+	splat_frag_touch,
+	splat_frag_share,
+	splat_frag_unshare,
+	splat_frag_convert,
+	splat_file_init,
+	splat_frag_mix,
+	splat_frag_mix_many,
+	splat_frag_get_peak,
+	splat_frag_get_stats,
+	splat_frag_get_norm,
+	splat_frag_normalize,
+	splat_frag_amp,
+	splat_frag_lin2dB,
+	splat_frag_dB2lin,
+	splat_frag_offset,
+	splat_frag_resample,
+	splat_sine_floats,
+	splat_sine_signals,
+	splat_square_floats,
+	splat_square_signals,
+	splat_triangle_floats,
+	splat_triangle_signals,
+	splat_overtones_float,
+	splat_overtones_mixed,
+	splat_overtones_signal,
+	splat_filter_biquad,
+	splat_filter_limiter,
+	splat_filter_limiter_stream,
+	splat_filter_compressor,
+	splat_filter_chain,
+	splat_filter_reverse,
+	splat_filter_reverb,
+	splat_filter_convolve,
+	splat_filter_fdn,
+};
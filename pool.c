@@ -0,0 +1,196 @@
+/*
+    Splat - pool.c
+
+    Copyright (C) 2015
+    Guillaume Tucker <guillaume@mangoz.org>
+
+    This program is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "_splat.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/* The calling thread runs jobs too, so there is one worker thread less than
+ * the number of threads.  Workers are only started when first needed.  */
+struct splat_pool {
+	pthread_mutex_t lock;
+	pthread_mutex_t busy; /* held while a set of jobs is being run */
+	pthread_cond_t work;
+	pthread_cond_t done;
+	unsigned n_threads;
+	unsigned n_workers; /* number of worker threads started */
+	pthread_t workers[SPLAT_POOL_MAX_THREADS];
+	unsigned long gen; /* incremented for each new set of jobs */
+	int quit;
+	splat_pool_fn fn;
+	void *arg;
+	size_t n_jobs;
+	size_t next;
+	size_t pending;
+};
+
+static struct splat_pool splat_pool = {
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 1,
+};
+
+/* Run the remaining jobs, called and returning with the lock held */
+static void splat_pool_jobs(struct splat_pool *pool)
+{
+	while (pool->next < pool->n_jobs) {
+		const size_t i = pool->next++;
+
+		pthread_mutex_unlock(&pool->lock);
+		pool->fn(pool->arg, i);
+		pthread_mutex_lock(&pool->lock);
+
+		if (!--pool->pending)
+			pthread_cond_signal(&pool->done);
+	}
+}
+
+static void *splat_pool_worker(void *arg)
+{
+	struct splat_pool *pool = arg;
+	unsigned long gen;
+
+	pthread_mutex_lock(&pool->lock);
+	gen = pool->gen;
+
+	for (;;) {
+		while (!pool->quit && (pool->gen == gen))
+			pthread_cond_wait(&pool->work, &pool->lock);
+
+		if (pool->quit)
+			break;
+
+		gen = pool->gen;
+		splat_pool_jobs(pool);
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void splat_pool_stop(struct splat_pool *pool)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->n_workers; ++i)
+		pthread_join(pool->workers[i], NULL);
+
+	pool->n_workers = 0;
+	pool->quit = 0;
+}
+
+static void splat_pool_start(struct splat_pool *pool)
+{
+	while (pool->n_workers < (pool->n_threads - 1)) {
+		if (pthread_create(&pool->workers[pool->n_workers], NULL,
+				   splat_pool_worker, pool))
+			break;
+
+		pool->n_workers++;
+	}
+}
+
+/* The worker threads don't exist any more in a child process */
+static void splat_pool_atfork_child(void)
+{
+	struct splat_pool *pool = &splat_pool;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_mutex_init(&pool->busy, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->n_workers = 0;
+	pool->quit = 0;
+}
+
+unsigned splat_pool_init(void)
+{
+	const char *env = getenv("SPLAT_THREADS");
+	long n = 0;
+
+	if (env != NULL)
+		n = strtol(env, NULL, 10);
+
+	if (n <= 0)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	pthread_atfork(NULL, NULL, splat_pool_atfork_child);
+	splat_pool_set_threads((n > 0) ? n : 1);
+
+	return splat_pool.n_threads;
+}
+
+unsigned splat_pool_get_threads(void)
+{
+	return splat_pool.n_threads;
+}
+
+void splat_pool_set_threads(unsigned n)
+{
+	struct splat_pool *pool = &splat_pool;
+
+	n = minmax(n, 1, SPLAT_POOL_MAX_THREADS);
+
+	pthread_mutex_lock(&pool->busy);
+
+	if (n < (pool->n_workers + 1))
+		splat_pool_stop(pool);
+
+	pool->n_threads = n;
+	pthread_mutex_unlock(&pool->busy);
+}
+
+/* If the pool is already busy with jobs from another thread, all the jobs are
+ * simply run in the calling thread.  The GIL is kept so no other Python thread
+ * can resize or free the fragments used by the jobs while they are running,
+ * and the workers don't need it as they don't use the Python API.  */
+void splat_pool_run(splat_pool_fn fn, void *arg, size_t n_jobs)
+{
+	struct splat_pool *pool = &splat_pool;
+	size_t i;
+
+	if ((n_jobs < 2) || (pool->n_threads < 2) ||
+	    pthread_mutex_trylock(&pool->busy)) {
+		for (i = 0; i < n_jobs; ++i)
+			fn(arg, i);
+	} else {
+		splat_pool_start(pool);
+		pthread_mutex_lock(&pool->lock);
+		pool->fn = fn;
+		pool->arg = arg;
+		pool->n_jobs = n_jobs;
+		pool->next = 0;
+		pool->pending = n_jobs;
+		pool->gen++;
+		pthread_cond_broadcast(&pool->work);
+		splat_pool_jobs(pool);
+
+		while (pool->pending)
+			pthread_cond_wait(&pool->done, &pool->lock);
+
+		pthread_mutex_unlock(&pool->lock);
+		pthread_mutex_unlock(&pool->busy);
+	}
+}
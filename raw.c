@@ -0,0 +1,283 @@
+/*
+    Splat - raw.c
+
+    Copyright (C) 2015
+    Guillaume Tucker <guillaume@mangoz.org>
+
+    This program is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "_splat.h"
+#include <stdint.h>
+
+/* Conversions between the samples of a fragment and raw data in any of the
+ * supported sample types */
+
+static const char SPLAT_INT_8[] = "int8";
+static const char SPLAT_INT_16[] = "int16";
+static const char SPLAT_INT_24[] = "int24";
+static const char SPLAT_FLOAT_32[] = "float32";
+static const char SPLAT_FLOAT_64[] = "float64";
+
+static void splat_import_float64(sample_t *out, const char *in, size_t n,
+				 size_t step)
+{
+	while (n--) {
+		*out++ = *(const double *)in;
+		in += step;
+	}
+}
+
+static void splat_export_float64(char *out, const sample_t **in,
+				 unsigned channels, size_t n,
+				 const struct splat_norm *norm)
+{
+	const double gain = norm->gain;
+	double *out64 = (double *)out;
+
+	while (n--) {
+		unsigned c;
+
+		for (c = 0; c < channels; ++c)
+			*out64++ = (*(in[c]++) - norm->offset[c]) * gain;
+	}
+}
+
+static void splat_import_float32(sample_t *out, const char *in, size_t n,
+				 size_t step)
+{
+	while (n--) {
+		*out++ = *(const float *)in;
+		in += step;
+	}
+}
+
+static void splat_export_float32(char *out, const sample_t **in,
+				 unsigned channels, size_t n,
+				 const struct splat_norm *norm)
+{
+	const double gain = norm->gain;
+	float *out32 = (float *)out;
+
+	while (n--) {
+		unsigned c;
+
+		for (c = 0; c < channels; ++c)
+			*out32++ = (*(in[c]++) - norm->offset[c]) * gain;
+	}
+}
+
+static void splat_import_int24(sample_t *out, const char *in, size_t n,
+			       size_t step)
+{
+	static const int32_t neg24 = 1 << 23;
+	static const int32_t neg_mask32 = 0xFF000000;
+	static const sample_t scale = (1 << 23) - 1;
+
+	while (n--) {
+		const uint8_t *in8 = (const uint8_t *)in;
+		int32_t sample32;
+
+		sample32 = *in8++;
+		sample32 += (*in8++) << 8;
+		sample32 += (*in8++) << 16;
+
+		if (sample32 & neg24)
+			sample32 |= neg_mask32;
+
+		*out++ = sample32 / scale;
+		in += step;
+	}
+}
+
+static void splat_export_int24(char *out, const sample_t **in,
+			       unsigned channels, size_t n,
+			       const struct splat_norm *norm)
+{
+	static const int32_t scale = (1 << 23) - 1;
+	const double gain = norm->gain;
+
+	while (n--) {
+		unsigned c;
+
+		for (c = 0; c < channels; ++c) {
+			const sample_t z = (*(in[c]++) - norm->offset[c]) * gain;
+			int32_t s;
+
+			if (z < -1.0)
+				s = -scale;
+			else if (z > 1.0)
+				s = scale;
+			else
+				s = z * scale;
+
+			*out++ = s & 0xFF;
+			*out++ = (s >> 8) & 0xFF;
+			*out++ = (s >> 16) & 0xFF;
+		}
+	}
+}
+
+static void splat_import_int16(sample_t *out, const char *in, size_t n,
+			       size_t step)
+{
+	static const sample_t scale = (1 << 15) - 1;
+
+	while (n--) {
+		*out++ = *(int16_t *)in / scale;
+		in += step;
+	}
+}
+
+static void splat_export_int16(char *out, const sample_t **in,
+			       unsigned channels, size_t n,
+			       const struct splat_norm *norm)
+{
+	static const long scale = (1 << 15) - 1;
+	const double gain = norm->gain;
+
+	while (n--) {
+		unsigned c;
+
+		for (c = 0; c < channels; ++c) {
+			const sample_t z = (*(in[c]++) - norm->offset[c]) * gain;
+			int16_t s;
+
+			if (z < -1.0)
+				s = -scale;
+			else if (z > 1.0)
+				s = scale;
+			else
+				s = z * scale;
+
+			*out++ = s & 0xFF;
+			*out++ = (s >> 8) & 0xFF;
+		}
+	}
+}
+
+static void splat_import_int8(sample_t *out, const char *in, size_t n,
+			      size_t step)
+{
+	static const sample_t scale = 127.0;
+
+	while (n--) {
+		*out++ = *(int8_t *)in / scale;
+		in += step;
+	}
+}
+
+static void splat_export_int8(char *out, const sample_t **in,
+			      unsigned channels, size_t n,
+			      const struct splat_norm *norm)
+{
+	static const sample_t scale = 127.0;
+	const double gain = norm->gain;
+
+	while (n--) {
+		unsigned c;
+
+		for (c = 0; c < channels; ++c) {
+			const sample_t z = ((*in[c]++) - norm->offset[c]) * gain;
+			int8_t s;
+
+			if (z < -1.0)
+				s = 0;
+			else if (z > 1.0)
+				s = 255;
+			else
+				s = z * scale;
+
+			*out++ = s;
+		}
+	}
+}
+
+struct splat_raw_io splat_raw_io_table[SPLAT_RAW_IO_N] = {
+	{ SPLAT_FLOAT_64, 64, splat_import_float64, splat_export_float64 },
+	{ SPLAT_FLOAT_32, 32, splat_import_float32, splat_export_float32 },
+	{ SPLAT_INT_24, 24, splat_import_int24, splat_export_int24, },
+	{ SPLAT_INT_16, 16, splat_import_int16, splat_export_int16, },
+	{ SPLAT_INT_8, 8, splat_import_int8, splat_export_int8 },
+};
+
+#ifdef SPLAT_X86_SIMD_IO
+/* Same order as splat_raw_io_table */
+static const struct splat_raw_io splat_raw_io_avx2_table[] = {
+	{ SPLAT_FLOAT_64, 64,
+	  splat_import_float64_avx2, splat_export_float64_avx2 },
+	{ SPLAT_FLOAT_32, 32,
+	  splat_import_float32_avx2, splat_export_float32_avx2 },
+	{ SPLAT_INT_24, 24, splat_import_int24_avx2, splat_export_int24_avx2 },
+	{ SPLAT_INT_16, 16, splat_import_int16_avx2, splat_export_int16_avx2 },
+	{ SPLAT_INT_8, 8, splat_import_int8_avx2, splat_export_int8_avx2 },
+};
+#endif
+
+/* Select the fastest converters for the given instruction set level */
+const char *splat_raw_io_init(enum splat_simd level)
+{
+#ifdef SPLAT_X86_SIMD_IO
+	if (level >= SPLAT_SIMD_AVX2) {
+		memcpy(splat_raw_io_table, splat_raw_io_avx2_table,
+		       sizeof(splat_raw_io_table));
+		return splat_simd_names[SPLAT_SIMD_AVX2];
+	}
+#endif
+
+	return splat_simd_names[SPLAT_SIMD_GENERIC];
+}
+
+const struct splat_raw_io *splat_raw_io_get(const char *sample_type)
+{
+	const struct splat_raw_io *it;
+	const struct splat_raw_io * const end =
+		&splat_raw_io_table[ARRAY_SIZE(splat_raw_io_table)];
+
+	for (it = splat_raw_io_table; it != end; ++it)
+		if (!strcmp(sample_type, it->sample_type))
+			return it;
+
+	PyErr_SetString(PyExc_ValueError, "unsupported sample type");
+
+	return NULL;
+}
+
+/* Import length samples from raw data with step bytes between each sample of
+ * a channel and the channels one after the other, into the fragment from the
+ * given offset */
+void splat_raw_import(struct splat_fragment *frag,
+		      const struct splat_raw_io *io, const char *in,
+		      size_t offset, size_t length, size_t step)
+{
+	const size_t sample_size = io->sample_width / 8;
+	unsigned c;
+
+	for (c = 0; c < frag->n_channels; ++c)
+		io->import(&frag->data[c][offset], (in + (c * sample_size)),
+			   length, step);
+}
+
+void splat_raw_export(const struct splat_fragment *frag,
+		      const struct splat_raw_io *io, char *out, size_t start,
+		      size_t length, const struct splat_norm *norm)
+{
+	const sample_t *in[SPLAT_MAX_CHANNELS];
+	unsigned c;
+
+	for (c = 0; c < frag->n_channels; ++c)
+		in[c] = &frag->data[c][start];
+
+	io->export(out, in, frag->n_channels, length, norm);
+}
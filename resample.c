@@ -0,0 +1,334 @@
+/*
+    Splat - resample.c
+
+    Copyright (C) 2015
+    Guillaume Tucker <guillaume@mangoz.org>
+
+    This program is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "_splat.h"
+#include <stdint.h>
+
+/* Polyphase windowed-sinc resampler.  With the rates reduced to up / down,
+ * output sample m is at the input position m * down / up so its integer part
+ * gives the first input tap and the remainder gives the phase.  Each phase has
+ * its own set of coefficients, taken from a sinc with a Kaiser window.  */
+
+/* About 90dB of stop-band attenuation */
+#define SPLAT_RESAMPLE_BETA 9.0
+/* Transition width with this window, in zero crossings */
+#define SPLAT_RESAMPLE_TRANSITION 2.87
+
+static unsigned splat_resample_gcd(unsigned a, unsigned b)
+{
+	while (b) {
+		const unsigned t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/* Modified Bessel function of the first kind, order 0 */
+static double splat_resample_i0(double x)
+{
+	const double q = (x * x) / 4.0;
+	double term = 1.0;
+	double sum = 1.0;
+	unsigned k;
+
+	for (k = 1; term > (sum * 1e-21); ++k) {
+		term *= q / ((double)k * k);
+		sum += term;
+	}
+
+	return sum;
+}
+
+static void splat_resample_phase(const struct splat_resampler *rs,
+				 double *k, double frac, double cutoff,
+				 double width)
+{
+	const double i0_beta = splat_resample_i0(SPLAT_RESAMPLE_BETA);
+	double sum = 0.0;
+	size_t j;
+
+	for (j = 0; j < rs->n_taps; ++j) {
+		const double d = (double)j - rs->half + 1 - frac;
+		const double x = d / width;
+		double h;
+
+		if (fabs(x) >= 1.0) {
+			k[j] = 0.0;
+			continue;
+		}
+
+		h = (d == 0.0) ? 1.0 :
+			sin(M_PI * cutoff * d) / (M_PI * cutoff * d);
+		h *= splat_resample_i0(SPLAT_RESAMPLE_BETA * sqrt(1.0 - x * x))
+			/ i0_beta;
+		k[j] = h;
+		sum += h;
+	}
+
+	/* Unity gain at DC for every phase */
+	for (j = 0; j < rs->n_taps; ++j)
+		k[j] /= sum;
+}
+
+int splat_resampler_init(struct splat_resampler *rs, unsigned in_rate,
+			 unsigned out_rate, unsigned quality)
+{
+	const unsigned gcd = splat_resample_gcd(in_rate, out_rate);
+	double scale;
+	double cutoff;
+	double width;
+	size_t p;
+
+	rs->in_rate = in_rate;
+	rs->out_rate = out_rate;
+	rs->up = out_rate / gcd;
+	rs->down = in_rate / gcd;
+	rs->n_phases = min(rs->up, SPLAT_RESAMPLE_MAX_PHASES);
+
+	/* When decimating, the sinc gets wider to cut below the new Nyquist */
+	scale = (rs->up < rs->down) ? ((double)rs->up / rs->down) : 1.0;
+	cutoff = scale * (1.0 - (SPLAT_RESAMPLE_TRANSITION / quality));
+	width = quality / scale;
+
+	/* Keep a multiple of 4 taps for the dot products */
+	rs->half = ceil(width);
+	rs->half += rs->half % 2;
+	rs->n_taps = rs->half * 2;
+
+	rs->k = PyMem_Malloc((rs->n_phases + 1) * rs->n_taps * sizeof(double));
+
+	if (rs->k == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	for (p = 0; p <= rs->n_phases; ++p) {
+		const double frac = (double)p / rs->n_phases;
+
+		splat_resample_phase(rs, &rs->k[p * rs->n_taps], frac, cutoff,
+				     width);
+	}
+
+	return 0;
+}
+
+void splat_resampler_free(struct splat_resampler *rs)
+{
+	PyMem_Free(rs->k);
+	rs->k = NULL;
+}
+
+size_t splat_resample_length(size_t length, unsigned in_rate,
+			     unsigned out_rate)
+{
+	return (((uint64_t)length * out_rate) + in_rate - 1) / in_rate;
+}
+
+/* Input sample number of the first tap for output sample m */
+#define splat_resample_pos(_rs, _m) \
+	(((uint64_t)(_m) * (_rs)->down) / (_rs)->up)
+
+/* Check whether any input sample needed for the given output range is used */
+int splat_resample_used(const struct splat_resampler *rs,
+			const struct splat_fragment *frag,
+			size_t start, size_t n)
+{
+	const size_t first_pos = splat_resample_pos(rs, start);
+	const size_t last_pos = splat_resample_pos(rs, (start + n - 1));
+	size_t first;
+	size_t last;
+	size_t b;
+
+	if (!n || !frag->length)
+		return 0;
+
+	first = (first_pos < rs->half) ? 0 : (first_pos - rs->half + 1);
+	last = min((last_pos + rs->half), (frag->length - 1));
+
+	if (first > last)
+		return 0;
+
+	for (b = (first >> SPLAT_FRAG_BLOCK_BITS);
+	     b <= (last >> SPLAT_FRAG_BLOCK_BITS); ++b)
+		if (frag->blocks[b] & SPLAT_FRAG_BLOCK_USED)
+			return 1;
+
+	return 0;
+}
+
+/* The samples outside the input are zeros, which leaves the sums unchanged
+ * so both cases give exactly the same results */
+static double splat_resample_dot(const double *k, const sample_t *in,
+				 size_t in_length, ssize_t first,
+				 size_t n_taps)
+{
+	double a[4] = { 0.0, 0.0, 0.0, 0.0 };
+	size_t j;
+	unsigned l;
+
+	if ((first >= 0) && ((first + n_taps) <= in_length)) {
+		const sample_t *x = &in[first];
+
+		for (j = 0; j < n_taps; j += 4)
+			for (l = 0; l < 4; ++l)
+				a[l] += k[j + l] * x[j + l];
+	} else {
+		for (j = 0; j < n_taps; j += 4) {
+			for (l = 0; l < 4; ++l) {
+				const ssize_t i = first + j + l;
+
+				if ((i >= 0) && ((size_t)i < in_length))
+					a[l] += k[j + l] * in[i];
+			}
+		}
+	}
+
+	return (a[0] + a[1]) + (a[2] + a[3]);
+}
+
+void splat_resample(const struct splat_resampler *rs, const sample_t *in,
+		    size_t in_length, sample_t *out, size_t start, size_t n)
+{
+	const size_t step = rs->down / rs->up;
+	const size_t step_rem = rs->down % rs->up;
+	size_t pos = splat_resample_pos(rs, start);
+	size_t rem = ((uint64_t)start * rs->down) % rs->up;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		const ssize_t first =
+			(ssize_t)pos - (ssize_t)rs->half + 1;
+		double y;
+
+		if (rs->n_phases == rs->up) {
+			y = splat_resample_dot(&rs->k[rem * rs->n_taps], in,
+					       in_length, first, rs->n_taps);
+		} else {
+			const double phase = (double)rem * rs->n_phases /
+				rs->up;
+			const size_t p = phase;
+			const double *k = &rs->k[p * rs->n_taps];
+			const double y0 = splat_resample_dot(
+				k, in, in_length, first, rs->n_taps);
+			const double y1 = splat_resample_dot(
+				&k[rs->n_taps], in, in_length, first,
+				rs->n_taps);
+
+			y = y0 + ((phase - p) * (y1 - y0));
+		}
+
+		out[i] = y;
+		pos += step;
+		rem += step_rem;
+
+		if (rem >= rs->up) {
+			rem -= rs->up;
+			++pos;
+		}
+	}
+}
+
+/* One job for each output block, with all the channels */
+struct splat_resample_job {
+	const struct splat_resampler *rs;
+	const struct splat_fragment *in;
+	struct splat_fragment *out;
+};
+
+static void splat_resample_job(void *arg, size_t b)
+{
+	const struct splat_resample_job *job = arg;
+	const struct splat_fragment *in = job->in;
+	struct splat_fragment *out = job->out;
+	const size_t start = b << SPLAT_FRAG_BLOCK_BITS;
+	const size_t n = min(SPLAT_FRAG_BLOCK, (out->length - start));
+	unsigned c;
+
+	if (!splat_resample_used(job->rs, in, start, n))
+		return;
+
+	for (c = 0; c < out->n_channels; ++c)
+		splat_resample(job->rs, in->data[c], in->length,
+			       &out->data[c][start], start, n);
+
+	out->blocks[b] = SPLAT_FRAG_BLOCK_USED;
+}
+
+int splat_frag_resample(struct splat_fragment *frag, unsigned rate,
+			unsigned quality)
+{
+	struct splat_resampler rs;
+	struct splat_fragment tmp;
+	struct splat_resample_job job;
+	size_t length;
+	size_t i;
+	unsigned c;
+	int res = -1;
+
+	if (rate == frag->rate)
+		return 0;
+
+	length = splat_resample_length(frag->length, frag->rate, rate);
+
+	if (splat_resampler_init(&rs, frag->rate, rate, quality))
+		return -1;
+
+	if (splat_frag_init(&tmp, frag->n_channels, rate, length, NULL))
+		goto free_rs;
+
+	job.rs = &rs;
+	job.in = frag;
+	job.out = &tmp;
+	splat_pool_run(splat_resample_job, &job, splat_frag_n_blocks(length));
+
+	/* Start again from silence so only the used blocks are copied */
+	if (splat_frag_resize(frag, 0) || splat_frag_resize(frag, length))
+		goto free_tmp;
+
+	frag->rate = rate;
+
+	if (frag->file != NULL)
+		splat_file_set_rate(frag);
+
+	for (i = 0; i < length; i += SPLAT_FRAG_BLOCK) {
+		const size_t n = min(SPLAT_FRAG_BLOCK, (length - i));
+
+		if (!splat_frag_block_used(&tmp, i))
+			continue;
+
+		splat_frag_touch(frag, i, n);
+
+		for (c = 0; c < frag->n_channels; ++c)
+			memcpy(&frag->data[c][i], &tmp.data[c][i],
+			       (n * sizeof(sample_t)));
+	}
+
+	res = 0;
+
+free_tmp:
+	splat_frag_free(&tmp);
+free_rs:
+	splat_resampler_free(&rs);
+
+	return res;
+}
@@ -5,6 +5,7 @@ try:
 except ImportError:
     import distutils.core as setuptools
 from setuptools import setup, Extension
+from setuptools.command.build_ext import build_ext
 
 # The manual needs to be generated with Sphinx but is only required when
 # running the sdist command.
@@ -15,6 +16,34 @@ elif len(sys.argv) > 1 and sys.argv[1] == 'sdist':
 else:
     data_files = []
 
+# Fragments store their samples as double unless created with float32 samples,
+# which halves their memory and bandwidth.  Setting SPLAT_SAMPLE_TYPE=float32
+# makes this the default.
+if os.environ.get('SPLAT_SAMPLE_TYPE') == 'float32':
+    define_macros = [('SPLAT_DEFAULT_SAMPLE_WIDTH', '32')]
+else:
+    define_macros = []
+
+# Keep SIMD kernels bit-exact with generic ones
+extra_compile_args = ['-ffp-contract=off']
+
+# Sources depending on the sample type, which also get built with float
+# samples and SPLAT_FLOAT32 defined
+sample_sources = ['frag.c', 'source.c', 'filter.c', 'simd.c', 'file.c',
+                  'resample.c', 'raw.c', 'ops.c']
+
+class splat_build_ext(build_ext):
+    def build_extension(self, ext):
+        # The object files go in their own directory as they have the same
+        # names as the ones built with double samples
+        ext.extra_objects = self.compiler.compile(
+            sample_sources,
+            output_dir=os.path.join(self.build_temp, 'float32'),
+            macros=(ext.define_macros + [('SPLAT_FLOAT32', None)]),
+            include_dirs=ext.include_dirs, debug=self.debug,
+            extra_postargs=ext.extra_compile_args, depends=ext.depends)
+        build_ext.build_extension(self, ext)
+
 setup(name='verdigris.mu-splat', version='1.5',
       description="Sound generator, synthesizer and editor",
       author="Guillaume Tucker",
@@ -22,9 +51,12 @@ setup(name='verdigris.mu-splat', version='1.5',
       url="https://github.com/verdigris/splat",
       py_modules=['test', 'example', 'dew_drop'],
       ext_modules=[Extension('_splat',
-                             sources=['_splat.c', 'signal.c', 'spline.c',
-                                      'frag.c', 'source.c', 'filter.c'],
-                             depends=['_splat.h'])],
+                             sources=(['_splat.c', 'signal.c', 'spline.c',
+                                       'fft.c', 'pool.c'] + sample_sources),
+                             depends=['_splat.h'],
+                             define_macros=define_macros,
+                             extra_compile_args=extra_compile_args)],
+      cmdclass={'build_ext': splat_build_ext},
       packages=['splat'],
       data_files=data_files,
       long_description=open('README.rst', 'rb').read(),
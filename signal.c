@@ -23,7 +23,7 @@
 static int splat_signal_func(struct splat_signal *s, struct splat_vector *v)
 {
 	const double rate = s->rate;
-	sample_t *out = v->data;
+	double *out = v->data;
 	size_t i = s->cur;
 	size_t j = s->len;
 
@@ -50,8 +50,22 @@ static int splat_signal_func(struct splat_signal *s, struct splat_vector *v)
 static int splat_signal_frag(struct splat_signal *s, struct splat_vector *v)
 {
 	struct splat_fragment *frag = splat_frag_from_obj(v->obj);
+	const void *in = frag->data[0];
+	double *out = v->data;
+	size_t j = s->len;
+
+	/* This is built once, so it deals with both sample types */
+	if (frag->sample_width == 32) {
+		const float *in32 = (const float *)in + s->cur;
 
-	memcpy(v->data, &frag->data[0][s->cur], (s->len * sizeof(sample_t)));
+		while (j--)
+			*out++ = *in32++;
+	} else {
+		const double *in64 = (const double *)in + s->cur;
+
+		while (j--)
+			*out++ = *in64++;
+	}
 
 	return 0;
 }
@@ -61,7 +75,7 @@ static int splat_signal_spline(struct splat_signal *s, struct splat_vector *v)
 	struct splat_spline *spline = splat_spline_from_obj(v->obj);
 	const double rate = s->rate;
 	const double k0 = spline->k0;
-	sample_t *out = v->data;
+	double *out = v->data;
 	size_t i = s->cur;
 	size_t j = s->len;
 	PyObject *poly = NULL;
@@ -158,7 +172,7 @@ int splat_signal_init(struct splat_signal *s, size_t length,
 		struct splat_fragment *frag = splat_frag_from_obj(signal);
 
 		if (PyFloat_Check(signal)) {
-			const sample_t value = PyFloat_AS_DOUBLE(signal);
+			const double value = PyFloat_AS_DOUBLE(signal);
 			size_t j;
 
 			for (j = 0; j < SPLAT_VECTOR_LEN; ++j)
@@ -0,0 +1,1061 @@
+/*
+    Splat - simd.c
+
+    Copyright (C) 2015
+    Guillaume Tucker <guillaume@mangoz.org>
+
+    This program is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "_splat.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SPLAT_X86_SIMD
+# include <immintrin.h>
+#endif
+
+const char *splat_simd_names[SPLAT_SIMD_N] = {
+	"generic", "avx2", "avx512",
+};
+
+#ifdef SPLAT_X86_SIMD
+static const struct splat_kernels splat_kernels_avx2;
+static const struct splat_kernels splat_kernels_avx512;
+#endif
+
+static enum splat_simd splat_simd_detect(void)
+{
+	enum splat_simd level = SPLAT_SIMD_GENERIC;
+
+#ifdef SPLAT_X86_SIMD
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		level = SPLAT_SIMD_AVX2;
+
+	if ((level == SPLAT_SIMD_AVX2) && __builtin_cpu_supports("avx512f"))
+		level = SPLAT_SIMD_AVX512;
+#endif
+
+	return level;
+}
+
+enum splat_simd splat_simd_init(void)
+{
+	enum splat_simd level = splat_simd_detect();
+	const char *env = getenv("SPLAT_SIMD");
+
+	if (env != NULL) {
+		enum splat_simd max_level;
+
+		for (max_level = 0; max_level < SPLAT_SIMD_N; ++max_level)
+			if (!strcmp(env, splat_simd_names[max_level]))
+				break;
+
+		if (max_level < level)
+			level = max_level;
+	}
+
+#ifdef SPLAT_X86_SIMD
+	if (level == SPLAT_SIMD_AVX512)
+		splat_kernels = splat_kernels_avx512;
+	else if (level == SPLAT_SIMD_AVX2)
+		splat_kernels = splat_kernels_avx2;
+#endif
+
+	return level;
+}
+
+#ifdef SPLAT_X86_SIMD
+
+/* The functions below are built for a specific instruction set and must only
+ * be called after checking it is supported by the CPU.  They give the exact
+ * same results as the generic versions.  */
+#define SPLAT_AVX2 __attribute__((target("avx2")))
+#define SPLAT_AVX512 __attribute__((target("avx2,avx512f")))
+
+/* Number of frames converted at once when interleaving channels */
+#define SPLAT_SIMD_BLOCK 64
+
+/* ----------------------------------------------------------------------------
+ * Fragment kernels
+ */
+
+#ifdef SPLAT_FLOAT32
+
+/* With 32-bit samples, the gains are applied in double precision like in the
+ * generic kernels and the results are then rounded to float */
+
+SPLAT_AVX2 static void splat_mix_avx2(sample_t *dst, const sample_t *src,
+				      size_t n, double gain)
+{
+	const __m256d g = _mm256_set1_pd(gain);
+
+	for (; n >= 4; n -= 4, dst += 4, src += 4) {
+		const __m256d a = _mm256_mul_pd(
+			_mm256_cvtps_pd(_mm_loadu_ps(src)), g);
+		const __m256d b = _mm256_cvtps_pd(_mm_loadu_ps(dst));
+
+		_mm_storeu_ps(dst, _mm256_cvtpd_ps(_mm256_add_pd(b, a)));
+	}
+
+	while (n--)
+		*dst++ += gain * (*src++);
+}
+
+SPLAT_AVX2 static void splat_amp_avx2(sample_t *data, size_t n, double gain)
+{
+	const __m256d g = _mm256_set1_pd(gain);
+
+	for (; n >= 4; n -= 4, data += 4) {
+		const __m256d a = _mm256_cvtps_pd(_mm_loadu_ps(data));
+
+		_mm_storeu_ps(data, _mm256_cvtpd_ps(_mm256_mul_pd(a, g)));
+	}
+
+	while (n--)
+		*data++ *= gain;
+}
+
+SPLAT_AVX2 static void splat_mix_vec_avx2(sample_t *dst, const sample_t *src,
+					  const double *gains, size_t n)
+{
+	for (; n >= 4; n -= 4, dst += 4, src += 4, gains += 4) {
+		const __m256d a = _mm256_mul_pd(
+			_mm256_cvtps_pd(_mm_loadu_ps(src)),
+			_mm256_loadu_pd(gains));
+		const __m256d b = _mm256_cvtps_pd(_mm_loadu_ps(dst));
+
+		_mm_storeu_ps(dst, _mm256_cvtpd_ps(_mm256_add_pd(b, a)));
+	}
+
+	while (n--)
+		*dst++ += *src++ * *gains++;
+}
+
+SPLAT_AVX2 static void splat_amp_vec_avx2(sample_t *data,
+					  const double *gains, size_t n)
+{
+	for (; n >= 4; n -= 4, data += 4, gains += 4) {
+		const __m256d a = _mm256_cvtps_pd(_mm_loadu_ps(data));
+		const __m256d g = _mm256_loadu_pd(gains);
+
+		_mm_storeu_ps(data, _mm256_cvtpd_ps(_mm256_mul_pd(a, g)));
+	}
+
+	while (n--)
+		*data++ *= *gains++;
+}
+
+SPLAT_AVX512 static void splat_mix_avx512(sample_t *dst, const sample_t *src,
+					  size_t n, double gain)
+{
+	const __m512d g = _mm512_set1_pd(gain);
+
+	for (; n >= 8; n -= 8, dst += 8, src += 8) {
+		const __m512d a = _mm512_mul_pd(
+			_mm512_cvtps_pd(_mm256_loadu_ps(src)), g);
+		const __m512d b = _mm512_cvtps_pd(_mm256_loadu_ps(dst));
+
+		_mm256_storeu_ps(dst, _mm512_cvtpd_ps(_mm512_add_pd(b, a)));
+	}
+
+	while (n--)
+		*dst++ += gain * (*src++);
+}
+
+SPLAT_AVX512 static void splat_amp_avx512(sample_t *data, size_t n,
+					  double gain)
+{
+	const __m512d g = _mm512_set1_pd(gain);
+
+	for (; n >= 8; n -= 8, data += 8) {
+		const __m512d a = _mm512_cvtps_pd(_mm256_loadu_ps(data));
+
+		_mm256_storeu_ps(data, _mm512_cvtpd_ps(_mm512_mul_pd(a, g)));
+	}
+
+	while (n--)
+		*data++ *= gain;
+}
+
+SPLAT_AVX512 static void splat_mix_vec_avx512(sample_t *dst,
+					      const sample_t *src,
+					      const double *gains, size_t n)
+{
+	for (; n >= 8; n -= 8, dst += 8, src += 8, gains += 8) {
+		const __m512d a = _mm512_mul_pd(
+			_mm512_cvtps_pd(_mm256_loadu_ps(src)),
+			_mm512_loadu_pd(gains));
+		const __m512d b = _mm512_cvtps_pd(_mm256_loadu_ps(dst));
+
+		_mm256_storeu_ps(dst, _mm512_cvtpd_ps(_mm512_add_pd(b, a)));
+	}
+
+	while (n--)
+		*dst++ += *src++ * *gains++;
+}
+
+SPLAT_AVX512 static void splat_amp_vec_avx512(sample_t *data,
+					      const double *gains, size_t n)
+{
+	for (; n >= 8; n -= 8, data += 8, gains += 8) {
+		const __m512d a = _mm512_cvtps_pd(_mm256_loadu_ps(data));
+		const __m512d g = _mm512_loadu_pd(gains);
+
+		_mm256_storeu_ps(data, _mm512_cvtpd_ps(_mm512_mul_pd(a, g)));
+	}
+
+	while (n--)
+		*data++ *= *gains++;
+}
+
+#else /* SPLAT_FLOAT32 */
+
+SPLAT_AVX2 static void splat_mix_avx2(sample_t *dst, const sample_t *src,
+				      size_t n, double gain)
+{
+	const __m256d g = _mm256_set1_pd(gain);
+
+	for (; n >= 8; n -= 8, dst += 8, src += 8) {
+		const __m256d a = _mm256_mul_pd(_mm256_loadu_pd(src), g);
+		const __m256d b = _mm256_mul_pd(_mm256_loadu_pd(src + 4), g);
+
+		_mm256_storeu_pd(dst, _mm256_add_pd(_mm256_loadu_pd(dst), a));
+		_mm256_storeu_pd(dst + 4,
+				 _mm256_add_pd(_mm256_loadu_pd(dst + 4), b));
+	}
+
+	while (n--)
+		*dst++ += gain * (*src++);
+}
+
+SPLAT_AVX2 static void splat_amp_avx2(sample_t *data, size_t n, double gain)
+{
+	const __m256d g = _mm256_set1_pd(gain);
+
+	for (; n >= 8; n -= 8, data += 8) {
+		const __m256d a = _mm256_loadu_pd(data);
+		const __m256d b = _mm256_loadu_pd(data + 4);
+
+		_mm256_storeu_pd(data, _mm256_mul_pd(a, g));
+		_mm256_storeu_pd(data + 4, _mm256_mul_pd(b, g));
+	}
+
+	while (n--)
+		*data++ *= gain;
+}
+
+SPLAT_AVX2 static void splat_mix_vec_avx2(sample_t *dst, const sample_t *src,
+					  const double *gains, size_t n)
+{
+	for (; n >= 8; n -= 8, dst += 8, src += 8, gains += 8) {
+		const __m256d a = _mm256_mul_pd(_mm256_loadu_pd(src),
+						_mm256_loadu_pd(gains));
+		const __m256d b = _mm256_mul_pd(_mm256_loadu_pd(src + 4),
+						_mm256_loadu_pd(gains + 4));
+
+		_mm256_storeu_pd(dst, _mm256_add_pd(_mm256_loadu_pd(dst), a));
+		_mm256_storeu_pd(dst + 4,
+				 _mm256_add_pd(_mm256_loadu_pd(dst + 4), b));
+	}
+
+	while (n--)
+		*dst++ += *src++ * *gains++;
+}
+
+SPLAT_AVX2 static void splat_amp_vec_avx2(sample_t *data,
+					  const double *gains, size_t n)
+{
+	for (; n >= 8; n -= 8, data += 8, gains += 8) {
+		const __m256d a = _mm256_mul_pd(_mm256_loadu_pd(data),
+						_mm256_loadu_pd(gains));
+		const __m256d b = _mm256_mul_pd(_mm256_loadu_pd(data + 4),
+						_mm256_loadu_pd(gains + 4));
+
+		_mm256_storeu_pd(data, a);
+		_mm256_storeu_pd(data + 4, b);
+	}
+
+	while (n--)
+		*data++ *= *gains++;
+}
+
+SPLAT_AVX512 static void splat_mix_avx512(sample_t *dst, const sample_t *src,
+					  size_t n, double gain)
+{
+	const __m512d g = _mm512_set1_pd(gain);
+
+	for (; n >= 16; n -= 16, dst += 16, src += 16) {
+		const __m512d a = _mm512_mul_pd(_mm512_loadu_pd(src), g);
+		const __m512d b = _mm512_mul_pd(_mm512_loadu_pd(src + 8), g);
+
+		_mm512_storeu_pd(dst, _mm512_add_pd(_mm512_loadu_pd(dst), a));
+		_mm512_storeu_pd(dst + 8,
+				 _mm512_add_pd(_mm512_loadu_pd(dst + 8), b));
+	}
+
+	if (n) {
+		const __mmask8 m0 = (n >= 8) ? 0xFF : ((1 << n) - 1);
+		const __mmask8 m1 = (n > 8) ? ((1 << (n - 8)) - 1) : 0;
+		const __m512d a = _mm512_mul_pd(
+			_mm512_maskz_loadu_pd(m0, src), g);
+		const __m512d b = _mm512_mul_pd(
+			_mm512_maskz_loadu_pd(m1, src + 8), g);
+
+		_mm512_mask_storeu_pd(dst, m0, _mm512_add_pd(
+					      _mm512_maskz_loadu_pd(m0, dst), a));
+		_mm512_mask_storeu_pd(dst + 8, m1, _mm512_add_pd(
+					      _mm512_maskz_loadu_pd(m1, dst + 8),
+					      b));
+	}
+}
+
+SPLAT_AVX512 static void splat_amp_avx512(sample_t *data, size_t n,
+					  double gain)
+{
+	const __m512d g = _mm512_set1_pd(gain);
+
+	for (; n >= 16; n -= 16, data += 16) {
+		const __m512d a = _mm512_loadu_pd(data);
+		const __m512d b = _mm512_loadu_pd(data + 8);
+
+		_mm512_storeu_pd(data, _mm512_mul_pd(a, g));
+		_mm512_storeu_pd(data + 8, _mm512_mul_pd(b, g));
+	}
+
+	if (n) {
+		const __mmask8 m0 = (n >= 8) ? 0xFF : ((1 << n) - 1);
+		const __mmask8 m1 = (n > 8) ? ((1 << (n - 8)) - 1) : 0;
+
+		_mm512_mask_storeu_pd(data, m0, _mm512_mul_pd(
+					      _mm512_maskz_loadu_pd(m0, data), g));
+		_mm512_mask_storeu_pd(data + 8, m1, _mm512_mul_pd(
+					      _mm512_maskz_loadu_pd(m1, data + 8),
+					      g));
+	}
+}
+
+SPLAT_AVX512 static void splat_mix_vec_avx512(sample_t *dst,
+					      const sample_t *src,
+					      const double *gains, size_t n)
+{
+	for (; n >= 8; n -= 8, dst += 8, src += 8, gains += 8) {
+		const __m512d a = _mm512_mul_pd(_mm512_loadu_pd(src),
+						_mm512_loadu_pd(gains));
+
+		_mm512_storeu_pd(dst, _mm512_add_pd(_mm512_loadu_pd(dst), a));
+	}
+
+	if (n) {
+		const __mmask8 m = (1 << n) - 1;
+		const __m512d a = _mm512_mul_pd(
+			_mm512_maskz_loadu_pd(m, src),
+			_mm512_maskz_loadu_pd(m, gains));
+
+		_mm512_mask_storeu_pd(dst, m, _mm512_add_pd(
+					      _mm512_maskz_loadu_pd(m, dst), a));
+	}
+}
+
+SPLAT_AVX512 static void splat_amp_vec_avx512(sample_t *data,
+					      const double *gains, size_t n)
+{
+	for (; n >= 8; n -= 8, data += 8, gains += 8)
+		_mm512_storeu_pd(data, _mm512_mul_pd(_mm512_loadu_pd(data),
+						     _mm512_loadu_pd(gains)));
+
+	if (n) {
+		const __mmask8 m = (1 << n) - 1;
+
+		_mm512_mask_storeu_pd(data, m, _mm512_mul_pd(
+					      _mm512_maskz_loadu_pd(m, data),
+					      _mm512_maskz_loadu_pd(m, gains)));
+	}
+}
+
+#endif /* SPLAT_FLOAT32 */
+
+/* The biquad kernels work on double buffers with either sample type, and
+ * process the channels in parallel as each one depends on the previous
+ * samples */
+
+/* Process a group of 4 lanes, the frames being lanes apart */
+SPLAT_AVX2 static void splat_biquad4_avx2(double *x, size_t n, size_t lanes,
+					  const struct splat_biquad_coefs *k,
+					  double *s1, double *s2)
+{
+	const __m256d b0 = _mm256_set1_pd(k->b0);
+	const __m256d b1 = _mm256_set1_pd(k->b1);
+	const __m256d b2 = _mm256_set1_pd(k->b2);
+	const __m256d a1 = _mm256_set1_pd(k->a1);
+	const __m256d a2 = _mm256_set1_pd(k->a2);
+	__m256d z1 = _mm256_loadu_pd(s1);
+	__m256d z2 = _mm256_loadu_pd(s2);
+
+	for (; n; --n, x += lanes) {
+		const __m256d in = _mm256_loadu_pd(x);
+		const __m256d y = _mm256_add_pd(_mm256_mul_pd(b0, in), z1);
+
+		z1 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(b1, in),
+						 _mm256_mul_pd(a1, y)), z2);
+		z2 = _mm256_sub_pd(_mm256_mul_pd(b2, in),
+				   _mm256_mul_pd(a2, y));
+		_mm256_storeu_pd(x, y);
+	}
+
+	_mm256_storeu_pd(s1, z1);
+	_mm256_storeu_pd(s2, z2);
+}
+
+SPLAT_AVX2 static void splat_biquad_avx2(double *x, size_t n, size_t lanes,
+					 const struct splat_biquad_coefs *k,
+					 double *s1, double *s2)
+{
+	size_t c;
+
+	for (c = 0; c < lanes; c += 4)
+		splat_biquad4_avx2(&x[c], n, lanes, k, &s1[c], &s2[c]);
+}
+
+SPLAT_AVX512 static void splat_biquad_avx512(double *x, size_t n,
+					     size_t lanes,
+					     const struct splat_biquad_coefs *k,
+					     double *s1, double *s2)
+{
+	const __m512d b0 = _mm512_set1_pd(k->b0);
+	const __m512d b1 = _mm512_set1_pd(k->b1);
+	const __m512d b2 = _mm512_set1_pd(k->b2);
+	const __m512d a1 = _mm512_set1_pd(k->a1);
+	const __m512d a2 = _mm512_set1_pd(k->a2);
+	size_t c;
+
+	for (c = 0; (c + 8) <= lanes; c += 8) {
+		__m512d z1 = _mm512_loadu_pd(&s1[c]);
+		__m512d z2 = _mm512_loadu_pd(&s2[c]);
+		double *it = &x[c];
+		size_t i;
+
+		for (i = 0; i < n; ++i, it += lanes) {
+			const __m512d in = _mm512_loadu_pd(it);
+			const __m512d y = _mm512_add_pd(_mm512_mul_pd(b0, in),
+							z1);
+
+			z1 = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(b1, in),
+							 _mm512_mul_pd(a1, y)),
+					   z2);
+			z2 = _mm512_sub_pd(_mm512_mul_pd(b2, in),
+					   _mm512_mul_pd(a2, y));
+			_mm512_storeu_pd(it, y);
+		}
+
+		_mm512_storeu_pd(&s1[c], z1);
+		_mm512_storeu_pd(&s2[c], z2);
+	}
+
+	if (c < lanes)
+		splat_biquad4_avx2(&x[c], n, lanes, k, &s1[c], &s2[c]);
+}
+
+/* The sums kernels load samples of either type as doubles, and keep one SIMD
+ * lane for each lane of the sums */
+
+#ifdef SPLAT_FLOAT32
+# define splat_load_avx2(_x) _mm256_cvtps_pd(_mm_loadu_ps(_x))
+# define splat_load_avx512(_x) _mm512_cvtps_pd(_mm256_loadu_ps(_x))
+#else
+# define splat_load_avx2(_x) _mm256_loadu_pd(_x)
+# define splat_load_avx512(_x) _mm512_loadu_pd(_x)
+#endif
+
+/* Add the last samples which don't fill all the lanes */
+static void splat_sums_tail(const sample_t *x, size_t n,
+			    struct splat_sums *sums, const double *lo,
+			    const double *hi)
+{
+	size_t l;
+
+	for (l = 0; l < SPLAT_SUMS_LANES; ++l) {
+		sums->min = min(sums->min, lo[l]);
+		sums->max = max(sums->max, hi[l]);
+	}
+
+	for (l = 0; l < n; ++l) {
+		const double v = x[l];
+
+		sums->min = min(sums->min, v);
+		sums->max = max(sums->max, v);
+		sums->sum[l] += v;
+		sums->sum2[l] += v * v;
+	}
+}
+
+SPLAT_AVX2 static void splat_sums_avx2(const sample_t *x, size_t n,
+				       struct splat_sums *sums)
+{
+	__m256d lo0 = _mm256_set1_pd(sums->min);
+	__m256d lo1 = lo0;
+	__m256d hi0 = _mm256_set1_pd(sums->max);
+	__m256d hi1 = hi0;
+	__m256d s0 = _mm256_loadu_pd(sums->sum);
+	__m256d s1 = _mm256_loadu_pd(&sums->sum[4]);
+	__m256d q0 = _mm256_loadu_pd(sums->sum2);
+	__m256d q1 = _mm256_loadu_pd(&sums->sum2[4]);
+	double lo[SPLAT_SUMS_LANES];
+	double hi[SPLAT_SUMS_LANES];
+
+	for (; n >= 8; n -= 8, x += 8) {
+		const __m256d a = splat_load_avx2(x);
+		const __m256d b = splat_load_avx2(&x[4]);
+
+		lo0 = _mm256_min_pd(lo0, a);
+		lo1 = _mm256_min_pd(lo1, b);
+		hi0 = _mm256_max_pd(hi0, a);
+		hi1 = _mm256_max_pd(hi1, b);
+		s0 = _mm256_add_pd(s0, a);
+		s1 = _mm256_add_pd(s1, b);
+		q0 = _mm256_add_pd(q0, _mm256_mul_pd(a, a));
+		q1 = _mm256_add_pd(q1, _mm256_mul_pd(b, b));
+	}
+
+	_mm256_storeu_pd(lo, lo0);
+	_mm256_storeu_pd(&lo[4], lo1);
+	_mm256_storeu_pd(hi, hi0);
+	_mm256_storeu_pd(&hi[4], hi1);
+	_mm256_storeu_pd(sums->sum, s0);
+	_mm256_storeu_pd(&sums->sum[4], s1);
+	_mm256_storeu_pd(sums->sum2, q0);
+	_mm256_storeu_pd(&sums->sum2[4], q1);
+	splat_sums_tail(x, n, sums, lo, hi);
+}
+
+SPLAT_AVX512 static void splat_sums_avx512(const sample_t *x, size_t n,
+					   struct splat_sums *sums)
+{
+	__m512d lo0 = _mm512_set1_pd(sums->min);
+	__m512d hi0 = _mm512_set1_pd(sums->max);
+	__m512d s0 = _mm512_loadu_pd(sums->sum);
+	__m512d q0 = _mm512_loadu_pd(sums->sum2);
+	double lo[SPLAT_SUMS_LANES];
+	double hi[SPLAT_SUMS_LANES];
+
+	for (; n >= 8; n -= 8, x += 8) {
+		const __m512d a = splat_load_avx512(x);
+
+		lo0 = _mm512_min_pd(lo0, a);
+		hi0 = _mm512_max_pd(hi0, a);
+		s0 = _mm512_add_pd(s0, a);
+		q0 = _mm512_add_pd(q0, _mm512_mul_pd(a, a));
+	}
+
+	_mm512_storeu_pd(lo, lo0);
+	_mm512_storeu_pd(hi, hi0);
+	_mm512_storeu_pd(sums->sum, s0);
+	_mm512_storeu_pd(sums->sum2, q0);
+	splat_sums_tail(x, n, sums, lo, hi);
+}
+
+/* Each SIMD lane gets the interpolated values for one sample */
+SPLAT_AVX2 static double splat_true_peak_avx2(const double *x, size_t n,
+					      const double *k)
+{
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	__m256d peak4 = _mm256_setzero_pd();
+	double res[4];
+	double peak;
+	size_t t;
+
+	for (t = 0; (t + 4) <= n; t += 4) {
+		unsigned p;
+
+		for (p = 0; p < (SPLAT_TP_PHASES - 1); ++p) {
+			const double *kp = &k[p * SPLAT_TP_TAPS];
+			__m256d y = _mm256_setzero_pd();
+			unsigned j;
+
+			for (j = 0; j < SPLAT_TP_TAPS; ++j)
+				y = _mm256_add_pd(y, _mm256_mul_pd(
+					_mm256_loadu_pd(&x[t + j + 1]),
+					_mm256_set1_pd(kp[j])));
+
+			peak4 = _mm256_max_pd(peak4,
+					      _mm256_andnot_pd(sign, y));
+		}
+	}
+
+	_mm256_storeu_pd(res, peak4);
+	peak = max(max(res[0], res[1]), max(res[2], res[3]));
+
+	for (; t < n; ++t) {
+		unsigned p;
+
+		for (p = 0; p < (SPLAT_TP_PHASES - 1); ++p) {
+			const double *kp = &k[p * SPLAT_TP_TAPS];
+			double y = 0.0;
+			unsigned j;
+
+			for (j = 0; j < SPLAT_TP_TAPS; ++j)
+				y += x[t + j + 1] * kp[j];
+
+			peak = max(peak, fabs(y));
+		}
+	}
+
+	return peak;
+}
+
+SPLAT_AVX512 static double splat_true_peak_avx512(const double *x, size_t n,
+						  const double *k)
+{
+	__m512d peak8 = _mm512_setzero_pd();
+	double peak;
+	size_t t;
+
+	for (t = 0; (t + 8) <= n; t += 8) {
+		unsigned p;
+
+		for (p = 0; p < (SPLAT_TP_PHASES - 1); ++p) {
+			const double *kp = &k[p * SPLAT_TP_TAPS];
+			__m512d y = _mm512_setzero_pd();
+			unsigned j;
+
+			for (j = 0; j < SPLAT_TP_TAPS; ++j)
+				y = _mm512_add_pd(y, _mm512_mul_pd(
+					_mm512_loadu_pd(&x[t + j + 1]),
+					_mm512_set1_pd(kp[j])));
+
+			peak8 = _mm512_max_pd(peak8, _mm512_abs_pd(y));
+		}
+	}
+
+	peak = _mm512_reduce_max_pd(peak8);
+
+	if (t < n)
+		peak = max(peak, splat_true_peak_avx2(&x[t], (n - t), k));
+
+	return peak;
+}
+
+static const struct splat_kernels splat_kernels_avx2 = {
+	"avx2", splat_mix_avx2, splat_mix_vec_avx2,
+	splat_amp_avx2, splat_amp_vec_avx2, splat_biquad_avx2,
+	splat_sums_avx2, splat_true_peak_avx2,
+};
+
+static const struct splat_kernels splat_kernels_avx512 = {
+	"avx512", splat_mix_avx512, splat_mix_vec_avx512,
+	splat_amp_avx512, splat_amp_vec_avx512, splat_biquad_avx512,
+	splat_sums_avx512, splat_true_peak_avx512,
+};
+
+#ifdef SPLAT_X86_SIMD_IO
+
+/* ----------------------------------------------------------------------------
+ * Sample format conversion
+ */
+
+static const double splat_int24_scale = (1 << 23) - 1;
+static const double splat_int16_scale = (1 << 15) - 1;
+static const double splat_int8_scale = 127.0;
+
+static inline int32_t splat_int24_load(const char *in)
+{
+	const uint8_t *in8 = (const uint8_t *)in;
+	const uint32_t s = (in8[0] << 8) | (in8[1] << 16) | (in8[2] << 24);
+
+	return (int32_t)s >> 8;
+}
+
+static inline double splat_clamp(double z)
+{
+	return (z < -1.0) ? -1.0 : ((z > 1.0) ? 1.0 : z);
+}
+
+SPLAT_AVX2 static void splat_avx2_divide(sample_t *out, __m128i s,
+					 __m256d scale)
+{
+	_mm256_storeu_pd(out, _mm256_div_pd(_mm256_cvtepi32_pd(s), scale));
+}
+
+SPLAT_AVX2 void splat_import_float64_avx2(sample_t *out, const char *in,
+					  size_t n, size_t step)
+{
+	const __m256i idx = _mm256_set_epi64x(3 * step, 2 * step, step, 0);
+
+	if (step == sizeof(double)) {
+		memcpy(out, in, (n * sizeof(double)));
+		return;
+	}
+
+	for (; n >= 4; n -= 4, out += 4, in += (4 * step))
+		_mm256_storeu_pd(out, _mm256_i64gather_pd((const double *)in,
+							  idx, 1));
+
+	while (n--) {
+		*out++ = *(const double *)in;
+		in += step;
+	}
+}
+
+SPLAT_AVX2 void splat_import_float32_avx2(sample_t *out, const char *in,
+					  size_t n, size_t step)
+{
+	const __m256i idx = _mm256_set_epi64x(3 * step, 2 * step, step, 0);
+
+	for (; n >= 4; n -= 4, out += 4, in += (4 * step)) {
+		const __m128 s = (step == sizeof(float)) ?
+			_mm_loadu_ps((const float *)in) :
+			_mm256_i64gather_ps((const float *)in, idx, 1);
+
+		_mm256_storeu_pd(out, _mm256_cvtps_pd(s));
+	}
+
+	while (n--) {
+		*out++ = *(const float *)in;
+		in += step;
+	}
+}
+
+SPLAT_AVX2 void splat_import_int24_avx2(sample_t *out, const char *in,
+					size_t n, size_t step)
+{
+	const __m256d scale = _mm256_set1_pd(splat_int24_scale);
+
+	for (; n >= 4; n -= 4, out += 4, in += (4 * step)) {
+		const __m128i s = _mm_set_epi32(
+			splat_int24_load(in + (3 * step)),
+			splat_int24_load(in + (2 * step)),
+			splat_int24_load(in + step),
+			splat_int24_load(in));
+
+		splat_avx2_divide(out, s, scale);
+	}
+
+	while (n--) {
+		*out++ = splat_int24_load(in) / splat_int24_scale;
+		in += step;
+	}
+}
+
+SPLAT_AVX2 void splat_import_int16_avx2(sample_t *out, const char *in,
+					size_t n, size_t step)
+{
+	const __m256d scale = _mm256_set1_pd(splat_int16_scale);
+
+	for (; n >= 4; n -= 4, out += 4, in += (4 * step)) {
+		const __m128i s = (step == sizeof(int16_t)) ?
+			_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)in)) :
+			_mm_set_epi32(*(const int16_t *)(in + (3 * step)),
+				      *(const int16_t *)(in + (2 * step)),
+				      *(const int16_t *)(in + step),
+				      *(const int16_t *)in);
+
+		splat_avx2_divide(out, s, scale);
+	}
+
+	while (n--) {
+		*out++ = *(const int16_t *)in / splat_int16_scale;
+		in += step;
+	}
+}
+
+SPLAT_AVX2 void splat_import_int8_avx2(sample_t *out, const char *in,
+				       size_t n, size_t step)
+{
+	const __m256d scale = _mm256_set1_pd(splat_int8_scale);
+
+	for (; n >= 4; n -= 4, out += 4, in += (4 * step)) {
+		const __m128i s = _mm_set_epi32(*(const int8_t *)(in + (3 * step)),
+						*(const int8_t *)(in + (2 * step)),
+						*(const int8_t *)(in + step),
+						*(const int8_t *)in);
+
+		splat_avx2_divide(out, s, scale);
+	}
+
+	while (n--) {
+		*out++ = *(const int8_t *)in / splat_int8_scale;
+		in += step;
+	}
+}
+
+/* Apply the normalisation to n samples of one channel and convert them to
+ * integers with the given scale, the same way as the generic exporters. */
+SPLAT_AVX2 static void splat_avx2_to_int(int32_t *out, const sample_t *in,
+					 size_t n, double offset, double gain,
+					 double scale)
+{
+	const __m256d v_offset = _mm256_set1_pd(offset);
+	const __m256d v_gain = _mm256_set1_pd(gain);
+	const __m256d v_scale = _mm256_set1_pd(scale);
+	const __m256d v_neg = _mm256_set1_pd(-1.0);
+	const __m256d v_pos = _mm256_set1_pd(1.0);
+
+	for (; n >= 4; n -= 4, in += 4, out += 4) {
+		__m256d z = _mm256_loadu_pd(in);
+
+		z = _mm256_mul_pd(_mm256_sub_pd(z, v_offset), v_gain);
+		z = _mm256_min_pd(_mm256_max_pd(z, v_neg), v_pos);
+		z = _mm256_mul_pd(z, v_scale);
+		_mm_storeu_si128((__m128i *)out, _mm256_cvttpd_epi32(z));
+	}
+
+	while (n--)
+		*out++ = splat_clamp((*in++ - offset) * gain) * scale;
+}
+
+/* The int8 exporter maps values beyond the range to 0 and -1 (255) */
+SPLAT_AVX2 static void splat_avx2_to_int8(int32_t *out, const sample_t *in,
+					  size_t n, double offset, double gain)
+{
+	const __m256d v_offset = _mm256_set1_pd(offset);
+	const __m256d v_gain = _mm256_set1_pd(gain);
+	const __m256d v_scale = _mm256_set1_pd(splat_int8_scale);
+	const __m256d v_neg = _mm256_set1_pd(-1.0);
+	const __m256d v_pos = _mm256_set1_pd(1.0);
+	const __m256d v_zero = _mm256_setzero_pd();
+
+	for (; n >= 4; n -= 4, in += 4, out += 4) {
+		__m256d z = _mm256_loadu_pd(in);
+		__m256d s;
+
+		z = _mm256_mul_pd(_mm256_sub_pd(z, v_offset), v_gain);
+		s = _mm256_mul_pd(_mm256_min_pd(_mm256_max_pd(z, v_neg),
+						v_pos), v_scale);
+		s = _mm256_blendv_pd(s, v_zero,
+				     _mm256_cmp_pd(z, v_neg, _CMP_LT_OQ));
+		s = _mm256_blendv_pd(s, v_neg,
+				     _mm256_cmp_pd(z, v_pos, _CMP_GT_OQ));
+		_mm_storeu_si128((__m128i *)out, _mm256_cvttpd_epi32(s));
+	}
+
+	while (n--) {
+		const double z = (*in++ - offset) * gain;
+
+		if (z < -1.0)
+			*out++ = 0;
+		else if (z > 1.0)
+			*out++ = -1;
+		else
+			*out++ = (int32_t)(z * splat_int8_scale);
+	}
+}
+
+/* The output of these two functions may not be aligned when exporting
+ * directly to a file mapped after its header. */
+SPLAT_AVX2 static void splat_avx2_to_double(char *out, const sample_t *in,
+					    size_t n, double offset,
+					    double gain)
+{
+	const __m256d v_offset = _mm256_set1_pd(offset);
+	const __m256d v_gain = _mm256_set1_pd(gain);
+
+	for (; n >= 4; n -= 4, in += 4, out += (4 * sizeof(double))) {
+		const __m256d z = _mm256_loadu_pd(in);
+
+		_mm256_storeu_pd((double *)out,
+				 _mm256_mul_pd(_mm256_sub_pd(z, v_offset),
+					       v_gain));
+	}
+
+	for (; n; --n, out += sizeof(double)) {
+		const double z = (*in++ - offset) * gain;
+
+		memcpy(out, &z, sizeof(double));
+	}
+}
+
+SPLAT_AVX2 static void splat_avx2_to_float(char *out, const sample_t *in,
+					   size_t n, double offset, double gain)
+{
+	const __m256d v_offset = _mm256_set1_pd(offset);
+	const __m256d v_gain = _mm256_set1_pd(gain);
+
+	for (; n >= 4; n -= 4, in += 4, out += (4 * sizeof(float))) {
+		const __m256d z = _mm256_loadu_pd(in);
+
+		_mm_storeu_ps((float *)out, _mm256_cvtpd_ps(
+				      _mm256_mul_pd(_mm256_sub_pd(z, v_offset),
+						    v_gain)));
+	}
+
+	for (; n; --n, out += sizeof(float)) {
+		const float z = (*in++ - offset) * gain;
+
+		memcpy(out, &z, sizeof(float));
+	}
+}
+
+SPLAT_AVX2 void splat_export_float64_avx2(char *out, const sample_t **in,
+					  unsigned channels, size_t n,
+					  const struct splat_norm *norm)
+{
+	double block[SPLAT_MAX_CHANNELS][SPLAT_SIMD_BLOCK];
+
+	if (channels == 1) {
+		splat_avx2_to_double(out, in[0], n, norm->offset[0],
+				     norm->gain);
+		in[0] += n;
+		return;
+	}
+
+	while (n) {
+		const size_t len = min(n, SPLAT_SIMD_BLOCK);
+		unsigned c;
+		size_t i;
+
+		for (c = 0; c < channels; ++c) {
+			splat_avx2_to_double((char *)block[c], in[c], len,
+					     norm->offset[c], norm->gain);
+			in[c] += len;
+		}
+
+		for (i = 0; i < len; ++i) {
+			for (c = 0; c < channels; ++c) {
+				memcpy(out, &block[c][i], sizeof(double));
+				out += sizeof(double);
+			}
+		}
+
+		n -= len;
+	}
+}
+
+SPLAT_AVX2 void splat_export_float32_avx2(char *out, const sample_t **in,
+					  unsigned channels, size_t n,
+					  const struct splat_norm *norm)
+{
+	float block[SPLAT_MAX_CHANNELS][SPLAT_SIMD_BLOCK];
+
+	if (channels == 1) {
+		splat_avx2_to_float(out, in[0], n, norm->offset[0],
+				    norm->gain);
+		in[0] += n;
+		return;
+	}
+
+	while (n) {
+		const size_t len = min(n, SPLAT_SIMD_BLOCK);
+		unsigned c;
+		size_t i;
+
+		for (c = 0; c < channels; ++c) {
+			splat_avx2_to_float((char *)block[c], in[c], len,
+					    norm->offset[c], norm->gain);
+			in[c] += len;
+		}
+
+		for (i = 0; i < len; ++i) {
+			for (c = 0; c < channels; ++c) {
+				memcpy(out, &block[c][i], sizeof(float));
+				out += sizeof(float);
+			}
+		}
+
+		n -= len;
+	}
+}
+
+SPLAT_AVX2 void splat_export_int24_avx2(char *out, const sample_t **in,
+					unsigned channels, size_t n,
+					const struct splat_norm *norm)
+{
+	int32_t block[SPLAT_MAX_CHANNELS][SPLAT_SIMD_BLOCK];
+
+	while (n) {
+		const size_t len = min(n, SPLAT_SIMD_BLOCK);
+		unsigned c;
+		size_t i;
+
+		for (c = 0; c < channels; ++c) {
+			splat_avx2_to_int(block[c], in[c], len,
+					  norm->offset[c], norm->gain,
+					  splat_int24_scale);
+			in[c] += len;
+		}
+
+		for (i = 0; i < len; ++i) {
+			for (c = 0; c < channels; ++c) {
+				const int32_t s = block[c][i];
+
+				*out++ = s & 0xFF;
+				*out++ = (s >> 8) & 0xFF;
+				*out++ = (s >> 16) & 0xFF;
+			}
+		}
+
+		n -= len;
+	}
+}
+
+SPLAT_AVX2 void splat_export_int16_avx2(char *out, const sample_t **in,
+					unsigned channels, size_t n,
+					const struct splat_norm *norm)
+{
+	int32_t block[SPLAT_MAX_CHANNELS][SPLAT_SIMD_BLOCK];
+
+	while (n) {
+		const size_t len = min(n, SPLAT_SIMD_BLOCK);
+		unsigned c;
+		size_t i;
+
+		for (c = 0; c < channels; ++c) {
+			splat_avx2_to_int(block[c], in[c], len,
+					  norm->offset[c], norm->gain,
+					  splat_int16_scale);
+			in[c] += len;
+		}
+
+		for (i = 0; i < len; ++i) {
+			for (c = 0; c < channels; ++c) {
+				const int16_t s = block[c][i];
+
+				memcpy(out, &s, sizeof(int16_t));
+				out += sizeof(int16_t);
+			}
+		}
+
+		n -= len;
+	}
+}
+
+SPLAT_AVX2 void splat_export_int8_avx2(char *out, const sample_t **in,
+				       unsigned channels, size_t n,
+				       const struct splat_norm *norm)
+{
+	int32_t block[SPLAT_MAX_CHANNELS][SPLAT_SIMD_BLOCK];
+
+	while (n) {
+		const size_t len = min(n, SPLAT_SIMD_BLOCK);
+		unsigned c;
+		size_t i;
+
+		for (c = 0; c < channels; ++c) {
+			splat_avx2_to_int8(block[c], in[c], len,
+					   norm->offset[c], norm->gain);
+			in[c] += len;
+		}
+
+		for (i = 0; i < len; ++i)
+			for (c = 0; c < channels; ++c)
+				*out++ = block[c][i];
+
+		n -= len;
+	}
+}
+
+#endif /* SPLAT_X86_SIMD_IO */
+
+#endif /* SPLAT_X86_SIMD */
@@ -20,25 +20,49 @@
 
 #include "_splat.h"
 
+static void splat_source_data(const struct splat_source *src, sample_t **out)
+{
+	unsigned c;
+
+	for (c = 0; c < src->frag->n_channels; ++c)
+		out[c] = &src->frag->data[c][src->start];
+}
+
+/* Either write or add a sample value */
+#define splat_source_put(_src, _out, _val) do {	\
+		if ((_src)->add)			\
+			*(_out) += (_val);		\
+		else					\
+			*(_out) = (_val);		\
+	} while (0)
+
 /* -- sine source -- */
 
-void splat_sine_floats(struct splat_fragment *frag, const double *levels,
+void splat_sine_floats(const struct splat_source *src, const double *levels,
 		       double freq, double phase)
 {
+	const struct splat_fragment *frag = src->frag;
 	const double k = 2 * M_PI * freq / frag->rate;
 	const long ph = phase * frag->rate;
+	sample_t *out[SPLAT_MAX_CHANNELS];
+	double lvls[SPLAT_MAX_CHANNELS];
 	size_t i;
+	unsigned c;
 
-	for (i = 0; i < frag->length; ++i) {
+	splat_source_data(src, out);
+
+	for (c = 0; c < frag->n_channels; ++c)
+		lvls[c] = levels[c] * src->gain;
+
+	for (i = 0; i < src->length; ++i) {
 		const double s = sin(k * (i + ph));
-		unsigned c;
 
 		for (c = 0; c < frag->n_channels; ++c)
-			frag->data[c][i] = s * levels[c];
+			splat_source_put(src, &out[c][i], (s * lvls[c]));
 	}
 }
 
-int splat_sine_signals(struct splat_fragment *frag, PyObject **levels,
+int splat_sine_signals(const struct splat_source *src, PyObject **levels,
 		       PyObject *freq, PyObject *phase, double origin)
 {
 	enum {
@@ -47,18 +71,21 @@ int splat_sine_signals(struct splat_fragment *frag, PyObject **levels,
 		SIG_AMP,
 	};
 	static const double k = 2 * M_PI;
+	const struct splat_fragment *frag = src->frag;
 	struct splat_signal sig;
 	PyObject *signals[SIG_AMP + SPLAT_MAX_CHANNELS];
+	sample_t *out[SPLAT_MAX_CHANNELS];
 	unsigned c;
 	size_t i;
 
+	splat_source_data(src, out);
 	signals[SIG_FREQ] = freq;
 	signals[SIG_PHASE] = phase;
 
 	for (c = 0; c < frag->n_channels; ++c)
 		signals[SIG_AMP + c] = levels[c];
 
-	if (splat_signal_init(&sig, frag->length, (origin * frag->rate),
+	if (splat_signal_init(&sig, src->length, (origin * frag->rate),
 			      signals, (SIG_AMP + frag->n_channels),
 			      frag->rate))
 		return -1;
@@ -78,7 +105,8 @@ int splat_sine_signals(struct splat_fragment *frag, PyObject **levels,
 				const double a =
 					sig.vectors[SIG_AMP + c].data[j];
 
-				frag->data[c][i] = s * a;
+				splat_source_put(src, &out[c][i],
+						 (s * a * src->gain));
 			}
 		}
 	}
@@ -91,36 +119,43 @@ int splat_sine_signals(struct splat_fragment *frag, PyObject **levels,
 
 /* -- square source -- */
 
-void splat_square_floats(struct splat_fragment *frag, const double *fl_pos,
-			 double freq, double phase, double ratio)
+void splat_square_floats(const struct splat_source *src,
+			 const double *levels, double freq, double phase,
+			 double ratio)
 {
+	const struct splat_fragment *frag = src->frag;
 	const double k = freq / frag->rate;
+	double fl_pos[SPLAT_MAX_CHANNELS];
 	double fl_neg[SPLAT_MAX_CHANNELS];
+	sample_t *out[SPLAT_MAX_CHANNELS];
 	unsigned c;
-	Py_ssize_t i;
+	size_t i;
 
+	splat_source_data(src, out);
 	ratio = min(ratio, 1.0);
 	ratio = max(ratio, 0.0);
 
-	for (c = 0; c < frag->n_channels; ++c)
+	for (c = 0; c < frag->n_channels; ++c) {
+		fl_pos[c] = levels[c] * src->gain;
 		fl_neg[c] = -fl_pos[c];
+	}
 
-	for (i = 0; i < frag->length; ++i) {
+	for (i = 0; i < src->length; ++i) {
 		double n_periods;
 		const double t_rel = modf(((i * k) + phase), &n_periods);
-		const double *levels;
+		const double *lvls;
 
 		if (t_rel < ratio)
-			levels = fl_pos;
+			lvls = fl_pos;
 		else
-			levels = fl_neg;
+			lvls = fl_neg;
 
 		for (c = 0; c < frag->n_channels; ++c)
-			frag->data[c][i] = levels[c];
+			splat_source_put(src, &out[c][i], lvls[c]);
 	}
 }
 
-int splat_square_signals(struct splat_fragment *frag, PyObject **levels,
+int splat_square_signals(const struct splat_source *src, PyObject **levels,
 			 PyObject *freq, PyObject *phase,
 			 PyObject *ratio, double origin)
 {
@@ -130,11 +165,14 @@ int splat_square_signals(struct splat_fragment *frag, PyObject **levels,
 		SIG_RATIO,
 		SIG_AMP,
 	};
+	const struct splat_fragment *frag = src->frag;
 	struct splat_signal sig;
 	PyObject *signals[SIG_AMP + SPLAT_MAX_CHANNELS];
+	sample_t *out[SPLAT_MAX_CHANNELS];
 	unsigned c;
 	size_t i;
 
+	splat_source_data(src, out);
 	signals[SIG_FREQ] = freq;
 	signals[SIG_PHASE] = phase;
 	signals[SIG_RATIO] = ratio;
@@ -142,7 +180,7 @@ int splat_square_signals(struct splat_fragment *frag, PyObject **levels,
 	for (c = 0; c < frag->n_channels; ++c)
 		signals[SIG_AMP + c] = levels[c];
 
-	if (splat_signal_init(&sig, frag->length, (origin * frag->rate),
+	if (splat_signal_init(&sig, src->length, (origin * frag->rate),
 			      signals, (SIG_AMP + frag->n_channels),
 			      frag->rate))
 		return -1;
@@ -169,7 +207,8 @@ int splat_square_signals(struct splat_fragment *frag, PyObject **levels,
 				const double a =
 					sig.vectors[SIG_AMP + c].data[j];
 
-				frag->data[c][i] = a * s;
+				splat_source_put(src, &out[c][i],
+						 (a * s * src->gain));
 			}
 		}
 	}
@@ -181,21 +220,25 @@ int splat_square_signals(struct splat_fragment *frag, PyObject **levels,
 
 /* -- triangle source -- */
 
-void splat_triangle_floats(struct splat_fragment *frag, const double *lvls,
-			   double freq, double phase, double ratio)
+void splat_triangle_floats(const struct splat_source *src,
+			   const double *lvls, double freq, double phase,
+			   double ratio)
 {
+	const struct splat_fragment *frag = src->frag;
 	const double k = freq / frag->rate;
 	double a1[SPLAT_MAX_CHANNELS], b1[SPLAT_MAX_CHANNELS];
 	double a2[SPLAT_MAX_CHANNELS], b2[SPLAT_MAX_CHANNELS];
 	const double *a, *b;
+	sample_t *out[SPLAT_MAX_CHANNELS];
 	unsigned c;
-	Py_ssize_t i;
+	size_t i;
 
+	splat_source_data(src, out);
 	ratio = min(ratio, 1.0);
 	ratio = max(ratio, 0.0);
 
 	for (c = 0; c < frag->n_channels; ++c) {
-		const double llin = lvls[c];
+		const double llin = lvls[c] * src->gain;
 
 		a1[c] = 2 * llin / ratio;
 		b1[c] = -llin;
@@ -203,7 +246,7 @@ void splat_triangle_floats(struct splat_fragment *frag, const double *lvls,
 		b2[c] = llin - (a2[c] * ratio);
 	}
 
-	for (i = 0; i < frag->length; ++i) {
+	for (i = 0; i < src->length; ++i) {
 		double n_periods;
 		const double t_rel = modf(((i * k) + phase), &n_periods);
 
@@ -216,11 +259,12 @@ void splat_triangle_floats(struct splat_fragment *frag, const double *lvls,
 		}
 
 		for (c = 0; c < frag->n_channels; ++c)
-			frag->data[c][i] = (a[c] * t_rel) + b[c];
+			splat_source_put(src, &out[c][i],
+					 ((a[c] * t_rel) + b[c]));
 	}
 }
 
-int splat_triangle_signals(struct splat_fragment *frag, PyObject **levels,
+int splat_triangle_signals(const struct splat_source *src, PyObject **levels,
 			   PyObject *freq, PyObject *phase, PyObject *ratio,
 			   double origin)
 {
@@ -230,11 +274,14 @@ int splat_triangle_signals(struct splat_fragment *frag, PyObject **levels,
 		SIG_RATIO,
 		SIG_AMP,
 	};
+	const struct splat_fragment *frag = src->frag;
 	struct splat_signal sig;
 	PyObject *signals[SIG_AMP + SPLAT_MAX_CHANNELS];
+	sample_t *out[SPLAT_MAX_CHANNELS];
 	unsigned c;
 	size_t i;
 
+	splat_source_data(src, out);
 	signals[SIG_FREQ] = freq;
 	signals[SIG_PHASE] = phase;
 	signals[SIG_RATIO] = ratio;
@@ -242,7 +289,7 @@ int splat_triangle_signals(struct splat_fragment *frag, PyObject **levels,
 	for (c = 0; c < frag->n_channels; ++c)
 		signals[SIG_AMP + c] = levels[c];
 
-	if (splat_signal_init(&sig, frag->length, (origin * frag->rate),
+	if (splat_signal_init(&sig, src->length, (origin * frag->rate),
 			      signals, (SIG_AMP + frag->n_channels),
 			      frag->rate))
 		return -1;
@@ -264,7 +311,7 @@ int splat_triangle_signals(struct splat_fragment *frag, PyObject **levels,
 			ratio = max(ratio, 0.0);
 
 			for (c = 0; c < frag->n_channels; ++c) {
-				const double l =
+				const double l = src->gain *
 					sig.vectors[SIG_AMP + c].data[j];
 				double a, b;
 
@@ -276,7 +323,8 @@ int splat_triangle_signals(struct splat_fragment *frag, PyObject **levels,
 					b = l - (a * ratio);
 				}
 
-				frag->data[c][i] = (a * t_rel) + b;
+				splat_source_put(src, &out[c][i],
+						 ((a * t_rel) + b));
 			}
 		}
 	}
@@ -288,17 +336,22 @@ int splat_triangle_signals(struct splat_fragment *frag, PyObject **levels,
 
 /* -- overtones source -- */
 
-void splat_overtones_float(struct splat_fragment *frag, const double *levels,
-			   double freq, double phase,
+/* The overtones are always added to the existing samples */
+void splat_overtones_float(const struct splat_source *src,
+			   const double *levels, double freq, double phase,
 			   struct splat_overtone *overtones, Py_ssize_t n)
 {
+	const struct splat_fragment *frag = src->frag;
 	const double k = 2 * M_PI * freq;
 	const double max_ratio = (frag->rate / freq) / 2;
 	struct splat_overtone *ot;
 	const struct splat_overtone *ot_end = &overtones[n];
+	sample_t *out[SPLAT_MAX_CHANNELS];
 	unsigned c;
 	size_t i;
 
+	splat_source_data(src, out);
+
 	/* Silence harmonics above (rate / 2) to avoid spectrum overlap
 	   and multiply each overtone levels with global levels. */
 	for (ot = overtones; ot != ot_end; ++ot) {
@@ -307,11 +360,11 @@ void splat_overtones_float(struct splat_fragment *frag, const double *levels,
 				ot->levels.fl[c] = 0.0f;
 		} else {
 			for (c = 0; c < frag->n_channels; ++c)
-				ot->levels.fl[c] *= levels[c];
+				ot->levels.fl[c] *= levels[c] * src->gain;
 		}
 	}
 
-	for (i = 0; i < frag->length; ++i) {
+	for (i = 0; i < src->length; ++i) {
 		const double t = phase + (double)i / frag->rate;
 
 		for (ot = overtones; ot != ot_end; ++ot) {
@@ -319,12 +372,12 @@ void splat_overtones_float(struct splat_fragment *frag, const double *levels,
 				sin(k * ot->fl_ratio * (t + ot->fl_phase));
 
 			for (c = 0; c < frag->n_channels; ++c)
-				frag->data[c][i] += s * ot->levels.fl[c];
+				out[c][i] += s * ot->levels.fl[c];
 		}
 	}
 }
 
-int splat_overtones_mixed(struct splat_fragment *frag, PyObject **levels,
+int splat_overtones_mixed(const struct splat_source *src, PyObject **levels,
 			  PyObject *freq, PyObject *phase,
 			  struct splat_overtone *overtones, Py_ssize_t n,
 			  double origin)
@@ -334,22 +387,25 @@ int splat_overtones_mixed(struct splat_fragment *frag, PyObject **levels,
 		SIG_PHASE,
 		SIG_AMP,
 	};
+	const struct splat_fragment *frag = src->frag;
 	const double k = 2 * M_PI;
 	const double half_rate = frag->rate / 2;
 	PyObject *signals[SIG_AMP + SPLAT_MAX_CHANNELS];
 	struct splat_signal sig;
 	struct splat_overtone *ot;
 	const struct splat_overtone *ot_end = &overtones[n];
+	sample_t *out[SPLAT_MAX_CHANNELS];
 	unsigned c;
 	size_t i;
 
+	splat_source_data(src, out);
 	signals[SIG_FREQ] = freq;
 	signals[SIG_PHASE] = phase;
 
 	for (c = 0; c < frag->n_channels; ++c)
 		signals[SIG_AMP + c] = levels[c];
 
-	if (splat_signal_init(&sig, frag->length, (origin * frag->rate),
+	if (splat_signal_init(&sig, src->length, (origin * frag->rate),
 			      signals, (SIG_AMP + frag->n_channels),
 			      frag->rate))
 		return -1;
@@ -378,8 +434,8 @@ int splat_overtones_mixed(struct splat_fragment *frag, PyObject **levels,
 					double x;
 
 					x = sig.vectors[SIG_AMP + c].data[j];
-					x *= ot->levels.fl[c];
-					frag->data[c][i] += s * x;
+					x *= ot->levels.fl[c] * src->gain;
+					out[c][i] += s * x;
 				}
 			}
 		}
@@ -390,7 +446,7 @@ int splat_overtones_mixed(struct splat_fragment *frag, PyObject **levels,
 	return (sig.stat == SPLAT_SIGNAL_ERROR) ? -1 : 0;
 }
 
-int splat_overtones_signal(struct splat_fragment *frag, PyObject **levels,
+int splat_overtones_signal(const struct splat_source *src, PyObject **levels,
 			   PyObject *freq, PyObject *phase,
 			   struct splat_overtone *overtones, Py_ssize_t n,
 			   double origin)
@@ -401,6 +457,7 @@ int splat_overtones_signal(struct splat_fragment *frag, PyObject **levels,
 		SIG_AMP = 2,
 		SIG_OT = 2 + SPLAT_MAX_CHANNELS,
 	};
+	const struct splat_fragment *frag = src->frag;
 	const double k = 2 * M_PI;
 	const double half_rate = frag->rate / 2;
 	PyObject **signals;
@@ -414,9 +471,12 @@ int splat_overtones_signal(struct splat_fragment *frag, PyObject **levels,
 	PyObject **sig_ot_it;
 	/* for each overtone: ratio, phase and levels */
 	const size_t sig_n = sig_ot + (n * (2 + frag->n_channels));
+	sample_t *out[SPLAT_MAX_CHANNELS];
 	unsigned c;
 	size_t i;
 
+	splat_source_data(src, out);
+
 	signals = PyMem_Malloc(sig_n * sizeof(PyObject *));
 
 	if (signals == NULL) {
@@ -438,7 +498,7 @@ int splat_overtones_signal(struct splat_fragment *frag, PyObject **levels,
 			*sig_ot_it++ = ot->levels.obj[c];
 	}
 
-	if (splat_signal_init(&sig, frag->length, (origin * frag->rate),
+	if (splat_signal_init(&sig, src->length, (origin * frag->rate),
 			      signals, sig_n, frag->rate))
 		return -1;
 
@@ -472,7 +532,7 @@ int splat_overtones_signal(struct splat_fragment *frag, PyObject **levels,
 
 					x = sig.vectors[sig_amp + c].data[j];
 					y = (otv++)->data[j];
-					frag->data[c][i] += s * x * y;
+					out[c][i] += s * x * y * src->gain;
 				}
 			}
 		}
@@ -18,6 +18,8 @@
 import _splat
 from _splat import lin2dB, dB2lin
 from _splat import sample_types, SAMPLE_TYPE, SAMPLE_WIDTH
+from _splat import kernels, SIMD
+from _splat import get_threads, set_threads
 
 __all__ = ['gen', 'data', 'filters', 'sources', 'scales', 'interpol', 'seq']
 
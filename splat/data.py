@@ -16,17 +16,15 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 import os
+import contextlib
 import struct
 import wave
 import md5
+import mmap
 try:
     # For extra standard audio formats
     import audiotools
     has_audiotools = True
-    try:
-        from cStringIO import StringIO
-    except ImportError:
-        from StringIO import StringIO
 except ImportError:
     has_audiotools = False
 import _splat
@@ -36,6 +34,15 @@ import splat
 SAF_MAGIC = 'Splat!'
 SAF_FORMAT = 1
 
+# Used in WAV files
+WAV_FORMAT_PCM = 0x0001
+WAV_FORMAT_FLOAT = 0x0003
+WAV_FORMAT_EXTENSIBLE = 0xFFFE
+WAV_HEADER_SIZE = 44
+
+# Size of the data chunks when reading or writing files
+CHUNK_SIZE = 65536
+
 # -----------------------------------------------------------------------------
 # Utilities
 
@@ -50,7 +57,7 @@ def _get_fmt(f, fmt):
 def _read_chunks(frag, read_frames, frame_size, sample_type):
     rem = len(frag)
     cur = 0
-    chunk_size = 65536 / frame_size # read in blocks of 64K
+    chunk_size = CHUNK_SIZE / frame_size
 
     while rem > 0:
         n = min(chunk_size, rem)
@@ -59,6 +66,75 @@ def _read_chunks(frag, read_frames, frame_size, sample_type):
         rem -= n
         cur += n
 
+def _range_length(frag, start, end):
+    n = len(frag)
+    start = 0 if start is None else max(0, min(start, n))
+    end = n if end is None else max(start, min(end, n))
+    return end - start
+
+def _md5(frag, sample_type, start=None, end=None, norm=None):
+    md5sum = md5.new()
+    frame_size = frag.channels * splat.sample_types[sample_type] / 8
+    chunk = CHUNK_SIZE / frame_size
+    start = 0 if start is None else start
+    end = len(frag) if end is None else end
+    for n in xrange(start, end, chunk):
+        md5sum.update(frag.export_bytes(sample_type, n, min((n + chunk), end),
+                                        norm))
+    return md5sum
+
+def _file_md5(f, offset, size):
+    if size == 0:
+        return md5.new().hexdigest()
+    mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    try:
+        return md5.new(buffer(mm, offset, size)).hexdigest()
+    finally:
+        mm.close()
+
+def _read_wav_header(f):
+    riff, riff_size, wave_id = struct.unpack('<4sI4s', f.read(12))
+    if riff != 'RIFF' or wave_id != 'WAVE':
+        raise Exception("Invalid WAV file header")
+    fmt = None
+    while True:
+        chunk = f.read(8)
+        if len(chunk) < 8:
+            raise Exception("No data found in WAV file")
+        chunk_id, chunk_size = struct.unpack('<4sI', chunk)
+        if chunk_id == 'data':
+            break
+        if chunk_id == 'fmt ':
+            fmt = f.read(chunk_size)
+            f.seek(chunk_size & 1, os.SEEK_CUR)
+        else:
+            f.seek(chunk_size + (chunk_size & 1), os.SEEK_CUR)
+    if fmt is None:
+        raise Exception("No format found in WAV file")
+    tag, channels, rate, _, _, width = struct.unpack('<HHIIHH', fmt[:16])
+    if tag == WAV_FORMAT_EXTENSIBLE:
+        tag = struct.unpack('<H', fmt[24:26])[0]
+    if tag == WAV_FORMAT_PCM:
+        sample_type = 'int{:d}'.format(width)
+    elif tag == WAV_FORMAT_FLOAT:
+        sample_type = 'float{:d}'.format(width)
+    else:
+        raise Exception("Unsupported WAV format: {0}".format(tag))
+    return channels, rate, sample_type, f.tell(), chunk_size
+
+def _wav_header(frag, sample_type, length):
+    sample_width = splat.sample_types[sample_type]
+    if sample_type.startswith('float'):
+        tag = WAV_FORMAT_FLOAT
+    else:
+        tag = WAV_FORMAT_PCM
+    frame_size = frag.channels * sample_width / 8
+    data_size = length * frame_size
+    return struct.pack('<4sI4s4sIHHIIHH4sI', 'RIFF', (36 + data_size), 'WAVE',
+                       'fmt ', 16, tag, frag.channels, frag.rate,
+                       (frag.rate * frame_size), frame_size, sample_width,
+                       'data', data_size)
+
 # -----------------------------------------------------------------------------
 # Audio file openers
 
@@ -66,6 +142,17 @@ def open_wav(wav_file, fmt=None):
     if _get_fmt(wav_file, fmt) != 'wav':
         return None
 
+    if isinstance(wav_file, str):
+        with open(wav_file, 'rb') as f:
+            channels, rate, sample_type, offset, size = _read_wav_header(f)
+            f.seek(0, os.SEEK_END)
+            size = min(size, (f.tell() - offset))
+        frame_size = channels * splat.sample_types[sample_type] / 8
+        length = size / frame_size
+        frag = Fragment(channels, rate, length=length)
+        frag.import_file(wav_file, sample_type, offset, (length * frame_size))
+        return frag
+
     w = wave.open(wav_file, 'rb')
     channels = w.getnchannels()
     n_frames = w.getnframes()
@@ -94,15 +181,28 @@ def open_saf(saf_file, fmt=None):
         raise Exception("Format is more recent than this version of Splat")
     frag = Fragment(rate=rate, channels=channels, length=length)
     frame_size = channels * precision / 8
-    _read_chunks(frag, (lambda x: f.read(x * frame_size)), frame_size,
-                 sample_type='float{:d}'.format(precision))
+    sample_type = 'float{:d}'.format(precision)
     if is_str:
+        offset = f.tell()
+        md5sum = _file_md5(f, offset, (length * frame_size))
         f.close()
+        if md5sum != attr['md5']:
+            raise Exception("Fragment MD5 sum mismatch")
+        frag.import_file(saf_file, sample_type, offset, (length * frame_size))
+        return frag
+    _read_chunks(frag, (lambda x: f.read(x * frame_size)), frame_size,
+                 sample_type)
     if frag.md5() != attr['md5']:
         raise Exception("Fragment MD5 sum mismatch")
     return frag
 
-audio_file_openers = [open_wav, open_saf,]
+def open_smap(smap_file, fmt=None):
+    if _get_fmt(smap_file, fmt) != 'smap' or not isinstance(smap_file, str):
+        return None
+
+    return Fragment(path=smap_file, reopen=True)
+
+audio_file_openers = [open_wav, open_saf, open_smap,]
 
 if has_audiotools is True:
     def open_audiotools(f_name, fmt=None):
@@ -117,7 +217,7 @@ if has_audiotools is True:
         frag = Fragment(rate=f.sample_rate(), channels=f.channels(),
                         length=f.total_frames())
         frame_size = frag.channels * sample_width / 8
-        chunk_size = 65536 / frame_size
+        chunk_size = CHUNK_SIZE / frame_size
         rem = f.total_frames()
         cur = 0
         while rem > 0:
@@ -136,58 +236,112 @@ if has_audiotools is True:
 # -----------------------------------------------------------------------------
 # Audio file savers
 
-def save_wav(wav_file, frag, start, end, sample_type='int16'):
-    sample_width = splat.sample_types[sample_type]
-    w = wave.open(wav_file, 'w')
-    w.setnchannels(frag.channels)
-    w.setsampwidth(sample_width / 8)
-    w.setframerate(frag.rate)
-    w.setnframes(len(frag))
-    raw_bytes = frag.export_bytes(sample_type, start, end)
-    w.writeframes(buffer(raw_bytes))
-    w.close()
+def save_wav(wav_file, frag, start, end, norm=None, sample_type='int16'):
+    if isinstance(wav_file, str):
+        length = frag.export_file(wav_file, sample_type, WAV_HEADER_SIZE,
+                                  start, end, norm)
+        with open(wav_file, 'r+b') as f:
+            f.write(_wav_header(frag, sample_type, length))
+        return
 
-def save_saf(saf_file, frag, start, end):
-    is_str = isinstance(saf_file, str)
-    f = open(saf_file, 'w') if is_str else saf_file
-    raw_bytes = frag.export_bytes(start=start, end=end)
-    frame_size = frag.channels * splat.SAMPLE_WIDTH / 8
-    length = len(raw_bytes) / frame_size
-    md5sum = md5.new(raw_bytes).hexdigest()
+    wav_file.write(_wav_header(frag, sample_type,
+                               _range_length(frag, start, end)))
+    frag.write_to(wav_file, sample_type, start, end, norm=norm)
+
+def _saf_header(frag, length, md5sum):
     attrs = {
         'version': splat.VERSION_STR,
         'build': splat.BUILD,
         'format': SAF_FORMAT,
         'channels': frag.channels,
         'rate': frag.rate,
-        'precision': splat.SAMPLE_WIDTH,
+        'precision': splat.sample_types[frag.sample_type],
         'length': length,
         'md5': md5sum,
         }
     h = ' '.join('='.join(str(x) for x in kv) for kv in attrs.iteritems())
-    f.write(SAF_MAGIC + '\n')
-    f.write(h + '\n')
-    f.write(buffer(raw_bytes))
-    if is_str:
-        f.close()
-
-audio_file_savers = { 'wav': save_wav, 'saf': save_saf, }
+    return '\n'.join([SAF_MAGIC, h, ''])
+
+def save_saf(saf_file, frag, start, end, norm=None):
+    frame_size = frag.channels * splat.sample_types[frag.sample_type] / 8
+
+    if isinstance(saf_file, str):
+        # The MD5 sum has a fixed length so the header can be written once
+        # the data has been exported and its sum is known.
+        length = _range_length(frag, start, end)
+        offset = len(_saf_header(frag, length, ('0' * 32)))
+        frag.export_file(saf_file, data_offset=offset, start=start, end=end,
+                         norm=norm)
+        with open(saf_file, 'r+b') as f:
+            md5sum = _file_md5(f, offset, (length * frame_size))
+            f.write(_saf_header(frag, length, md5sum))
+        return
+
+    length = _range_length(frag, start, end)
+    md5sum = _md5(frag, frag.sample_type, start, end, norm).hexdigest()
+    saf_file.write(_saf_header(frag, length, md5sum))
+    frag.write_to(saf_file, start=start, end=end, norm=norm)
+
+def save_smap(smap_file, frag, start, end, norm=None):
+    if not isinstance(smap_file, str):
+        raise Exception("File name required with the smap format")
+
+    out = Fragment(channels=frag.channels, rate=frag.rate, path=smap_file,
+                   sample_type=frag.sample_type)
+    start = 0 if start is None else max(0, min(start, len(frag)))
+    length = _range_length(frag, start, end)
+    out.reserve(length=length)
+    chunk_size = CHUNK_SIZE / (frag.channels *
+                               splat.sample_types[frag.sample_type] / 8)
+
+    for cur in xrange(0, length, chunk_size):
+        n = min(chunk_size, (length - cur))
+        data = frag.export_bytes(start=(start + cur), end=(start + cur + n),
+                                 norm=norm)
+        out.import_bytes(data, frag.rate, frag.channels, offset=cur)
+
+audio_file_savers = { 'wav': save_wav, 'saf': save_saf, 'smap': save_smap, }
 
 if has_audiotools is True:
     channel_masks = [0x4, 0x3, 0x7, 0x33, 0x37, 0x137, 0x637, 0x737, 0xF37,
                      0x7F7, 0xFF7, 0x2FF7, 0x6FF7, 0x7FF7, 0x17FF7, 0x2FFF7]
 
-    def save_audiotools(cls, fname, frag, start, end, sample_type='int16',
-                        channel_mask=None, compression=None):
+    class _ExportReader(object):
+        # File-like object to read exported data by chunks
+
+        def __init__(self, frag, sample_type, start, end, norm):
+            self._frag = frag
+            self._sample_type = sample_type
+            self._norm = norm
+            self._frame_size = (frag.channels *
+                                splat.sample_types[sample_type] / 8)
+            self._cur = 0 if start is None else start
+            self._end = len(frag) if end is None else end
+
+        def read(self, n_bytes):
+            end = min((self._cur + max((n_bytes / self._frame_size), 1)),
+                      self._end)
+            if end <= self._cur:
+                return ''
+            data = self._frag.export_bytes(self._sample_type, self._cur, end,
+                                           self._norm)
+            self._cur = end
+            return str(data)
+
+        def close(self):
+            pass
+
+    def save_audiotools(cls, fname, frag, start, end, norm=None,
+                        sample_type='int16', channel_mask=None,
+                        compression=None):
         if not isinstance(fname, str):
             raise TypeError('File name needed when saving with audiotools')
         if channel_mask is None:
             channel_mask = channel_masks[frag.channels]
-        data = frag.export_bytes(sample_type, start, end)
-        str_io = StringIO(str(data))
         sample_width = splat.sample_types[sample_type]
-        reader = audiotools.PCMReader(str_io, frag.rate, frag.channels,
-                                      channel_mask, sample_width)
+        reader = audiotools.PCMReader(
+            _ExportReader(frag, sample_type, start, end, norm), frag.rate,
+            frag.channels, channel_mask, sample_width)
         cls.from_pcm(fname, reader, compression, len(frag))
 
     fmt_cls = {
@@ -211,6 +365,25 @@ class Fragment(_splat.Fragment):
     rate is 48000.  If no duration is specified, the fragment will be empty.
     Otherwise, the samples are initialised to 0 (silence).
 
+    Silence is cheap: large fragments only use memory for the parts where some
+    sound has actually been written, and the blocks of samples which are known
+    to be silent are skipped when mixing, amplifying or normalizing.
+
+    When ``path`` is a file name, the samples are stored in this file instead
+    of memory, which gets created or overwritten.  Only the parts of the file
+    being used are then loaded in memory by the operating system, so
+    fragments can be much larger than the available memory.  Setting
+    ``reopen`` to ``True`` opens an existing file instead to use the data it
+    contains, in which case the number of channels, rate, length and sample
+    type are the ones saved in the file.  This is also available with the
+    ``smap`` file format in :py:meth:`splat.data.Fragment.open`.
+
+    The samples are stored as ``float64`` values unless ``sample_type`` is set
+    to ``float32``, which halves the memory and bandwidth used by the fragment
+    at the cost of some precision.  The default is ``splat.SAMPLE_TYPE``.
+    Fragments with different sample types can still be mixed together, see
+    :ref:`sample_formats`.
+
     All Splat sound data is contained in :py:class:`splat.data.Fragment`
     objects.  They are accessible as a mutable sequence of tuples of floating
     point values to represent the samples across all the audio channels.  The
@@ -237,7 +410,9 @@ class Fragment(_splat.Fragment):
         be automatically detected whenever possible.  Only a limited set of
         :ref:`audio_files` formats are supported (currently only ``wav`` and
         ``saf``).  All the samples are converted to floating point values with
-        the native precision of the fragment.
+        the native precision of the fragment.  When ``in_file`` is a file name
+        with one of these formats, the file is memory-mapped and the samples
+        are converted directly into the fragment.
         """
         fmt = _get_fmt(in_file, fmt)
         for opener in audio_file_openers:
@@ -259,8 +434,9 @@ class Fragment(_splat.Fragment):
         otherwise, it must be a file-like object.  The contents of the audio
         fragment are written to this file.  It is possible to save only a part
         of the fragment using the ``start`` and ``end`` arguments with times in
-        seconds.  The contents of the fragment will be automatically normalized
-        unless ``normalized`` is set to ``False``.
+        seconds.  The saved data will be automatically normalized unless
+        ``normalize`` is set to ``False``.  This is done on the fly while
+        exporting the samples, so the fragment itself is left unchanged.
 
         The ``fmt`` argument is a string to identify the output file format to
         use.  If ``None``, the file name extension is used.  It may otherwise
@@ -275,15 +451,51 @@ class Fragment(_splat.Fragment):
         saver = audio_file_savers.get(fmt, None)
         if saver is None:
             raise Exception("Unsupported file format: {0}".format(fmt))
-        if normalize is True:
-            self.normalize()
-        saver(out_file, self, start, end, *args, **kw)
+        norm = self.get_norm() if normalize is True else None
+        saver(out_file, self, start, end, norm, *args, **kw)
+
+    _batch = None
+
+    def mix(self, frag, offset=0.0, skip=0.0, levels=None, duration=None,
+            resample=False, matrix=None, pan=None):
+        if self._batch is None:
+            super(Fragment, self).mix(frag, offset, skip, levels, duration,
+                                      resample, matrix, pan)
+        else:
+            self._batch.append((frag, offset, skip, levels, duration,
+                                resample, matrix, pan))
+
+    mix.__doc__ = _splat.Fragment.mix.__doc__
+
+    @contextlib.contextmanager
+    def batch(self):
+        """Context manager to mix many fragments at once.
+
+        All the calls to :py:meth:`splat.data.Fragment.mix` on this fragment
+        within the context are recorded and then run with a single call to
+        :py:meth:`splat.data.Fragment.mix_many` when leaving it.  The mixed
+        data is therefore not visible until the end of the batch, and the
+        incoming fragments must not be modified in the meantime.  Nested
+        batches are merged into the outermost one.
+        """
+        if self._batch is not None:
+            yield self
+            return
+        self._batch = []
+        try:
+            yield self
+            self.mix_many(self._batch)
+        finally:
+            self._batch = None
 
     def dup(self):
-        """Duplicate this fragment into a new one and return it."""
-        dup_frag = Fragment(channels=self.channels, rate=self.rate)
-        dup_frag.mix(self)
-        return dup_frag
+        """Duplicate this fragment into a new one and return it.
+
+        The data is shared until either fragment gets modified, so keeping a
+        copy of the original data costs nothing until then.  See
+        :py:meth:`splat.data.Fragment.view`.
+        """
+        return self.view()
 
     def grow(self, duration=None, length=None):
         """Resize if ``duration`` or ``length`` is greater than current."""
@@ -303,7 +515,7 @@ class Fragment(_splat.Fragment):
         and ``sample_width`` in bytes.  Then the MD5 checksum is returned as a
         string unless ``as_md5_obj`` is set to True in which case an ``md5``
         object is returned instead."""
-        md5sum = md5.new(self.export_bytes(sample_type))
+        md5sum = _md5(self, sample_type)
         return md5sum if as_md5_obj is True else md5sum.hexdigest()
 
     def n2s(self, n):
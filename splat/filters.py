@@ -16,7 +16,9 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 import collections
-from _splat import dec_envelope, reverse, reverb
+from _splat import dB2lin, dec_envelope, envelope, filter_chain
+from _splat import reverse, reverb, convolve, fdn_reverb, biquad
+from _splat import limiter, compressor
 
 class FilterChain(collections.Sequence):
     """Chain of filters to process existing data
@@ -66,11 +68,31 @@ class FilterChain(collections.Sequence):
 
         All the filter functions in the chain are run with their associated
         arguments on the :py:class:`splat.data.Fragment` argument ``frag``.
+        Consecutive filters which have a native block implementation are run
+        together with :py:func:`splat.filters.filter_chain` so the fragment
+        data only goes once through the memory for all of them.
         """
+        native = []
         for f, args in self:
+            if f in _block_filters:
+                block = _block_filters[f]
+                if block is not None:
+                    f, args = block(frag, *args)
+                native.append((f, args))
+                continue
+            if native:
+                filter_chain(frag, native)
+                native = []
             f(frag, *args)
+        if native:
+            filter_chain(frag, native)
 
 
+def _fade_points(frag, duration=0.01):
+    fade = min(duration, (frag.duration / 2))
+    end = frag.duration
+    return [(0.0, 0.0), (fade, 1.0), ((end - fade), 1.0), (end, 0.0)]
+
 def linear_fade(frag, duration=0.01):
     """Apply a linear fade-in and fade-out on the fragment.
 
@@ -79,11 +101,37 @@ def linear_fade(frag, duration=0.01):
     end of the fragment.  This duration is adjusted evenly if the fragment is
     too short.
     """
-    fade = min((frag.rate * duration), (len(frag) / 2))
-    for i in range(int(fade)):
-        l = i / fade
-        for j in (i, -i):
-            frag[j] = tuple((s * l) for s in frag[j])
+    envelope(frag, _fade_points(frag, duration))
+
+def _adsr_points(frag, attack=0.01, decay=0.1, sustain=-6.0, release=0.1):
+    total = attack + decay + release
+    if total > frag.duration:
+        k = frag.duration / total
+        attack, decay, release = (t * k for t in (attack, decay, release))
+    end = frag.duration
+    level = dB2lin(sustain)
+    return [(0.0, 0.0), (attack, 1.0), ((attack + decay), level),
+            ((end - release), level), (end, 0.0)]
+
+def adsr(frag, attack=0.01, decay=0.1, sustain=-6.0, release=0.1):
+    """Apply an ADSR envelope on the fragment.
+
+    The gain rises linearly from 0.0 to 1.0 during the ``attack`` time, then
+    goes down to the ``sustain`` level in dB during the ``decay`` time and
+    stays there until the ``release`` time before the end of the fragment when
+    it goes back down to 0.0.  All the times are in seconds, and they are
+    adjusted evenly if the fragment is too short.
+    """
+    envelope(frag, _adsr_points(frag, attack, decay, sustain, release))
+
+# Filters which FilterChain can run in a native block chain, with None for the
+# native ones or a function to turn the arguments into a native filter
+_block_filters = {
+    dec_envelope: None,
+    envelope: None,
+    linear_fade: lambda frag, *args: (envelope, (_fade_points(frag, *args),)),
+    adsr: lambda frag, *args: (envelope, (_adsr_points(frag, *args),)),
+}
 
 def reverb_delays(level=-6.0, length=2.0, dec=0.25, rate=400):
     n2 = int(length * rate)
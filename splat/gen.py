@@ -106,6 +106,26 @@ class Generator(object):
         """
         raise NotImplementedError
 
+    def _run_in_place(self, levels, origin, duration, *args, **kw):
+        """Generate the sound directly into the main fragment
+
+        This is called by :py:meth:`splat.gen.Generator.run` when there are
+        no filters to run on the new sound, so it can be added to the main
+        fragment between ``origin`` and ``origin + duration`` without creating
+        an intermediate fragment.  It returns ``True`` if this was done, or
+        ``False`` by default to use :py:meth:`splat.gen.Generator._run`
+        instead.  It is only called when the class which provides ``_run``
+        also provides ``_run_in_place``, so a sub-class overriding only
+        ``_run`` always gets its own ``_run`` method called.
+        """
+        return False
+
+    def _in_place(self):
+        for cls in type(self).__mro__:
+            if '_run' in cls.__dict__:
+                return '_run_in_place' in cls.__dict__
+        return False
+
     def run(self, start, end, *args, **kw):
         """Main public method to run the generator
 
@@ -125,6 +145,10 @@ class Generator(object):
 
         When ``_run`` has been performed on the new fragment, filters are then
         run on it and it is finally mixed with the main internal fragment.
+        When there are no filters and no ``mix_levels``, the sound is
+        generated directly into the main fragment if the generator supports
+        it via :py:meth:`splat.gen.Generator._run_in_place` and doesn't
+        override ``_run`` without it.
 
         It's also possible to pass a ``mix_levels`` keyword argument which is
         used when mixing the newly generated fragment into the main generator
@@ -133,8 +157,14 @@ class Generator(object):
         beginning and length of the main fragment.
         """
         levels = kw.pop('levels', self._levels)
+        mix_levels = kw.pop('mix_levels', None)
         start = float(start)
-        frag_kw = { 'channels': self.channels, 'rate': self.rate }
+        if (end is not None and mix_levels is None and not len(self.filters)
+            and self._in_place() and self._run_in_place(levels, start, (float(end) - start),
+                                   *args, **kw)):
+            return
+        frag_kw = { 'channels': self.channels, 'rate': self.rate,
+                    'sample_type': self.frag.sample_type }
         if end is None:
             frag_kw['length'] = kw.pop('length')
         else:
@@ -142,7 +172,7 @@ class Generator(object):
         frag = Fragment(**frag_kw)
         self._run(frag, levels, start, *args, **kw)
         self.filters.run(frag)
-        self.frag.mix(frag, start, levels=kw.pop('mix_levels', None))
+        self.frag.mix(frag, start, levels=mix_levels)
 
 
 class SourceGenerator(Generator):
@@ -169,6 +199,12 @@ class SourceGenerator(Generator):
     def _run(self, frag, levels, origin, freq, phase=0.0, *args, **kw):
         self.source(frag, levels, freq, phase, origin, *args)
 
+    def _run_in_place(self, levels, origin, duration, freq, phase=0.0, *args,
+                      **kw):
+        self.source(self.frag, levels, freq, phase, origin, *args,
+                    offset=origin, duration=duration)
+        return True
+
 
 class SineGenerator(SourceGenerator):
     """Sine wave generator
@@ -242,6 +278,12 @@ class OvertonesGenerator(SourceGenerator):
         super(OvertonesGenerator, self).source(frag, levels, freq,
                                                self.overtones, phase, origin)
 
+    def _run_in_place(self, levels, origin, duration, freq, phase=0.0, *args,
+                      **kw):
+        self.source(self.frag, levels, freq, self.overtones, phase, origin,
+                    offset=origin, duration=duration)
+        return True
+
 
 class Particle(object):
     """Sound particle
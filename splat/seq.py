@@ -198,7 +198,7 @@ class PatternSequencer(Sequencer):
     :py:meth:`splat.seq.Pattern.play` method each time.
     """
 
-    def run(self, frag, patterns):
+    def run(self, frag, patterns, batch=False):
         """Run the sequencer over the given list of ``patterns``.
 
         Each entry in the ``patterns`` list (or any iterable sequence)
@@ -208,10 +208,23 @@ class PatternSequencer(Sequencer):
         each beat in each bar on each pattern object found.  Each pattern may
         have a different number of beats, but the tempo is controlled by the
         sequencer and not by the pattern.
+
+        When ``batch`` is ``True``, all the fragments mixed into ``frag`` by
+        the patterns are mixed in one go at the end using
+        :py:meth:`splat.data.Fragment.batch`.  This is faster with many
+        overlapping sounds, but the patterns then can't see the mixed data
+        in ``frag`` until the end of the run.
         """
         pats = list((p,) if isinstance(p, Pattern) else p for p in patterns)
         total_beats = sum(p[0].beats for p in pats)
         frag.grow(total_beats * self.period)
+        if batch:
+            with frag.batch():
+                self._run(frag, pats)
+        else:
+            self._run(frag, pats)
+
+    def _run(self, frag, pats):
         n_beat = 0
         for bar, group in enumerate(pats):
             beats = group[0].beats
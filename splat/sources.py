@@ -15,4 +15,20 @@
 # You should have received a copy of the GNU Lesser General Public License
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+"""Sound sources generate some sound data into a fragment.
+
+They all take the target ``fragment`` and its ``levels``, a ``frequency``,
+a ``phase`` and an ``origin`` in time, the levels, frequency and phase being
+either constant values or signals.  By default, the samples of the whole
+fragment are replaced with the generated sound.
+
+When an ``offset`` in seconds is given, the sound is instead added to the
+existing samples of the fragment from the offset time for the given
+``duration`` or until the end of the fragment, and the fragment grows if
+necessary.  The samples are also multiplied with a linear ``gain``.  This
+avoids creating a separate fragment to then mix it, for example with one
+for each note in a main fragment.  The ``origin`` still gives the time of the
+first generated sample, so it is usually the same as the offset.
+"""
+
 from _splat import sine, square, triangle, overtones
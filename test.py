@@ -16,8 +16,14 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 import sys
+import os
 import md5
 import math
+import shutil
+import resource
+import struct
+import subprocess
+import tempfile
 import unittest
 try:
     from cStringIO import StringIO
@@ -25,6 +31,7 @@ except ImportError:
     from StringIO import StringIO
 import splat
 import splat.data
+import splat.filters
 import splat.gen
 import splat.sources
 import splat.interpol
@@ -45,10 +52,14 @@ class SplatTest(unittest.TestCase):
     def assert_md5(self, frags, hexdigest):
         if isinstance(frags, splat.data.Fragment):
             frags = [frags]
-        for frag in frags:
+        if isinstance(hexdigest, dict):
+            hexdigest = hexdigest[splat.SAMPLE_WIDTH]
+        if isinstance(hexdigest, str):
+            hexdigest = [hexdigest] * len(frags)
+        for frag, digest in zip(frags, hexdigest):
             md5sum = frag.md5(sample_type="int16")
-            self.assertEqual(md5sum, hexdigest,
-                             "MD5 mismatch: {0} {1}".format(md5sum, hexdigest))
+            self.assertEqual(md5sum, digest,
+                             "MD5 mismatch: {0} {1}".format(md5sum, digest))
 
     def assert_samples(self, frag, samples, places=None):
         if places is None:
@@ -117,6 +128,51 @@ class FragmentTest(SplatTest):
         frag.grow(duration=(duration * 1.5))
         self.assertEqual(len(frag), (length * 1.5))
 
+    def test_frag_reserve(self):
+        """Fragment.reserve"""
+        frag = splat.data.Fragment(channels=1, length=100)
+        for i in range(len(frag)):
+            frag[i] = (float(i),)
+        frag.reserve(duration=1.0)
+        self.assertEqual(len(frag), 100)
+        frag.reserve(length=10)
+        self.assertEqual(len(frag), 100)
+        frag.resize(length=50)
+        frag.resize(length=200)
+        self.assertEqual(len(frag), 200)
+        for i in range(len(frag)):
+            self.assertEqual(frag[i][0], float(i) if i < 50 else 0.0)
+        for i in range(1000):
+            frag.grow(length=(len(frag) + 7))
+            frag[len(frag) - 1] = (1.0,)
+        self.assertEqual(len(frag), 7200)
+        for i in range(1, 15):
+            self.assertEqual(frag[len(frag) - i][0],
+                             1.0 if i in (1, 8) else 0.0)
+
+    def test_frag_sparse(self):
+        """Fragment sparse data"""
+        rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+        frag = splat.data.Fragment(duration=600.0)
+        events = [123, 300000, 9000000, len(frag) - 1]
+        for i, n in enumerate(events):
+            frag[n] = (0.1 * (i + 1), -0.05 * (i + 1))
+        frag_peak = frag.get_peak()[0]
+        self.assertAlmostEqual(frag_peak['max'], 0.4, self._places)
+        self.assertAlmostEqual(frag_peak['min'], -0.2, self._places)
+        frag.amp(2.0)
+        frag.normalize(-0.05, False)
+        self.assertAlmostEqual(frag[events[-1]][0], splat.dB2lin(-0.05))
+        ref = splat.data.Fragment(length=len(frag))
+        ref.mix(frag)
+        ref.resize(length=10)
+        ref.resize(length=len(frag))
+        ref.mix(frag, skip=(200000.0 / frag.rate))
+        self.assertEqual(ref[events[0]], (0.0, 0.0))
+        self.assertEqual(ref[events[1] - 200000], frag[events[1]])
+        rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss - rss
+        self.assertLess(rss * 1024, (len(frag) * 8 / 4))
+
     def test_frag_normalize(self):
         """Fragment.normalize"""
         levels = dB(-3.0)
@@ -140,6 +196,56 @@ class FragmentTest(SplatTest):
         ref = x * ref_peak / levels
         self.assertAlmostEqual(y, ref, small_places)
 
+    def test_frag_stats(self):
+        """Fragment.get_stats"""
+        frag = splat.data.Fragment(channels=2, length=5000)
+        for i in range(len(frag)):
+            frag[i] = (0.5 + (i % 7) * 0.01,
+                       math.sin((math.pi / 2) * i + (math.pi / 4)))
+        frag_stats, chan_stats = frag.get_stats()
+        x = [s[0] for s in frag]
+        self.assertEqual(chan_stats[0]['min'], 0.5)
+        self.assertEqual(chan_stats[0]['max'], max(x))
+        self.assertAlmostEqual(chan_stats[0]['avg'], sum(x) / len(x),
+                               self._places)
+        self.assertAlmostEqual(chan_stats[0]['rms'],
+                               math.sqrt(sum(v * v for v in x) / len(x)),
+                               self._places)
+        self.assertEqual(frag.get_peak()[1][0]['min'], 0.5)
+        self.assertAlmostEqual(chan_stats[1]['peak'], math.sqrt(0.5),
+                               self._places)
+        self.assertAlmostEqual(chan_stats[1]['true_peak'], 1.0, 1)
+        self.assertGreater(chan_stats[1]['true_peak'], chan_stats[1]['peak'])
+        self.assertEqual(frag_stats['true_peak'], chan_stats[1]['true_peak'])
+        self.assertEqual(frag_stats['loudness'], float('-inf'))
+        frag = splat.data.Fragment(channels=2, rate=48000, duration=5.0)
+        splat.sources.sine(frag, dB(-23.0), 1000.0)
+        frag_stats, chan_stats = frag.get_stats()
+        self.assertAlmostEqual(frag_stats['loudness'], -23.0, 1)
+        self.assertAlmostEqual(chan_stats[0]['loudness'], -26.0, 1)
+        self.assertAlmostEqual(frag_stats['rms'], dB(-23.0) / math.sqrt(2),
+                               4)
+
+    def test_frag_peak_cache(self):
+        """Fragment.get_peak incremental updates"""
+        frag = splat.data.Fragment(channels=2, duration=1.0)
+        burst = splat.data.Fragment(channels=2, duration=0.1)
+        splat.sources.sine(burst, 0.5, 440.0)
+        ops = [lambda: frag.mix(burst, 0.3),
+               lambda: frag.__setitem__(100, (0.9, -0.9)),
+               lambda: frag.amp(0.5),
+               lambda: frag.offset(0.01),
+               lambda: splat.filters.biquad(frag, [('lowpass', 300.0)]),
+               lambda: splat.filters.limiter(frag, -30.0),
+               lambda: splat.filters.reverse(frag),
+               lambda: frag.resize(length=(len(frag) - 5000)),
+               lambda: frag.normalize(),
+               lambda: frag.import_bytes(burst.export_bytes(), burst.rate,
+                                         burst.channels, offset=2000)]
+        for op in ops:
+            op()
+            self.assertEqual(frag.get_peak(), frag.dup().get_peak())
+
     def test_frag_mix(self):
         """Fragment.mix"""
         duration = 1.0
@@ -179,6 +285,138 @@ class FragmentTest(SplatTest):
         self.assertEqual(x2, y2)
         self.assertAlmostEqual((a + b), c, self._places)
 
+    def test_frag_mix_signal(self):
+        """Fragment.mix with signal levels"""
+        frag1, frag2 = (splat.data.Fragment(channels=2) for i in range(2))
+        splat.gen.SineGenerator(frag=frag1).run(0.0, 0.5, 1234.0, -3.0)
+        splat.gen.SineGenerator(frag=frag2).run(0.0, 0.5, 567.8, -3.0)
+        offset, skip = 0.1, 0.05
+        offset_n, skip_n = (frag1.s2n(t) for t in (offset, skip))
+        gain = lambda t: 0.5 + t
+        frag3 = frag1.dup()
+        frag3.mix(frag2, offset, skip, levels=(gain, gain))
+        for n in [0, (offset_n - 1), offset_n, (offset_n + 1234),
+                  (len(frag3) - 1)]:
+            for c in range(frag3.channels):
+                ref = frag1[n][c] if n < len(frag1) else 0.0
+                if n >= offset_n:
+                    t = float(n) / frag3.rate
+                    ref += frag2[n - offset_n + skip_n][c] * gain(t)
+                self.assertAlmostEqual(frag3[n][c], ref, self._places)
+        frag4 = frag2.dup()
+        frag4.amp((gain, 0.5))
+        for n in [0, 1234, (len(frag4) - 1)]:
+            t = float(n) / frag4.rate
+            self.assertAlmostEqual(frag4[n][0], frag2[n][0] * gain(t),
+                                   self._places)
+            self.assertAlmostEqual(frag4[n][1], frag2[n][1] * 0.5,
+                                   self._places)
+
+    def test_frag_mix_many(self):
+        """Fragment.mix_many"""
+        frag1, frag2 = (splat.data.Fragment(channels=2) for i in range(2))
+        splat.gen.SineGenerator(frag=frag1).run(0.0, 0.1, 1234.0)
+        splat.gen.SineGenerator(frag=frag2).run(0.0, 0.2, 567.8)
+        events = [
+            (frag1,),
+            (frag2, 0.05, 0.01, (0.5, 0.25)),
+            (frag1, 0.15, 0.0, lambda t: t, 0.05),
+            (frag2, 0.25, 0.02, None, 0.1),
+            (frag1, 0.15, 0.03, 0.8),
+            ]
+        ref = splat.data.Fragment(channels=2)
+        for event in events:
+            ref.mix(*event)
+        for evts in [events, list(reversed(events))]:
+            frag = splat.data.Fragment(channels=2)
+            frag.mix_many(evts)
+            self.assertEqual(len(frag), len(ref))
+            for n in range(0, len(ref), 97):
+                for a, b in zip(frag[n], ref[n]):
+                    self.assertAlmostEqual(a, b, self._places)
+        frag = splat.data.Fragment(channels=2)
+        frag.mix_many(events)
+        self.assertEqual(frag.md5(), ref.md5())
+        frag = splat.data.Fragment(channels=2)
+        with frag.batch():
+            for event in events:
+                frag.mix(*event)
+            self.assertEqual(len(frag), 0)
+        self.assertEqual(frag.md5(), ref.md5())
+        with self.assertRaises(ValueError):
+            frag.mix_many([(splat.data.Fragment(channels=1),)])
+
+    def test_frag_mix_matrix(self):
+        """Fragment.mix with a channel matrix or pan"""
+        mono = splat.data.Fragment(channels=1)
+        splat.gen.SineGenerator(frag=mono).run(0.0, 0.1, 1234.0)
+        stereo = splat.data.Fragment(channels=2)
+        splat.gen.SineGenerator(frag=stereo).run(0.0, 0.1, 567.8)
+        with self.assertRaises(ValueError):
+            stereo.dup().mix(mono)
+        with self.assertRaises(ValueError):
+            stereo.dup().mix(stereo, pan=0.0)
+        with self.assertRaises(ValueError):
+            stereo.dup().mix(mono, matrix=((1.0, 0.5),))
+        centre = math.sqrt(0.5)
+        for kw, gains in [({'pan': -1.0}, (1.0, 0.0)),
+                          ({'pan': 0.0}, (centre, centre)),
+                          ({'pan': 1.0}, (0.0, 1.0)),
+                          ({'matrix': ((0.25,), (0.5,))}, (0.25, 0.5))]:
+            frag = stereo.dup()
+            frag.mix(mono, levels=(1.0, 0.5), **kw)
+            for n in range(0, len(mono), 97):
+                x, y, z = mono[n][0], frag[n], stereo[n]
+                for c, level in enumerate((1.0, 0.5)):
+                    self.assertAlmostEqual(y[c], z[c] + x * gains[c] * level,
+                                           self._places)
+        frag = splat.data.Fragment(channels=1)
+        frag.mix(stereo, matrix=((0.5, 0.5),))
+        for n in range(0, len(stereo), 97):
+            self.assertAlmostEqual(frag[n][0], sum(stereo[n]) * 0.5,
+                                   self._places)
+        ref = splat.data.Fragment(channels=2)
+        ref.mix(mono, 0.02, pan=-0.5)
+        ref.mix(mono, 0.05, 0.0, lambda t: t, pan=0.5)
+        frag = splat.data.Fragment(channels=2)
+        frag.mix_many([(mono, 0.02, 0.0, None, None, False, None, -0.5),
+                       (mono, 0.05, 0.0, lambda t: t, None, False, None, 0.5)])
+        self.assertEqual(frag.md5(), ref.md5())
+
+    def test_frag_resample(self):
+        """Fragment.resample"""
+        def sine(rate, freq):
+            frag = splat.data.Fragment(channels=1, rate=rate, duration=0.5)
+            splat.sources.sine(frag, 0.5, freq)
+            return frag
+        frag = sine(44100, 1000.0)
+        frag.resample(48000)
+        ref = sine(48000, 1000.0)
+        self.assertEqual(frag.rate, 48000)
+        self.assertEqual(len(frag), len(ref))
+        for n in range(1000, len(ref) - 1000, 97):
+            self.assertAlmostEqual(frag[n][0], ref[n][0], 4)
+        frag = sine(96000, 30000.0)
+        frag.resample(44100)
+        self.assertEqual(len(frag), 22050)
+        peak = max(abs(frag[n][0]) for n in range(1000, len(frag) - 1000))
+        self.assertLess(peak, dB(-80))
+        with self.assertRaises(ValueError):
+            frag.resample(48000, 2)
+        src = sine(44100, 440.0)
+        ref = src.dup()
+        ref.resample(48000)
+        ref_mix = splat.data.Fragment(channels=1)
+        ref_mix.mix(ref, 0.1, 0.05, 0.5)
+        with self.assertRaises(ValueError):
+            ref_mix.mix(src)
+        frag = splat.data.Fragment(channels=1)
+        frag.mix(src, 0.1, 0.05, 0.5, resample=True)
+        self.assertEqual(frag.md5(), ref_mix.md5())
+        frag = splat.data.Fragment(channels=1)
+        frag.mix_many([(src, 0.1, 0.05, 0.5, None, True)])
+        self.assertEqual(frag.md5(), ref_mix.md5())
+
     def test_frag_import_bytes(self):
         """Fragment.import_bytes"""
         frag = splat.data.Fragment()
@@ -236,6 +474,39 @@ class FragmentTest(SplatTest):
             b_len, ref_len,
             "Incorrect data length: {} instead of {}".format(b_len, ref_len))
 
+    def test_frag_export_clip(self):
+        """Fragment.export_bytes with out of range values"""
+        values = [-2.0, -1.0, -0.5, 0.0, 0.25, 1.0, 1.5]
+        ref = {
+            'int8': [0, -127, -63, 0, 31, 127, -1],
+            'int16': [-32767, -32767, -16383, 0, 8191, 32767, 32767],
+            'int24': [-8388607, -8388607, -4194303, 0, 2097151, 8388607,
+                      8388607],
+            }
+        fmt = { 'int8': '<{}b', 'int16': '<{}h', 'int24': '<{}i' }
+        for channels in [1, 2, 3]:
+            frag = splat.data.Fragment(channels=channels)
+            # Repeat the values to use both the vector and the scalar paths
+            n = len(values) * 11
+            frag.resize(length=n)
+            for i in range(n):
+                frag[i] = (values[i % len(values)],) * channels
+            for sample_type, ref_values in ref.iteritems():
+                data = str(frag.export_bytes(sample_type))
+                if sample_type == 'int24':
+                    data = ''.join(data[i:(i + 3)] +
+                                   ('\xff' if ord(data[i + 2]) & 0x80
+                                    else '\x00')
+                                   for i in range(0, len(data), 3))
+                exp = struct.unpack(fmt[sample_type].format(n * channels),
+                                    data)
+                for i in range(n):
+                    for c in range(channels):
+                        self.assertEqual(
+                            exp[(i * channels) + c],
+                            ref_values[i % len(values)],
+                            "Incorrect {} value at {}".format(sample_type, i))
+
     def test_frag_dup(self):
         """Fragment.dup"""
         frag1 = splat.data.Fragment(channels=1)
@@ -244,6 +515,88 @@ class FragmentTest(SplatTest):
         self.assertEqual(frag1.md5(), frag2.md5(),
                          "Duplicated fragment MD5 mismatch")
 
+    def test_frag_view(self):
+        """Fragment.view"""
+        frag = splat.data.Fragment(duration=1.0)
+        splat.gen.SineGenerator(frag=frag).run(0.1, 0.6, 1234.0)
+        md5_sum = frag.md5()
+        dry = frag.dup()
+        view = frag.view(4000, 30000)
+        view2 = view.view(5000)
+        self.assertEqual(len(view), 26000)
+        self.assertEqual(len(view2), 21000)
+        self.assertEqual(view.export_bytes(),
+                         frag.export_bytes(start=4000, end=30000))
+        frag.amp(0.5)
+        self.assertEqual(dry.md5(), md5_sum)
+        self.assertEqual(view2[0], dry[9000])
+        view2[0] = (1.0, 1.0)
+        self.assertEqual(view[5000], dry[9000])
+        self.assertEqual(view2[0], (1.0, 1.0))
+        view.resize(length=50000)
+        self.assertEqual(view.export_bytes(end=26000),
+                         dry.export_bytes(start=4000, end=30000))
+        self.assertEqual(view[40000], (0.0, 0.0))
+        del dry
+        view2.normalize()
+        frag.amp(2.0)
+        self.assertEqual(frag.md5(), md5_sum)
+        burst = splat.data.Fragment(duration=0.1)
+        splat.sources.sine(burst, 0.5, 440.0)
+        for use_batch in (False, True):
+            for mix_view in (False, True):
+                src = frag.dup()
+                view = src.view()
+                dst, other = (view, src) if mix_view else (src, view)
+                peak = other.get_peak()
+                if use_batch:
+                    with dst.batch():
+                        dst.mix(burst, 0.2)
+                else:
+                    dst.mix_many([(burst, 0.2)])
+                self.assertNotEqual(dst.md5(), md5_sum)
+                self.assertEqual(other.md5(), md5_sum)
+                self.assertEqual(other.get_peak(), peak)
+
+    def test_frag_sample_type(self):
+        """Fragments with float32 and float64 samples"""
+        self.assertEqual(splat.data.Fragment().sample_type, splat.SAMPLE_TYPE)
+        with self.assertRaises(ValueError):
+            splat.data.Fragment(sample_type='int16')
+        frags = dict()
+        for sample_type in ['float32', 'float64']:
+            frag = splat.data.Fragment(channels=1, duration=1.0,
+                                       sample_type=sample_type)
+            splat.gen.SineGenerator(frag=frag).run(0.1, 0.6, 1234.0)
+            self.assertEqual(frag.sample_type, sample_type)
+            self.assertEqual(frag.view().sample_type, sample_type)
+            self.assertEqual(len(frag.export_bytes()),
+                             (len(frag) * splat.sample_types[sample_type] / 8))
+            frags[sample_type] = frag
+        f32, f64 = frags['float32'], frags['float64']
+        self.assert_samples(f32, { f32.s2n(0.3): f64[f64.s2n(0.3)] }, 6)
+        mixed64 = splat.data.Fragment(channels=1, sample_type='float64')
+        mixed64.mix(f32)
+        self.assertEqual(mixed64.export_bytes('float32'), f32.export_bytes())
+        mixed32 = splat.data.Fragment(channels=1, sample_type='float32')
+        mixed32.mix_many([(f64,)])
+        self.assertEqual(mixed32.export_bytes(), f64.export_bytes('float32'))
+        imp = splat.data.Fragment(channels=1, sample_type='float32')
+        imp.import_bytes(f64.export_bytes(), f64.rate, 1, 'float64')
+        self.assertEqual(imp.export_bytes(), mixed32.export_bytes())
+        sig = splat.data.Fragment(channels=1, duration=1.0)
+        sig.offset(f32)
+        self.assertEqual(sig.export_bytes('float32'), f32.export_bytes())
+        tmp = tempfile.mkdtemp()
+        try:
+            path = os.path.join(tmp, 'frag.smap')
+            f32.save(path, normalize=False)
+            saved = splat.data.Fragment.open(path)
+            self.assertEqual(saved.sample_type, 'float32')
+            self.assertEqual(saved.export_bytes(), f32.export_bytes())
+        finally:
+            shutil.rmtree(tmp)
+
     def test_frag_save(self):
         """Fragment.save"""
         duration = 0.1
@@ -251,20 +604,174 @@ class FragmentTest(SplatTest):
         length = len(frag)
         for i in range(length):
             frag[i] = (float(i) * 0.9 / length,)
+        ref = frag.dup()
+        ref.normalize()
+        frag_md5 = frag.md5()
         for fmt in ['wav', 'saf']:
             f = StringIO()
             frag.save(f, fmt)
+            self.assertEqual(frag.md5(), frag_md5,
+                             "Fragment modified when saving")
             f.reset()
             frag2 = splat.data.Fragment.open(f, fmt)
             if fmt == 'saf':
-                self.assertEqual(frag.md5(), frag2.md5())
+                self.assertEqual(ref.md5(), frag2.md5())
             for i in range(length):
-                a = frag[i][0]
+                a = ref[i][0]
                 b = frag2[i][0]
                 self.assertAlmostEqual(
                     a, b, 3,
                     "Fragment data mismatch [{}] {} {}".format(i, a, b))
 
+    def test_frag_get_norm(self):
+        """Fragment.get_norm"""
+        frag = splat.data.Fragment(channels=2)
+        splat.gen.SineGenerator(frag=frag).run(0.0, 0.1, 432.1,
+                                               levels=(dB(-6.0), dB(-9.0)))
+        frag.offset(0.1)
+        frag_md5 = frag.md5()
+        norm = frag.get_norm()
+        self.assertEqual(len(norm[1]), frag.channels)
+        ref = frag.dup()
+        ref.normalize()
+        self.assertEqual(frag.export_bytes(norm=norm), ref.export_bytes())
+        self.assertEqual(frag.md5(), frag_md5)
+        for sample_type in ['int8', 'int16', 'int24', 'float32']:
+            self.assertEqual(frag.export_bytes(sample_type, norm=norm),
+                             ref.export_bytes(sample_type))
+        silent = splat.data.Fragment(channels=1, length=100)
+        self.assertEqual(silent.get_norm(), (1.0, (0.0,)))
+
+    def test_frag_save_file(self):
+        """Fragment.save with file names"""
+        frag = splat.data.Fragment(channels=3)
+        splat.gen.SineGenerator(frag=frag).run(0.0, 0.321, 1234.5)
+        frag.normalize()
+        tmp = tempfile.mkdtemp()
+        try:
+            for fmt, sample_type in [('wav', 'int8'), ('wav', 'int16'),
+                                     ('wav', 'int24'), ('wav', 'float32'),
+                                     ('wav', 'float64'), ('saf', None)]:
+                path = os.path.join(tmp, 'test.{}'.format(fmt))
+                kw = {} if sample_type is None else {'sample_type': sample_type}
+                frag.save(path, normalize=False, **kw)
+                frag2 = splat.data.Fragment.open(path)
+                self.assertEqual(frag2.name, 'test')
+                self.assertEqual(len(frag2), len(frag))
+                self.assertEqual(frag2.channels, frag.channels)
+                if sample_type is None:
+                    sample_type = splat.SAMPLE_TYPE
+                self.assertEqual(frag.md5(sample_type),
+                                 frag2.md5(sample_type),
+                                 "{} MD5 mismatch".format(sample_type))
+                if fmt == 'wav' and sample_type.startswith('float'):
+                    continue
+                f = StringIO()
+                frag.save(f, fmt, normalize=False, **kw)
+                with open(path, 'rb') as f_path:
+                    self.assertEqual(f.getvalue(), f_path.read())
+            i0, i1 = (int(len(frag) * r) for r in (0.23, 0.83))
+            frag.save(path, start=i0, end=i1, normalize=False)
+            frag2 = splat.data.Fragment.open(path)
+            self.assertEqual(len(frag2), (i1 - i0))
+            self.assertEqual(frag2.md5(), md5.new(
+                    frag.export_bytes(start=i0, end=i1)).hexdigest())
+        finally:
+            shutil.rmtree(tmp)
+
+    def test_frag_path(self):
+        """Fragment with data mapped from a file"""
+        tmp = tempfile.mkdtemp()
+        try:
+            path = os.path.join(tmp, 'frag.smap')
+            frag = splat.data.Fragment(channels=3, path=path)
+            ref = splat.data.Fragment(channels=3)
+            self.assertEqual(frag.path, path)
+            self.assertEqual(ref.path, None)
+            for f in (frag, ref):
+                gen = splat.gen.SineGenerator(frag=f)
+                for i in range(5):
+                    gen.run((i * 0.3), ((i * 0.3) + 0.2), (440.0 * (i + 1)))
+                f.resize(duration=1.0)
+                splat.filters.reverb(f, [(0.05, -3.0), (0.11, -6.0)],
+                                     0.2, 6.0, 1)
+            self.assertEqual(frag.md5(), ref.md5())
+            frag_md5 = frag.md5()
+            dup = frag.dup()
+            del frag
+            frag = splat.data.Fragment(path=path, reopen=True)
+            self.assertEqual(frag.channels, 3)
+            self.assertEqual(frag.md5(), frag_md5)
+            self.assertEqual(dup.md5(), frag_md5)
+            frag.amp(0.5)
+            self.assertEqual(dup.md5(), frag_md5)
+            path2 = os.path.join(tmp, 'saved.smap')
+            ref.save(path2, normalize=False)
+            saved = splat.data.Fragment.open(path2)
+            self.assertEqual(saved.path, path2)
+            self.assertEqual(saved.name, 'saved')
+            self.assertEqual(saved.md5(), frag_md5)
+        finally:
+            shutil.rmtree(tmp)
+
+    def test_frag_write_to(self):
+        """Fragment.write_to"""
+        frag = splat.data.Fragment()
+        splat.gen.SineGenerator(frag=frag).run(0.0, 0.234, 3456.7)
+        i0, i1 = (int(len(frag) * r) for r in (0.12, 0.87))
+        for sample_type in splat.sample_types.iterkeys():
+            for chunk in [None, 1, 1000, (len(frag) * 2)]:
+                for start, end in [(None, None), (i0, i1)]:
+                    f = StringIO()
+                    n = frag.write_to(f, sample_type, start, end, chunk)
+                    ref = frag.export_bytes(sample_type, start, end)
+                    self.assertEqual(f.getvalue(), str(ref))
+                    frame_size = (frag.channels *
+                                  splat.sample_types[sample_type] / 8)
+                    self.assertEqual(n, (len(ref) / frame_size))
+        tmp = tempfile.mkdtemp()
+        try:
+            path = os.path.join(tmp, 'test.raw')
+            with open(path, 'wb') as f:
+                f.write('header')
+                frag.write_to(f, chunk=123)
+            with open(path, 'rb') as f:
+                self.assertEqual(f.read(), 'header' + frag.export_bytes())
+        finally:
+            shutil.rmtree(tmp)
+
+    def test_frag_kernels(self):
+        """Fragment kernels with SIMD dispatch"""
+        self.assertIn(splat.SIMD, ['generic', 'avx2', 'avx512'])
+        for name in ['mix', 'amp', 'biquad', 'sums', 'true_peak', 'import',
+                     'export']:
+            self.assertIn(name, splat.kernels)
+        script = '\n'.join([
+            "import splat.data, splat.gen, splat.filters",
+            "frag = splat.data.Fragment(channels=3)",
+            "splat.gen.SineGenerator(frag=frag).run(0.0, 0.1001, 1234.5)",
+            "frag.amp((-3.0, 1.5, 0.0))",
+            "frag.mix(frag.dup(), 0.0123, levels=-4.5)",
+            "frag.mix(frag.dup(), 0.0234, 0.01, levels=(lambda x: x,) * 3)",
+            "frag.amp((lambda x: 1.0 - x, 0.5, lambda x: x))",
+            "splat.filters.biquad(frag, [('peak', 1000.0, 2.0, 6.0),",
+            "                            ('lowpass', lambda x: 5000 - x)])",
+            "frag.import_bytes(frag.export_bytes('int24'), frag.rate,",
+            "                  frag.channels, 'int24', offset=2345)",
+            "print splat.kernels['mix'], frag.md5(), frag.md5('int16'),",
+            "print repr(frag.get_stats()).replace(' ', '')",
+            ])
+        res = {}
+        for level in ['generic', splat.SIMD]:
+            env = dict(os.environ, SPLAT_SIMD=level)
+            proc = subprocess.Popen([sys.executable, '-c', script], env=env,
+                                    stdout=subprocess.PIPE)
+            out = proc.communicate()[0].split()
+            self.assertEqual(proc.returncode, 0)
+            self.assertEqual(out[0], level)
+            res[level] = out[1:]
+        self.assertEqual(res['generic'], res[splat.SIMD])
+
 
 class InterpolTest(SplatTest):
 
@@ -309,7 +816,8 @@ class SignalTest(SplatTest):
         frag.offset(lambda x: offset_value)
         pts = [0.0, 0.1, 0.4, 0.6, 0.9, 0.99]
         for pt in pts:
-            self.assertEqual(frag[frag.s2n(pt)], (offset_value,))
+            self.assertAlmostEqual(frag[frag.s2n(pt)][0], offset_value,
+                                   self._places)
 
     def test_signal_frag(self):
         """Fragment signals"""
@@ -391,6 +899,276 @@ class SignalTest(SplatTest):
                     i, z, float_value))
 
 
+class FilterTest(SplatTest):
+
+    def test_envelope(self):
+        """filters.envelope"""
+        frag = splat.data.Fragment(channels=2, duration=1.0)
+        frag.offset(1.0)
+        splat.filters.envelope(frag, [(0.1, 0.5), (0.3, 1.0), (0.5, 0.0)])
+        samples = {0: (0.5, 0.5), frag.s2n(0.1): (0.5, 0.5),
+                   frag.s2n(0.2): (0.75, 0.75), frag.s2n(0.3): (1.0, 1.0),
+                   frag.s2n(0.4): (0.5, 0.5), frag.s2n(0.7): (0.0, 0.0)}
+        self.assert_samples(frag, samples)
+        frag = splat.data.Fragment(channels=1, duration=1.0)
+        frag.offset(1.0)
+        splat.filters.envelope(frag, [(0.0, 1.0), (1.0, 0.01)], True)
+        for t in [0.25, 0.5, 0.75, 0.99]:
+            self.assertAlmostEqual(frag[frag.s2n(t)][0], (0.01 ** t),
+                                   self._places)
+        sparse = splat.data.Fragment(channels=1, duration=10.0)
+        n = sparse.s2n(5.0)
+        sparse[n] = (1.0,)
+        splat.filters.envelope(sparse, [(0.0, 0.0), (10.0, 1.0)])
+        self.assertAlmostEqual(sparse[n][0], 0.5, self._places)
+        self.assertEqual(sparse.get_peak()[0]['max'], sparse[n][0])
+        for points in [[], [(0.2, 1.0), (0.1, 1.0)], [(0.1, 'x')], [1.0]]:
+            with self.assertRaises((ValueError, TypeError)):
+                splat.filters.envelope(frag, points)
+        with self.assertRaises(ValueError):
+            splat.filters.envelope(frag, [(0.0, 1.0), (0.1, 0.0)], True)
+
+    def test_filter_chain(self):
+        """filters.FilterChain and filters.filter_chain"""
+        filters = [(splat.filters.linear_fade, (0.1,)),
+                   (splat.filters.dec_envelope, (4800.0, 1.5)),
+                   (splat.filters.reverse, ()),
+                   (splat.filters.adsr, (0.2, 0.3, -3.0, 0.4)),
+                   (splat.filters.envelope, ([(0.0, 1.0), (2.0, 0.1)], True))]
+        frag = splat.data.Fragment(channels=2)
+        splat.gen.SineGenerator(frag).run(0.0, 3.0, 1234.5)
+        ref = frag.dup()
+        for f, args in filters:
+            f(ref, *args)
+        splat.filters.FilterChain(filters).run(frag)
+        self.assertEqual(frag.md5(), ref.md5())
+        with self.assertRaises(TypeError):
+            splat.filters.filter_chain(frag, [(splat.filters.reverse, ())])
+
+    def _convolve(self, x, h):
+        y = [0.0] * (len(x) + len(h) - 1)
+        taps = [(j, w) for j, w in enumerate(h) if w != 0.0]
+        for i, v in enumerate(x):
+            for j, w in taps:
+                y[i + j] += v * w
+        return y
+
+    def test_convolve(self):
+        """filters.convolve"""
+        frag = splat.data.Fragment(channels=2)
+        splat.gen.SineGenerator(frag).run(0.0, 0.1, 1234.5)
+        impulse = splat.data.Fragment(channels=1, length=9000)
+        for i, n in enumerate(range(0, len(impulse), 577)):
+            impulse[n] = (0.9 ** i,)
+        ref = self._convolve([s[1] for s in frag],
+                             [s[0] for s in impulse])
+        length = len(frag)
+        splat.filters.convolve(frag, impulse)
+        self.assertEqual(len(frag), (length + len(impulse) - 1))
+        for i in range(0, len(frag), 97):
+            self.assertAlmostEqual(frag[i][1], ref[i], self._places)
+        with self.assertRaises(ValueError):
+            splat.filters.convolve(frag, splat.data.Fragment(channels=3,
+                                                             length=10))
+        with self.assertRaises(ValueError):
+            splat.filters.convolve(frag, splat.data.Fragment(channels=1))
+
+    def test_reverb_fft(self):
+        """filters.reverb with many delays"""
+        frag = splat.data.Fragment(channels=1, duration=0.02)
+        splat.sources.sine(frag, 0.0, 1234.5)
+        delays = [((t * 0.0011), -(t * 0.5)) for t in range(1, 60)]
+        h = [0.0] * (frag.s2n(delays[-1][0]) + 1)
+        h[0] = 1.0
+        for t, g in delays:
+            h[int(t * frag.rate)] += splat.dB2lin(g)
+        ref = self._convolve([s[0] for s in frag], h)
+        splat.filters.reverb(frag, delays, 0.0, 0.0)
+        self.assertEqual(len(frag), len(ref))
+        for i in range(0, len(frag), 7):
+            self.assertAlmostEqual(frag[i][0], ref[i], self._places)
+
+    def test_reverb_taps(self):
+        """filters.reverb with a few delays"""
+        frag = splat.data.Fragment(channels=2)
+        gen = splat.gen.SineGenerator(frag)
+        gen.run(0.0, 0.1, 1234.5)
+        gen.run(0.3, 0.4, 567.8)
+        delays = [(0.002, -3.0), (0.05, -6.0), (0.13, -9.0), (0.011, -1.5)]
+        h = [0.0] * (frag.s2n(0.13) + 1)
+        h[0] = 1.0
+        for t, g in delays:
+            h[int(t * frag.rate)] += splat.dB2lin(g)
+        ref = self._convolve([s[1] for s in frag], h)
+        splat.filters.reverb(frag, delays, 0.0, 0.0)
+        self.assertEqual(len(frag), len(ref))
+        for i in range(0, len(frag), 7):
+            self.assertAlmostEqual(frag[i][1], ref[i], self._places)
+        frag = splat.data.Fragment(channels=2, duration=0.5)
+        splat.sources.sine(frag, 0.5, 440.0)
+        splat.filters.reverb(frag, delays, 0.2, 6.0, 1)
+        self.assert_md5(frag, {64: 'e6e43f30c455276e8fd9455017645a8a',
+                               32: '4560c31d1d052a7338dd5c935e23467c'})
+
+    def test_fdn_reverb(self):
+        """filters.fdn_reverb"""
+        frag = splat.data.Fragment(channels=2, duration=1.0)
+        frag[0] = (1.0, 1.0)
+        splat.filters.fdn_reverb(frag, 0.5, 1.0, 0.0, 0.0)
+        self.assertEqual(frag.duration, 1.5)
+        self.assertEqual(frag[0], (1.0, 1.0))
+        self.assertEqual(frag[frag.s2n(0.02)], (0.0, 0.0))
+        self.assertNotEqual(frag[frag.s2n(0.3)][0], frag[frag.s2n(0.3)][1])
+        def level(start):
+            n = frag.s2n(start)
+            return sum(frag[i][0] ** 2 for i in range(n, n + frag.s2n(0.1)))
+        decay = 10 * math.log10(level(0.6) / level(0.1))
+        self.assertTrue(-63.0 < decay < -57.0)
+        frag = splat.data.Fragment(channels=1, duration=1.0)
+        splat.filters.fdn_reverb(frag)
+        self.assertEqual(frag.get_peak()[0]['peak'], 0.0)
+
+    def test_threads(self):
+        """filters with several threads"""
+        threads = splat.get_threads()
+        digests = []
+        try:
+            for n in [1, 4]:
+                splat.set_threads(n)
+                self.assertEqual(splat.get_threads(), n)
+                frag = splat.data.Fragment(channels=3, duration=1.0)
+                splat.sources.sine(frag, 0.5, 440.0)
+                splat.filters.reverb(frag, [(0.05, -3.0), (0.11, -6.0)],
+                                     0.2, 6.0, 1)
+                delays = splat.filters.reverb_delays(length=0.2)
+                splat.filters.reverb(frag, delays, 0.2, 6.0, 1)
+                splat.filters.adsr(frag)
+                splat.filters.reverse(frag)
+                digests.append(frag.md5(sample_type="float64"))
+        finally:
+            splat.set_threads(threads)
+        self.assertEqual(digests[0], digests[1])
+
+    def test_biquad(self):
+        """filters.biquad"""
+        frag = splat.data.Fragment(channels=3, duration=0.05)
+        splat.sources.square(frag, 0.5, 440.0)
+        x = [s[1] for s in frag]
+        w0 = 2 * math.pi * 1000.0 / frag.rate
+        alpha = math.sin(w0) / (2 * 0.9)
+        a0 = 1 + alpha
+        b0, b1, b2, a1, a2 = ((1 - math.cos(w0)) / 2 / a0,
+                              (1 - math.cos(w0)) / a0,
+                              (1 - math.cos(w0)) / 2 / a0,
+                              -2 * math.cos(w0) / a0, (1 - alpha) / a0)
+        s1 = s2 = 0.0
+        ref = []
+        for v in x:
+            y = (b0 * v) + s1
+            s1 = ((b1 * v) - (a1 * y)) + s2
+            s2 = (b2 * v) - (a2 * y)
+            ref.append(y)
+        splat.filters.biquad(frag, [('lowpass', 1000, 0.9)])
+        for i in range(0, len(frag), 7):
+            for c in range(3):
+                self.assertAlmostEqual(frag[i][c], ref[i], self._places)
+        sections = [('peak', 3000.0, 2.0, 6.0), ('highpass', 80.0),
+                    (1.0, 0.5, 0.25, -0.2, 0.1)]
+        whole = splat.data.Fragment(channels=2, duration=0.5)
+        splat.sources.square(whole, 0.5, 220.0)
+        first = splat.data.Fragment(channels=2)
+        first.mix(whole, duration=0.1234)
+        second = splat.data.Fragment(channels=2)
+        second.mix(whole, skip=0.1234)
+        splat.filters.biquad(whole, sections)
+        state = splat.filters.biquad(first, sections)
+        splat.filters.biquad(second, sections, state)
+        n = len(first)
+        for i in range(0, len(whole), 11):
+            self.assertEqual(whole[i], (first[i] if i < n else second[i - n]))
+        self.assertRaises(ValueError, splat.filters.biquad, frag,
+                          [('bandstop', 1000.0)])
+
+    def test_limiter(self):
+        """filters.limiter"""
+        frag = splat.data.Fragment(channels=2, duration=0.5)
+        splat.sources.sine(frag, dB(-20.0), 440.0)
+        burst = splat.data.Fragment(channels=2, duration=0.05)
+        splat.sources.sine(burst, 1.0, 1000.0)
+        frag.mix(burst, 0.25)
+        ref = splat.data.Fragment(channels=2)
+        ref.mix(frag)
+        splat.filters.limiter(frag, -6.0)
+        thr = dB(-6.0) + 1e-6
+        for s in frag:
+            for c in s:
+                self.assertTrue(abs(c) <= thr)
+        n = int(0.2 * frag.rate)
+        for i in range(0, n, 13):
+            self.assertAlmostEqual(frag[i][0], ref[i][0], self._places)
+        frag = splat.data.Fragment(channels=2, duration=1.0)
+        for start in [0.2, 0.65]:
+            frag.mix(burst, start)
+        ref = frag.dup()
+        splat.filters.limiter(frag, -6.0)
+        delay = int(0.005 * frag.rate)
+        bounds = [0, 4800, 12157, 30000, len(ref)]
+        stream = []
+        state = []
+        for start, end in zip(bounds[:-1], bounds[1:]):
+            part = ref.view(start, end).dup()
+            state = splat.filters.limiter(part, -6.0, 0.005, 0.05, state)
+            stream += list(part)
+        part = splat.data.Fragment(channels=2, length=delay)
+        splat.filters.limiter(part, -6.0, 0.005, 0.05, state)
+        stream += list(part)
+        self.assertEqual(len(stream), len(frag) + delay)
+        self.assertEqual(stream[:delay], [(0.0, 0.0)] * delay)
+        self.assertEqual(stream[delay:], list(frag))
+        self.assertRaises(ValueError, splat.filters.limiter, frag, -6.0,
+                          0.005, 0.05, [0.0])
+
+    def test_compressor(self):
+        """filters.compressor"""
+        frag = splat.data.Fragment(channels=1, duration=1.0)
+        splat.sources.sine(frag, 1.0, 1000.0)
+        splat.filters.compressor(frag, -20.0, 4.0, 0.01, 0.1, 0.05, 3.0)
+        start = int(0.8 * frag.rate)
+        ms = sum(frag[i][0] ** 2 for i in range(start, len(frag)))
+        ms /= len(frag) - start
+        rms = 10 * math.log10(ms)
+        level = 10 * math.log10(0.5)
+        self.assertAlmostEqual(rms, -20.0 + ((level + 20.0) / 4.0) + 3.0, 1)
+        self.assertRaises(ValueError, splat.filters.compressor, frag, 0.0,
+                          0.5)
+        frag = splat.data.Fragment(channels=2, duration=1.0)
+        splat.sources.sine(frag, 1.0, 1000.0)
+        part1 = frag.view(0, 20000).dup()
+        part2 = frag.view(20000).dup()
+        splat.filters.compressor(frag)
+        state = splat.filters.compressor(part1)
+        splat.filters.compressor(part2, -20.0, 4.0, 0.01, 0.1, 0.05, 0.0,
+                                 state)
+        self.assertEqual(list(part1) + list(part2), list(frag))
+
+    def test_fades(self):
+        """filters.linear_fade and filters.adsr"""
+        frag = splat.data.Fragment(channels=1, duration=0.01)
+        frag.offset(1.0)
+        splat.filters.linear_fade(frag, 1.0)
+        n = len(frag) / 2
+        self.assert_samples(frag, {0: (0.0,), (n / 2): (0.5,), n: (1.0,),
+                                   (n + n / 2): (0.5,)})
+        frag = splat.data.Fragment(channels=1, duration=1.0)
+        frag.offset(1.0)
+        splat.filters.adsr(frag, 0.1, 0.2, -6.0, 0.3)
+        sustain = splat.dB2lin(-6.0)
+        self.assert_samples(frag, {
+                0: (0.0,), frag.s2n(0.05): (0.5,), frag.s2n(0.1): (1.0,),
+                frag.s2n(0.3): (sustain,), frag.s2n(0.7): (sustain,),
+                frag.s2n(0.85): (sustain / 2,)})
+
+
 class GeneratorTest(SplatTest):
 
     def test_gen_frag(self):
@@ -413,7 +1191,8 @@ class GeneratorTest(SplatTest):
             gen = splat.gen.SineGenerator()
             gen.run(0.0, duration, freq, levels=levels)
             self.assert_md5([frag, gen.frag],
-                            '1d6c38f467b1bdb5a9c3e8d573e815f4')
+                            {64: '1d6c38f467b1bdb5a9c3e8d573e815f4',
+                             32: 'e8c2431c5df08e8fc33e1754eedcee43'})
 
     def test_sine(self):
         """sources.sine"""
@@ -429,7 +1208,10 @@ class GeneratorTest(SplatTest):
         frag_frag = splat.data.Fragment(duration=1.0)
         splat.sources.sine(frag_frag, lvl0, frag_freq, ph)
         self.assert_md5([frag_float, frag_signal, frag_frag],
-                        'ebd3117927861068cf77af5ed2e7c5d7')
+                        {64: 'ebd3117927861068cf77af5ed2e7c5d7',
+                         32: ['52509552aad8de983d0dc343bd295ace',
+                             '52509552aad8de983d0dc343bd295ace',
+                             'f08fc9407eb8be283bb3916021d00e86']})
 
     def test_sine_gen(self):
         """gen.SineGenerator"""
@@ -455,7 +1237,10 @@ class GeneratorTest(SplatTest):
         frag_frag = splat.data.Fragment(duration=1.0)
         splat.sources.square(frag_frag, lvl0, frag_freq)
         self.assert_md5([frag_float, frag_signal, frag_frag],
-                        '6a6ab2e991baf48a6fe2c1d18700e40e')
+                        {64: '6a6ab2e991baf48a6fe2c1d18700e40e',
+                         32: ['6a6ab2e991baf48a6fe2c1d18700e40e',
+                             '6a6ab2e991baf48a6fe2c1d18700e40e',
+                             'bb6487ca7c4bf4f57f61df1896e83860']})
 
     def test_square_gen(self):
         """gen.SquareGenerator"""
@@ -519,7 +1304,8 @@ class GeneratorTest(SplatTest):
         frag_frag = splat.data.Fragment(duration=1.0)
         splat.sources.overtones(frag_frag, lvl0, frag_freq, ot)
         self.assert_md5([frag_float, frag_mixed, frag_signal, frag_frag],
-                        '8974a1eea0db97af1aa171f531685e9d')
+                        {64: '8974a1eea0db97af1aa171f531685e9d',
+                         32: '6539fb5a4ed5cd5d22cd78037128f2b3'})
 
     def test_overtones_gen(self):
         """gen.OvertonesGenerator"""
@@ -528,6 +1314,38 @@ class GeneratorTest(SplatTest):
         gen.run(0.0, 1.0, 1000.0, 0.1)
         self.assert_md5(gen.frag, 'ee045e012673ff7ed4ab9bd590b57368')
 
+    def test_source_add(self):
+        """sources with offset, duration and gain"""
+        freq = 1000.0
+        frag = splat.data.Fragment(duration=1.0)
+        splat.sources.sine(frag, 0.25, 220.0)
+        ref = frag.dup()
+        splat.sources.sine(frag, 0.5, freq, 0.0, 0.25, offset=0.25,
+                           duration=1.0, gain=0.5)
+        self.assertEqual(frag.duration, 1.25)
+        note = splat.data.Fragment(duration=1.0)
+        splat.sources.sine(note, 0.5, freq, 0.0, 0.25)
+        ref.mix(note, 0.25, levels=0.5)
+        for n in range(0, len(ref), 997):
+            self.assert_samples(frag, {n: ref[n]})
+        self.assertRaises(ValueError, splat.sources.sine, frag, 0.5, freq,
+                          duration=0.5)
+        gen = splat.gen.SineGenerator()
+        gen.run(0.0, 1.0, 220.0, levels=0.25)
+        gen.run(0.25, 1.25, freq, levels=0.25)
+        for n in range(0, len(ref), 997):
+            self.assert_samples(gen.frag, {n: ref[n]})
+
+        class HalfSineGenerator(splat.gen.SineGenerator):
+            def _run(self, frag, *args, **kw):
+                super(HalfSineGenerator, self)._run(frag, *args, **kw)
+                frag.amp(0.5)
+        gen = HalfSineGenerator()
+        gen.run(0.0, 1.0, freq, levels=0.5)
+        ref = splat.data.Fragment(duration=1.0)
+        splat.sources.sine(ref, 0.25, freq)
+        self.assertEqual(gen.frag.md5(), ref.md5())
+
 
 class ParticleTest(SplatTest):
 
@@ -706,10 +1524,18 @@ class SequencerTest(SplatTest):
         frag = splat.data.Fragment(channels=1)
         splat.seq.PatternSequencer(120).run(frag, [(p,), (p,)])
         self.assert_md5(frag, '3b9dbf48691e185339a461a493fc5e7e')
+        p.gen.filters = [splat.filters.linear_fade]
+        frag = splat.data.Fragment(channels=1)
+        splat.seq.PatternSequencer(120).run(frag, [(p,), (p,)])
+        md5_sum = frag.md5()
+        frag = splat.data.Fragment(channels=1)
+        splat.seq.PatternSequencer(120).run(frag, [(p,), (p,)], batch=True)
+        self.assertEqual(frag.md5(), md5_sum)
 
 # -----------------------------------------------------------------------------
 # main function
 
 if __name__ == '__main__':
     print("Sample precision: {}-bit".format(splat.SAMPLE_WIDTH))
+    print("SIMD kernels: {}".format(splat.SIMD))
     unittest.main()